@@ -39,7 +39,8 @@
  *
  *    The builtin_builder::create_builtins() function contains lists of all
  *    built-in function signatures, where they're available, what types they
- *    take, and so on.
+ *    take, and so on.  Only the function being looked up is created each
+ *    time it runs.
  *
  * 4. Implementations of built-in function signatures
  *
@@ -60,6 +61,8 @@
 #include "ir_builder.h"
 #include "glsl_parser_extras.h"
 #include "program/prog_instruction.h"
+#include "util/hash_table.h"
+#include "util/set.h"
 #include <math.h>
 
 #define M_PIf   ((float) M_PI)
@@ -551,8 +554,9 @@ namespace {
  * builtin_builder: A singleton object representing the core of the built-in
  * function module.
  *
- * It generates IR for every built-in function signature, and organizes them
- * into functions.
+ * It generates IR for built-in function signatures, and organizes them
+ * into functions.  A function's signatures are generated the first time the
+ * function is looked up.
  */
 class builtin_builder {
 public:
@@ -563,19 +567,34 @@ public:
    void release();
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
+   ir_function *find_function(const char *name);
 
    /**
-    * A shader to hold all the built-in signatures; created by this module.
+    * A shader to hold the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * This includes the signatures of every intrinsic and of every built-in
+    * looked up so far, regardless of version or enabled extensions.  The
+    * availability predicate associated with each signature allows
+    * matching_signature() to filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /**
+    * Name of the built-in create_builtins() is creating, or NULL when
+    * creating the intrinsics.
+    */
+   const char *requested_name;
+
+   /**
+    * Names of all the built-ins, listed by create_builtins() when
+    * \c listing_names is set.  Only these names are worth creating.
+    */
+   struct set *builtin_names;
+   bool listing_names;
+
    /** Global variables used by built-in functions. */
    ir_variable *gl_ModelViewProjectionMatrix;
    ir_variable *gl_Vertex;
@@ -897,6 +916,9 @@ enum image_function_flags {
  */
 builtin_builder::builtin_builder()
    : shader(NULL),
+     requested_name(NULL),
+     builtin_names(NULL),
+     listing_names(false),
      gl_ModelViewProjectionMatrix(NULL),
      gl_Vertex(NULL)
 {
@@ -921,7 +943,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = find_function(name);
    if (f == NULL)
       return NULL;
 
@@ -933,6 +955,24 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+/**
+ * Look up a built-in function by name, creating its signatures if this is
+ * the first lookup.
+ */
+ir_function *
+builtin_builder::find_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL || !_mesa_set_search(builtin_names, name))
+      return f;
+
+   requested_name = name;
+   create_builtins();
+   requested_name = NULL;
+
+   return shader->symbols->get_function(name);
+}
+
 void
 builtin_builder::initialize()
 {
@@ -943,7 +983,15 @@ builtin_builder::initialize()
    mem_ctx = ralloc_context(NULL);
    create_shader();
    create_intrinsics();
+
+   /* The names are string literals, so listing them allocates nothing but
+    * the set.
+    */
+   builtin_names = _mesa_set_create(mem_ctx, _mesa_key_hash_string,
+                                    _mesa_key_string_equal);
+   listing_names = true;
    create_builtins();
+   listing_names = false;
 }
 
 void
@@ -951,6 +999,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   builtin_names = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1084,13 +1133,24 @@ builtin_builder::create_intrinsics()
 }
 
 /**
- * Create ir_function and ir_function_signature objects for each built-in.
+ * Create ir_function and ir_function_signature objects for the built-in
+ * named \c requested_name, or list the names of all the built-ins in
+ * \c builtin_names.
  *
- * Contains a list of every available built-in.
+ * Contains a list of every available built-in.  The signatures of a
+ * built-in are only created when its name is the requested one.
  */
 void
 builtin_builder::create_builtins()
 {
+#define add_function(NAME, ...)                       \
+   do {                                               \
+      if (listing_names)                              \
+         _mesa_set_add(builtin_names, NAME);          \
+      else if (strcmp(NAME, requested_name) == 0)     \
+         add_function(NAME, __VA_ARGS__);             \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
@@ -2954,6 +3014,7 @@ builtin_builder::create_builtins()
    add_function("allInvocationsARB", _vote(ir_unop_vote_all), NULL);
    add_function("allInvocationsEqualARB", _vote(ir_unop_vote_eq), NULL);
 
+#undef add_function
 #undef F
 #undef FI
 #undef FIUD
@@ -3030,6 +3091,14 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   if (listing_names) {
+      _mesa_set_add(builtin_names, name);
+      return;
+   }
+
+   if (requested_name && strcmp(name, requested_name) != 0)
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -5651,7 +5720,7 @@ _mesa_glsl_find_builtin_function_by_name(const char *name)
 {
    ir_function *f;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.find_function(name);
    mtx_unlock(&builtins_lock);
    return f;
 }
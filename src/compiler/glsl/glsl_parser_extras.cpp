@@ -1831,13 +1831,22 @@ add_builtin_defines(struct _mesa_glsl_parse_state *state,
    }
 }
 
+/**
+ * Compile \c shader->Source.
+ *
+ * \param force_recompile  The shader's compile was skipped because it was
+ *                         found in the shader cache, and it must really be
+ *                         compiled now.  If the source was replaced since,
+ *                         the skipped source is compiled instead.
+ */
 void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
-                          bool dump_ast, bool dump_hir)
+                          bool dump_ast, bool dump_hir, bool force_recompile)
 {
    struct _mesa_glsl_parse_state *state =
       new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
-   const char *source = shader->Source;
+   const char *source = force_recompile && shader->FallbackSource ?
+      shader->FallbackSource : shader->Source;
 
    if (ctx->Const.GenerateTemporaryNames)
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
@@ -1917,7 +1926,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       set_shader_inout_layout(shader, state);
 
    shader->symbols = new(shader->ir) glsl_symbol_table;
-   shader->CompileStatus = !state->error;
+   shader->CompileStatus = state->error ? compile_failure : compile_success;
    shader->InfoLog = state->info_log;
    shader->Version = state->language_version;
    shader->IsES = state->es_shader;
@@ -1955,6 +1964,9 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 
    _mesa_glsl_initialize_derived_variables(ctx, shader);
 
+   free((void *)shader->FallbackSource);
+   shader->FallbackSource = NULL;
+
    delete state->symbols;
    ralloc_free(state);
 }
@@ -33,6 +33,10 @@ static ir_function_signature *
 find_matching_signature(const char *name, const exec_list *actual_parameters,
                         glsl_symbol_table *symbols, bool use_builtin);
 
+static ir_function_signature *
+find_matching_signature(const char *name, const exec_list *actual_parameters,
+                        gl_shader *shader, bool use_builtin);
+
 namespace {
 
 class call_link_visitor : public ir_hierarchical_visitor {
@@ -89,8 +93,7 @@ public:
        */
       for (unsigned i = 0; i < num_shaders; i++) {
          sig = find_matching_signature(name, &ir->actual_parameters,
-                                       shader_list[i]->symbols,
-                                       ir->use_builtin);
+                                       shader_list[i], ir->use_builtin);
          if (sig)
             break;
       }
@@ -307,15 +310,10 @@ private:
 
 } /* anonymous namespace */
 
-/**
- * Searches a list of shaders for a particular function definition
- */
-ir_function_signature *
-find_matching_signature(const char *name, const exec_list *actual_parameters,
-                        glsl_symbol_table *symbols, bool use_builtin)
+static ir_function_signature *
+find_defined_signature(ir_function *f, const exec_list *actual_parameters,
+                       bool use_builtin)
 {
-   ir_function *const f = symbols->get_function(name);
-
    if (f) {
       ir_function_signature *sig =
          f->matching_signature(NULL, actual_parameters, use_builtin);
@@ -333,6 +331,34 @@ find_matching_signature(const char *name, const exec_list *actual_parameters,
    return NULL;
 }
 
+/**
+ * Searches a list of shaders for a particular function definition
+ */
+ir_function_signature *
+find_matching_signature(const char *name, const exec_list *actual_parameters,
+                        glsl_symbol_table *symbols, bool use_builtin)
+{
+   return find_defined_signature(symbols->get_function(name),
+                                 actual_parameters, use_builtin);
+}
+
+ir_function_signature *
+find_matching_signature(const char *name, const exec_list *actual_parameters,
+                        gl_shader *shader, bool use_builtin)
+{
+   /* Built-ins are added to the built-in shader as other threads compile,
+    * so its symbol table is only accessed through the locked lookup.
+    */
+   if (shader == _mesa_glsl_get_builtin_function_shader()) {
+      return find_defined_signature(
+         _mesa_glsl_find_builtin_function_by_name(name),
+         actual_parameters, use_builtin);
+   }
+
+   return find_matching_signature(name, actual_parameters, shader->symbols,
+                                  use_builtin);
+}
+
 
 bool
 link_function_calls(gl_shader_program *prog, gl_linked_shader *main,
@@ -81,6 +81,7 @@
 #include "ir_uniform.h"
 
 #include "main/shaderobj.h"
+#include "main/shader_queue.h"
 #include "main/enums.h"
 
 
@@ -4697,6 +4698,55 @@ link_varyings_and_uniforms(unsigned first, unsigned last,
    return true;
 }
 
+struct optimize_stage_job {
+   struct gl_linked_shader *shader;
+   const struct gl_shader_compiler_options *options;
+   bool native_integers;
+};
+
+/**
+ * The link-time optimization loop of one stage.  It only touches the IR of
+ * its stage, which is allocated out of the stage's own ralloc context, so
+ * the stages of a program can be optimized concurrently.
+ */
+static void
+optimize_stage(void *data)
+{
+   struct optimize_stage_job *job = (struct optimize_stage_job *) data;
+   exec_list *ir = job->shader->ir;
+
+   while (do_common_optimization(ir, true, false, job->options,
+                                 job->native_integers))
+      ;
+
+   lower_const_arrays_to_uniforms(ir);
+   propagate_invariance(ir);
+}
+
+/**
+ * Run optimize_stage() for every linked stage on the shader queue's worker
+ * threads, so the program takes about as long as its slowest stage.
+ */
+static void
+optimize_stages(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   struct optimize_stage_job jobs[MESA_SHADER_STAGES];
+   unsigned num_jobs = 0;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] == NULL)
+         continue;
+
+      jobs[num_jobs].shader = prog->_LinkedShaders[i];
+      jobs[num_jobs].options = &ctx->Const.ShaderCompilerOptions[i];
+      jobs[num_jobs].native_integers = ctx->Const.NativeIntegers;
+      num_jobs++;
+   }
+
+   _mesa_shader_queue_run(ctx, optimize_stage, jobs, num_jobs,
+                          sizeof(jobs[0]));
+}
+
 void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
 {
@@ -4994,16 +5044,10 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
       if (ctx->Const.LowerTessLevel) {
          lower_tess_level(prog->_LinkedShaders[i]);
       }
-
-      while (do_common_optimization(prog->_LinkedShaders[i]->ir, true, false,
-                                    &ctx->Const.ShaderCompilerOptions[i],
-                                    ctx->Const.NativeIntegers))
-	 ;
-
-      lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir);
-      propagate_invariance(prog->_LinkedShaders[i]->ir);
    }
 
+   optimize_stages(ctx, prog);
+
    /* Validation for special cases where we allow sampler array indexing
     * with loop induction variable. This check emits a warning or error
     * depending if backend can handle dynamic indexing.
@@ -37,6 +37,8 @@
 #include "ir_basic_block.h"
 #include "ir_optimization.h"
 #include "compiler/glsl_types.h"
+#include "util/hash_table.h"
+#include "util/set.h"
 
 namespace {
 
@@ -56,16 +58,90 @@ public:
 };
 
 
-class kill_entry : public exec_node
+/**
+ * The available copies, found by the variable they write when it is used
+ * and by the variable they read when that is killed.  There is at most one
+ * copy to each variable; the copies from a variable are kept in a list.
+ */
+class acp_table
 {
 public:
-   kill_entry(ir_variable *var)
+   acp_table()
+   {
+      lhs_ht = _mesa_hash_table_create(this, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+      rhs_ht = _mesa_hash_table_create(this, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+   }
+
+   DECLARE_RALLOC_CXX_OPERATORS(acp_table)
+
+   /** Returns the variable \p lhs is a copy of, or NULL. */
+   ir_variable *find(ir_variable *lhs)
    {
-      assert(var);
-      this->var = var;
+      hash_entry *he = _mesa_hash_table_search(lhs_ht, lhs);
+      return he ? ((acp_entry *) he->data)->rhs : NULL;
    }
 
-   ir_variable *var;
+   void add(ir_variable *lhs, ir_variable *rhs)
+   {
+      acp_entry *entry = new(this) acp_entry(lhs, rhs);
+      hash_entry *he = _mesa_hash_table_search(rhs_ht, rhs);
+      exec_list *copies;
+
+      if (he) {
+         copies = (exec_list *) he->data;
+      } else {
+         copies = new(this) exec_list;
+         _mesa_hash_table_insert(rhs_ht, rhs, copies);
+      }
+
+      copies->push_tail(entry);
+      _mesa_hash_table_insert(lhs_ht, lhs, entry);
+   }
+
+   /** Removes the copies to and from \p var. */
+   void kill(ir_variable *var)
+   {
+      hash_entry *he = _mesa_hash_table_search(lhs_ht, var);
+      if (he) {
+         ((acp_entry *) he->data)->remove();
+         _mesa_hash_table_remove(lhs_ht, he);
+      }
+
+      he = _mesa_hash_table_search(rhs_ht, var);
+      if (he) {
+         exec_list *copies = (exec_list *) he->data;
+
+         foreach_in_list(acp_entry, entry, copies) {
+            hash_entry *copy = _mesa_hash_table_search(lhs_ht, entry->lhs);
+            _mesa_hash_table_remove(lhs_ht, copy);
+         }
+         copies->make_empty();
+      }
+   }
+
+   void make_empty()
+   {
+      _mesa_hash_table_clear(lhs_ht, NULL);
+      _mesa_hash_table_clear(rhs_ht, NULL);
+   }
+
+   void copy_from(acp_table *src)
+   {
+      struct hash_entry *he;
+
+      hash_table_foreach(src->lhs_ht, he) {
+         acp_entry *entry = (acp_entry *) he->data;
+         add(entry->lhs, entry->rhs);
+      }
+   }
+
+private:
+   /** Hash table of acp_entry, keyed by the LHS */
+   hash_table *lhs_ht;
+   /** Hash table of lists of acp_entry, keyed by the RHS */
+   hash_table *rhs_ht;
 };
 
 class ir_copy_propagation_visitor : public ir_hierarchical_visitor {
@@ -74,8 +150,8 @@ public:
    {
       progress = false;
       mem_ctx = ralloc_context(0);
-      this->acp = new(mem_ctx) exec_list;
-      this->kills = new(mem_ctx) exec_list;
+      this->acp = new(mem_ctx) acp_table;
+      this->kills = create_kills();
       killed_all = false;
    }
    ~ir_copy_propagation_visitor()
@@ -96,13 +172,19 @@ public:
    void kill(ir_variable *ir);
    void handle_if_block(exec_list *instructions);
 
-   /** List of acp_entry: The available copies to propagate */
-   exec_list *acp;
+   set *create_kills()
+   {
+      return _mesa_set_create(mem_ctx, _mesa_hash_pointer,
+                              _mesa_key_pointer_equal);
+   }
+
+   /** The available copies to propagate */
+   acp_table *acp;
    /**
-    * List of kill_entry: The variables whose values were killed in this
+    * Set of ir_variable: The variables whose values were killed in this
     * block.
     */
-   exec_list *kills;
+   set *kills;
 
    bool progress;
 
@@ -120,12 +202,12 @@ ir_copy_propagation_visitor::visit_enter(ir_function_signature *ir)
     * block.  Any instructions at global scope will be shuffled into
     * main() at link time, so they're irrelevant to us.
     */
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   set *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    visit_list_elements(this, &ir->body);
@@ -170,14 +252,10 @@ ir_copy_propagation_visitor::visit(ir_dereference_variable *ir)
    if (this->in_assignee)
       return visit_continue;
 
-   ir_variable *var = ir->var;
-
-   foreach_in_list(acp_entry, entry, this->acp) {
-      if (var == entry->lhs) {
-	 ir->var = entry->rhs;
-	 this->progress = true;
-	 break;
-      }
+   ir_variable *rhs = this->acp->find(ir->var);
+   if (rhs) {
+      ir->var = rhs;
+      this->progress = true;
    }
 
    return visit_continue;
@@ -210,18 +288,16 @@ ir_copy_propagation_visitor::visit_enter(ir_call *ir)
 void
 ir_copy_propagation_visitor::handle_if_block(exec_list *instructions)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   set *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    /* Populate the initial acp with a copy of the original */
-   foreach_in_list(acp_entry, a, orig_acp) {
-      this->acp->push_tail(new(this->acp) acp_entry(a->lhs, a->rhs));
-   }
+   this->acp->copy_from(orig_acp);
 
    visit_list_elements(this, instructions);
 
@@ -229,14 +305,15 @@ ir_copy_propagation_visitor::handle_if_block(exec_list *instructions)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   set *new_kills = this->kills;
    this->kills = orig_kills;
    ralloc_free(this->acp);
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   foreach_in_list(kill_entry, k, new_kills) {
-      kill(k->var);
+   struct set_entry *k;
+   set_foreach(new_kills, k) {
+      kill((ir_variable *) k->key);
    }
 
    ralloc_free(new_kills);
@@ -257,19 +334,17 @@ ir_copy_propagation_visitor::visit_enter(ir_if *ir)
 void
 ir_copy_propagation_visitor::handle_loop(ir_loop *ir, bool keep_acp)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   set *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    if (keep_acp) {
       /* Populate the initial acp with a copy of the original */
-      foreach_in_list(acp_entry, a, orig_acp) {
-         this->acp->push_tail(new(this->acp) acp_entry(a->lhs, a->rhs));
-      }
+      this->acp->copy_from(orig_acp);
    }
 
    visit_list_elements(this, &ir->body_instructions);
@@ -278,14 +353,15 @@ ir_copy_propagation_visitor::handle_loop(ir_loop *ir, bool keep_acp)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   set *new_kills = this->kills;
    this->kills = orig_kills;
    ralloc_free(this->acp);
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   foreach_in_list(kill_entry, k, new_kills) {
-      kill(k->var);
+   struct set_entry *k;
+   set_foreach(new_kills, k) {
+      kill((ir_variable *) k->key);
    }
 
    ralloc_free(new_kills);
@@ -314,15 +390,11 @@ ir_copy_propagation_visitor::kill(ir_variable *var)
    assert(var != NULL);
 
    /* Remove any entries currently in the ACP for this kill. */
-   foreach_in_list_safe(acp_entry, entry, acp) {
-      if (entry->lhs == var || entry->rhs == var) {
-	 entry->remove();
-      }
-   }
+   acp->kill(var);
 
-   /* Add the LHS variable to the list of killed variables in this block.
+   /* Add the LHS variable to the set of killed variables in this block.
     */
-   this->kills->push_tail(new(this->kills) kill_entry(var));
+   _mesa_set_add(this->kills, var);
 }
 
 /**
@@ -332,8 +404,6 @@ ir_copy_propagation_visitor::kill(ir_variable *var)
 void
 ir_copy_propagation_visitor::add_copy(ir_assignment *ir)
 {
-   acp_entry *entry;
-
    if (ir->condition)
       return;
 
@@ -352,8 +422,7 @@ ir_copy_propagation_visitor::add_copy(ir_assignment *ir)
       } else if (lhs_var->data.mode != ir_var_shader_storage &&
                  lhs_var->data.mode != ir_var_shader_shared &&
                  lhs_var->data.precise == rhs_var->data.precise) {
-	 entry = new(this->acp) acp_entry(lhs_var, rhs_var);
-	 this->acp->push_tail(entry);
+	 this->acp->add(lhs_var, rhs_var);
       }
    }
 }
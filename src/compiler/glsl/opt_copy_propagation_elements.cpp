@@ -46,6 +46,7 @@
 #include "ir_basic_block.h"
 #include "ir_optimization.h"
 #include "compiler/glsl_types.h"
+#include "util/hash_table.h"
 
 static bool debug = false;
 
@@ -74,20 +75,105 @@ public:
    ir_variable *rhs;
    unsigned int write_mask;
    int swizzle[4];
+
+   /** Link in the list of copies from \c rhs */
+   exec_node rhs_node;
 };
 
 
-class kill_entry : public exec_node
+/**
+ * The available copies, found by the variable they write when it is used
+ * and by the variable they read when that is killed.  An entry is linked
+ * both into the list of copies to its LHS, in the order they were made,
+ * and into the list of copies from its RHS.
+ */
+class acp_table
 {
 public:
-   kill_entry(ir_variable *var, int write_mask)
+   acp_table()
    {
-      this->var = var;
-      this->write_mask = write_mask;
+      lhs_ht = _mesa_hash_table_create(this, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+      rhs_ht = _mesa_hash_table_create(this, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
    }
 
-   ir_variable *var;
-   unsigned int write_mask;
+   DECLARE_RALLOC_CXX_OPERATORS(acp_table)
+
+   /** Returns the list of copies to \p lhs, or NULL. */
+   exec_list *copies_to(ir_variable *lhs)
+   {
+      hash_entry *he = _mesa_hash_table_search(lhs_ht, lhs);
+      return he ? (exec_list *) he->data : NULL;
+   }
+
+   /** Adds \p entry, which must have been allocated out of the table. */
+   void add(acp_entry *entry)
+   {
+      get_list(lhs_ht, entry->lhs)->push_tail(entry);
+      get_list(rhs_ht, entry->rhs)->push_tail(&entry->rhs_node);
+   }
+
+   /**
+    * Removes the channels in \p write_mask from the copies to \p var, and
+    * all the copies from \p var.
+    */
+   void kill(ir_variable *var, unsigned write_mask)
+   {
+      exec_list *copies = copies_to(var);
+      if (copies) {
+         foreach_in_list_safe(acp_entry, entry, copies) {
+            entry->write_mask &= ~write_mask;
+            if (entry->write_mask == 0) {
+               entry->remove();
+               entry->rhs_node.remove();
+            }
+         }
+      }
+
+      hash_entry *he = _mesa_hash_table_search(rhs_ht, var);
+      if (he) {
+         copies = (exec_list *) he->data;
+         foreach_list_typed_safe(acp_entry, entry, rhs_node, copies) {
+            entry->remove();
+            entry->rhs_node.remove();
+         }
+      }
+   }
+
+   void make_empty()
+   {
+      _mesa_hash_table_clear(lhs_ht, NULL);
+      _mesa_hash_table_clear(rhs_ht, NULL);
+   }
+
+   void copy_from(acp_table *src)
+   {
+      struct hash_entry *he;
+
+      hash_table_foreach(src->lhs_ht, he) {
+         foreach_in_list(acp_entry, a, (exec_list *) he->data) {
+            add(new(this) acp_entry(a));
+         }
+      }
+   }
+
+private:
+   exec_list *get_list(hash_table *ht, ir_variable *var)
+   {
+      hash_entry *he = _mesa_hash_table_search(ht, var);
+      if (he)
+         return (exec_list *) he->data;
+
+      exec_list *list = new(this) exec_list;
+      _mesa_hash_table_insert(ht, var, list);
+      return list;
+   }
+
+   /** Hash table of lists of acp_entry, keyed by the LHS */
+   hash_table *lhs_ht;
+   /** Hash table of lists of acp_entry::rhs_node, keyed by the RHS */
+   hash_table *rhs_ht;
 };
 
 class ir_copy_propagation_elements_visitor : public ir_rvalue_visitor {
@@ -98,8 +184,8 @@ public:
       this->killed_all = false;
       this->mem_ctx = ralloc_context(NULL);
       this->shader_mem_ctx = NULL;
-      this->acp = new(mem_ctx) exec_list;
-      this->kills = new(mem_ctx) exec_list;
+      this->acp = new(mem_ctx) acp_table;
+      this->kills = create_kills();
    }
    ~ir_copy_propagation_elements_visitor()
    {
@@ -117,16 +203,22 @@ public:
    void handle_rvalue(ir_rvalue **rvalue);
 
    void add_copy(ir_assignment *ir);
-   void kill(kill_entry *k);
+   void kill(ir_variable *var, unsigned write_mask);
    void handle_if_block(exec_list *instructions);
 
-   /** List of acp_entry: The available copies to propagate */
-   exec_list *acp;
+   hash_table *create_kills()
+   {
+      return _mesa_hash_table_create(mem_ctx, _mesa_hash_pointer,
+                                     _mesa_key_pointer_equal);
+   }
+
+   /** The available copies to propagate */
+   acp_table *acp;
    /**
-    * List of kill_entry: The variables whose values were killed in this
-    * block.
+    * Hash table of write masks, keyed by ir_variable: The variable channels
+    * whose values were killed in this block.
     */
-   exec_list *kills;
+   hash_table *kills;
 
    bool progress;
 
@@ -147,12 +239,12 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_function_signature *ir)
     * block.  Any instructions at global scope will be shuffled into
     * main() at link time, so they're irrelevant to us.
     */
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   hash_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    visit_list_elements(this, &ir->body);
@@ -174,14 +266,10 @@ ir_copy_propagation_elements_visitor::visit_leave(ir_assignment *ir)
    ir_variable *var = ir->lhs->variable_referenced();
 
    if (var->type->is_scalar() || var->type->is_vector()) {
-      kill_entry *k;
-
       if (lhs)
-	 k = new(this->kills) kill_entry(var, ir->write_mask);
+	 kill(var, ir->write_mask);
       else
-	 k = new(this->kills) kill_entry(var, ~0);
-
-      kill(k);
+	 kill(var, ~0);
    }
 
    add_copy(ir);
@@ -246,19 +334,21 @@ ir_copy_propagation_elements_visitor::handle_rvalue(ir_rvalue **ir)
 
    ir_variable *var = deref_var->var;
 
+   exec_list *copies = this->acp->copies_to(var);
+   if (!copies)
+      return;
+
    /* Try to find ACP entries covering swizzle_chan[], hoping they're
     * the same source variable.
     */
-   foreach_in_list(acp_entry, entry, this->acp) {
-      if (var == entry->lhs) {
-	 for (int c = 0; c < chans; c++) {
-	    if (entry->write_mask & (1 << swizzle_chan[c])) {
-	       source[c] = entry->rhs;
-	       source_chan[c] = entry->swizzle[swizzle_chan[c]];
-
-               if (source_chan[c] != swizzle_chan[c])
-                  noop_swizzle = false;
-	    }
+   foreach_in_list(acp_entry, entry, copies) {
+      for (int c = 0; c < chans; c++) {
+	 if (entry->write_mask & (1 << swizzle_chan[c])) {
+	    source[c] = entry->rhs;
+	    source_chan[c] = entry->swizzle[swizzle_chan[c]];
+
+            if (source_chan[c] != swizzle_chan[c])
+               noop_swizzle = false;
 	 }
       }
    }
@@ -328,18 +418,16 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_call *ir)
 void
 ir_copy_propagation_elements_visitor::handle_if_block(exec_list *instructions)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   hash_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    /* Populate the initial acp with a copy of the original */
-   foreach_in_list(acp_entry, a, orig_acp) {
-      this->acp->push_tail(new(this->acp) acp_entry(a));
-   }
+   this->acp->copy_from(orig_acp);
 
    visit_list_elements(this, instructions);
 
@@ -347,17 +435,18 @@ ir_copy_propagation_elements_visitor::handle_if_block(exec_list *instructions)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   hash_table *new_kills = this->kills;
    this->kills = orig_kills;
    ralloc_free(this->acp);
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   /* Move the new kills into the parent block's list, removing them
-    * from the parent's ACP list in the process.
+   /* Move the new kills into the parent block's table, removing them
+    * from the parent's ACP in the process.
     */
-   foreach_in_list_safe(kill_entry, k, new_kills) {
-      kill(k);
+   struct hash_entry *k;
+   hash_table_foreach(new_kills, k) {
+      kill((ir_variable *) k->key, (uintptr_t) k->data);
    }
 
    ralloc_free(new_kills);
@@ -378,23 +467,21 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_if *ir)
 void
 ir_copy_propagation_elements_visitor::handle_loop(ir_loop *ir, bool keep_acp)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   hash_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
    /* FINISHME: For now, the initial acp for loops is totally empty.
     * We could go through once, then go through again with the acp
     * cloned minus the killed entries after the first run through.
     */
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   this->acp = new(mem_ctx) acp_table;
+   this->kills = create_kills();
    this->killed_all = false;
 
    if (keep_acp) {
       /* Populate the initial acp with a copy of the original */
-      foreach_in_list(acp_entry, a, orig_acp) {
-         this->acp->push_tail(new(this->acp) acp_entry(a));
-      }
+      this->acp->copy_from(orig_acp);
    }
 
    visit_list_elements(this, &ir->body_instructions);
@@ -403,14 +490,15 @@ ir_copy_propagation_elements_visitor::handle_loop(ir_loop *ir, bool keep_acp)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   hash_table *new_kills = this->kills;
    this->kills = orig_kills;
    ralloc_free(this->acp);
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   foreach_in_list_safe(kill_entry, k, new_kills) {
-      kill(k);
+   struct hash_entry *k;
+   hash_table_foreach(new_kills, k) {
+      kill((ir_variable *) k->key, (uintptr_t) k->data);
    }
 
    ralloc_free(new_kills);
@@ -428,27 +516,19 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_loop *ir)
 
 /* Remove any entries currently in the ACP for this kill. */
 void
-ir_copy_propagation_elements_visitor::kill(kill_entry *k)
+ir_copy_propagation_elements_visitor::kill(ir_variable *var,
+                                           unsigned write_mask)
 {
-   foreach_in_list_safe(acp_entry, entry, acp) {
-      if (entry->lhs == k->var) {
-	 entry->write_mask = entry->write_mask & ~k->write_mask;
-	 if (entry->write_mask == 0) {
-	    entry->remove();
-	    continue;
-	 }
-      }
-      if (entry->rhs == k->var) {
-	 entry->remove();
-      }
-   }
+   acp->kill(var, write_mask);
 
-   /* If we were on a list, remove ourselves before inserting */
-   if (k->next)
-      k->remove();
-
-   ralloc_steal(this->kills, k);
-   this->kills->push_tail(k);
+   /* Add the channels to the ones killed in this block. */
+   hash_entry *he = _mesa_hash_table_search(this->kills, var);
+   if (he) {
+      he->data = (void *) ((uintptr_t) he->data | write_mask);
+   } else {
+      _mesa_hash_table_insert(this->kills, var,
+                              (void *) (uintptr_t) write_mask);
+   }
 }
 
 /**
@@ -511,9 +591,8 @@ ir_copy_propagation_elements_visitor::add_copy(ir_assignment *ir)
    if (lhs->var->data.precise != rhs->var->data.precise)
       return;
 
-   entry = new(this->mem_ctx) acp_entry(lhs->var, rhs->var, write_mask,
-					swizzle);
-   this->acp->push_tail(entry);
+   entry = new(this->acp) acp_entry(lhs->var, rhs->var, write_mask, swizzle);
+   this->acp->add(entry);
 }
 
 bool
@@ -0,0 +1,1778 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.cpp
+ *
+ * GLSL shader cache, on top of the on-disk cache in util/disk_cache.c.
+ *
+ * Every successful compile is recorded under the SHA-1 of the shader source
+ * and of the context state that affects compiling.  When a shader whose
+ * record is found gets compiled again, the compile is skipped.
+ *
+ * Linked programs are stored under the SHA-1 of their shaders' SHA-1s and
+ * of the state that affects linking.  The entry holds everything linking
+ * produced (uniforms, blocks, resources, the per-stage gl_program state)
+ * plus the driver's compiled code, so a hit skips both compiling and
+ * linking.  On a miss, the skipped compiles are done before linking.
+ *
+ * Programs using subroutines aren't cached.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "blob.h"
+#include "ir_uniform.h"
+#include "shader_cache.h"
+#include "compiler/glsl_types.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/shaderobj.h"
+#include "program/hash_table.h"
+#include "program/ir_to_mesa.h"
+#include "program/prog_parameter.h"
+#include "program/program.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+
+
+/** Bump whenever the layout of the serialized program changes */
+#define SHADER_CACHE_FORMAT 2
+
+#define TYPE_NULL ~0u
+
+#define REMAP_NULL ~0u
+#define REMAP_INACTIVE (~0u - 1)
+
+#define INDEX_NULL ~0u
+
+
+/**
+ * Read an element count, and check that that many elements of at least
+ * \p min_size bytes each can be present in the rest of the blob.
+ */
+static uint32_t
+read_count(struct blob_reader *metadata, size_t min_size)
+{
+   uint32_t count = blob_read_uint32(metadata);
+
+   if ((size_t) (metadata->end - metadata->current) / min_size < count) {
+      metadata->overrun = true;
+      return 0;
+   }
+
+   return count;
+}
+
+/**
+ * blob_copy_bytes(), which also accepts reading nothing at the very end
+ * of the blob.
+ */
+static void
+read_bytes(struct blob_reader *metadata, void *dest, size_t size)
+{
+   if (size)
+      blob_copy_bytes(metadata, (uint8_t *) dest, size);
+}
+
+static void
+write_nullable_string(struct blob *metadata, const char *str)
+{
+   blob_write_uint32(metadata, str != NULL);
+   if (str)
+      blob_write_string(metadata, str);
+}
+
+static const char *
+read_nullable_string(struct blob_reader *metadata)
+{
+   if (!blob_read_uint32(metadata))
+      return NULL;
+
+   return blob_read_string(metadata);
+}
+
+static char *
+read_ralloc_string(void *mem_ctx, struct blob_reader *metadata)
+{
+   const char *str = blob_read_string(metadata);
+
+   return str ? ralloc_strdup(mem_ctx, str) : NULL;
+}
+
+
+static void
+encode_type_to_blob(struct blob *metadata, const glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_uint32(metadata, TYPE_NULL);
+      return;
+   }
+
+   blob_write_uint32(metadata, type->base_type);
+
+   switch (type->base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL:
+      blob_write_uint32(metadata, type->vector_elements);
+      blob_write_uint32(metadata, type->matrix_columns);
+      break;
+   case GLSL_TYPE_SAMPLER:
+      blob_write_uint32(metadata, type->sampler_dimensionality);
+      blob_write_uint32(metadata, type->sampler_shadow);
+      blob_write_uint32(metadata, type->sampler_array);
+      blob_write_uint32(metadata, type->sampled_type);
+      break;
+   case GLSL_TYPE_IMAGE:
+      blob_write_uint32(metadata, type->sampler_dimensionality);
+      blob_write_uint32(metadata, type->sampler_array);
+      blob_write_uint32(metadata, type->sampled_type);
+      break;
+   case GLSL_TYPE_SUBROUTINE:
+      blob_write_string(metadata, type->name);
+      break;
+   case GLSL_TYPE_ARRAY:
+      blob_write_uint32(metadata, type->length);
+      encode_type_to_blob(metadata, type->fields.array);
+      break;
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      blob_write_string(metadata, type->name);
+      blob_write_uint32(metadata, type->interface_packing);
+      blob_write_uint32(metadata, type->length);
+
+      for (unsigned i = 0; i < type->length; i++) {
+         const glsl_struct_field *field = &type->fields.structure[i];
+
+         encode_type_to_blob(metadata, field->type);
+         blob_write_string(metadata, field->name);
+         blob_write_uint32(metadata, field->location);
+         blob_write_uint32(metadata, field->offset);
+         blob_write_uint32(metadata, field->xfb_buffer);
+         blob_write_uint32(metadata, field->xfb_stride);
+         blob_write_uint32(metadata, field->interpolation);
+         blob_write_uint32(metadata, field->centroid);
+         blob_write_uint32(metadata, field->sample);
+         blob_write_uint32(metadata, field->matrix_layout);
+         blob_write_uint32(metadata, field->patch);
+         blob_write_uint32(metadata, field->precision);
+         blob_write_uint32(metadata, field->image_read_only);
+         blob_write_uint32(metadata, field->image_write_only);
+         blob_write_uint32(metadata, field->image_coherent);
+         blob_write_uint32(metadata, field->image_volatile);
+         blob_write_uint32(metadata, field->image_restrict);
+         blob_write_uint32(metadata, field->explicit_xfb_buffer);
+         blob_write_uint32(metadata, field->implicit_sized_array);
+      }
+      break;
+   case GLSL_TYPE_ATOMIC_UINT:
+   case GLSL_TYPE_VOID:
+   case GLSL_TYPE_FUNCTION:
+   case GLSL_TYPE_ERROR:
+      break;
+   }
+}
+
+/**
+ * Inverse of encode_type_to_blob().  Malformed data gives error_type.
+ */
+static const glsl_type *
+decode_type_from_blob(struct blob_reader *metadata)
+{
+   const uint32_t base_type = blob_read_uint32(metadata);
+
+   if (base_type == TYPE_NULL)
+      return NULL;
+
+   switch (base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL: {
+      const unsigned rows = blob_read_uint32(metadata);
+      const unsigned columns = blob_read_uint32(metadata);
+
+      return glsl_type::get_instance(base_type, rows, columns);
+   }
+   case GLSL_TYPE_SAMPLER: {
+      const unsigned dim = blob_read_uint32(metadata);
+      const bool shadow = blob_read_uint32(metadata);
+      const bool array = blob_read_uint32(metadata);
+      const unsigned sampled_type = blob_read_uint32(metadata);
+
+      if (dim > GLSL_SAMPLER_DIM_MS || sampled_type > GLSL_TYPE_FLOAT)
+         return glsl_type::error_type;
+
+      return glsl_type::get_sampler_instance((enum glsl_sampler_dim) dim,
+                                             shadow, array,
+                                             (glsl_base_type) sampled_type);
+   }
+   case GLSL_TYPE_IMAGE: {
+      const unsigned dim = blob_read_uint32(metadata);
+      const bool array = blob_read_uint32(metadata);
+      const unsigned sampled_type = blob_read_uint32(metadata);
+
+      if (dim > GLSL_SAMPLER_DIM_MS || sampled_type > GLSL_TYPE_FLOAT)
+         return glsl_type::error_type;
+
+      return glsl_type::get_image_instance((enum glsl_sampler_dim) dim,
+                                           array,
+                                           (glsl_base_type) sampled_type);
+   }
+   case GLSL_TYPE_ATOMIC_UINT:
+      return glsl_type::atomic_uint_type;
+   case GLSL_TYPE_SUBROUTINE: {
+      const char *name = blob_read_string(metadata);
+
+      return name ? glsl_type::get_subroutine_instance(name) :
+                    glsl_type::error_type;
+   }
+   case GLSL_TYPE_ARRAY: {
+      const unsigned length = blob_read_uint32(metadata);
+      const glsl_type *element = decode_type_from_blob(metadata);
+
+      if (element == NULL || element->is_error())
+         return glsl_type::error_type;
+
+      return glsl_type::get_array_instance(element, length);
+   }
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE: {
+      const char *name = blob_read_string(metadata);
+      const unsigned packing = blob_read_uint32(metadata);
+      const unsigned length = read_count(metadata, sizeof(uint32_t));
+      glsl_struct_field *fields;
+      const glsl_type *type = glsl_type::error_type;
+
+      if (name == NULL || metadata->overrun)
+         return glsl_type::error_type;
+
+      fields = ralloc_array(NULL, glsl_struct_field, length);
+      if (fields == NULL)
+         return glsl_type::error_type;
+
+      for (unsigned i = 0; i < length; i++) {
+         glsl_struct_field *field = &fields[i];
+
+         field->type = decode_type_from_blob(metadata);
+         field->name = blob_read_string(metadata);
+         field->location = blob_read_uint32(metadata);
+         field->offset = blob_read_uint32(metadata);
+         field->xfb_buffer = blob_read_uint32(metadata);
+         field->xfb_stride = blob_read_uint32(metadata);
+         field->interpolation = blob_read_uint32(metadata);
+         field->centroid = blob_read_uint32(metadata);
+         field->sample = blob_read_uint32(metadata);
+         field->matrix_layout = blob_read_uint32(metadata);
+         field->patch = blob_read_uint32(metadata);
+         field->precision = blob_read_uint32(metadata);
+         field->image_read_only = blob_read_uint32(metadata);
+         field->image_write_only = blob_read_uint32(metadata);
+         field->image_coherent = blob_read_uint32(metadata);
+         field->image_volatile = blob_read_uint32(metadata);
+         field->image_restrict = blob_read_uint32(metadata);
+         field->explicit_xfb_buffer = blob_read_uint32(metadata);
+         field->implicit_sized_array = blob_read_uint32(metadata);
+
+         if (field->type == NULL || field->type->is_error() ||
+             field->name == NULL)
+            goto done;
+      }
+
+      if (base_type == GLSL_TYPE_STRUCT) {
+         type = glsl_type::get_record_instance(fields, length, name);
+      } else {
+         type = glsl_type::get_interface_instance(fields, length,
+                                                  (enum glsl_interface_packing) packing,
+                                                  name);
+      }
+
+   done:
+      ralloc_free(fields);
+      return type;
+   }
+   case GLSL_TYPE_VOID:
+      return glsl_type::void_type;
+   default:
+      return glsl_type::error_type;
+   }
+}
+
+/**
+ * decode_type_from_blob() for a type which can't be NULL.
+ */
+static const glsl_type *
+read_type(struct blob_reader *metadata)
+{
+   const glsl_type *type = decode_type_from_blob(metadata);
+
+   if (type == NULL || type->is_error()) {
+      metadata->overrun = true;
+      return glsl_type::error_type;
+   }
+
+   return type;
+}
+
+
+struct write_hash_closure {
+   struct blob *metadata;
+   unsigned count;
+};
+
+static void
+write_hash_table_entry(const char *key, unsigned value, void *closure)
+{
+   struct write_hash_closure *data = (struct write_hash_closure *) closure;
+
+   blob_write_uint32(data->metadata, value);
+   blob_write_string(data->metadata, key);
+   data->count++;
+}
+
+static void
+write_uniform_hash(struct blob *metadata, struct string_to_uint_map *hash)
+{
+   struct write_hash_closure data = { metadata, 0 };
+   size_t count_offset;
+
+   /* The count is only known after iterating. */
+   blob_write_uint32(metadata, 0);
+   count_offset = metadata->size - sizeof(uint32_t);
+   hash->iterate(write_hash_table_entry, &data);
+   blob_overwrite_uint32(metadata, count_offset, data.count);
+}
+
+static bool
+read_uniform_hash(struct blob_reader *metadata,
+                  struct gl_shader_program *prog)
+{
+   const unsigned count = read_count(metadata, 2 * sizeof(uint32_t));
+
+   prog->UniformHash = new string_to_uint_map;
+
+   for (unsigned i = 0; i < count; i++) {
+      const unsigned value = blob_read_uint32(metadata);
+      const char *key = blob_read_string(metadata);
+
+      if (key == NULL || value >= prog->NumUniformStorage)
+         return false;
+
+      prog->UniformHash->put(value, key);
+   }
+
+   return !metadata->overrun;
+}
+
+
+static bool
+write_uniforms(struct blob *metadata, struct gl_shader_program *prog)
+{
+   blob_write_uint32(metadata, prog->NumUniformStorage);
+   blob_write_uint32(metadata, prog->NumHiddenUniforms);
+   blob_write_uint32(metadata, prog->NumUniformDataSlots);
+
+   for (unsigned i = 0; i < prog->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *uni = &prog->UniformStorage[i];
+
+      encode_type_to_blob(metadata, uni->type);
+      blob_write_string(metadata, uni->name);
+      blob_write_uint32(metadata, uni->array_elements);
+      blob_write_bytes(metadata, uni->opaque, sizeof(uni->opaque));
+      blob_write_uint32(metadata, uni->block_index);
+      blob_write_uint32(metadata, uni->offset);
+      blob_write_uint32(metadata, uni->matrix_stride);
+      blob_write_uint32(metadata, uni->array_stride);
+      blob_write_uint32(metadata, uni->row_major);
+      blob_write_uint32(metadata, uni->hidden);
+      blob_write_uint32(metadata, uni->builtin);
+      blob_write_uint32(metadata, uni->is_shader_storage);
+      blob_write_uint32(metadata, uni->atomic_buffer_index);
+      blob_write_uint32(metadata, uni->remap_location);
+      blob_write_uint32(metadata, uni->num_compatible_subroutines);
+      blob_write_uint32(metadata, uni->top_level_array_size);
+      blob_write_uint32(metadata, uni->top_level_array_stride);
+
+      if (uni->storage == NULL) {
+         blob_write_uint32(metadata, INDEX_NULL);
+      } else {
+         const ptrdiff_t slot = uni->storage - prog->UniformDataSlots;
+
+         if (slot < 0 || slot >= (ptrdiff_t) prog->NumUniformDataSlots)
+            return false;
+
+         blob_write_uint32(metadata, slot);
+      }
+   }
+
+   if (prog->NumUniformDataSlots) {
+      blob_write_bytes(metadata, prog->UniformDataSlots,
+                       sizeof(prog->UniformDataSlots[0]) *
+                       prog->NumUniformDataSlots);
+   }
+
+   blob_write_uint32(metadata, prog->NumUniformRemapTable);
+   for (unsigned i = 0; i < prog->NumUniformRemapTable; i++) {
+      const struct gl_uniform_storage *entry = prog->UniformRemapTable[i];
+
+      if (entry == NULL)
+         blob_write_uint32(metadata, REMAP_NULL);
+      else if (entry == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+         blob_write_uint32(metadata, REMAP_INACTIVE);
+      else
+         blob_write_uint32(metadata, entry - prog->UniformStorage);
+   }
+
+   if (prog->UniformHash)
+      write_uniform_hash(metadata, prog->UniformHash);
+   else
+      blob_write_uint32(metadata, 0);
+
+   return true;
+}
+
+static bool
+read_uniforms(struct blob_reader *metadata, struct gl_shader_program *prog)
+{
+   const unsigned num_uniforms = read_count(metadata, sizeof(uint32_t));
+   const unsigned num_hidden = blob_read_uint32(metadata);
+   const unsigned num_slots =
+      read_count(metadata, sizeof(prog->UniformDataSlots[0]));
+
+   if (metadata->overrun)
+      return false;
+
+   if (num_uniforms) {
+      struct gl_uniform_storage *uniforms =
+         rzalloc_array(prog, struct gl_uniform_storage, num_uniforms);
+      union gl_constant_value *data =
+         rzalloc_array(uniforms, union gl_constant_value, num_slots);
+
+      if (uniforms == NULL || (num_slots && data == NULL)) {
+         ralloc_free(uniforms);
+         return false;
+      }
+
+      prog->NumUniformStorage = num_uniforms;
+      prog->UniformStorage = uniforms;
+      prog->NumUniformDataSlots = num_slots;
+      prog->UniformDataSlots = data;
+   }
+   prog->NumHiddenUniforms = num_hidden;
+
+   for (unsigned i = 0; i < num_uniforms; i++) {
+      struct gl_uniform_storage *uni = &prog->UniformStorage[i];
+
+      uni->type = read_type(metadata);
+      uni->name = read_ralloc_string(prog->UniformStorage, metadata);
+      uni->array_elements = blob_read_uint32(metadata);
+      read_bytes(metadata, uni->opaque, sizeof(uni->opaque));
+      uni->block_index = blob_read_uint32(metadata);
+      uni->offset = blob_read_uint32(metadata);
+      uni->matrix_stride = blob_read_uint32(metadata);
+      uni->array_stride = blob_read_uint32(metadata);
+      uni->row_major = blob_read_uint32(metadata);
+      uni->hidden = blob_read_uint32(metadata);
+      uni->builtin = blob_read_uint32(metadata);
+      uni->is_shader_storage = blob_read_uint32(metadata);
+      uni->atomic_buffer_index = blob_read_uint32(metadata);
+      uni->remap_location = blob_read_uint32(metadata);
+      uni->num_compatible_subroutines = blob_read_uint32(metadata);
+      uni->top_level_array_size = blob_read_uint32(metadata);
+      uni->top_level_array_stride = blob_read_uint32(metadata);
+
+      const unsigned slot = blob_read_uint32(metadata);
+      if (slot != INDEX_NULL) {
+         const unsigned components =
+            MAX2(1, uni->array_elements) * uni->type->component_slots();
+
+         if (slot > num_slots || num_slots - slot < components)
+            return false;
+
+         uni->storage = &prog->UniformDataSlots[slot];
+      }
+
+      if (uni->name == NULL || metadata->overrun)
+         return false;
+   }
+
+   read_bytes(metadata, prog->UniformDataSlots,
+              sizeof(prog->UniformDataSlots[0]) * num_slots);
+
+   const unsigned num_remap = read_count(metadata, sizeof(uint32_t));
+   if (num_remap) {
+      prog->UniformRemapTable =
+         rzalloc_array(prog, struct gl_uniform_storage *, num_remap);
+      if (prog->UniformRemapTable == NULL)
+         return false;
+      prog->NumUniformRemapTable = num_remap;
+   }
+
+   for (unsigned i = 0; i < num_remap; i++) {
+      const unsigned index = blob_read_uint32(metadata);
+
+      if (index == REMAP_NULL)
+         prog->UniformRemapTable[i] = NULL;
+      else if (index == REMAP_INACTIVE)
+         prog->UniformRemapTable[i] = INACTIVE_UNIFORM_EXPLICIT_LOCATION;
+      else if (index < num_uniforms)
+         prog->UniformRemapTable[i] = &prog->UniformStorage[index];
+      else
+         return false;
+   }
+
+   return read_uniform_hash(metadata, prog);
+}
+
+
+static void
+write_uniform_block(struct blob *metadata, const struct gl_uniform_block *b)
+{
+   blob_write_string(metadata, b->Name);
+   blob_write_uint32(metadata, b->Binding);
+   blob_write_uint32(metadata, b->UniformBufferSize);
+   blob_write_uint32(metadata, b->stageref);
+   blob_write_uint32(metadata, b->_Packing);
+   blob_write_uint32(metadata, b->NumUniforms);
+
+   for (unsigned i = 0; i < b->NumUniforms; i++) {
+      const struct gl_uniform_buffer_variable *var = &b->Uniforms[i];
+
+      blob_write_string(metadata, var->Name);
+      /* IndexName usually shares the storage of Name */
+      if (var->IndexName == var->Name)
+         blob_write_uint32(metadata, 0);
+      else
+         write_nullable_string(metadata, var->IndexName);
+      encode_type_to_blob(metadata, var->Type);
+      blob_write_uint32(metadata, var->Offset);
+      blob_write_uint32(metadata, var->RowMajor);
+   }
+}
+
+static bool
+read_uniform_block(struct blob_reader *metadata, void *mem_ctx,
+                   struct gl_uniform_block *b)
+{
+   b->Name = read_ralloc_string(mem_ctx, metadata);
+   b->Binding = blob_read_uint32(metadata);
+   b->UniformBufferSize = blob_read_uint32(metadata);
+   b->stageref = blob_read_uint32(metadata);
+   b->_Packing = (enum gl_uniform_block_packing) blob_read_uint32(metadata);
+   b->NumUniforms = read_count(metadata, 3 * sizeof(uint32_t));
+
+   if (b->Name == NULL || metadata->overrun)
+      return false;
+
+   b->Uniforms = rzalloc_array(mem_ctx, struct gl_uniform_buffer_variable,
+                               b->NumUniforms);
+   if (b->NumUniforms && b->Uniforms == NULL)
+      return false;
+
+   for (unsigned i = 0; i < b->NumUniforms; i++) {
+      struct gl_uniform_buffer_variable *var = &b->Uniforms[i];
+
+      var->Name = read_ralloc_string(mem_ctx, metadata);
+      if (blob_read_uint32(metadata)) {
+         var->IndexName = read_ralloc_string(mem_ctx, metadata);
+         if (var->IndexName == NULL)
+            return false;
+      } else {
+         var->IndexName = var->Name;
+      }
+      var->Type = read_type(metadata);
+      var->Offset = blob_read_uint32(metadata);
+      var->RowMajor = blob_read_uint32(metadata);
+
+      if (var->Name == NULL || metadata->overrun)
+         return false;
+   }
+
+   return true;
+}
+
+static void
+write_blocks(struct blob *metadata, unsigned num_blocks,
+             const struct gl_uniform_block *blocks)
+{
+   blob_write_uint32(metadata, num_blocks);
+   for (unsigned i = 0; i < num_blocks; i++)
+      write_uniform_block(metadata, &blocks[i]);
+}
+
+static bool
+read_blocks(struct blob_reader *metadata, struct gl_shader_program *prog,
+            unsigned *num_blocks, struct gl_uniform_block **blocks)
+{
+   const unsigned count = read_count(metadata, 6 * sizeof(uint32_t));
+
+   if (metadata->overrun)
+      return false;
+
+   if (count == 0)
+      return true;
+
+   *blocks = rzalloc_array(prog, struct gl_uniform_block, count);
+   if (*blocks == NULL)
+      return false;
+   *num_blocks = count;
+
+   for (unsigned i = 0; i < count; i++) {
+      if (!read_uniform_block(metadata, *blocks, &(*blocks)[i]))
+         return false;
+   }
+
+   return true;
+}
+
+
+static void
+write_atomic_buffers(struct blob *metadata, struct gl_shader_program *prog)
+{
+   blob_write_uint32(metadata, prog->NumAtomicBuffers);
+
+   for (unsigned i = 0; i < prog->NumAtomicBuffers; i++) {
+      const struct gl_active_atomic_buffer *buf = &prog->AtomicBuffers[i];
+
+      blob_write_uint32(metadata, buf->Binding);
+      blob_write_uint32(metadata, buf->MinimumSize);
+      blob_write_bytes(metadata, buf->StageReferences,
+                       sizeof(buf->StageReferences));
+      blob_write_uint32(metadata, buf->NumUniforms);
+      for (unsigned j = 0; j < buf->NumUniforms; j++)
+         blob_write_uint32(metadata, buf->Uniforms[j]);
+   }
+}
+
+static bool
+read_atomic_buffers(struct blob_reader *metadata,
+                    struct gl_shader_program *prog)
+{
+   const unsigned count = read_count(metadata, 3 * sizeof(uint32_t));
+
+   if (metadata->overrun)
+      return false;
+
+   if (count == 0)
+      return true;
+
+   prog->AtomicBuffers =
+      rzalloc_array(prog, struct gl_active_atomic_buffer, count);
+   if (prog->AtomicBuffers == NULL)
+      return false;
+   prog->NumAtomicBuffers = count;
+
+   for (unsigned i = 0; i < count; i++) {
+      struct gl_active_atomic_buffer *buf = &prog->AtomicBuffers[i];
+
+      buf->Binding = blob_read_uint32(metadata);
+      buf->MinimumSize = blob_read_uint32(metadata);
+      read_bytes(metadata, buf->StageReferences,
+                 sizeof(buf->StageReferences));
+      buf->NumUniforms = read_count(metadata, sizeof(uint32_t));
+
+      if (metadata->overrun)
+         return false;
+
+      buf->Uniforms = rzalloc_array(prog->AtomicBuffers, GLuint,
+                                    buf->NumUniforms);
+      if (buf->NumUniforms && buf->Uniforms == NULL)
+         return false;
+
+      for (unsigned j = 0; j < buf->NumUniforms; j++) {
+         buf->Uniforms[j] = blob_read_uint32(metadata);
+         if (buf->Uniforms[j] >= prog->NumUniformStorage)
+            return false;
+      }
+   }
+
+   return !metadata->overrun;
+}
+
+
+static void
+write_xfb(struct blob *metadata, struct gl_shader_program *prog)
+{
+   const struct gl_transform_feedback_info *xfb =
+      &prog->LinkedTransformFeedback;
+
+   blob_write_uint32(metadata, xfb->NumVarying);
+   for (int i = 0; i < xfb->NumVarying; i++) {
+      const struct gl_transform_feedback_varying_info *varying =
+         &xfb->Varyings[i];
+
+      blob_write_string(metadata, varying->Name);
+      blob_write_uint32(metadata, varying->Type);
+      blob_write_uint32(metadata, varying->BufferIndex);
+      blob_write_uint32(metadata, varying->Size);
+      blob_write_uint32(metadata, varying->Offset);
+   }
+
+   blob_write_uint32(metadata, xfb->NumOutputs);
+   if (xfb->NumOutputs) {
+      blob_write_bytes(metadata, xfb->Outputs,
+                       sizeof(xfb->Outputs[0]) * xfb->NumOutputs);
+   }
+
+   blob_write_uint32(metadata, xfb->ActiveBuffers);
+   blob_write_bytes(metadata, xfb->Buffers, sizeof(xfb->Buffers));
+}
+
+static bool
+read_xfb(struct blob_reader *metadata, struct gl_shader_program *prog)
+{
+   struct gl_transform_feedback_info *xfb = &prog->LinkedTransformFeedback;
+
+   ralloc_free(xfb->Varyings);
+   ralloc_free(xfb->Outputs);
+   memset(xfb, 0, sizeof(*xfb));
+
+   const unsigned num_varyings = read_count(metadata, 5 * sizeof(uint32_t));
+   if (metadata->overrun)
+      return false;
+
+   if (num_varyings) {
+      xfb->Varyings = rzalloc_array(prog,
+                                    struct gl_transform_feedback_varying_info,
+                                    num_varyings);
+      if (xfb->Varyings == NULL)
+         return false;
+      xfb->NumVarying = num_varyings;
+   }
+
+   for (unsigned i = 0; i < num_varyings; i++) {
+      struct gl_transform_feedback_varying_info *varying = &xfb->Varyings[i];
+
+      varying->Name = read_ralloc_string(xfb->Varyings, metadata);
+      varying->Type = blob_read_uint32(metadata);
+      varying->BufferIndex = blob_read_uint32(metadata);
+      varying->Size = blob_read_uint32(metadata);
+      varying->Offset = blob_read_uint32(metadata);
+
+      if (varying->Name == NULL)
+         return false;
+   }
+
+   const unsigned num_outputs = read_count(metadata, sizeof(xfb->Outputs[0]));
+   if (metadata->overrun)
+      return false;
+
+   if (num_outputs) {
+      xfb->Outputs = rzalloc_array(prog, struct gl_transform_feedback_output,
+                                   num_outputs);
+      if (xfb->Outputs == NULL)
+         return false;
+      xfb->NumOutputs = num_outputs;
+      read_bytes(metadata, xfb->Outputs,
+                 sizeof(xfb->Outputs[0]) * num_outputs);
+   }
+
+   xfb->ActiveBuffers = blob_read_uint32(metadata);
+   read_bytes(metadata, xfb->Buffers, sizeof(xfb->Buffers));
+
+   return !metadata->overrun;
+}
+
+
+static void
+write_shader_variable(struct blob *metadata,
+                      const struct gl_shader_variable *var)
+{
+   encode_type_to_blob(metadata, var->type);
+   encode_type_to_blob(metadata, var->interface_type);
+   encode_type_to_blob(metadata, var->outermost_struct_type);
+   blob_write_string(metadata, var->name);
+   blob_write_uint32(metadata, var->location);
+   blob_write_uint32(metadata, var->component);
+   blob_write_uint32(metadata, var->index);
+   blob_write_uint32(metadata, var->patch);
+   blob_write_uint32(metadata, var->mode);
+   blob_write_uint32(metadata, var->interpolation);
+   blob_write_uint32(metadata, var->explicit_location);
+   blob_write_uint32(metadata, var->precision);
+}
+
+static struct gl_shader_variable *
+read_shader_variable(struct blob_reader *metadata, void *mem_ctx)
+{
+   struct gl_shader_variable *var =
+      rzalloc(mem_ctx, struct gl_shader_variable);
+
+   if (var == NULL)
+      return NULL;
+
+   var->type = read_type(metadata);
+   var->interface_type = decode_type_from_blob(metadata);
+   var->outermost_struct_type = decode_type_from_blob(metadata);
+   var->name = read_ralloc_string(var, metadata);
+   var->location = blob_read_uint32(metadata);
+   var->component = blob_read_uint32(metadata);
+   var->index = blob_read_uint32(metadata);
+   var->patch = blob_read_uint32(metadata);
+   var->mode = blob_read_uint32(metadata);
+   var->interpolation = blob_read_uint32(metadata);
+   var->explicit_location = blob_read_uint32(metadata);
+   var->precision = blob_read_uint32(metadata);
+
+   if (var->name == NULL || metadata->overrun)
+      return NULL;
+
+   return var;
+}
+
+/**
+ * Index of the element of \p array pointed to by a resource, which must be
+ * one of \p count elements of \p size bytes.
+ */
+static bool
+resource_index(const void *data, const void *array, unsigned count,
+               size_t size, uint32_t *index)
+{
+   const char *ptr = (const char *) data;
+   const char *base = (const char *) array;
+
+   if (ptr < base || ptr >= base + count * size)
+      return false;
+
+   *index = (ptr - base) / size;
+   return true;
+}
+
+static bool
+write_program_resource_list(struct blob *metadata,
+                            struct gl_shader_program *prog)
+{
+   const struct gl_transform_feedback_info *xfb =
+      &prog->LinkedTransformFeedback;
+
+   blob_write_uint32(metadata, prog->NumProgramResourceList);
+
+   for (unsigned i = 0; i < prog->NumProgramResourceList; i++) {
+      const struct gl_program_resource *res = &prog->ProgramResourceList[i];
+      uint32_t index;
+      bool found;
+
+      blob_write_uint32(metadata, res->Type);
+      blob_write_uint32(metadata, res->StageReferences);
+
+      switch (res->Type) {
+      case GL_PROGRAM_INPUT:
+      case GL_PROGRAM_OUTPUT:
+         write_shader_variable(metadata,
+                               (const struct gl_shader_variable *) res->Data);
+         continue;
+      case GL_UNIFORM:
+      case GL_BUFFER_VARIABLE:
+         found = resource_index(res->Data, prog->UniformStorage,
+                                prog->NumUniformStorage,
+                                sizeof(prog->UniformStorage[0]), &index);
+         break;
+      case GL_UNIFORM_BLOCK:
+         found = resource_index(res->Data, prog->UniformBlocks,
+                                prog->NumUniformBlocks,
+                                sizeof(prog->UniformBlocks[0]), &index);
+         break;
+      case GL_SHADER_STORAGE_BLOCK:
+         found = resource_index(res->Data, prog->ShaderStorageBlocks,
+                                prog->NumShaderStorageBlocks,
+                                sizeof(prog->ShaderStorageBlocks[0]), &index);
+         break;
+      case GL_ATOMIC_COUNTER_BUFFER:
+         found = resource_index(res->Data, prog->AtomicBuffers,
+                                prog->NumAtomicBuffers,
+                                sizeof(prog->AtomicBuffers[0]), &index);
+         break;
+      case GL_TRANSFORM_FEEDBACK_VARYING:
+         found = resource_index(res->Data, xfb->Varyings, xfb->NumVarying,
+                                sizeof(xfb->Varyings[0]), &index);
+         break;
+      case GL_TRANSFORM_FEEDBACK_BUFFER:
+         found = resource_index(res->Data, xfb->Buffers,
+                                ARRAY_SIZE(xfb->Buffers),
+                                sizeof(xfb->Buffers[0]), &index);
+         break;
+      default:
+         /* Subroutines and subroutine uniforms. */
+         found = false;
+         break;
+      }
+
+      if (!found)
+         return false;
+
+      blob_write_uint32(metadata, index);
+   }
+
+   return true;
+}
+
+static bool
+read_program_resource_list(struct blob_reader *metadata,
+                           struct gl_shader_program *prog)
+{
+   struct gl_transform_feedback_info *xfb = &prog->LinkedTransformFeedback;
+   const unsigned count = read_count(metadata, 3 * sizeof(uint32_t));
+
+   if (metadata->overrun)
+      return false;
+
+   if (count == 0)
+      return true;
+
+   prog->ProgramResourceList =
+      rzalloc_array(prog, struct gl_program_resource, count);
+   if (prog->ProgramResourceList == NULL)
+      return false;
+   prog->NumProgramResourceList = count;
+
+   for (unsigned i = 0; i < count; i++) {
+      struct gl_program_resource *res = &prog->ProgramResourceList[i];
+      const void *data = NULL;
+
+      res->Type = blob_read_uint32(metadata);
+      res->StageReferences = blob_read_uint32(metadata);
+
+      if (res->Type == GL_PROGRAM_INPUT || res->Type == GL_PROGRAM_OUTPUT) {
+         res->Data = read_shader_variable(metadata, prog->ProgramResourceList);
+         if (res->Data == NULL)
+            return false;
+         continue;
+      }
+
+      const unsigned index = blob_read_uint32(metadata);
+
+      switch (res->Type) {
+      case GL_UNIFORM:
+      case GL_BUFFER_VARIABLE:
+         if (index < prog->NumUniformStorage)
+            data = &prog->UniformStorage[index];
+         break;
+      case GL_UNIFORM_BLOCK:
+         if (index < prog->NumUniformBlocks)
+            data = &prog->UniformBlocks[index];
+         break;
+      case GL_SHADER_STORAGE_BLOCK:
+         if (index < prog->NumShaderStorageBlocks)
+            data = &prog->ShaderStorageBlocks[index];
+         break;
+      case GL_ATOMIC_COUNTER_BUFFER:
+         if (index < prog->NumAtomicBuffers)
+            data = &prog->AtomicBuffers[index];
+         break;
+      case GL_TRANSFORM_FEEDBACK_VARYING:
+         if (index < (unsigned) xfb->NumVarying)
+            data = &xfb->Varyings[index];
+         break;
+      case GL_TRANSFORM_FEEDBACK_BUFFER:
+         if (index < ARRAY_SIZE(xfb->Buffers))
+            data = &xfb->Buffers[index];
+         break;
+      default:
+         break;
+      }
+
+      if (data == NULL || metadata->overrun)
+         return false;
+
+      res->Data = data;
+   }
+
+   return true;
+}
+
+
+/**
+ * Write the indices into the program-level \p blocks of a stage's
+ * \p stage_blocks.
+ */
+static bool
+write_block_indices(struct blob *metadata, unsigned num_stage_blocks,
+                    void **stage_blocks, const void *blocks,
+                    unsigned num_blocks, size_t size)
+{
+   blob_write_uint32(metadata, num_stage_blocks);
+
+   for (unsigned i = 0; i < num_stage_blocks; i++) {
+      uint32_t index;
+
+      if (!resource_index(stage_blocks[i], blocks, num_blocks, size, &index))
+         return false;
+
+      blob_write_uint32(metadata, index);
+   }
+
+   return true;
+}
+
+static bool
+read_block_indices(struct blob_reader *metadata, void *mem_ctx,
+                   unsigned *num_stage_blocks, void ***stage_blocks,
+                   void *blocks, unsigned num_blocks, size_t size)
+{
+   const unsigned count = read_count(metadata, sizeof(uint32_t));
+
+   if (metadata->overrun)
+      return false;
+
+   if (count == 0)
+      return true;
+
+   *stage_blocks = ralloc_array(mem_ctx, void *, count);
+   if (*stage_blocks == NULL)
+      return false;
+   *num_stage_blocks = count;
+
+   for (unsigned i = 0; i < count; i++) {
+      const unsigned index = blob_read_uint32(metadata);
+
+      if (index >= num_blocks)
+         return false;
+
+      (*stage_blocks)[i] = (char *) blocks + index * size;
+   }
+
+   return true;
+}
+
+
+static size_t
+program_size(gl_shader_stage stage)
+{
+   switch (stage) {
+   case MESA_SHADER_VERTEX:
+      return sizeof(struct gl_vertex_program);
+   case MESA_SHADER_TESS_CTRL:
+      return sizeof(struct gl_tess_ctrl_program);
+   case MESA_SHADER_TESS_EVAL:
+      return sizeof(struct gl_tess_eval_program);
+   case MESA_SHADER_GEOMETRY:
+      return sizeof(struct gl_geometry_program);
+   case MESA_SHADER_FRAGMENT:
+      return sizeof(struct gl_fragment_program);
+   case MESA_SHADER_COMPUTE:
+      return sizeof(struct gl_compute_program);
+   default:
+      unreachable("bad shader stage");
+   }
+}
+
+/*
+ * The plain-data parts of gl_program, and of the stage subclass, which
+ * follow the base class.
+ */
+#define PROGRAM_STATE_START offsetof(struct gl_program, InputsRead)
+#define PROGRAM_STATE_END offsetof(struct gl_program, Parameters)
+#define PROGRAM_COUNTS_START offsetof(struct gl_program, SamplerUnits)
+
+static void
+write_parameters(struct blob *metadata,
+                 const struct gl_program_parameter_list *params)
+{
+   blob_write_uint32(metadata, params->NumParameters);
+   blob_write_uint32(metadata, params->StateFlags);
+
+   for (unsigned i = 0; i < params->NumParameters; i++) {
+      const struct gl_program_parameter *p = &params->Parameters[i];
+
+      write_nullable_string(metadata, p->Name);
+      blob_write_uint32(metadata, p->Type);
+      blob_write_uint32(metadata, p->DataType);
+      blob_write_uint32(metadata, p->Size);
+      blob_write_uint32(metadata, p->Initialized);
+      blob_write_bytes(metadata, p->StateIndexes, sizeof(p->StateIndexes));
+      blob_write_bytes(metadata, params->ParameterValues[i],
+                       sizeof(params->ParameterValues[i]));
+   }
+}
+
+static struct gl_program_parameter_list *
+read_parameters(struct blob_reader *metadata)
+{
+   const unsigned count = read_count(metadata, 6 * sizeof(uint32_t));
+   const GLbitfield state_flags = blob_read_uint32(metadata);
+   struct gl_program_parameter_list *params;
+
+   if (metadata->overrun)
+      return NULL;
+
+   params = _mesa_new_parameter_list_sized(count);
+   if (params == NULL)
+      return NULL;
+
+   params->StateFlags = state_flags;
+
+   for (unsigned i = 0; i < count; i++) {
+      struct gl_program_parameter *p = &params->Parameters[i];
+      const char *name = read_nullable_string(metadata);
+
+      p->Name = name ? strdup(name) : NULL;
+      params->NumParameters = i + 1;
+
+      p->Type = (gl_register_file) blob_read_uint32(metadata);
+      p->DataType = blob_read_uint32(metadata);
+      p->Size = blob_read_uint32(metadata);
+      p->Initialized = blob_read_uint32(metadata);
+      read_bytes(metadata, p->StateIndexes, sizeof(p->StateIndexes));
+      read_bytes(metadata, params->ParameterValues[i],
+                 sizeof(params->ParameterValues[i]));
+
+      if (metadata->overrun || p->Type >= PROGRAM_FILE_MAX) {
+         _mesa_free_parameter_list(params);
+         return NULL;
+      }
+   }
+
+   return params;
+}
+
+static void
+write_program(struct blob *metadata, gl_shader_stage stage,
+              struct gl_program *glprog)
+{
+   const char *base = (const char *) glprog;
+
+   blob_write_bytes(metadata, base + PROGRAM_STATE_START,
+                    PROGRAM_STATE_END - PROGRAM_STATE_START);
+   blob_write_bytes(metadata, base + PROGRAM_COUNTS_START,
+                    sizeof(struct gl_program) - PROGRAM_COUNTS_START);
+   blob_write_bytes(metadata, base + sizeof(struct gl_program),
+                    program_size(stage) - sizeof(struct gl_program));
+
+   write_parameters(metadata, glprog->Parameters);
+}
+
+static struct gl_program *
+read_program(struct blob_reader *metadata, struct gl_context *ctx,
+             gl_shader_stage stage)
+{
+   struct gl_program *glprog =
+      ctx->Driver.NewProgram(ctx, _mesa_shader_stage_to_program(stage), 0);
+   char *base = (char *) glprog;
+
+   if (glprog == NULL)
+      return NULL;
+
+   read_bytes(metadata, base + PROGRAM_STATE_START,
+              PROGRAM_STATE_END - PROGRAM_STATE_START);
+   read_bytes(metadata, base + PROGRAM_COUNTS_START,
+              sizeof(struct gl_program) - PROGRAM_COUNTS_START);
+   read_bytes(metadata, base + sizeof(struct gl_program),
+              program_size(stage) - sizeof(struct gl_program));
+
+   glprog->Parameters = read_parameters(metadata);
+   if (glprog->Parameters == NULL) {
+      _mesa_reference_program(ctx, &glprog, NULL);
+      return NULL;
+   }
+
+   return glprog;
+}
+
+
+static bool
+write_shader(struct blob *metadata, struct gl_shader_program *prog,
+             struct gl_linked_shader *sh)
+{
+   blob_write_uint32(metadata, sh->num_samplers);
+   blob_write_uint32(metadata, sh->active_samplers);
+   blob_write_uint32(metadata, sh->shadow_samplers);
+   blob_write_bytes(metadata, sh->SamplerUnits, sizeof(sh->SamplerUnits));
+   blob_write_bytes(metadata, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   blob_write_uint32(metadata, sh->num_uniform_components);
+   blob_write_uint32(metadata, sh->num_combined_uniform_components);
+   blob_write_uint32(metadata, sh->NumImages);
+   blob_write_bytes(metadata, sh->ImageUnits, sizeof(sh->ImageUnits));
+   blob_write_bytes(metadata, sh->ImageAccess, sizeof(sh->ImageAccess));
+   blob_write_bytes(metadata, &sh->info, sizeof(sh->info));
+
+   if (!write_block_indices(metadata, sh->NumUniformBlocks,
+                            (void **) sh->UniformBlocks,
+                            prog->UniformBlocks, prog->NumUniformBlocks,
+                            sizeof(prog->UniformBlocks[0])) ||
+       !write_block_indices(metadata, sh->NumShaderStorageBlocks,
+                            (void **) sh->ShaderStorageBlocks,
+                            prog->ShaderStorageBlocks,
+                            prog->NumShaderStorageBlocks,
+                            sizeof(prog->ShaderStorageBlocks[0])) ||
+       !write_block_indices(metadata, sh->NumAtomicBuffers,
+                            (void **) sh->AtomicBuffers,
+                            prog->AtomicBuffers, prog->NumAtomicBuffers,
+                            sizeof(prog->AtomicBuffers[0])))
+      return false;
+
+   write_program(metadata, sh->Stage, sh->Program);
+   return true;
+}
+
+static bool
+read_shader(struct blob_reader *metadata, struct gl_context *ctx,
+            struct gl_shader_program *prog, struct gl_linked_shader *sh)
+{
+   sh->num_samplers = blob_read_uint32(metadata);
+   sh->active_samplers = blob_read_uint32(metadata);
+   sh->shadow_samplers = blob_read_uint32(metadata);
+   read_bytes(metadata, sh->SamplerUnits, sizeof(sh->SamplerUnits));
+   read_bytes(metadata, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   sh->num_uniform_components = blob_read_uint32(metadata);
+   sh->num_combined_uniform_components = blob_read_uint32(metadata);
+   sh->NumImages = blob_read_uint32(metadata);
+   read_bytes(metadata, sh->ImageUnits, sizeof(sh->ImageUnits));
+   read_bytes(metadata, sh->ImageAccess, sizeof(sh->ImageAccess));
+   read_bytes(metadata, &sh->info, sizeof(sh->info));
+
+   if (!read_block_indices(metadata, sh, &sh->NumUniformBlocks,
+                           (void ***) &sh->UniformBlocks,
+                           prog->UniformBlocks, prog->NumUniformBlocks,
+                           sizeof(prog->UniformBlocks[0])) ||
+       !read_block_indices(metadata, sh, &sh->NumShaderStorageBlocks,
+                           (void ***) &sh->ShaderStorageBlocks,
+                           prog->ShaderStorageBlocks,
+                           prog->NumShaderStorageBlocks,
+                           sizeof(prog->ShaderStorageBlocks[0])) ||
+       !read_block_indices(metadata, sh, &sh->NumAtomicBuffers,
+                           (void ***) &sh->AtomicBuffers,
+                           prog->AtomicBuffers, prog->NumAtomicBuffers,
+                           sizeof(prog->AtomicBuffers[0])))
+      return false;
+
+   if (metadata->overrun)
+      return false;
+
+   sh->Program = read_program(metadata, ctx, sh->Stage);
+   return sh->Program != NULL;
+}
+
+
+static bool
+program_uses_subroutines(struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh && (sh->NumSubroutineUniformTypes ||
+                 sh->NumSubroutineUniformRemapTable ||
+                 sh->NumSubroutineFunctions))
+         return true;
+   }
+
+   return false;
+}
+
+extern "C" bool
+serialize_glsl_program(struct blob *metadata, struct gl_context *ctx,
+                       struct gl_shader_program *prog)
+{
+   if (!prog->LinkStatus || program_uses_subroutines(prog) ||
+       !ctx->Driver.ShaderCacheSerializeDriverBlob)
+      return false;
+
+   blob_write_uint32(metadata, prog->Version);
+   blob_write_uint32(metadata, prog->IsES);
+   blob_write_uint32(metadata, prog->ARB_fragment_coord_conventions_enable);
+   blob_write_uint32(metadata, prog->FragDepthLayout);
+   blob_write_uint32(metadata, prog->LastClipDistanceArraySize);
+   blob_write_uint32(metadata, prog->LastCullDistanceArraySize);
+   blob_write_bytes(metadata, &prog->Vert, sizeof(prog->Vert));
+   blob_write_bytes(metadata, &prog->TessEval, sizeof(prog->TessEval));
+   blob_write_bytes(metadata, &prog->Geom, sizeof(prog->Geom));
+   blob_write_bytes(metadata, &prog->Comp, sizeof(prog->Comp));
+   blob_write_bytes(metadata, prog->TransformFeedback.BufferStride,
+                    sizeof(prog->TransformFeedback.BufferStride));
+   blob_write_string(metadata, prog->InfoLog);
+
+   if (!write_uniforms(metadata, prog))
+      return false;
+
+   write_blocks(metadata, prog->NumUniformBlocks, prog->UniformBlocks);
+   write_blocks(metadata, prog->NumShaderStorageBlocks,
+                prog->ShaderStorageBlocks);
+   write_atomic_buffers(metadata, prog);
+   write_xfb(metadata, prog);
+
+   if (!write_program_resource_list(metadata, prog))
+      return false;
+
+   uint32_t stages = 0;
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i])
+         stages |= 1 << i;
+   }
+   blob_write_uint32(metadata, stages);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] &&
+          !write_shader(metadata, prog, prog->_LinkedShaders[i]))
+         return false;
+   }
+
+   /* The driver blobs follow all of the stages, as the reader can only hand
+    * them to the driver once the uniform storage is associated.
+    */
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh && !ctx->Driver.ShaderCacheSerializeDriverBlob(ctx, sh->Program,
+                                                             metadata))
+         return false;
+   }
+
+   return true;
+}
+
+static void
+delete_linked_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] != NULL)
+         _mesa_delete_linked_shader(ctx, prog->_LinkedShaders[i]);
+
+      prog->_LinkedShaders[i] = NULL;
+   }
+}
+
+static bool
+read_program_metadata(struct blob_reader *metadata, struct gl_context *ctx,
+                      struct gl_shader_program *prog)
+{
+   prog->Version = blob_read_uint32(metadata);
+   prog->IsES = blob_read_uint32(metadata);
+   prog->ARB_fragment_coord_conventions_enable = blob_read_uint32(metadata);
+   prog->FragDepthLayout =
+      (enum gl_frag_depth_layout) blob_read_uint32(metadata);
+   prog->LastClipDistanceArraySize = blob_read_uint32(metadata);
+   prog->LastCullDistanceArraySize = blob_read_uint32(metadata);
+   read_bytes(metadata, &prog->Vert, sizeof(prog->Vert));
+   read_bytes(metadata, &prog->TessEval, sizeof(prog->TessEval));
+   read_bytes(metadata, &prog->Geom, sizeof(prog->Geom));
+   read_bytes(metadata, &prog->Comp, sizeof(prog->Comp));
+   read_bytes(metadata, prog->TransformFeedback.BufferStride,
+              sizeof(prog->TransformFeedback.BufferStride));
+
+   const char *info_log = blob_read_string(metadata);
+   if (info_log == NULL)
+      return false;
+   ralloc_free(prog->InfoLog);
+   prog->InfoLog = ralloc_strdup(prog, info_log);
+
+   if (!read_uniforms(metadata, prog) ||
+       !read_blocks(metadata, prog, &prog->NumUniformBlocks,
+                    &prog->UniformBlocks) ||
+       !read_blocks(metadata, prog, &prog->NumShaderStorageBlocks,
+                    &prog->ShaderStorageBlocks) ||
+       !read_atomic_buffers(metadata, prog) ||
+       !read_xfb(metadata, prog) ||
+       !read_program_resource_list(metadata, prog))
+      return false;
+
+   const uint32_t stages = blob_read_uint32(metadata);
+   if (metadata->overrun || stages == 0 ||
+       stages >= (1 << MESA_SHADER_STAGES))
+      return false;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (!(stages & (1 << i)))
+         continue;
+
+      prog->_LinkedShaders[i] = _mesa_new_linked_shader((gl_shader_stage) i);
+      if (prog->_LinkedShaders[i] == NULL ||
+          !read_shader(metadata, ctx, prog, prog->_LinkedShaders[i]))
+         return false;
+   }
+
+   /* As in the regular link path: reserve some room in the parameter lists
+    * before associating the uniform storage with them, so state references
+    * added later don't reallocate the values.
+    */
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh == NULL)
+         continue;
+
+      _mesa_reserve_parameter_storage(sh->Program->Parameters, 8);
+      _mesa_associate_uniform_storage(ctx, prog, sh->Program->Parameters);
+   }
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh && !ctx->Driver.ShaderCacheDeserializeDriverBlob(ctx,
+                                                               sh->Program,
+                                                               metadata))
+         return false;
+   }
+
+   return !metadata->overrun;
+}
+
+extern "C" bool
+deserialize_glsl_program(struct blob_reader *metadata, struct gl_context *ctx,
+                         struct gl_shader_program *prog)
+{
+   _mesa_clear_shader_program_data(prog);
+   delete_linked_shaders(ctx, prog);
+
+   if (!ctx->Driver.ShaderCacheDeserializeDriverBlob ||
+       !read_program_metadata(metadata, ctx, prog)) {
+      delete_linked_shaders(ctx, prog);
+      _mesa_clear_shader_program_data(prog);
+      prog->LinkStatus = false;
+      return false;
+   }
+
+   prog->LinkStatus = true;
+   prog->Validated = false;
+   prog->_Used = false;
+
+   return true;
+}
+
+
+/**
+ * Hash the state of \p ctx which affects compiling and linking.
+ */
+static void
+update_context_key(struct mesa_sha1 *sha1_ctx, struct gl_context *ctx)
+{
+   const size_t options_start =
+      offsetof(struct gl_constants, ShaderCompilerOptions);
+   const size_t options_end =
+      options_start + sizeof(ctx->Const.ShaderCompilerOptions);
+
+   _mesa_sha1_update(sha1_ctx, ctx->CacheDriverSha1,
+                     sizeof(ctx->CacheDriverSha1));
+   _mesa_sha1_update(sha1_ctx, &ctx->API, sizeof(ctx->API));
+   _mesa_sha1_update(sha1_ctx, &ctx->Version, sizeof(ctx->Version));
+   _mesa_sha1_update(sha1_ctx, &ctx->_Shader->Flags,
+                     sizeof(ctx->_Shader->Flags));
+
+   /* All of gl_constants, but the NIR options pointers. */
+   _mesa_sha1_update(sha1_ctx, &ctx->Const, options_start);
+   _mesa_sha1_update(sha1_ctx, (const char *) &ctx->Const + options_end,
+                     sizeof(ctx->Const) - options_end);
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      _mesa_sha1_update(sha1_ctx, &ctx->Const.ShaderCompilerOptions[i],
+                        offsetof(struct gl_shader_compiler_options,
+                                 NirOptions));
+   }
+
+   /* The extension enables; the string and the rest may change. */
+   _mesa_sha1_update(sha1_ctx, &ctx->Extensions,
+                     offsetof(struct gl_extensions, String));
+}
+
+extern "C" bool
+shader_cache_context_sha1(struct gl_context *ctx, unsigned char sha1[20])
+{
+   struct mesa_sha1 *sha1_ctx = _mesa_sha1_init();
+
+   if (sha1_ctx == NULL)
+      return false;
+
+   update_context_key(sha1_ctx, ctx);
+   _mesa_sha1_final(sha1_ctx, sha1);
+
+   return true;
+}
+
+static bool
+compute_shader_key(struct gl_context *ctx, struct gl_shader *sh,
+                   cache_key key)
+{
+   struct mesa_sha1 *sha1_ctx = _mesa_sha1_init();
+
+   if (sha1_ctx == NULL)
+      return false;
+
+   _mesa_sha1_update(sha1_ctx, "shader", sizeof("shader"));
+   update_context_key(sha1_ctx, ctx);
+   _mesa_sha1_update(sha1_ctx, &sh->Stage, sizeof(sh->Stage));
+   _mesa_sha1_update(sha1_ctx, sh->sha1, sizeof(sh->sha1));
+   _mesa_sha1_final(sha1_ctx, key);
+
+   return true;
+}
+
+struct binding_key {
+   unsigned char sha1[20];
+};
+
+/**
+ * Combine the hashes of all the entries of a string to uint map, in a way
+ * that doesn't depend on the order of iteration.
+ */
+static void
+hash_binding(const char *name, unsigned value, void *closure)
+{
+   struct binding_key *key = (struct binding_key *) closure;
+   struct mesa_sha1 *sha1_ctx = _mesa_sha1_init();
+   unsigned char sha1[20];
+
+   if (sha1_ctx == NULL) {
+      /* Can't happen after the first _mesa_sha1_init() succeeded, but make
+       * sure the key doesn't match anything.
+       */
+      memset(key->sha1, 0xff, sizeof(key->sha1));
+      return;
+   }
+
+   _mesa_sha1_update(sha1_ctx, &value, sizeof(value));
+   _mesa_sha1_update(sha1_ctx, name, strlen(name));
+   _mesa_sha1_final(sha1_ctx, sha1);
+
+   for (unsigned i = 0; i < sizeof(sha1); i++)
+      key->sha1[i] ^= sha1[i];
+}
+
+static void
+update_bindings_key(struct mesa_sha1 *sha1_ctx,
+                    struct string_to_uint_map *bindings)
+{
+   struct binding_key key;
+
+   memset(&key, 0, sizeof(key));
+   bindings->iterate(hash_binding, &key);
+   _mesa_sha1_update(sha1_ctx, key.sha1, sizeof(key.sha1));
+}
+
+static bool
+compute_program_key(struct gl_context *ctx, struct gl_shader_program *prog,
+                    cache_key key)
+{
+   struct mesa_sha1 *sha1_ctx = _mesa_sha1_init();
+
+   if (sha1_ctx == NULL)
+      return false;
+
+   _mesa_sha1_update(sha1_ctx, "program", sizeof("program"));
+   update_context_key(sha1_ctx, ctx);
+
+   _mesa_sha1_update(sha1_ctx, &prog->NumShaders, sizeof(prog->NumShaders));
+   for (unsigned i = 0; i < prog->NumShaders; i++) {
+      struct gl_shader *sh = prog->Shaders[i];
+
+      _mesa_sha1_update(sha1_ctx, &sh->Stage, sizeof(sh->Stage));
+      _mesa_sha1_update(sha1_ctx, sh->sha1, sizeof(sh->sha1));
+   }
+
+   update_bindings_key(sha1_ctx, prog->AttributeBindings);
+   update_bindings_key(sha1_ctx, prog->FragDataBindings);
+   update_bindings_key(sha1_ctx, prog->FragDataIndexBindings);
+
+   _mesa_sha1_update(sha1_ctx, &prog->TransformFeedback.BufferMode,
+                     sizeof(prog->TransformFeedback.BufferMode));
+   _mesa_sha1_update(sha1_ctx, &prog->TransformFeedback.NumVarying,
+                     sizeof(prog->TransformFeedback.NumVarying));
+   for (unsigned i = 0; i < prog->TransformFeedback.NumVarying; i++) {
+      const char *name = prog->TransformFeedback.VaryingNames[i];
+
+      _mesa_sha1_update(sha1_ctx, name, strlen(name) + 1);
+   }
+
+   _mesa_sha1_update(sha1_ctx, &prog->SeparateShader,
+                     sizeof(prog->SeparateShader));
+
+   _mesa_sha1_final(sha1_ctx, key);
+   return true;
+}
+
+/**
+ * Whether the cache may be used for \p prog: the shaders must have been
+ * compiled from source (fixed-function shaders are built from IR), and the
+ * debug output of compiling and linking must not be skipped.
+ */
+static bool
+program_cacheable(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   if (ctx->Cache == NULL || prog->NumShaders == 0 ||
+       (ctx->_Shader->Flags & (GLSL_DUMP | GLSL_LOG)))
+      return false;
+
+   for (unsigned i = 0; i < prog->NumShaders; i++) {
+      if (prog->Shaders[i]->Source == NULL)
+         return false;
+   }
+
+   return true;
+}
+
+
+extern "C" bool
+shader_cache_skip_compile(struct gl_context *ctx, struct gl_shader *sh)
+{
+   cache_key key;
+   char *info_log;
+   size_t size;
+
+   if (ctx->Cache == NULL)
+      return false;
+
+   /* The SHA-1 of what was compiled identifies the shader in the program
+    * keys, so it is needed even when the compile isn't skipped.
+    */
+   _mesa_sha1_compute(sh->Source, strlen(sh->Source), sh->sha1);
+
+   if (ctx->_Shader->Flags & (GLSL_DUMP | GLSL_LOG))
+      return false;
+
+   if (!compute_shader_key(ctx, sh, key))
+      return false;
+
+   info_log = (char *) disk_cache_get(ctx->Cache, key, &size);
+   if (info_log == NULL)
+      return false;
+
+   if (size == 0 || info_log[size - 1] != '\0') {
+      free(info_log);
+      return false;
+   }
+
+   /* Drop the IR of an earlier compile, which is for another source. */
+   ralloc_free(sh->ir);
+   sh->ir = NULL;
+   sh->symbols = NULL;
+
+   free((void *) sh->FallbackSource);
+   sh->FallbackSource = NULL;
+
+   ralloc_free(sh->InfoLog);
+   sh->InfoLog = ralloc_strdup(sh, info_log);
+   free(info_log);
+
+   sh->CompileStatus = compile_skipped;
+   return true;
+}
+
+extern "C" bool
+shader_cache_compile_key(struct gl_context *ctx, struct gl_shader *sh,
+                         unsigned char key[20])
+{
+   if (ctx->Cache == NULL)
+      return false;
+
+   return compute_shader_key(ctx, sh, key);
+}
+
+extern "C" void
+shader_cache_put_compile(struct gl_context *ctx, struct gl_shader *sh,
+                         const unsigned char key[20])
+{
+   const char *info_log = sh->InfoLog ? sh->InfoLog : "";
+
+   if (ctx->Cache == NULL || sh->CompileStatus != compile_success)
+      return;
+
+   /* The record holds the info log, so the warnings are still reported
+    * when the compile is skipped.
+    */
+   disk_cache_put(ctx->Cache, key, info_log, strlen(info_log) + 1);
+}
+
+extern "C" void
+shader_cache_record_compile(struct gl_context *ctx, struct gl_shader *sh)
+{
+   cache_key key;
+
+   if (shader_cache_compile_key(ctx, sh, key))
+      shader_cache_put_compile(ctx, sh, key);
+}
+
+extern "C" bool
+shader_cache_read_program_metadata(struct gl_context *ctx,
+                                   struct gl_shader_program *prog)
+{
+   struct blob_reader metadata;
+   cache_key key;
+   uint8_t *buffer;
+   size_t size;
+   bool ok;
+
+   if (!program_cacheable(ctx, prog) ||
+       !ctx->Driver.ShaderCacheDeserializeDriverBlob)
+      return false;
+
+   if (!compute_program_key(ctx, prog, key))
+      return false;
+
+   buffer = (uint8_t *) disk_cache_get(ctx->Cache, key, &size);
+   if (buffer == NULL)
+      return false;
+
+   blob_reader_init(&metadata, buffer, size);
+
+   ok = blob_read_uint32(&metadata) == SHADER_CACHE_FORMAT;
+   if (ok) {
+      const uint8_t *stored_key = (const uint8_t *)
+         blob_read_bytes(&metadata, sizeof(cache_key));
+
+      ok = stored_key && memcmp(stored_key, key, sizeof(cache_key)) == 0;
+   }
+
+   if (ok)
+      ok = deserialize_glsl_program(&metadata, ctx, prog) &&
+           metadata.current == metadata.end;
+
+   if (!ok) {
+      /* Stale or corrupt: drop it, and relink from scratch. */
+      disk_cache_remove(ctx->Cache, key);
+      delete_linked_shaders(ctx, prog);
+      _mesa_clear_shader_program_data(prog);
+      prog->LinkStatus = true;
+   }
+
+   free(buffer);
+   return ok;
+}
+
+extern "C" void
+shader_cache_write_program_metadata(struct gl_context *ctx,
+                                    struct gl_shader_program *prog)
+{
+   struct blob *metadata;
+   cache_key key;
+
+   if (!program_cacheable(ctx, prog) ||
+       !ctx->Driver.ShaderCacheSerializeDriverBlob)
+      return;
+
+   if (!compute_program_key(ctx, prog, key))
+      return;
+
+   metadata = blob_create(NULL);
+   if (metadata == NULL)
+      return;
+
+   blob_write_uint32(metadata, SHADER_CACHE_FORMAT);
+   blob_write_bytes(metadata, key, sizeof(cache_key));
+
+   if (serialize_glsl_program(metadata, ctx, prog))
+      disk_cache_put(ctx->Cache, key, metadata->data, metadata->size);
+
+   ralloc_free(metadata);
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct blob;
+struct blob_reader;
+struct gl_context;
+struct gl_shader;
+struct gl_shader_program;
+
+/**
+ * Look up the record of an earlier successful compile of \p sh's source.
+ *
+ * On a hit, the shader is marked \c compile_skipped and true is returned;
+ * the compile then only happens if the program it is linked into isn't
+ * found in the cache either.
+ */
+bool
+shader_cache_skip_compile(struct gl_context *ctx, struct gl_shader *sh);
+
+/**
+ * Record a successful compile of \p sh, for shader_cache_skip_compile().
+ */
+void
+shader_cache_record_compile(struct gl_context *ctx, struct gl_shader *sh);
+
+/**
+ * Compute the key under which a compile of \p sh is recorded, from the
+ * current context state.
+ *
+ * \return  false if the compile can't be recorded.
+ */
+bool
+shader_cache_compile_key(struct gl_context *ctx, struct gl_shader *sh,
+                         unsigned char key[20]);
+
+/**
+ * shader_cache_record_compile() with a key computed earlier, for compiles
+ * which ran on another thread.  This must be called from the thread of
+ * the context.
+ */
+void
+shader_cache_put_compile(struct gl_context *ctx, struct gl_shader *sh,
+                         const unsigned char key[20]);
+
+/**
+ * Restore the result of linking \p prog from the cache.
+ *
+ * \return  true if the program was found and is ready to use, in which case
+ *          the link can be skipped.
+ */
+bool
+shader_cache_read_program_metadata(struct gl_context *ctx,
+                                   struct gl_shader_program *prog);
+
+/**
+ * Store the result of successfully linking \p prog in the cache.
+ */
+void
+shader_cache_write_program_metadata(struct gl_context *ctx,
+                                    struct gl_shader_program *prog);
+
+/**
+ * SHA-1 of the driver and of the context state which affects compiling and
+ * linking.  Serialized programs are only valid for the same SHA-1.
+ */
+bool
+shader_cache_context_sha1(struct gl_context *ctx, unsigned char sha1[20]);
+
+/**
+ * Serialize everything linking produced for \p prog, including the
+ * driver's compiled code.
+ *
+ * \return  false if the program can't be serialized.
+ */
+bool
+serialize_glsl_program(struct blob *blob, struct gl_context *ctx,
+                       struct gl_shader_program *prog);
+
+/**
+ * Replace the link results of \p prog by the ones read from \p blob.
+ *
+ * On failure the program is left unlinked, with its link data cleared.
+ */
+bool
+deserialize_glsl_program(struct blob_reader *blob, struct gl_context *ctx,
+                         struct gl_shader_program *prog);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SHADER_CACHE_H */
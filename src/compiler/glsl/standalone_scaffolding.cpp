@@ -34,6 +34,8 @@
 #include <string.h>
 #include "util/ralloc.h"
 #include "util/strtod.h"
+#include "program/hash_table.h"
+#include "main/shader_queue.h"
 
 void
 _mesa_warning(struct gl_context *ctx, const char *fmt, ...)
@@ -67,6 +69,14 @@ _mesa_shader_debug(struct gl_context *, GLenum, GLuint *,
 {
 }
 
+void
+_mesa_shader_queue_run(struct gl_context *, shader_queue_func func,
+                       void *data, unsigned count, size_t size)
+{
+   for (unsigned i = 0; i < count; i++)
+      func((char *) data + i * size);
+}
+
 struct gl_shader *
 _mesa_new_shader(GLuint name, gl_shader_stage stage)
 {
@@ -113,10 +123,17 @@ _mesa_delete_linked_shader(struct gl_context *ctx,
 void
 _mesa_clear_shader_program_data(struct gl_shader_program *shProg)
 {
+   ralloc_free(shProg->UniformStorage);
    shProg->NumUniformStorage = 0;
    shProg->UniformStorage = NULL;
+   shProg->NumUniformDataSlots = 0;
+   shProg->UniformDataSlots = NULL;
+
+   ralloc_free(shProg->UniformRemapTable);
    shProg->NumUniformRemapTable = 0;
    shProg->UniformRemapTable = NULL;
+
+   delete shProg->UniformHash;
    shProg->UniformHash = NULL;
 
    ralloc_free(shProg->InfoLog);
@@ -133,6 +150,10 @@ _mesa_clear_shader_program_data(struct gl_shader_program *shProg)
    ralloc_free(shProg->AtomicBuffers);
    shProg->AtomicBuffers = NULL;
    shProg->NumAtomicBuffers = 0;
+
+   ralloc_free(shProg->ProgramResourceList);
+   shProg->ProgramResourceList = NULL;
+   shProg->NumProgramResourceList = 0;
 }
 
 void initialize_context_to_defaults(struct gl_context *ctx, gl_api api)
@@ -0,0 +1,946 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Tests for shader_cache.cpp: a linked program must survive a round trip
+ * through serialize_glsl_program() and deserialize_glsl_program(), and a
+ * corrupt or stale entry in the disk cache must make
+ * shader_cache_read_program_metadata() fall back to a regular link.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "program.h"
+#include "program/hash_table.h"
+#include "program/ir_to_mesa.h"
+#include "program/prog_parameter.h"
+#include "program/program.h"
+#include "blob.h"
+#include "ir.h"
+#include "ir_uniform.h"
+#include "shader_cache.h"
+#include "standalone_scaffolding.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+
+#define DRIVER_BLOB_MAGIC 0x54534554
+
+static const char *vs_source =
+   "#version 140\n"
+   "in vec4 pos;\n"
+   "uniform mat4 mvp;\n"
+   "uniform Block {\n"
+   "   vec4 tint;\n"
+   "   float scale;\n"
+   "};\n"
+   "uniform float weights[3];\n"
+   "out vec2 uv;\n"
+   "void main()\n"
+   "{\n"
+   "   uv = pos.xy * (weights[0] + weights[1] + weights[2]) + tint.xy;\n"
+   "   gl_Position = mvp * pos * scale;\n"
+   "}\n";
+
+static const char *fs_source =
+   "#version 140\n"
+   "in vec2 uv;\n"
+   "uniform sampler2D tex;\n"
+   "uniform vec4 color = vec4(1.0, 0.5, 0.25, 1.0);\n"
+   "out vec4 frag_color;\n"
+   "void main()\n"
+   "{\n"
+   "   frag_color = texture(tex, uv) * color;\n"
+   "}\n";
+
+bool error = false;
+
+/* Owner of the gl_programs made by new_program(). */
+static void *mem_ctx;
+
+static bool reject_driver_blob;
+static unsigned driver_blobs_read;
+static unsigned storage_associations;
+
+static void
+expect_equal(uint64_t expected, uint64_t actual, const char *test)
+{
+   if (actual != expected) {
+      fprintf (stderr, "Error: Test '%s' failed: Expected=%lu, Actual=%lu\n",
+               test, (unsigned long) expected, (unsigned long) actual);
+      error = true;
+   }
+}
+
+static void
+expect_equal_str(const char *expected, const char *actual, const char *test)
+{
+   if (expected == NULL || actual == NULL) {
+      expect_equal(expected == NULL, actual == NULL, test);
+      return;
+   }
+
+   if (strcmp(expected, actual)) {
+      fprintf (stderr, "Error: Test '%s' failed:\n\t"
+               "Expected=\"%s\", Actual=\"%s\"\n",
+               test, expected, actual);
+      error = true;
+   }
+}
+
+static void
+expect_equal_bytes(const void *expected, const void *actual,
+                   size_t num_bytes, const char *test)
+{
+   if (memcmp(expected, actual, num_bytes)) {
+      fprintf (stderr, "Error: Test '%s' failed: %lu bytes differ\n",
+               test, (unsigned long) num_bytes);
+      error = true;
+   }
+}
+
+
+/* The parts of the core Mesa program code which the shader cache uses,
+ * stripped down like the functions in standalone_scaffolding.cpp.
+ */
+struct gl_program_parameter_list *
+_mesa_new_parameter_list_sized(unsigned size)
+{
+   struct gl_program_parameter_list *list =
+      rzalloc(NULL, struct gl_program_parameter_list);
+
+   list->Size = size;
+   list->Parameters = rzalloc_array(list, struct gl_program_parameter, size);
+   list->ParameterValues = (gl_constant_value (*)[4])
+      rzalloc_array_size(list, 4 * sizeof(gl_constant_value), size);
+   return list;
+}
+
+void
+_mesa_free_parameter_list(struct gl_program_parameter_list *list)
+{
+   if (list == NULL)
+      return;
+
+   for (unsigned i = 0; i < list->NumParameters; i++)
+      free((void *) list->Parameters[i].Name);
+   ralloc_free(list);
+}
+
+void
+_mesa_reserve_parameter_storage(struct gl_program_parameter_list *list,
+                                unsigned reserve_slots)
+{
+   const unsigned size = list->NumParameters + reserve_slots;
+
+   if (size <= list->Size)
+      return;
+
+   list->Parameters = reralloc(list, list->Parameters,
+                               struct gl_program_parameter, size);
+   list->ParameterValues = (gl_constant_value (*)[4])
+      reralloc_array_size(list, list->ParameterValues,
+                          4 * sizeof(gl_constant_value), size);
+   list->Size = size;
+}
+
+void
+_mesa_reference_program_(struct gl_context *ctx, struct gl_program **ptr,
+                         struct gl_program *prog)
+{
+   if (*ptr && --(*ptr)->RefCount == 0) {
+      _mesa_free_parameter_list((*ptr)->Parameters);
+      ralloc_free(*ptr);
+   }
+
+   *ptr = prog;
+   if (prog)
+      prog->RefCount++;
+}
+
+void
+_mesa_associate_uniform_storage(struct gl_context *ctx,
+                                struct gl_shader_program *shader_program,
+                                struct gl_program_parameter_list *params)
+{
+   /* The parameter lists must have room for the state references. */
+   expect_equal(true, params->Size >= params->NumParameters + 8,
+                "parameter storage reserved before association");
+   storage_associations++;
+}
+
+
+static struct gl_program *
+new_program(struct gl_context *ctx, GLenum target, GLuint id)
+{
+   struct gl_program *prog;
+
+   switch (target) {
+   case GL_VERTEX_PROGRAM_ARB:
+      prog = &rzalloc(mem_ctx, struct gl_vertex_program)->Base;
+      break;
+   case GL_FRAGMENT_PROGRAM_ARB:
+      prog = &rzalloc(mem_ctx, struct gl_fragment_program)->Base;
+      break;
+   default:
+      return NULL;
+   }
+
+   prog->Id = id;
+   prog->Target = target;
+   prog->RefCount = 1;
+   return prog;
+}
+
+static bool
+serialize_driver_blob(struct gl_context *ctx, struct gl_program *prog,
+                      struct blob *blob)
+{
+   blob_write_uint32(blob, DRIVER_BLOB_MAGIC);
+   blob_write_uint32(blob, prog->Target);
+   return true;
+}
+
+static bool
+deserialize_driver_blob(struct gl_context *ctx, struct gl_program *prog,
+                        struct blob_reader *blob)
+{
+   const uint32_t magic = blob_read_uint32(blob);
+   const uint32_t target = blob_read_uint32(blob);
+
+   if (reject_driver_blob || blob->overrun ||
+       magic != DRIVER_BLOB_MAGIC || target != prog->Target)
+      return false;
+
+   driver_blobs_read++;
+   return true;
+}
+
+static void
+initialize_context(struct gl_context *ctx,
+                   struct gl_pipeline_object *pipeline)
+{
+   initialize_context_to_defaults(ctx, API_OPENGL_COMPAT);
+
+   ctx->Const.GLSLVersion = 140;
+   ctx->Const.MaxClipPlanes = 8;
+   ctx->Const.MaxCombinedTextureImageUnits = 16;
+   ctx->Const.MaxDrawBuffers = 8;
+   ctx->Const.Program[MESA_SHADER_VERTEX].MaxTextureImageUnits = 16;
+   ctx->Const.Program[MESA_SHADER_VERTEX].MaxUniformComponents = 1024;
+   ctx->Const.Program[MESA_SHADER_VERTEX].MaxCombinedUniformComponents = 1024;
+   ctx->Const.Program[MESA_SHADER_VERTEX].MaxOutputComponents = 64;
+   ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxTextureImageUnits = 16;
+   ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxUniformComponents = 1024;
+   ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxCombinedUniformComponents = 1024;
+   ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxInputComponents = 64;
+   ctx->Const.MaxVarying = 16;
+
+   ctx->Const.MaxVertexStreams = 1;
+   ctx->Const.MaxTransformFeedbackBuffers = 4;
+   ctx->Const.MaxUniformBlockSize = 16384;
+   ctx->Const.MaxUniformBufferBindings = 36;
+   ctx->Const.MaxCombinedUniformBlocks = 36;
+   ctx->Const.UniformBufferOffsetAlignment = 16;
+   ctx->Const.Program[MESA_SHADER_VERTEX].MaxUniformBlocks = 12;
+   ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxUniformBlocks = 12;
+
+   ctx->Const.GenerateTemporaryNames = true;
+   ctx->Const.MaxUserAssignableUniformLocations =
+      4 * MESA_SHADER_STAGES * MAX_UNIFORMS;
+
+   ctx->Driver.NewShader = _mesa_new_linked_shader;
+   ctx->Driver.NewProgram = new_program;
+   ctx->Driver.ShaderCacheSerializeDriverBlob = serialize_driver_blob;
+   ctx->Driver.ShaderCacheDeserializeDriverBlob = deserialize_driver_blob;
+
+   memset(pipeline, 0, sizeof(*pipeline));
+   ctx->_Shader = pipeline;
+}
+
+static struct gl_shader *
+compile_shader(struct gl_context *ctx, void *mem_ctx, GLenum type,
+               const char *source)
+{
+   struct gl_shader *sh = rzalloc(mem_ctx, struct gl_shader);
+
+   sh->Type = type;
+   sh->Stage = _mesa_shader_enum_to_shader_stage(type);
+   sh->Source = source;
+   _mesa_sha1_compute(source, strlen(source), sh->sha1);
+
+   _mesa_glsl_compile_shader(ctx, sh, false, false, false);
+   expect_equal(true, sh->CompileStatus, "compile");
+   if (!sh->CompileStatus)
+      fprintf(stderr, "%s", sh->InfoLog);
+
+   return sh;
+}
+
+/**
+ * A program which hasn't been linked yet, made of \p shaders.
+ */
+static struct gl_shader_program *
+create_program(struct gl_shader **shaders, unsigned num_shaders)
+{
+   struct gl_shader_program *prog = rzalloc(NULL, struct gl_shader_program);
+
+   prog->Type = GL_SHADER_PROGRAM_MESA;
+   prog->RefCount = 1;
+   prog->InfoLog = ralloc_strdup(prog, "");
+   prog->AttributeBindings = new string_to_uint_map;
+   prog->FragDataBindings = new string_to_uint_map;
+   prog->FragDataIndexBindings = new string_to_uint_map;
+
+   prog->Shaders = ralloc_array(prog, struct gl_shader *, num_shaders);
+   memcpy(prog->Shaders, shaders, num_shaders * sizeof(shaders[0]));
+   prog->NumShaders = num_shaders;
+
+   return prog;
+}
+
+/**
+ * Link \p prog, and give its stages the gl_programs and parameters which
+ * the driver would have made of them.
+ */
+static void
+link_program(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   link_shaders(ctx, prog);
+   expect_equal(true, prog->LinkStatus, "link");
+   if (!prog->LinkStatus) {
+      fprintf(stderr, "%s", prog->InfoLog);
+      return;
+   }
+
+   build_program_resource_list(ctx, prog);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh == NULL)
+         continue;
+
+      sh->Program =
+         ctx->Driver.NewProgram(ctx, _mesa_shader_stage_to_program(i), 0);
+      sh->Program->InputsRead = 0x5 << i;
+      sh->Program->OutputsWritten = 0x3 << i;
+      sh->Program->SamplersUsed = sh->active_samplers;
+      for (unsigned j = 0; j < MAX_SAMPLERS; j++)
+         sh->Program->SamplerUnits[j] = sh->SamplerUnits[j];
+
+      struct gl_program_parameter_list *params =
+         _mesa_new_parameter_list_sized(1);
+      params->NumParameters = 1;
+      params->StateFlags = 0x10 << i;
+      params->Parameters[0].Name = strdup("color");
+      params->Parameters[0].Type = PROGRAM_UNIFORM;
+      params->Parameters[0].DataType = GL_FLOAT_VEC4;
+      params->Parameters[0].Size = 4;
+      for (unsigned j = 0; j < 4; j++)
+         params->ParameterValues[0][j].f = i + j * 0.5f;
+      sh->Program->Parameters = params;
+   }
+}
+
+static void
+destroy_program(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+
+      if (sh == NULL)
+         continue;
+
+      _mesa_reference_program(ctx, &sh->Program, NULL);
+      _mesa_delete_linked_shader(ctx, sh);
+      prog->_LinkedShaders[i] = NULL;
+   }
+
+   _mesa_clear_shader_program_data(prog);
+
+   delete prog->AttributeBindings;
+   delete prog->FragDataBindings;
+   delete prog->FragDataIndexBindings;
+
+   ralloc_free(prog);
+}
+
+static bool
+program_is_cleared(const struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] != NULL)
+         return false;
+   }
+
+   return prog->NumUniformStorage == 0 && prog->UniformStorage == NULL &&
+          prog->NumUniformDataSlots == 0 && prog->UniformDataSlots == NULL &&
+          prog->NumUniformRemapTable == 0 && prog->UniformHash == NULL &&
+          prog->NumUniformBlocks == 0 && prog->NumShaderStorageBlocks == 0 &&
+          prog->NumAtomicBuffers == 0 && prog->NumProgramResourceList == 0;
+}
+
+
+static unsigned
+uniform_index(const struct gl_shader_program *prog,
+              const struct gl_uniform_storage *uni)
+{
+   if (uni == NULL)
+      return ~0u;
+   if (uni == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+      return ~0u - 1;
+   return uni - prog->UniformStorage;
+}
+
+static unsigned
+resource_index(const struct gl_shader_program *prog,
+               const struct gl_program_resource *res)
+{
+   switch (res->Type) {
+   case GL_UNIFORM:
+   case GL_BUFFER_VARIABLE:
+      return (const struct gl_uniform_storage *) res->Data -
+             prog->UniformStorage;
+   case GL_UNIFORM_BLOCK:
+      return (const struct gl_uniform_block *) res->Data - prog->UniformBlocks;
+   case GL_SHADER_STORAGE_BLOCK:
+      return (const struct gl_uniform_block *) res->Data -
+             prog->ShaderStorageBlocks;
+   default:
+      return ~0u;
+   }
+}
+
+static void
+compare_uniforms(const struct gl_shader_program *a,
+                 const struct gl_shader_program *b)
+{
+   expect_equal(a->NumUniformStorage, b->NumUniformStorage, "uniform count");
+   expect_equal(a->NumHiddenUniforms, b->NumHiddenUniforms,
+                "hidden uniform count");
+   expect_equal(a->NumUniformDataSlots, b->NumUniformDataSlots,
+                "uniform data slot count");
+   if (a->NumUniformStorage != b->NumUniformStorage ||
+       a->NumUniformDataSlots != b->NumUniformDataSlots)
+      return;
+
+   for (unsigned i = 0; i < a->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *ua = &a->UniformStorage[i];
+      const struct gl_uniform_storage *ub = &b->UniformStorage[i];
+
+      expect_equal_str(ua->name, ub->name, "uniform name");
+      expect_equal((uintptr_t) ua->type, (uintptr_t) ub->type,
+                   "uniform type");
+      expect_equal(ua->array_elements, ub->array_elements,
+                   "uniform array elements");
+      expect_equal(ua->block_index, ub->block_index, "uniform block index");
+      expect_equal(ua->offset, ub->offset, "uniform offset");
+      expect_equal(ua->remap_location, ub->remap_location,
+                   "uniform remap location");
+      expect_equal(ua->hidden, ub->hidden, "uniform hidden");
+      expect_equal(ua->builtin, ub->builtin, "uniform builtin");
+      expect_equal_bytes(ua->opaque, ub->opaque, sizeof(ua->opaque),
+                         "uniform opaque indices");
+      expect_equal(ua->storage ? ua->storage - a->UniformDataSlots : -1,
+                   ub->storage ? ub->storage - b->UniformDataSlots : -1,
+                   "uniform storage slot");
+
+      unsigned ia = ~0u, ib = ~0u;
+      a->UniformHash->get(ia, ua->name);
+      b->UniformHash->get(ib, ua->name);
+      expect_equal(ia, ib, "uniform hash");
+   }
+
+   expect_equal_bytes(a->UniformDataSlots, b->UniformDataSlots,
+                      a->NumUniformDataSlots * sizeof(a->UniformDataSlots[0]),
+                      "uniform data");
+
+   expect_equal(a->NumUniformRemapTable, b->NumUniformRemapTable,
+                "uniform remap table size");
+   if (a->NumUniformRemapTable != b->NumUniformRemapTable)
+      return;
+
+   for (unsigned i = 0; i < a->NumUniformRemapTable; i++) {
+      expect_equal(uniform_index(a, a->UniformRemapTable[i]),
+                   uniform_index(b, b->UniformRemapTable[i]),
+                   "uniform remap table");
+   }
+}
+
+static void
+compare_blocks(const struct gl_uniform_block *a,
+               const struct gl_uniform_block *b, unsigned count)
+{
+   for (unsigned i = 0; i < count; i++) {
+      expect_equal_str(a[i].Name, b[i].Name, "block name");
+      expect_equal(a[i].Binding, b[i].Binding, "block binding");
+      expect_equal(a[i].UniformBufferSize, b[i].UniformBufferSize,
+                   "block size");
+      expect_equal(a[i].stageref, b[i].stageref, "block stage references");
+      expect_equal(a[i]._Packing, b[i]._Packing, "block packing");
+      expect_equal(a[i].NumUniforms, b[i].NumUniforms,
+                   "block uniform count");
+      if (a[i].NumUniforms != b[i].NumUniforms)
+         continue;
+
+      for (unsigned j = 0; j < a[i].NumUniforms; j++) {
+         const struct gl_uniform_buffer_variable *va = &a[i].Uniforms[j];
+         const struct gl_uniform_buffer_variable *vb = &b[i].Uniforms[j];
+
+         expect_equal_str(va->Name, vb->Name, "block uniform name");
+         expect_equal_str(va->IndexName, vb->IndexName,
+                          "block uniform index name");
+         expect_equal((uintptr_t) va->Type, (uintptr_t) vb->Type,
+                      "block uniform type");
+         expect_equal(va->Offset, vb->Offset, "block uniform offset");
+         expect_equal(va->RowMajor, vb->RowMajor, "block uniform row major");
+      }
+   }
+}
+
+static void
+compare_resources(const struct gl_shader_program *a,
+                  const struct gl_shader_program *b)
+{
+   expect_equal(a->NumProgramResourceList, b->NumProgramResourceList,
+                "resource count");
+   if (a->NumProgramResourceList != b->NumProgramResourceList)
+      return;
+
+   for (unsigned i = 0; i < a->NumProgramResourceList; i++) {
+      const struct gl_program_resource *ra = &a->ProgramResourceList[i];
+      const struct gl_program_resource *rb = &b->ProgramResourceList[i];
+
+      expect_equal(ra->Type, rb->Type, "resource type");
+      expect_equal(ra->StageReferences, rb->StageReferences,
+                   "resource stage references");
+      if (ra->Type != rb->Type)
+         continue;
+
+      if (ra->Type == GL_PROGRAM_INPUT || ra->Type == GL_PROGRAM_OUTPUT) {
+         const struct gl_shader_variable *va =
+            (const struct gl_shader_variable *) ra->Data;
+         const struct gl_shader_variable *vb =
+            (const struct gl_shader_variable *) rb->Data;
+
+         expect_equal_str(va->name, vb->name, "variable name");
+         expect_equal((uintptr_t) va->type, (uintptr_t) vb->type,
+                      "variable type");
+         expect_equal(va->location, vb->location, "variable location");
+         expect_equal(va->mode, vb->mode, "variable mode");
+      } else {
+         expect_equal(resource_index(a, ra), resource_index(b, rb),
+                      "resource index");
+      }
+   }
+}
+
+static void
+compare_gl_programs(const struct gl_program *a, const struct gl_program *b)
+{
+   expect_equal(a->Target, b->Target, "program target");
+   expect_equal(a->InputsRead, b->InputsRead, "program inputs");
+   expect_equal(a->OutputsWritten, b->OutputsWritten, "program outputs");
+   expect_equal(a->SamplersUsed, b->SamplersUsed, "program samplers");
+   expect_equal_bytes(a->SamplerUnits, b->SamplerUnits,
+                      sizeof(a->SamplerUnits), "program sampler units");
+
+   const struct gl_program_parameter_list *pa = a->Parameters;
+   const struct gl_program_parameter_list *pb = b->Parameters;
+
+   expect_equal(pa->NumParameters, pb->NumParameters, "parameter count");
+   expect_equal(pa->StateFlags, pb->StateFlags, "parameter state flags");
+   if (pa->NumParameters != pb->NumParameters)
+      return;
+
+   for (unsigned i = 0; i < pa->NumParameters; i++) {
+      expect_equal_str(pa->Parameters[i].Name, pb->Parameters[i].Name,
+                       "parameter name");
+      expect_equal(pa->Parameters[i].Type, pb->Parameters[i].Type,
+                   "parameter file");
+      expect_equal(pa->Parameters[i].DataType, pb->Parameters[i].DataType,
+                   "parameter type");
+      expect_equal(pa->Parameters[i].Size, pb->Parameters[i].Size,
+                   "parameter size");
+      expect_equal_bytes(pa->ParameterValues[i], pb->ParameterValues[i],
+                         sizeof(pa->ParameterValues[i]), "parameter value");
+   }
+}
+
+static void
+compare_programs(const struct gl_shader_program *a,
+                 const struct gl_shader_program *b)
+{
+   expect_equal(a->LinkStatus, b->LinkStatus, "link status");
+   expect_equal(a->Version, b->Version, "version");
+   expect_equal(a->IsES, b->IsES, "ES");
+   expect_equal_str(a->InfoLog, b->InfoLog, "info log");
+
+   compare_uniforms(a, b);
+
+   expect_equal(a->NumUniformBlocks, b->NumUniformBlocks,
+                "uniform block count");
+   if (a->NumUniformBlocks == b->NumUniformBlocks)
+      compare_blocks(a->UniformBlocks, b->UniformBlocks, a->NumUniformBlocks);
+
+   compare_resources(a, b);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      const struct gl_linked_shader *sa = a->_LinkedShaders[i];
+      const struct gl_linked_shader *sb = b->_LinkedShaders[i];
+
+      expect_equal(sa != NULL, sb != NULL, "linked stages");
+      if (sa == NULL || sb == NULL)
+         continue;
+
+      expect_equal(sa->num_samplers, sb->num_samplers, "stage samplers");
+      expect_equal(sa->active_samplers, sb->active_samplers,
+                   "stage active samplers");
+      expect_equal_bytes(sa->SamplerUnits, sb->SamplerUnits,
+                         sizeof(sa->SamplerUnits), "stage sampler units");
+      expect_equal(sa->num_uniform_components, sb->num_uniform_components,
+                   "stage uniform components");
+
+      expect_equal(sa->NumUniformBlocks, sb->NumUniformBlocks,
+                   "stage uniform block count");
+      if (sa->NumUniformBlocks == sb->NumUniformBlocks) {
+         for (unsigned j = 0; j < sa->NumUniformBlocks; j++) {
+            expect_equal(sa->UniformBlocks[j] - a->UniformBlocks,
+                         sb->UniformBlocks[j] - b->UniformBlocks,
+                         "stage uniform block");
+         }
+      }
+
+      compare_gl_programs(sa->Program, sb->Program);
+   }
+}
+
+
+/* Serialize the program and deserialize it into a new one, which must be
+ * the same program.
+ */
+static void
+test_round_trip(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   struct gl_shader_program *copy = create_program(prog->Shaders,
+                                                   prog->NumShaders);
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   expect_equal(true, serialize_glsl_program(blob, ctx, prog), "serialize");
+
+   driver_blobs_read = 0;
+   storage_associations = 0;
+   blob_reader_init(&reader, blob->data, blob->size);
+
+   expect_equal(true, deserialize_glsl_program(&reader, ctx, copy),
+                "deserialize");
+   expect_equal(blob->size, reader.current - reader.data,
+                "bytes read by deserialize");
+   expect_equal(2, driver_blobs_read, "driver blobs read");
+   expect_equal(2, storage_associations, "uniform storage associations");
+
+   compare_programs(prog, copy);
+
+   destroy_program(ctx, copy);
+   ralloc_free(blob);
+}
+
+/* Deserializing every truncation of a valid blob must fail, and leave the
+ * program unlinked with none of the partially read data.
+ */
+static void
+test_truncated_blob(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   struct blob *blob = blob_create(NULL);
+
+   serialize_glsl_program(blob, ctx, prog);
+
+   for (size_t size = 0; size < blob->size; size++) {
+      struct gl_shader_program *copy = create_program(prog->Shaders,
+                                                      prog->NumShaders);
+      struct blob_reader reader;
+      bool ok;
+
+      blob_reader_init(&reader, blob->data, size);
+      ok = !deserialize_glsl_program(&reader, ctx, copy) &&
+           !copy->LinkStatus && program_is_cleared(copy);
+
+      destroy_program(ctx, copy);
+
+      if (!ok) {
+         fprintf(stderr, "Error: Test 'truncated blob' failed: "
+                 "a blob truncated to %lu of %lu bytes was accepted, "
+                 "or left data behind\n",
+                 (unsigned long) size, (unsigned long) blob->size);
+         error = true;
+         break;
+      }
+   }
+
+   ralloc_free(blob);
+}
+
+
+#ifdef ENABLE_SHADER_CACHE
+
+static void
+remove_directory(const char *path)
+{
+   DIR *dir = opendir(path);
+   struct dirent *entry;
+
+   if (dir == NULL)
+      return;
+
+   while ((entry = readdir(dir)) != NULL) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         continue;
+
+      char *entry_path = ralloc_asprintf(NULL, "%s/%s", path, entry->d_name);
+      if (unlink(entry_path) != 0)
+         remove_directory(entry_path);
+      ralloc_free(entry_path);
+   }
+
+   closedir(dir);
+   rmdir(path);
+}
+
+static unsigned
+hex_digit(char c)
+{
+   return c <= '9' ? c - '0' : c - 'a' + 10;
+}
+
+/**
+ * Find the key of the only item in the cache at \p path, from the name of
+ * the file holding it: the first two hex digits of the key name the
+ * directory, and the rest the file.
+ */
+static bool
+find_cache_key(const char *path, cache_key key)
+{
+   DIR *dir = opendir(path);
+   struct dirent *entry;
+   unsigned found = 0;
+
+   if (dir == NULL)
+      return false;
+
+   while ((entry = readdir(dir)) != NULL) {
+      if (strlen(entry->d_name) != 2 || entry->d_name[0] == '.')
+         continue;
+
+      char *subdir_path = ralloc_asprintf(NULL, "%s/%s", path, entry->d_name);
+      DIR *subdir = opendir(subdir_path);
+      struct dirent *file;
+
+      while (subdir && (file = readdir(subdir)) != NULL) {
+         char name[2 * sizeof(cache_key) + 1];
+
+         if (strlen(file->d_name) != 2 * sizeof(cache_key) - 2)
+            continue;
+
+         snprintf(name, sizeof(name), "%s%s", entry->d_name, file->d_name);
+         for (unsigned i = 0; i < sizeof(cache_key); i++)
+            key[i] = hex_digit(name[2 * i]) << 4 | hex_digit(name[2 * i + 1]);
+         found++;
+      }
+
+      if (subdir)
+         closedir(subdir);
+      ralloc_free(subdir_path);
+   }
+
+   closedir(dir);
+   return found == 1;
+}
+
+/* Store \p data in place of the program's cache entry, and check that
+ * reading it makes the program fall back to a regular link, and drops the
+ * entry.
+ */
+static void
+expect_fallback(struct gl_context *ctx, struct gl_shader_program *prog,
+                const cache_key key, const void *data, size_t size,
+                const char *test)
+{
+   struct gl_shader_program *copy = create_program(prog->Shaders,
+                                                   prog->NumShaders);
+   size_t cached_size;
+   void *cached;
+
+   /* An existing entry is never replaced. */
+   disk_cache_remove(ctx->Cache, key);
+   disk_cache_put(ctx->Cache, key, data, size);
+
+   expect_equal(false, shader_cache_read_program_metadata(ctx, copy), test);
+   expect_equal(true, copy->LinkStatus, test);
+   expect_equal(true, program_is_cleared(copy), test);
+
+   cached = disk_cache_get(ctx->Cache, key, &cached_size);
+   expect_equal(true, cached == NULL, test);
+   free(cached);
+
+   destroy_program(ctx, copy);
+}
+
+/* Store the program in the disk cache, read it back, and check the
+ * fallback paths of shader_cache_read_program_metadata() on corrupt and
+ * stale entries.
+ */
+static void
+test_disk_cache(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   char cache_dir[] = "/tmp/shader-cache-test-XXXXXX";
+   struct gl_shader_program *copy;
+   cache_key key;
+   uint8_t *data;
+   size_t size;
+
+   if (mkdtemp(cache_dir) == NULL)
+      return;
+
+   setenv("MESA_SHADER_CACHE_DIR", cache_dir, 1);
+   unsetenv("MESA_SHADER_CACHE_DISABLE");
+   ctx->Cache = disk_cache_create("glsl");
+   if (ctx->Cache == NULL) {
+      remove_directory(cache_dir);
+      return;
+   }
+
+   shader_cache_write_program_metadata(ctx, prog);
+
+   char *path = ralloc_asprintf(NULL, "%s/glsl", cache_dir);
+   expect_equal(true, find_cache_key(path, key), "program stored");
+   ralloc_free(path);
+
+   data = (uint8_t *) disk_cache_get(ctx->Cache, key, &size);
+   expect_equal(true, data != NULL, "program entry read");
+   if (data == NULL)
+      goto done;
+
+   /* A program of the same shaders is found, and is the same program. */
+   copy = create_program(prog->Shaders, prog->NumShaders);
+   copy->LinkStatus = true;
+   expect_equal(true, shader_cache_read_program_metadata(ctx, copy),
+                "cache hit");
+   compare_programs(prog, copy);
+   destroy_program(ctx, copy);
+
+   /* Attribute bindings change the program, so they are part of the key. */
+   copy = create_program(prog->Shaders, prog->NumShaders);
+   copy->AttributeBindings->put(3, "pos");
+   expect_equal(false, shader_cache_read_program_metadata(ctx, copy),
+                "cache miss on other bindings");
+   destroy_program(ctx, copy);
+
+   {
+      const size_t header_size = sizeof(uint32_t) + sizeof(cache_key);
+      const size_t sizes[] = {
+         0, sizeof(uint32_t), header_size, header_size + 1,
+         size / 2, size - 1,
+      };
+      uint8_t *corrupt = (uint8_t *) malloc(size + 1);
+
+      for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++) {
+         expect_fallback(ctx, prog, key, data, sizes[i],
+                         "fallback on a truncated entry");
+      }
+
+      memcpy(corrupt, data, size);
+      corrupt[0] ^= 0xff;
+      expect_fallback(ctx, prog, key, corrupt, size,
+                      "fallback on another format");
+
+      memcpy(corrupt, data, size);
+      corrupt[sizeof(uint32_t)] ^= 0xff;
+      expect_fallback(ctx, prog, key, corrupt, size,
+                      "fallback on another stored key");
+
+      memcpy(corrupt, data, size);
+      corrupt[size] = 0;
+      expect_fallback(ctx, prog, key, corrupt, size + 1,
+                      "fallback on trailing data");
+
+      reject_driver_blob = true;
+      expect_fallback(ctx, prog, key, data, size,
+                      "fallback on a rejected driver blob");
+      reject_driver_blob = false;
+
+      free(corrupt);
+   }
+
+   free(data);
+
+done:
+   disk_cache_destroy(ctx->Cache);
+   ctx->Cache = NULL;
+   remove_directory(cache_dir);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+
+int
+main (void)
+{
+   struct gl_context local_ctx;
+   struct gl_context *ctx = &local_ctx;
+   struct gl_pipeline_object pipeline;
+
+   mem_ctx = ralloc_context(NULL);
+   initialize_context(ctx, &pipeline);
+
+   struct gl_shader *shaders[] = {
+      compile_shader(ctx, mem_ctx, GL_VERTEX_SHADER, vs_source),
+      compile_shader(ctx, mem_ctx, GL_FRAGMENT_SHADER, fs_source),
+   };
+   struct gl_shader_program *prog =
+      create_program(shaders, ARRAY_SIZE(shaders));
+
+   link_program(ctx, prog);
+
+   if (!error) {
+      test_round_trip(ctx, prog);
+      test_truncated_blob(ctx, prog);
+#ifdef ENABLE_SHADER_CACHE
+      test_disk_cache(ctx, prog);
+#endif
+   }
+
+   destroy_program(ctx, prog);
+   ralloc_free(mem_ctx);
+
+   _mesa_glsl_release_types();
+   _mesa_glsl_release_builtin_functions();
+
+   return error ? 1 : 0;
+}
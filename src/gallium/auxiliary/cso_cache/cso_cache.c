@@ -44,36 +44,35 @@ struct cso_cache {
    void                 *sanitize_data;
 };
 
-#if 1
+/**
+ * Hash the key a 64-bit word at a time.  The words are combined with a
+ * rotate and xor, which is as cheap as the plain xor of the dwords used
+ * before, but doesn't make states with swapped or repeated fields collide.
+ * A single multiply at the end then spreads the bits over the whole result,
+ * so that the hash table can use the top bits as the bucket index.
+ */
 static unsigned hash_key(const void *key, unsigned key_size)
 {
-   unsigned *ikey = (unsigned *)key;
-   unsigned hash = 0, i;
+   const uint8_t *p = (const uint8_t *)key;
+   uint64_t hash = key_size;
+   uint64_t k;
+   unsigned i;
 
    assert(key_size % 4 == 0);
 
-   /* I'm sure this can be improved on:
-    */
-   for (i = 0; i < key_size/4; i++)
-      hash ^= ikey[i];
-
-   return hash;
-}
-#else
-static unsigned hash_key(const unsigned char *p, int n)
-{
-   unsigned h = 0;
-   unsigned g;
-
-   while (n--) {
-      h = (h << 4) + *p++;
-      if ((g = (h & 0xf0000000)) != 0)
-         h ^= g >> 23;
-      h &= ~g;
+   for (i = 0; i + 8 <= key_size; i += 8) {
+      memcpy(&k, p + i, 8);
+      hash = ((hash << 7) | (hash >> 57)) ^ k;
    }
-   return h;
+   if (i < key_size) {
+      uint32_t k32;
+      memcpy(&k32, p + i, 4);
+      hash = ((hash << 7) | (hash >> 57)) ^ k32;
+   }
+
+   hash *= 0x9e3779b97f4a7c15ull;
+   return (unsigned)(hash >> 32);
 }
-#endif
 
 unsigned cso_construct_key(void *item, int item_size)
 {
@@ -216,7 +215,7 @@ void *cso_hash_find_data_from_template( struct cso_hash *hash,
 	  */
          return iter_data;
       }
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    return NULL;
 }
@@ -231,7 +230,7 @@ struct cso_hash_iter cso_find_state_template(struct cso_cache *sc,
       void *iter_data = cso_hash_iter_data(iter);
       if (!memcmp(iter_data, templ, size))
          return iter;
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    return iter;
 }
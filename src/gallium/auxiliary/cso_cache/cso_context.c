@@ -35,7 +35,11 @@
   * @author Keith Whitwell <keithw@vmware.com>
   */
 
+#include <inttypes.h>
+
 #include "pipe/p_state.h"
+#include "util/bitscan.h"
+#include "util/u_debug.h"
 #include "util/u_draw.h"
 #include "util/u_framebuffer.h"
 #include "util/u_inlines.h"
@@ -57,9 +61,60 @@ struct sampler_info
 {
    void *samplers[PIPE_MAX_SAMPLERS];
    unsigned nr_samplers;
+   unsigned nr_samplers_emitted;  /**< number the driver last got */
+   boolean changed;               /**< samplers[] changed since _done() */
 };
 
 
+/**
+ * The state setters which can tell that a call doesn't change anything,
+ * and so don't pass it on to the driver.  cso_context counts the calls
+ * it filtered out for each of these, see GALLIUM_CSO_STATS.
+ */
+enum cso_stat {
+   CSO_STAT_BLEND,
+   CSO_STAT_DEPTH_STENCIL_ALPHA,
+   CSO_STAT_RASTERIZER,
+   CSO_STAT_SHADER,
+   CSO_STAT_VERTEX_ELEMENTS,
+   CSO_STAT_SAMPLERS,
+   CSO_STAT_SAMPLER_VIEWS,
+   CSO_STAT_CONSTANT_BUFFER,
+   CSO_STAT_VERTEX_BUFFERS,
+   CSO_STAT_INDEX_BUFFER,
+   CSO_STAT_FRAMEBUFFER,
+   CSO_STAT_VIEWPORT,
+   CSO_STAT_BLEND_COLOR,
+   CSO_STAT_SAMPLE_MASK,
+   CSO_STAT_MIN_SAMPLES,
+   CSO_STAT_STENCIL_REF,
+   CSO_STAT_RENDER_CONDITION,
+   CSO_STAT_COUNT
+};
+
+static const char *cso_stat_names[CSO_STAT_COUNT] = {
+   "blend",
+   "depth_stencil_alpha",
+   "rasterizer",
+   "shader",
+   "vertex_elements",
+   "samplers",
+   "sampler_views",
+   "constant_buffer",
+   "vertex_buffers",
+   "index_buffer",
+   "framebuffer",
+   "viewport",
+   "blend_color",
+   "sample_mask",
+   "min_samples",
+   "stencil_ref",
+   "render_condition",
+};
+
+DEBUG_GET_ONCE_BOOL_OPTION(cso_stats, "GALLIUM_CSO_STATS", FALSE)
+
+
 
 struct cso_context {
    struct pipe_context *pipe;
@@ -73,8 +128,10 @@ struct cso_context {
 
    unsigned saved_state;  /**< bitmask of CSO_BIT_x flags */
 
-   struct pipe_sampler_view *fragment_views[PIPE_MAX_SHADER_SAMPLER_VIEWS];
-   unsigned nr_fragment_views;
+   /** Sampler views of each stage, the driver gets them at draw time */
+   struct pipe_sampler_view *views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   unsigned nr_views[PIPE_SHADER_TYPES];
+   unsigned nr_views_emitted[PIPE_SHADER_TYPES];
 
    struct pipe_sampler_view *fragment_views_saved[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    unsigned nr_fragment_views_saved;
@@ -84,11 +141,15 @@ struct cso_context {
 
    struct sampler_info samplers[PIPE_SHADER_TYPES];
 
-   struct pipe_vertex_buffer aux_vertex_buffer_current;
+   /** Vertex buffers, when there is no u_vbuf */
+   struct pipe_vertex_buffer vertex_buffers[PIPE_MAX_ATTRIBS];
    struct pipe_vertex_buffer aux_vertex_buffer_saved;
    unsigned aux_vertex_buffer_index;
 
-   struct pipe_constant_buffer aux_constbuf_current[PIPE_SHADER_TYPES];
+   /** Index buffer, when there is no u_vbuf */
+   struct pipe_index_buffer index_buffer;
+
+   struct pipe_constant_buffer constbufs[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
    struct pipe_constant_buffer aux_constbuf_saved[PIPE_SHADER_TYPES];
 
    struct pipe_image_view fragment_image0_current;
@@ -123,6 +184,18 @@ struct cso_context {
    unsigned sample_mask, sample_mask_saved;
    unsigned min_samples, min_samples_saved;
    struct pipe_stencil_ref stencil_ref, stencil_ref_saved;
+
+   /** State which changed since the last cso_emit_state() */
+   boolean dirty;
+   unsigned dirty_views;     /**< bitmask of shader stages */
+   unsigned dirty_samplers;  /**< bitmask of shader stages */
+   unsigned dirty_constbufs[PIPE_SHADER_TYPES];  /**< bitmask of slots */
+   unsigned dirty_vertex_buffers;                /**< bitmask of slots */
+   boolean dirty_index_buffer;
+
+   /** Number of calls which were filtered out, per CSO_STAT_x */
+   uint64_t redundant[CSO_STAT_COUNT];
+   uint64_t num_emits;
 };
 
 
@@ -157,6 +230,22 @@ static boolean delete_depth_stencil_state(struct cso_context *ctx, void *state)
 static boolean delete_sampler_state(struct cso_context *ctx, void *state)
 {
    struct cso_sampler *cso = (struct cso_sampler *)state;
+   unsigned sh, i;
+
+   /* Keep the samplers which are bound, staged or saved: they are told
+    * apart by their handle, which a new sampler could otherwise reuse.
+    */
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < PIPE_MAX_SAMPLERS; i++) {
+         if (ctx->samplers[sh].samplers[i] == cso->data)
+            return FALSE;
+      }
+   }
+   for (i = 0; i < PIPE_MAX_SAMPLERS; i++) {
+      if (ctx->fragment_samplers_saved[i] == cso->data)
+         return FALSE;
+   }
+
    if (cso->delete_state)
       cso->delete_state(cso->context, cso->data);
    FREE(state);
@@ -299,12 +388,29 @@ out:
    return NULL;
 }
 
+static void
+cso_dump_stats(struct cso_context *ctx)
+{
+   unsigned i;
+
+   debug_printf("cso_context %p: %" PRIu64 " state emits\n",
+                (void *) ctx, ctx->num_emits);
+   for (i = 0; i < CSO_STAT_COUNT; i++) {
+      debug_printf("   %-20s %" PRIu64 " redundant calls\n",
+                   cso_stat_names[i], ctx->redundant[i]);
+   }
+}
+
+
 /**
  * Free the CSO context.
  */
 void cso_destroy_context( struct cso_context *ctx )
 {
-   unsigned i;
+   unsigned i, sh;
+
+   if (debug_get_option_cso_stats())
+      cso_dump_stats(ctx);
 
    if (ctx->pipe) {
       ctx->pipe->set_index_buffer(ctx->pipe, NULL);
@@ -358,21 +464,23 @@ void cso_destroy_context( struct cso_context *ctx )
          ctx->pipe->set_stream_output_targets(ctx->pipe, 0, NULL, NULL);
    }
 
-   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
-      pipe_sampler_view_reference(&ctx->fragment_views[i], NULL);
-      pipe_sampler_view_reference(&ctx->fragment_views_saved[i], NULL);
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++)
+         pipe_sampler_view_reference(&ctx->views[sh][i], NULL);
+      for (i = 0; i < PIPE_MAX_CONSTANT_BUFFERS; i++)
+         pipe_resource_reference(&ctx->constbufs[sh][i].buffer, NULL);
+      pipe_resource_reference(&ctx->aux_constbuf_saved[sh].buffer, NULL);
    }
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++)
+      pipe_sampler_view_reference(&ctx->fragment_views_saved[i], NULL);
 
    util_unreference_framebuffer_state(&ctx->fb);
    util_unreference_framebuffer_state(&ctx->fb_saved);
 
-   pipe_resource_reference(&ctx->aux_vertex_buffer_current.buffer, NULL);
+   for (i = 0; i < PIPE_MAX_ATTRIBS; i++)
+      pipe_resource_reference(&ctx->vertex_buffers[i].buffer, NULL);
    pipe_resource_reference(&ctx->aux_vertex_buffer_saved.buffer, NULL);
-
-   for (i = 0; i < PIPE_SHADER_TYPES; i++) {
-      pipe_resource_reference(&ctx->aux_constbuf_current[i].buffer, NULL);
-      pipe_resource_reference(&ctx->aux_constbuf_saved[i].buffer, NULL);
-   }
+   pipe_resource_reference(&ctx->index_buffer.buffer, NULL);
 
    pipe_resource_reference(&ctx->fragment_image0_current.resource, NULL);
    pipe_resource_reference(&ctx->fragment_image0_saved.resource, NULL);
@@ -444,6 +552,9 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
       ctx->blend = handle;
       ctx->pipe->bind_blend_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_BLEND]++;
+   }
    return PIPE_OK;
 }
 
@@ -509,6 +620,9 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
       ctx->depth_stencil = handle;
       ctx->pipe->bind_depth_stencil_alpha_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_DEPTH_STENCIL_ALPHA]++;
+   }
    return PIPE_OK;
 }
 
@@ -570,6 +684,9 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
       ctx->rasterizer = handle;
       ctx->pipe->bind_rasterizer_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_RASTERIZER]++;
+   }
    return PIPE_OK;
 }
 
@@ -597,6 +714,9 @@ void cso_set_fragment_shader_handle(struct cso_context *ctx, void *handle )
       ctx->fragment_shader = handle;
       ctx->pipe->bind_fs_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_fragment_shader(struct cso_context *ctx, void *handle )
@@ -633,6 +753,9 @@ void cso_set_vertex_shader_handle(struct cso_context *ctx, void *handle)
       ctx->vertex_shader = handle;
       ctx->pipe->bind_vs_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_vertex_shader(struct cso_context *ctx, void *handle )
@@ -670,6 +793,9 @@ void cso_set_framebuffer(struct cso_context *ctx,
       util_copy_framebuffer_state(&ctx->fb, fb);
       ctx->pipe->set_framebuffer_state(ctx->pipe, fb);
    }
+   else {
+      ctx->redundant[CSO_STAT_FRAMEBUFFER]++;
+   }
 }
 
 static void
@@ -696,6 +822,9 @@ void cso_set_viewport(struct cso_context *ctx,
       ctx->vp = *vp;
       ctx->pipe->set_viewport_states(ctx->pipe, 0, 1, vp);
    }
+   else {
+      ctx->redundant[CSO_STAT_VIEWPORT]++;
+   }
 }
 
 /**
@@ -740,6 +869,9 @@ void cso_set_blend_color(struct cso_context *ctx,
       ctx->blend_color = *bc;
       ctx->pipe->set_blend_color(ctx->pipe, bc);
    }
+   else {
+      ctx->redundant[CSO_STAT_BLEND_COLOR]++;
+   }
 }
 
 void cso_set_sample_mask(struct cso_context *ctx, unsigned sample_mask)
@@ -748,6 +880,9 @@ void cso_set_sample_mask(struct cso_context *ctx, unsigned sample_mask)
       ctx->sample_mask = sample_mask;
       ctx->pipe->set_sample_mask(ctx->pipe, sample_mask);
    }
+   else {
+      ctx->redundant[CSO_STAT_SAMPLE_MASK]++;
+   }
 }
 
 static void
@@ -768,6 +903,9 @@ void cso_set_min_samples(struct cso_context *ctx, unsigned min_samples)
       ctx->min_samples = min_samples;
       ctx->pipe->set_min_samples(ctx->pipe, min_samples);
    }
+   else if (ctx->pipe->set_min_samples) {
+      ctx->redundant[CSO_STAT_MIN_SAMPLES]++;
+   }
 }
 
 static void
@@ -789,6 +927,9 @@ void cso_set_stencil_ref(struct cso_context *ctx,
       ctx->stencil_ref = *sr;
       ctx->pipe->set_stencil_ref(ctx->pipe, sr);
    }
+   else {
+      ctx->redundant[CSO_STAT_STENCIL_REF]++;
+   }
 }
 
 static void
@@ -822,6 +963,9 @@ void cso_set_render_condition(struct cso_context *ctx,
       ctx->render_condition_cond = condition;
       ctx->render_condition_mode = mode;
    }
+   else {
+      ctx->redundant[CSO_STAT_RENDER_CONDITION]++;
+   }
 }
 
 static void
@@ -848,6 +992,9 @@ void cso_set_geometry_shader_handle(struct cso_context *ctx, void *handle)
       ctx->geometry_shader = handle;
       ctx->pipe->bind_gs_state(ctx->pipe, handle);
    }
+   else if (ctx->has_geometry_shader) {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_geometry_shader(struct cso_context *ctx, void *handle)
@@ -893,6 +1040,9 @@ void cso_set_tessctrl_shader_handle(struct cso_context *ctx, void *handle)
       ctx->tessctrl_shader = handle;
       ctx->pipe->bind_tcs_state(ctx->pipe, handle);
    }
+   else if (ctx->has_tessellation) {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_tessctrl_shader(struct cso_context *ctx, void *handle)
@@ -938,6 +1088,9 @@ void cso_set_tesseval_shader_handle(struct cso_context *ctx, void *handle)
       ctx->tesseval_shader = handle;
       ctx->pipe->bind_tes_state(ctx->pipe, handle);
    }
+   else if (ctx->has_tessellation) {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_tesseval_shader(struct cso_context *ctx, void *handle)
@@ -983,6 +1136,9 @@ void cso_set_compute_shader_handle(struct cso_context *ctx, void *handle)
       ctx->compute_shader = handle;
       ctx->pipe->bind_compute_state(ctx->pipe, handle);
    }
+   else if (ctx->has_compute_shader) {
+      ctx->redundant[CSO_STAT_SHADER]++;
+   }
 }
 
 void cso_delete_compute_shader(struct cso_context *ctx, void *handle)
@@ -1052,6 +1208,9 @@ cso_set_vertex_elements(struct cso_context *ctx,
       ctx->velements = handle;
       ctx->pipe->bind_vertex_elements_state(ctx->pipe, handle);
    }
+   else {
+      ctx->redundant[CSO_STAT_VERTEX_ELEMENTS]++;
+   }
    return PIPE_OK;
 }
 
@@ -1093,33 +1252,56 @@ void cso_set_vertex_buffers(struct cso_context *ctx,
                             const struct pipe_vertex_buffer *buffers)
 {
    struct u_vbuf *vbuf = ctx->vbuf;
+   boolean user_buffers = FALSE;
+   unsigned changed = 0;
+   unsigned i;
 
    if (vbuf) {
       u_vbuf_set_vertex_buffers(vbuf, start_slot, count, buffers);
       return;
    }
 
-   /* Save what's in the auxiliary slot, so that we can save and restore it
-    * for meta ops. */
-   if (start_slot <= ctx->aux_vertex_buffer_index &&
-       start_slot+count > ctx->aux_vertex_buffer_index) {
-      if (buffers) {
-         const struct pipe_vertex_buffer *vb =
-               buffers + (ctx->aux_vertex_buffer_index - start_slot);
+   assert(start_slot + count <= PIPE_MAX_ATTRIBS);
 
-         pipe_resource_reference(&ctx->aux_vertex_buffer_current.buffer,
-                                 vb->buffer);
-         memcpy(&ctx->aux_vertex_buffer_current, vb,
-                sizeof(struct pipe_vertex_buffer));
+   for (i = 0; i < count; i++) {
+      struct pipe_vertex_buffer *vb = &ctx->vertex_buffers[start_slot + i];
+
+      if (buffers) {
+         /* The contents of user buffers may change behind our back, so
+          * they are never considered redundant.
+          */
+         if (buffers[i].user_buffer)
+            user_buffers = TRUE;
+         else if (!memcmp(vb, &buffers[i], sizeof(*vb)))
+            continue;
+
+         pipe_resource_reference(&vb->buffer, buffers[i].buffer);
+         memcpy(vb, &buffers[i], sizeof(*vb));
       }
       else {
-         pipe_resource_reference(&ctx->aux_vertex_buffer_current.buffer,
-                                 NULL);
-         ctx->aux_vertex_buffer_current.user_buffer = NULL;
+         if (!vb->buffer && !vb->user_buffer)
+            continue;
+
+         pipe_resource_reference(&vb->buffer, NULL);
+         vb->user_buffer = NULL;
       }
+      changed |= 1u << (start_slot + i);
    }
 
-   ctx->pipe->set_vertex_buffers(ctx->pipe, start_slot, count, buffers);
+   if (user_buffers) {
+      /* Pass these on right away, as the caller may reuse the memory once
+       * the driver has seen it.
+       */
+      ctx->pipe->set_vertex_buffers(ctx->pipe, start_slot, count, buffers);
+      ctx->dirty_vertex_buffers &= ~u_bit_consecutive(start_slot, count);
+   }
+   else if (changed) {
+      ctx->dirty_vertex_buffers |= changed;
+      ctx->dirty = TRUE;
+   }
+   else {
+      ctx->redundant[CSO_STAT_VERTEX_BUFFERS]++;
+   }
 }
 
 static void
@@ -1133,8 +1315,9 @@ cso_save_aux_vertex_buffer_slot(struct cso_context *ctx)
    }
 
    pipe_resource_reference(&ctx->aux_vertex_buffer_saved.buffer,
-                           ctx->aux_vertex_buffer_current.buffer);
-   memcpy(&ctx->aux_vertex_buffer_saved, &ctx->aux_vertex_buffer_current,
+                           ctx->vertex_buffers[ctx->aux_vertex_buffer_index].buffer);
+   memcpy(&ctx->aux_vertex_buffer_saved,
+          &ctx->vertex_buffers[ctx->aux_vertex_buffer_index],
           sizeof(struct pipe_vertex_buffer));
 }
 
@@ -1198,21 +1381,29 @@ cso_single_sampler(struct cso_context *ctx, unsigned shader_stage,
       }
    }
 
-   ctx->samplers[shader_stage].samplers[idx] = handle;
+   if (ctx->samplers[shader_stage].samplers[idx] != handle) {
+      ctx->samplers[shader_stage].samplers[idx] = handle;
+      ctx->samplers[shader_stage].changed = TRUE;
+   }
    return PIPE_OK;
 }
 
 
 /**
- * Send staged sampler state to the driver.
+ * Stage the sampler state for the driver, if it changed.
+ * It is sent by the next cso_emit_state().
  */
 void
 cso_single_sampler_done(struct cso_context *ctx, unsigned shader_stage)
 {
    struct sampler_info *info = &ctx->samplers[shader_stage];
-   const unsigned old_nr_samplers = info->nr_samplers;
    unsigned i;
 
+   if (!info->changed) {
+      ctx->redundant[CSO_STAT_SAMPLERS]++;
+      return;
+   }
+
    /* find highest non-null sampler */
    for (i = PIPE_MAX_SAMPLERS; i > 0; i--) {
       if (info->samplers[i - 1] != NULL)
@@ -1220,9 +1411,9 @@ cso_single_sampler_done(struct cso_context *ctx, unsigned shader_stage)
    }
 
    info->nr_samplers = i;
-   ctx->pipe->bind_sampler_states(ctx->pipe, shader_stage, 0,
-                                  MAX2(old_nr_samplers, info->nr_samplers),
-                                  info->samplers);
+   info->changed = FALSE;
+   ctx->dirty_samplers |= 1 << shader_stage;
+   ctx->dirty = TRUE;
 }
 
 
@@ -1274,9 +1465,12 @@ cso_restore_fragment_samplers(struct cso_context *ctx)
 {
    struct sampler_info *info = &ctx->samplers[PIPE_SHADER_FRAGMENT];
 
-   info->nr_samplers = ctx->nr_fragment_samplers_saved;
-   memcpy(info->samplers, ctx->fragment_samplers_saved,
-          sizeof(info->samplers));
+   if (memcmp(info->samplers, ctx->fragment_samplers_saved,
+              sizeof(info->samplers))) {
+      memcpy(info->samplers, ctx->fragment_samplers_saved,
+             sizeof(info->samplers));
+      info->changed = TRUE;
+   }
    cso_single_sampler_done(ctx, PIPE_SHADER_FRAGMENT);
 }
 
@@ -1287,46 +1481,48 @@ cso_set_sampler_views(struct cso_context *ctx,
                       unsigned count,
                       struct pipe_sampler_view **views)
 {
-   if (shader_stage == PIPE_SHADER_FRAGMENT) {
-      unsigned i;
-      boolean any_change = FALSE;
+   struct pipe_sampler_view **cur = ctx->views[shader_stage];
+   boolean any_change = FALSE;
+   unsigned i;
 
-      /* reference new views */
-      for (i = 0; i < count; i++) {
-         any_change |= ctx->fragment_views[i] != views[i];
-         pipe_sampler_view_reference(&ctx->fragment_views[i], views[i]);
-      }
-      /* unref extra old views, if any */
-      for (; i < ctx->nr_fragment_views; i++) {
-         any_change |= ctx->fragment_views[i] != NULL;
-         pipe_sampler_view_reference(&ctx->fragment_views[i], NULL);
+   /* reference new views */
+   for (i = 0; i < count; i++) {
+      if (cur[i] != views[i]) {
+         pipe_sampler_view_reference(&cur[i], views[i]);
+         any_change = TRUE;
       }
-
-      /* bind the new sampler views */
-      if (any_change) {
-         ctx->pipe->set_sampler_views(ctx->pipe, shader_stage, 0,
-                                      MAX2(ctx->nr_fragment_views, count),
-                                      ctx->fragment_views);
+   }
+   /* unref extra old views, if any */
+   for (; i < ctx->nr_views[shader_stage]; i++) {
+      if (cur[i]) {
+         pipe_sampler_view_reference(&cur[i], NULL);
+         any_change = TRUE;
       }
+   }
 
-      ctx->nr_fragment_views = count;
+   if (any_change) {
+      ctx->dirty_views |= 1 << shader_stage;
+      ctx->dirty = TRUE;
+   }
+   else {
+      ctx->redundant[CSO_STAT_SAMPLER_VIEWS]++;
    }
-   else
-      ctx->pipe->set_sampler_views(ctx->pipe, shader_stage, 0, count, views);
+
+   ctx->nr_views[shader_stage] = count;
 }
 
 
 static void
 cso_save_fragment_sampler_views(struct cso_context *ctx)
 {
+   struct pipe_sampler_view **views = ctx->views[PIPE_SHADER_FRAGMENT];
    unsigned i;
 
-   ctx->nr_fragment_views_saved = ctx->nr_fragment_views;
+   ctx->nr_fragment_views_saved = ctx->nr_views[PIPE_SHADER_FRAGMENT];
 
-   for (i = 0; i < ctx->nr_fragment_views; i++) {
+   for (i = 0; i < ctx->nr_fragment_views_saved; i++) {
       assert(!ctx->fragment_views_saved[i]);
-      pipe_sampler_view_reference(&ctx->fragment_views_saved[i],
-                                  ctx->fragment_views[i]);
+      pipe_sampler_view_reference(&ctx->fragment_views_saved[i], views[i]);
    }
 }
 
@@ -1335,25 +1531,13 @@ static void
 cso_restore_fragment_sampler_views(struct cso_context *ctx)
 {
    unsigned i, nr_saved = ctx->nr_fragment_views_saved;
-   unsigned num;
-
-   for (i = 0; i < nr_saved; i++) {
-      pipe_sampler_view_reference(&ctx->fragment_views[i], NULL);
-      /* move the reference from one pointer to another */
-      ctx->fragment_views[i] = ctx->fragment_views_saved[i];
-      ctx->fragment_views_saved[i] = NULL;
-   }
-   for (; i < ctx->nr_fragment_views; i++) {
-      pipe_sampler_view_reference(&ctx->fragment_views[i], NULL);
-   }
 
-   num = MAX2(ctx->nr_fragment_views, nr_saved);
+   cso_set_sampler_views(ctx, PIPE_SHADER_FRAGMENT, nr_saved,
+                         ctx->fragment_views_saved);
 
-   /* bind the old/saved sampler views */
-   ctx->pipe->set_sampler_views(ctx->pipe, PIPE_SHADER_FRAGMENT, 0, num,
-                                ctx->fragment_views);
+   for (i = 0; i < nr_saved; i++)
+      pipe_sampler_view_reference(&ctx->fragment_views_saved[i], NULL);
 
-   ctx->nr_fragment_views = nr_saved;
    ctx->nr_fragment_views_saved = 0;
 }
 
@@ -1479,13 +1663,29 @@ void
 cso_set_constant_buffer(struct cso_context *cso, unsigned shader_stage,
                         unsigned index, struct pipe_constant_buffer *cb)
 {
-   struct pipe_context *pipe = cso->pipe;
+   struct pipe_constant_buffer *cur = &cso->constbufs[shader_stage][index];
 
-   pipe->set_constant_buffer(pipe, shader_stage, index, cb);
+   assert(index < PIPE_MAX_CONSTANT_BUFFERS);
 
-   if (index == 0) {
-      util_copy_constant_buffer(&cso->aux_constbuf_current[shader_stage], cb);
+   if (cb && cb->user_buffer) {
+      /* The contents of user buffers may change behind our back, and the
+       * caller may reuse the memory once the driver has seen it, so pass
+       * these on right away.
+       */
+      cso->pipe->set_constant_buffer(cso->pipe, shader_stage, index, cb);
+      util_copy_constant_buffer(cur, cb);
+      cso->dirty_constbufs[shader_stage] &= ~(1u << index);
+      return;
    }
+
+   if (cb ? !memcmp(cur, cb, sizeof(*cb)) : !cur->buffer && !cur->user_buffer) {
+      cso->redundant[CSO_STAT_CONSTANT_BUFFER]++;
+      return;
+   }
+
+   util_copy_constant_buffer(cur, cb);
+   cso->dirty_constbufs[shader_stage] |= 1u << index;
+   cso->dirty = TRUE;
 }
 
 void
@@ -1511,7 +1711,7 @@ cso_save_constant_buffer_slot0(struct cso_context *cso,
                                   unsigned shader_stage)
 {
    util_copy_constant_buffer(&cso->aux_constbuf_saved[shader_stage],
-                             &cso->aux_constbuf_current[shader_stage]);
+                             &cso->constbufs[shader_stage][0]);
 }
 
 void
@@ -1646,21 +1846,123 @@ cso_set_index_buffer(struct cso_context *cso,
                      const struct pipe_index_buffer *ib)
 {
    struct u_vbuf *vbuf = cso->vbuf;
+   struct pipe_index_buffer *cur = &cso->index_buffer;
 
    if (vbuf) {
       u_vbuf_set_index_buffer(vbuf, ib);
-   } else {
-      struct pipe_context *pipe = cso->pipe;
-      pipe->set_index_buffer(pipe, ib);
+      return;
+   }
+
+   if (ib && ib->user_buffer) {
+      /* As for vertex buffers, user indices are passed on right away. */
+      cso->pipe->set_index_buffer(cso->pipe, ib);
+      pipe_resource_reference(&cur->buffer, NULL);
+      memcpy(cur, ib, sizeof(*cur));
+      cso->dirty_index_buffer = FALSE;
+      return;
    }
+
+   if (ib ? !memcmp(cur, ib, sizeof(*ib)) : !cur->buffer && !cur->user_buffer) {
+      cso->redundant[CSO_STAT_INDEX_BUFFER]++;
+      return;
+   }
+
+   if (ib) {
+      pipe_resource_reference(&cur->buffer, ib->buffer);
+      memcpy(cur, ib, sizeof(*cur));
+   }
+   else {
+      pipe_resource_reference(&cur->buffer, NULL);
+      memset(cur, 0, sizeof(*cur));
+   }
+   cso->dirty_index_buffer = TRUE;
+   cso->dirty = TRUE;
 }
 
+
+/**
+ * Send the sampler, sampler view, constant buffer, vertex buffer and index
+ * buffer changes which were made since the last call to the driver, in one
+ * go.  Only the bindings which actually changed are sent.
+ *
+ * cso_draw_vbo() does this.  Users which set state through the cso_context
+ * but then draw or launch grids with the pipe_context directly must call
+ * this first.
+ */
+void
+cso_emit_state(struct cso_context *cso)
+{
+   struct pipe_context *pipe = cso->pipe;
+   unsigned mask, sh;
+
+   if (!cso->dirty)
+      return;
+
+   mask = cso->dirty_samplers;
+   while (mask) {
+      struct sampler_info *info;
+
+      sh = u_bit_scan(&mask);
+      info = &cso->samplers[sh];
+      pipe->bind_sampler_states(pipe, sh, 0,
+                                MAX2(info->nr_samplers,
+                                     info->nr_samplers_emitted),
+                                info->samplers);
+      info->nr_samplers_emitted = info->nr_samplers;
+   }
+
+   mask = cso->dirty_views;
+   while (mask) {
+      sh = u_bit_scan(&mask);
+      pipe->set_sampler_views(pipe, sh, 0,
+                              MAX2(cso->nr_views[sh],
+                                   cso->nr_views_emitted[sh]),
+                              cso->views[sh]);
+      cso->nr_views_emitted[sh] = cso->nr_views[sh];
+   }
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      mask = cso->dirty_constbufs[sh];
+      while (mask) {
+         unsigned i = u_bit_scan(&mask);
+         struct pipe_constant_buffer *cb = &cso->constbufs[sh][i];
+
+         pipe->set_constant_buffer(pipe, sh, i, cb->buffer ? cb : NULL);
+      }
+      cso->dirty_constbufs[sh] = 0;
+   }
+
+   mask = cso->dirty_vertex_buffers;
+   while (mask) {
+      int start, count;
+
+      u_bit_scan_consecutive_range(&mask, &start, &count);
+      pipe->set_vertex_buffers(pipe, start, count,
+                               &cso->vertex_buffers[start]);
+   }
+
+   if (cso->dirty_index_buffer) {
+      pipe->set_index_buffer(pipe, cso->index_buffer.buffer ?
+                             &cso->index_buffer : NULL);
+   }
+
+   cso->dirty_samplers = 0;
+   cso->dirty_views = 0;
+   cso->dirty_vertex_buffers = 0;
+   cso->dirty_index_buffer = FALSE;
+   cso->dirty = FALSE;
+   cso->num_emits++;
+}
+
+
 void
 cso_draw_vbo(struct cso_context *cso,
              const struct pipe_draw_info *info)
 {
    struct u_vbuf *vbuf = cso->vbuf;
 
+   cso_emit_state(cso);
+
    if (vbuf) {
       u_vbuf_draw_vbo(vbuf, info);
    } else {
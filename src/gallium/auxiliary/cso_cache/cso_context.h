@@ -220,6 +220,9 @@ void
 cso_set_index_buffer(struct cso_context *cso,
                      const struct pipe_index_buffer *ib);
 
+void
+cso_emit_state(struct cso_context *cso);
+
 void
 cso_draw_vbo(struct cso_context *cso,
              const struct pipe_draw_info *info);
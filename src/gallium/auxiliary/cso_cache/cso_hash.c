@@ -30,412 +30,324 @@
   *   Zack Rusin <zackr@vmware.com>
   */
 
+/*
+ * The hash is an open addressing table with linear probing.  Each slot
+ * caches the key of its entry next to the value, so probing only touches
+ * the slot array, and callers comparing the full data (memcmp or similar)
+ * only do so for entries whose key matches.
+ *
+ * Probe sequences do not wrap around: there are some spare slots after
+ * the (1 << numBits) home slots, and the table is grown when a probe would
+ * run past the last one.  This way all the entries with a given key come
+ * after the first one in slot order, so iterating from cso_hash_find() is
+ * enough to visit them all, as with the chained implementation this
+ * replaced.  Erased entries leave a tombstone until the next rehash, so
+ * erasing never moves other entries and iterators stay valid.
+ */
+
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
 #include "cso_hash.h"
 
-#ifndef MAX
-#define MAX(a, b) ((a > b) ? (a) : (b))
-#endif
 
 static const int MinNumBits = 4;
+static const int MinNumSpare = 8;
 
-static const unsigned char prime_deltas[] = {
-   0,  0,  1,  3,  1,  5,  3,  3,  1,  9,  7,  5,  3,  9, 25,  3,
-   1, 21,  3, 21,  7, 15,  9,  5,  3, 29, 15,  0,  0,  0,  0,  0
+enum cso_node_state {
+   CSO_NODE_EMPTY = 0,
+   CSO_NODE_USED,
+   CSO_NODE_DELETED
 };
 
-static int primeForNumBits(int numBits)
-{
-   return (1 << numBits) + prime_deltas[numBits];
-}
-
-/*
-    Returns the smallest integer n such that
-    primeForNumBits(n) >= hint.
-*/
-static int countBits(int hint)
-{
-   int numBits = 0;
-   int bits = hint;
-
-   while (bits > 1) {
-      bits >>= 1;
-      numBits++;
-   }
-
-   if (numBits >= (int)sizeof(prime_deltas)) {
-      numBits = sizeof(prime_deltas) - 1;
-   } else if (primeForNumBits(numBits) < hint) {
-      ++numBits;
-   }
-   return numBits;
-}
-
 struct cso_node {
-   struct cso_node *next;
    unsigned key;
+   unsigned state;
    void *value;
 };
 
-struct cso_hash_data {
-   struct cso_node *fakeNext;
-   struct cso_node **buckets;
-   int size;
-   int nodeSize;
-   short userNumBits;
-   short numBits;
-   int numBuckets;
-};
-
 struct cso_hash {
-   union {
-      struct cso_hash_data *d;
-      struct cso_node      *e;
-   } data;
+   struct cso_node *nodes;
+   int numBits;
+   int numSpare;   /**< extra slots after the home slots */
+   int numNodes;   /**< (1 << numBits) + numSpare */
+   int size;       /**< number of used slots */
+   int deleted;    /**< number of tombstones */
 };
 
-static void *cso_data_allocate_node(struct cso_hash_data *hash)
-{
-   return MALLOC(hash->nodeSize);
-}
 
-static void cso_free_node(struct cso_node *node)
+/**
+ * Fibonacci hashing of the key, so that keys which only differ in their
+ * high bits (or are small integers) still spread over the table.
+ */
+static inline unsigned
+cso_home_slot(const struct cso_hash *hash, unsigned key)
 {
-   FREE(node);
+   return (key * 2654435769u) >> (32 - hash->numBits);
 }
 
-static struct cso_node *
-cso_hash_create_node(struct cso_hash *hash,
-                      unsigned akey, void *avalue,
-                      struct cso_node **anextNode)
-{
-   struct cso_node *node = cso_data_allocate_node(hash->data.d);
-
-   if (!node)
-      return NULL;
-
-   node->key = akey;
-   node->value = avalue;
 
-   node->next = (struct cso_node*)(*anextNode);
-   *anextNode = node;
-   ++hash->data.d->size;
-   return node;
-}
-
-static void cso_data_rehash(struct cso_hash_data *hash, int hint)
+/**
+ * Put an entry in its slot, without checking the load factor.
+ * \return the node, or NULL if the probe ran off the end of the table.
+ */
+static struct cso_node *
+cso_hash_place(struct cso_hash *hash, unsigned key, void *value)
 {
-   if (hint < 0) {
-      hint = countBits(-hint);
-      if (hint < MinNumBits)
-         hint = MinNumBits;
-      hash->userNumBits = (short)hint;
-      while (primeForNumBits(hint) < (hash->size >> 1))
-         ++hint;
-   } else if (hint < MinNumBits) {
-      hint = MinNumBits;
-   }
-
-   if (hash->numBits != hint) {
-      struct cso_node *e = (struct cso_node *)(hash);
-      struct cso_node **oldBuckets = hash->buckets;
-      int oldNumBuckets = hash->numBuckets;
-      int  i = 0;
-
-      hash->numBits = (short)hint;
-      hash->numBuckets = primeForNumBits(hint);
-      hash->buckets = MALLOC(sizeof(struct cso_node*) * hash->numBuckets);
-      for (i = 0; i < hash->numBuckets; ++i)
-         hash->buckets[i] = e;
-
-      for (i = 0; i < oldNumBuckets; ++i) {
-         struct cso_node *firstNode = oldBuckets[i];
-         while (firstNode != e) {
-            unsigned h = firstNode->key;
-            struct cso_node *lastNode = firstNode;
-            struct cso_node *afterLastNode;
-            struct cso_node **beforeFirstNode;
-            
-            while (lastNode->next != e && lastNode->next->key == h)
-               lastNode = lastNode->next;
-
-            afterLastNode = lastNode->next;
-            beforeFirstNode = &hash->buckets[h % hash->numBuckets];
-            while (*beforeFirstNode != e)
-               beforeFirstNode = &(*beforeFirstNode)->next;
-            lastNode->next = *beforeFirstNode;
-            *beforeFirstNode = firstNode;
-            firstNode = afterLastNode;
-         }
+   struct cso_node *node = &hash->nodes[cso_home_slot(hash, key)];
+   struct cso_node *end = hash->nodes + hash->numNodes;
+
+   for (; node != end; node++) {
+      if (node->state != CSO_NODE_USED) {
+         if (node->state == CSO_NODE_DELETED)
+            hash->deleted--;
+         node->key = key;
+         node->state = CSO_NODE_USED;
+         node->value = value;
+         hash->size++;
+         return node;
       }
-      FREE(oldBuckets);
    }
-}
 
-static void cso_data_might_grow(struct cso_hash_data *hash)
-{
-   if (hash->size >= hash->numBuckets)
-      cso_data_rehash(hash, hash->numBits + 1);
+   return NULL;
 }
 
-static void cso_data_has_shrunk(struct cso_hash_data *hash)
-{
-   if (hash->size <= (hash->numBuckets >> 3) &&
-       hash->numBits > hash->userNumBits) {
-      int max = MAX(hash->numBits-2, hash->userNumBits);
-      cso_data_rehash(hash,  max);
-   }
-}
 
-static struct cso_node *cso_data_first_node(struct cso_hash_data *hash)
+static boolean
+cso_hash_rehash(struct cso_hash *hash, int numBits, int numSpare)
 {
-   struct cso_node *e = (struct cso_node *)(hash);
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-   while (n--) {
-      if (*bucket != e)
-         return *bucket;
-      ++bucket;
+   struct cso_hash tmp;
+   int i;
+
+retry:
+   memset(&tmp, 0, sizeof(tmp));
+   tmp.numBits = numBits;
+   tmp.numSpare = numSpare;
+   tmp.numNodes = (1 << numBits) + numSpare;
+   tmp.nodes = CALLOC(tmp.numNodes, sizeof(struct cso_node));
+   if (!tmp.nodes)
+      return FALSE;
+
+   for (i = 0; i < hash->numNodes; i++) {
+      if (hash->nodes[i].state == CSO_NODE_USED &&
+          !cso_hash_place(&tmp, hash->nodes[i].key, hash->nodes[i].value)) {
+         /* Many entries with the same key: make more room at the end */
+         FREE(tmp.nodes);
+         numSpare *= 2;
+         goto retry;
+      }
    }
-   return e;
-}
 
-static struct cso_node **cso_hash_find_node(struct cso_hash *hash, unsigned akey)
-{
-   struct cso_node **node;
-
-   if (hash->data.d->numBuckets) {
-      node = (struct cso_node **)(&hash->data.d->buckets[akey % hash->data.d->numBuckets]);
-      assert(*node == hash->data.e || (*node)->next);
-      while (*node != hash->data.e && (*node)->key != akey)
-         node = &(*node)->next;
-   } else {
-      node = (struct cso_node **)((const struct cso_node * const *)(&hash->data.e));
-   }
-   return node;
+   FREE(hash->nodes);
+   *hash = tmp;
+   return TRUE;
 }
 
+
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash,
                                        unsigned key, void *data)
 {
-   cso_data_might_grow(hash->data.d);
-
-   {
-      struct cso_node **nextNode = cso_hash_find_node(hash, key);
-      struct cso_node *node = cso_hash_create_node(hash, key, data, nextNode);
-      if (!node) {
-         struct cso_hash_iter null_iter = {hash, 0};
-         return null_iter;
-      }
+   struct cso_hash_iter iter = {hash, NULL};
+
+   /* Keep the load (including tombstones) under one half */
+   if ((hash->size + hash->deleted + 1) * 2 > (1 << hash->numBits)) {
+      int numBits = hash->numBits;
 
-      {
-         struct cso_hash_iter iter = {hash, node};
+      if ((hash->size + 1) * 4 > (1 << numBits))
+         numBits++;
+      if (!cso_hash_rehash(hash, numBits, hash->numSpare))
          return iter;
-      }
    }
+
+   while (!(iter.node = cso_hash_place(hash, key, data))) {
+      if (!cso_hash_rehash(hash, hash->numBits, hash->numSpare * 2))
+         return iter;
+   }
+
+   return iter;
 }
 
 struct cso_hash * cso_hash_create(void)
 {
-   struct cso_hash *hash = MALLOC_STRUCT(cso_hash);
+   struct cso_hash *hash = CALLOC_STRUCT(cso_hash);
    if (!hash)
       return NULL;
 
-   hash->data.d = MALLOC_STRUCT(cso_hash_data);
-   if (!hash->data.d) {
+   if (!cso_hash_rehash(hash, MinNumBits, MinNumSpare)) {
       FREE(hash);
       return NULL;
    }
 
-   hash->data.d->fakeNext = 0;
-   hash->data.d->buckets = 0;
-   hash->data.d->size = 0;
-   hash->data.d->nodeSize = sizeof(struct cso_node);
-   hash->data.d->userNumBits = (short)MinNumBits;
-   hash->data.d->numBits = 0;
-   hash->data.d->numBuckets = 0;
-
    return hash;
 }
 
 void cso_hash_delete(struct cso_hash *hash)
 {
-   struct cso_node *e_for_x = (struct cso_node *)(hash->data.d);
-   struct cso_node **bucket = (struct cso_node **)(hash->data.d->buckets);
-   int n = hash->data.d->numBuckets;
-   while (n--) {
-      struct cso_node *cur = *bucket++;
-      while (cur != e_for_x) {
-         struct cso_node *next = cur->next;
-         cso_free_node(cur);
-         cur = next;
-      }
-   }
-   FREE(hash->data.d->buckets);
-   FREE(hash->data.d);
+   FREE(hash->nodes);
    FREE(hash);
 }
 
+static struct cso_node *
+cso_hash_find_node(struct cso_hash *hash, struct cso_node *node,
+                   unsigned key)
+{
+   struct cso_node *end = hash->nodes + hash->numNodes;
+
+   for (; node != end && node->state != CSO_NODE_EMPTY; node++) {
+      if (node->state == CSO_NODE_USED && node->key == key)
+         return node;
+   }
+
+   return NULL;
+}
+
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash,
                                      unsigned key)
 {
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_hash_iter iter = {hash, *nextNode};
+   struct cso_hash_iter iter = {
+      hash,
+      cso_hash_find_node(hash, &hash->nodes[cso_home_slot(hash, key)], key)
+   };
    return iter;
 }
 
+struct cso_hash_iter cso_hash_find_next(struct cso_hash_iter iter)
+{
+   struct cso_hash_iter next = {
+      iter.hash,
+      cso_hash_find_node(iter.hash, iter.node + 1, iter.node->key)
+   };
+   return next;
+}
+
 unsigned cso_hash_iter_key(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->key;
 }
 
 void * cso_hash_iter_data(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->data.e == iter.node)
+   if (!iter.node)
       return 0;
    return iter.node->value;
 }
 
-static struct cso_node *cso_hash_data_next(struct cso_node *node)
+struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
 {
-   union {
-      struct cso_node *next;
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node **bucket;
-   int n;
-
-   a.next = node->next;
-   if (!a.next) {
+   struct cso_hash_iter next = {iter.hash, NULL};
+   struct cso_node *node, *end;
+
+   if (!iter.node) {
       debug_printf("iterating beyond the last element\n");
-      return 0;
-   }
-   if (a.next->next)
-      return a.next;
-
-   start = (node->key % a.d->numBuckets) + 1;
-   bucket = a.d->buckets + start;
-   n = a.d->numBuckets - start;
-   while (n--) {
-      if (*bucket != a.e)
-         return *bucket;
-      ++bucket;
+      return next;
    }
-   return a.e;
-}
-
 
-static struct cso_node *cso_hash_data_prev(struct cso_node *node)
-{
-   union {
-      struct cso_node *e;
-      struct cso_hash_data *d;
-   } a;
-   int start;
-   struct cso_node *sentinel;
-   struct cso_node **bucket;
-
-   a.e = node;
-   while (a.e->next)
-      a.e = a.e->next;
-
-   if (node == a.e)
-      start = a.d->numBuckets - 1;
-   else
-      start = node->key % a.d->numBuckets;
-
-   sentinel = node;
-   bucket = a.d->buckets + start;
-   while (start >= 0) {
-      if (*bucket != sentinel) {
-         struct cso_node *prev = *bucket;
-         while (prev->next != sentinel)
-            prev = prev->next;
-         return prev;
+   end = iter.hash->nodes + iter.hash->numNodes;
+   for (node = iter.node + 1; node != end; node++) {
+      if (node->state == CSO_NODE_USED) {
+         next.node = node;
+         break;
       }
-
-      sentinel = a.e;
-      --bucket;
-      --start;
    }
-   debug_printf("iterating backward beyond first element\n");
-   return a.e;
-}
-
-struct cso_hash_iter cso_hash_iter_next(struct cso_hash_iter iter)
-{
-   struct cso_hash_iter next = {iter.hash, cso_hash_data_next(iter.node)};
    return next;
 }
 
 int cso_hash_iter_is_null(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.node == iter.hash->data.e)
-      return 1;
-   return 0;
+   return !iter.node;
 }
 
 void * cso_hash_take(struct cso_hash *hash,
                       unsigned akey)
 {
-   struct cso_node **node = cso_hash_find_node(hash, akey);
-   if (*node != hash->data.e) {
-      void *t = (*node)->value;
-      struct cso_node *next = (*node)->next;
-      cso_free_node(*node);
-      *node = next;
-      --hash->data.d->size;
-      cso_data_has_shrunk(hash->data.d);
-      return t;
-   }
-   return 0;
+   struct cso_hash_iter iter = cso_hash_find(hash, akey);
+   void *t;
+
+   if (!iter.node)
+      return 0;
+
+   t = iter.node->value;
+   cso_hash_erase(hash, iter);
+
+   /* shrink if it got mostly empty */
+   if (hash->size <= (1 << hash->numBits) >> 3 &&
+       hash->numBits > MinNumBits)
+      cso_hash_rehash(hash, hash->numBits - 1, hash->numSpare);
+
+   return t;
 }
 
 struct cso_hash_iter cso_hash_iter_prev(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter prev = {iter.hash,
-                                 cso_hash_data_prev(iter.node)};
+   struct cso_hash_iter prev = {iter.hash, NULL};
+   struct cso_node *node;
+
+   node = iter.node ? iter.node : iter.hash->nodes + iter.hash->numNodes;
+   while (node != iter.hash->nodes) {
+      node--;
+      if (node->state == CSO_NODE_USED) {
+         prev.node = node;
+         return prev;
+      }
+   }
+
+   debug_printf("iterating backward beyond first element\n");
    return prev;
 }
 
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash)
 {
-   struct cso_hash_iter iter = {hash, cso_data_first_node(hash->data.d)};
+   struct cso_hash_iter iter = {hash, NULL};
+   int i;
+
+   for (i = 0; i < hash->numNodes; i++) {
+      if (hash->nodes[i].state == CSO_NODE_USED) {
+         iter.node = &hash->nodes[i];
+         break;
+      }
+   }
    return iter;
 }
 
 int cso_hash_size(struct cso_hash *hash)
 {
-   return hash->data.d->size;
+   return hash->size;
 }
 
 struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter)
 {
-   struct cso_hash_iter ret = iter;
    struct cso_node *node = iter.node;
-   struct cso_node **node_ptr;
 
-   if (node == hash->data.e)
+   if (!node)
       return iter;
 
-   ret = cso_hash_iter_next(ret);
-   node_ptr = (struct cso_node**)(&hash->data.d->buckets[node->key % hash->data.d->numBuckets]);
-   while (*node_ptr != node)
-      node_ptr = &(*node_ptr)->next;
-   *node_ptr = node->next;
-   cso_free_node(node);
-   --hash->data.d->size;
-   return ret;
+   iter = cso_hash_iter_next(iter);
+
+   node->state = CSO_NODE_DELETED;
+   node->value = NULL;
+   --hash->size;
+   ++hash->deleted;
+
+   /* Tombstones right before an empty slot don't continue any probe
+    * sequence, so they can be emptied.
+    */
+   if (node + 1 == hash->nodes + hash->numNodes ||
+       node[1].state == CSO_NODE_EMPTY) {
+      while (node->state == CSO_NODE_DELETED) {
+         node->state = CSO_NODE_EMPTY;
+         --hash->deleted;
+         if (node == hash->nodes)
+            break;
+         node--;
+      }
+   }
+
+   return iter;
 }
 
 boolean cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **node = cso_hash_find_node(hash, key);
-   return (*node != hash->data.e);
+   return !cso_hash_iter_is_null(cso_hash_find(hash, key));
 }
@@ -30,13 +30,13 @@
  * Hash table implementation.
  * 
  * This file provides a hash implementation that is capable of dealing
- * with collisions. It stores colliding entries in linked list. All
- * functions operating on the hash return an iterator. The iterator
- * itself points to the collision list. If there wasn't any collision
- * the list will have just one entry, otherwise client code should
- * iterate over the entries to find the exact entry among ones that
- * had the same key (e.g. memcmp could be used on the data to check
- * that)
+ * with collisions: several entries may be stored with the same key.
+ * All functions operating on the hash return an iterator. The iterator
+ * returned by cso_hash_find() points to the first entry with the given
+ * key, and cso_hash_find_next() moves on to the next entry with the same
+ * key, so client code should walk those to find the exact entry among
+ * the ones that had the same key (e.g. memcmp could be used on the data
+ * to check that)
  * 
  * @author Zack Rusin <zackr@vmware.com>
  */
@@ -70,9 +70,9 @@ int              cso_hash_size(struct cso_hash *hash);
 
 /**
  * Adds a data with the given key to the hash. If entry with the given
- * key is already in the hash, this current entry is instered before it
- * in the collision list.
- * Function returns iterator pointing to the inserted item in the hash.
+ * key is already in the hash, both are kept.
+ * Function returns iterator pointing to the inserted item in the hash,
+ * which is only valid until the next insertion or cso_hash_take().
  */
 struct cso_hash_iter cso_hash_insert(struct cso_hash *hash, unsigned key,
                                      void *data);
@@ -92,10 +92,16 @@ void  *cso_hash_take(struct cso_hash *hash, unsigned key);
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash);
 
 /**
- * Return an iterator pointing to the first entry in the collision list.
+ * Return an iterator pointing to the first entry with the given key.
  */
 struct cso_hash_iter cso_hash_find(struct cso_hash *hash, unsigned key);
 
+/**
+ * Return an iterator pointing to the next entry with the same key as
+ * \p iter, or a null iterator if there is none.
+ */
+struct cso_hash_iter cso_hash_find_next(struct cso_hash_iter iter);
+
 /**
  * Returns true if a value with the given key exists in the hash
  */
@@ -1089,6 +1089,24 @@ draw_collect_pipeline_statistics(struct draw_context *draw,
    draw->collect_statistics = enable;
 }
 
+/**
+ * Returns the vertex reuse counters of the LLVM vertex pipeline, since
+ * the creation of the context.
+ *
+ * \p unique_indices counts the vertices the front end asked for, after
+ * removing the duplicates within each segment of a draw, and
+ * \p vs_invocations the vertices which were actually shaded; the
+ * difference is what the post-transform vertex cache saved.
+ */
+void
+draw_get_vertex_cache_stats(const struct draw_context *draw,
+                            uint64_t *unique_indices,
+                            uint64_t *vs_invocations)
+{
+   *unique_indices = draw->num_unique_indices;
+   *vs_invocations = draw->num_vs_invocations;
+}
+
 /**
  * Computes clipper invocation statistics.
  *
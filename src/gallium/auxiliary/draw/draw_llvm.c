@@ -525,6 +525,9 @@ fail:
 void
 draw_llvm_destroy(struct draw_llvm *llvm)
 {
+   if (llvm->clip_gallivm)
+      gallivm_destroy(llvm->clip_gallivm);
+
    if (llvm->context_owned)
       LLVMContextDispose(llvm->context);
    llvm->context = NULL;
@@ -628,6 +631,7 @@ generate_vs(struct draw_llvm_variant *variant,
                      NULL,
                      draw_sampler,
                      &llvm->draw->vs.vertex_shader->info,
+                     NULL,
                      NULL);
 
    {
@@ -1853,6 +1857,246 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
 }
 
 
+/**
+ * Generate the code assembling primitives of \p verts_per_prim vertices
+ * and classifying them against the clip planes, DRAW_LLVM_CLIP_PRIMS
+ * primitives at a time.  See draw_jit_clip_prims_func.
+ */
+static LLVMValueRef
+draw_llvm_generate_clip_prims(struct draw_llvm *llvm,
+                              struct gallivm_state *gallivm,
+                              unsigned verts_per_prim,
+                              boolean indexed)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(context);
+   LLVMTypeRef int16_type = LLVMInt16TypeInContext(context);
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef arg_types[9];
+   LLVMTypeRef func_type, codes_type;
+   LLVMValueRef func, verts_ptr, stride, elts_ptr, start, max_index;
+   LLVMValueRef layout_ptr, num_prims, out_ptr, codes_ptr;
+   LLVMValueRef step[3], base[3], odd[3], header[3];
+   LLVMValueRef last_prim, clipmask_bits, or_mask, and_mask, code, ptr;
+   LLVMBasicBlockRef block;
+   struct lp_type type = lp_type_uint_vec(32, 32 * DRAW_LLVM_CLIP_PRIMS);
+   struct lp_build_context bld, int_bld;
+   struct lp_build_loop_state loop;
+   char func_name[64];
+   unsigned i, j;
+
+   util_snprintf(func_name, sizeof(func_name), "draw_llvm_clip_prims%u_%s",
+                 verts_per_prim, indexed ? "elts" : "linear");
+
+   arg_types[0] = LLVMPointerType(int8_type, 0);   /* verts */
+   arg_types[1] = int32_type;                      /* stride */
+   arg_types[2] = LLVMPointerType(int16_type, 0);  /* elts */
+   arg_types[3] = int32_type;                      /* start */
+   arg_types[4] = int32_type;                      /* max_index */
+   arg_types[5] = LLVMPointerType(int32_type, 0);  /* layout */
+   arg_types[6] = int32_type;                      /* num_prims */
+   arg_types[7] = LLVMPointerType(int16_type, 0);  /* out */
+   arg_types[8] = LLVMPointerType(int8_type, 0);   /* codes */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   func = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   verts_ptr  = LLVMGetParam(func, 0);
+   stride     = LLVMGetParam(func, 1);
+   elts_ptr   = LLVMGetParam(func, 2);
+   start      = LLVMGetParam(func, 3);
+   max_index  = LLVMGetParam(func, 4);
+   layout_ptr = LLVMGetParam(func, 5);
+   num_prims  = LLVMGetParam(func, 6);
+   out_ptr    = LLVMGetParam(func, 7);
+   codes_ptr  = LLVMGetParam(func, 8);
+
+   lp_build_name(verts_ptr, "verts");
+   lp_build_name(stride, "stride");
+   lp_build_name(elts_ptr, "elts");
+   lp_build_name(start, "start");
+   lp_build_name(max_index, "max_index");
+   lp_build_name(layout_ptr, "layout");
+   lp_build_name(num_prims, "num_prims");
+   lp_build_name(out_ptr, "out");
+   lp_build_name(codes_ptr, "codes");
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&bld, gallivm, type);
+   lp_build_context_init(&int_bld, gallivm, lp_type_uint(32));
+
+   /* struct draw_clip_prims_layout, as an array of 9 ints */
+   for (i = 0; i < verts_per_prim; i++) {
+      LLVMValueRef index;
+
+      index = lp_build_const_int32(gallivm, i);
+      step[i] = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, layout_ptr, &index, 1, ""),
+                              "step");
+      index = lp_build_const_int32(gallivm, 3 + i);
+      base[i] = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, layout_ptr, &index, 1, ""),
+                              "base");
+      index = lp_build_const_int32(gallivm, 6 + i);
+      odd[i] = LLVMBuildLoad(builder,
+                             LLVMBuildGEP(builder, layout_ptr, &index, 1, ""),
+                             "odd");
+   }
+
+   codes_type = LLVMPointerType(LLVMVectorType(int8_type,
+                                               DRAW_LLVM_CLIP_PRIMS), 0);
+   clipmask_bits = lp_build_const_int_vec(gallivm, type,
+                                          (1 << DRAW_TOTAL_CLIP_PLANES) - 1);
+   last_prim = LLVMBuildSub(builder, num_prims,
+                            lp_build_const_int32(gallivm, 1), "");
+
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      for (i = 0; i < verts_per_prim; i++)
+         header[i] = bld.undef;
+
+      /* the lanes past the end repeat the last primitive, which stores
+       * the same indices again
+       */
+      for (j = 0; j < DRAW_LLVM_CLIP_PRIMS; j++) {
+         LLVMValueRef lane = lp_build_const_int32(gallivm, j);
+         LLVMValueRef prim, parity;
+
+         prim = LLVMBuildAdd(builder, loop.counter, lane, "");
+         prim = lp_build_min(&int_bld, prim, last_prim);
+         parity = LLVMBuildAnd(builder, prim, int_bld.one, "");
+
+         for (i = 0; i < verts_per_prim; i++) {
+            LLVMValueRef vert, elt, index, word;
+
+            /* assemble: vertex i of the primitive */
+            vert = LLVMBuildMul(builder, prim, step[i], "");
+            vert = LLVMBuildAdd(builder, vert, base[i], "");
+            vert = LLVMBuildAdd(builder, vert,
+                                LLVMBuildMul(builder, parity, odd[i], ""), "");
+            vert = LLVMBuildAdd(builder, vert, start, "");
+
+            if (indexed) {
+               elt = LLVMBuildLoad(builder,
+                                   LLVMBuildGEP(builder, elts_ptr, &vert, 1, ""),
+                                   "");
+               elt = LLVMBuildZExt(builder, elt, int32_type, "");
+               elt = lp_build_min(&int_bld, elt, max_index);
+            }
+            else {
+               elt = vert;
+            }
+
+            index = LLVMBuildMul(builder, prim,
+                                 lp_build_const_int32(gallivm, verts_per_prim),
+                                 "");
+            index = LLVMBuildAdd(builder, index,
+                                 lp_build_const_int32(gallivm, i), "");
+            LLVMBuildStore(builder,
+                           LLVMBuildTrunc(builder, elt, int16_type, ""),
+                           LLVMBuildGEP(builder, out_ptr, &index, 1, ""));
+
+            /* gather the header word of the vertex */
+            ptr = LLVMBuildMul(builder, elt, stride, "");
+            ptr = LLVMBuildGEP(builder, verts_ptr, &ptr, 1, "");
+            ptr = LLVMBuildBitCast(builder, ptr,
+                                   LLVMPointerType(int32_type, 0), "");
+            word = LLVMBuildLoad(builder, ptr, "");
+
+            header[i] = LLVMBuildInsertElement(builder, header[i], word,
+                                               lane, "");
+         }
+      }
+
+      or_mask = bld.zero;
+      and_mask = clipmask_bits;
+      for (i = 0; i < verts_per_prim; i++) {
+         or_mask = LLVMBuildOr(builder, or_mask, header[i], "");
+         and_mask = LLVMBuildAnd(builder, and_mask, header[i], "");
+      }
+
+      or_mask = LLVMBuildAnd(builder, or_mask, clipmask_bits, "");
+      and_mask = LLVMBuildAnd(builder, and_mask, clipmask_bits, "");
+
+      /* accept = 0, clip = 1, reject = 2 (the and mask implies the or) */
+      or_mask = lp_build_compare(gallivm, type, PIPE_FUNC_NOTEQUAL,
+                                 or_mask, bld.zero);
+      and_mask = lp_build_compare(gallivm, type, PIPE_FUNC_NOTEQUAL,
+                                  and_mask, bld.zero);
+      code = LLVMBuildAdd(builder,
+                          LLVMBuildAnd(builder, or_mask, bld.one, ""),
+                          LLVMBuildAnd(builder, and_mask, bld.one, ""), "");
+      code = LLVMBuildTrunc(builder, code,
+                            LLVMVectorType(int8_type, DRAW_LLVM_CLIP_PRIMS),
+                            "");
+
+      ptr = LLVMBuildGEP(builder, codes_ptr, &loop.counter, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr, codes_type, "");
+      LLVMSetAlignment(LLVMBuildStore(builder, code, ptr), 1);
+   }
+   lp_build_loop_end_cond(&loop, num_prims,
+                          lp_build_const_int32(gallivm, DRAW_LLVM_CLIP_PRIMS),
+                          LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/**
+ * Return the code assembling primitives and classifying them against the
+ * clip planes, see draw_jit_clip_prims_func.  The code is the same for all
+ * shaders, so it is only generated once, on first use.
+ *
+ * \param verts_per_prim  2 for lines, 3 for triangles
+ * \param indexed  whether the vertices of the run come from an elts array
+ */
+draw_jit_clip_prims_func
+draw_llvm_get_clip_prims(struct draw_llvm *llvm, unsigned verts_per_prim,
+                         boolean indexed)
+{
+   assert(verts_per_prim == 2 || verts_per_prim == 3);
+
+   if (!llvm->clip_gallivm) {
+      LLVMValueRef funcs[4][2];
+      unsigned i, j;
+
+      llvm->clip_gallivm = gallivm_create("draw_llvm_clip_prims",
+                                          llvm->context);
+      if (!llvm->clip_gallivm)
+         return NULL;
+
+      for (i = 2; i <= 3; i++) {
+         for (j = 0; j < 2; j++)
+            funcs[i][j] = draw_llvm_generate_clip_prims(llvm,
+                                                        llvm->clip_gallivm,
+                                                        i, j);
+      }
+
+      gallivm_compile_module(llvm->clip_gallivm);
+
+      for (i = 2; i <= 3; i++) {
+         for (j = 0; j < 2; j++)
+            llvm->clip_prims[i][j] = (draw_jit_clip_prims_func)
+               gallivm_jit_function(llvm->clip_gallivm, funcs[i][j]);
+      }
+
+      gallivm_free_ir(llvm->clip_gallivm);
+   }
+
+   return llvm->clip_prims[verts_per_prim][indexed];
+}
+
+
 struct draw_llvm_variant_key *
 draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
 {
@@ -2232,7 +2476,8 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                      NULL,
                      sampler,
                      &llvm->draw->gs.geometry_shader->info,
-                     (const struct lp_build_tgsi_gs_iface *)&gs_iface);
+                     (const struct lp_build_tgsi_gs_iface *)&gs_iface,
+                     NULL);
 
    sampler->destroy(sampler);
 
@@ -288,6 +288,46 @@ typedef int
                            unsigned start_instance);
 
 
+/** Primitives handled by each iteration of draw_jit_clip_prims_func */
+#define DRAW_LLVM_CLIP_PRIMS 8
+
+#define DRAW_CLIP_PRIM_ACCEPT 0  /**< no vertex outside a clip plane */
+#define DRAW_CLIP_PRIM_CLIP   1  /**< needs clipping */
+#define DRAW_CLIP_PRIM_REJECT 2  /**< all vertices outside one clip plane */
+
+/**
+ * How draw_jit_clip_prims_func assembles the primitives of a run: vertex
+ * k of primitive p is vertex  step[k] * p + base[k] + (p odd ? odd[k] : 0)
+ * of the run.  This covers lists, strips and fans.
+ */
+struct draw_clip_prims_layout {
+   int step[3];
+   int base[3];
+   int odd[3];
+};
+
+/**
+ * Assemble num_prims lines or triangles of a run of vertices, as laid out
+ * by layout, and classify them from the clip masks in their vertex
+ * headers.  Vertex v of the run is vertex MIN2(elts[start + v], max_index)
+ * for the indexed variant, and start + v for the linear one.  Writes the
+ * vertex indices of the primitives to out, and one DRAW_CLIP_PRIM_x code
+ * per primitive to codes, which must have room for num_prims rounded up
+ * to a multiple of DRAW_LLVM_CLIP_PRIMS.  out may be elts, if the layout
+ * is a list starting at 0.
+ */
+typedef void
+(*draw_jit_clip_prims_func)(const struct vertex_header *verts,
+                            unsigned stride,
+                            const ushort *elts,
+                            unsigned start,
+                            unsigned max_index,
+                            const struct draw_clip_prims_layout *layout,
+                            unsigned num_prims,
+                            ushort *out,
+                            ubyte *codes);
+
+
 typedef int
 (*draw_gs_jit_func)(struct draw_gs_jit_context *context,
                     float inputs[6][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS][TGSI_NUM_CHANNELS],
@@ -466,6 +506,12 @@ struct draw_llvm {
 
    struct draw_gs_llvm_variant_list_item gs_variants_list;
    int nr_gs_variants;
+
+   /* primitive assembly and clip classification, indexed by vertices
+    * per primitive and indexed/linear, see draw_llvm_get_clip_prims()
+    */
+   struct gallivm_state *clip_gallivm;
+   draw_jit_clip_prims_func clip_prims[4][2];
 };
 
 
@@ -504,6 +550,10 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store);
 void
 draw_llvm_dump_variant_key(struct draw_llvm_variant_key *key);
 
+draw_jit_clip_prims_func
+draw_llvm_get_clip_prims(struct draw_llvm *llvm, unsigned verts_per_prim,
+                         boolean indexed);
+
 
 struct draw_gs_llvm_variant *
 draw_gs_llvm_create_variant(struct draw_llvm *llvm,
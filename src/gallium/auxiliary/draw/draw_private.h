@@ -339,6 +339,10 @@ struct draw_context
    struct pipe_query_data_pipeline_statistics statistics;
    boolean collect_statistics;
 
+   /* vertex reuse counters, see draw_get_vertex_cache_stats() */
+   uint64_t num_unique_indices;
+   uint64_t num_vs_invocations;
+
    struct draw_assembler *ia;
 
    void *driver_private;
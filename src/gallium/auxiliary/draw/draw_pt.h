@@ -124,6 +124,14 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)( struct draw_pt_middle_end * );
 
+   /**
+    * Finish processing the segments passed to the run functions so far.
+    * Optional: only needed by middle ends which work on segments
+    * asynchronously.  The front end calls it before returning from a
+    * draw, as the vertex and index buffers may change afterwards.
+    */
+   void (*flush)( struct draw_pt_middle_end * );
+
    void (*finish)( struct draw_pt_middle_end * );
    void (*destroy)( struct draw_pt_middle_end * );
 };
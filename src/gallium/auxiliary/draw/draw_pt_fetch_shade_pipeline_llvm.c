@@ -28,6 +28,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -39,6 +40,91 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/** Most segments in flight when vertex shading is multithreaded */
+#define LLVM_MAX_QUEUED_SEGMENTS 32
+
+/** Smaller segments are shaded on the draw thread */
+#define LLVM_MIN_QUEUED_VERTICES 256
+
+/** Most vertex shading threads */
+#define DRAW_MAX_THREADS 32
+
+/** Default number of vertices in the post-transform vertex cache */
+#define LLVM_VCACHE_DEFAULT_SIZE 1024
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_threads, "DRAW_THREADS", 0)
+DEBUG_GET_ONCE_NUM_OPTION(draw_vcache_size, "DRAW_VERTEX_CACHE_SIZE",
+                          LLVM_VCACHE_DEFAULT_SIZE)
+
+
+struct llvm_middle_end;
+
+/**
+ * A segment whose vertices are being shaded by a worker thread.
+ */
+struct llvm_segment {
+   struct llvm_middle_end *fpme;
+   struct util_queue_fence fence;
+
+   struct draw_fetch_info fetch_info;
+   struct draw_prim_info prim_info;
+   unsigned prim_length;
+
+   /* copies of the front end's elements */
+   unsigned *fetch_elts;
+   unsigned max_fetch_elts;
+   ushort *draw_elts;
+   unsigned max_draw_elts;
+
+   /*
+    * Vertex cache lookup results: the first fetch_info.count vertices are
+    * shaded, the num_hits following ones are copied from the cache slots
+    * in hit_slots[], and the shaded ones go to the slots in miss_slots[].
+    */
+   boolean cached;
+   unsigned *hit_slots;
+   unsigned num_hits;
+   unsigned *miss_slots;
+
+   /* results of llvm_pipeline_shade() */
+   struct draw_vertex_info vert_info;
+   unsigned clipped;
+};
+
+
+struct llvm_vcache_entry {
+   unsigned elt;       /**< fetch element */
+   int next;           /**< next entry of the hash bucket, or -1 */
+   unsigned segment;   /**< serial of the segment which shaded it */
+   unsigned pos;       /**< vertex index in that segment */
+};
+
+
+/**
+ * Post-transform vertex cache.
+ *
+ * A FIFO of shaded vertices, keyed by fetch element, which is shared by
+ * the segments of a draw.  The vsplit front end already removes the
+ * duplicates within a segment, this catches the vertices shared between
+ * segments.  The lookups happen on the draw thread when a segment starts,
+ * but the vertex data is only copied in and out when it ends: segments
+ * end in order, so the data is then in the state the lookups saw.
+ */
+struct llvm_vcache {
+   unsigned size;             /**< number of entries, power of two */
+   unsigned max_vertex_size;  /**< vertex size the storage was sized for */
+   struct llvm_vcache_entry *entries;
+   int *buckets;              /**< first entry of each bucket, or -1 */
+   ubyte *vertices;           /**< size * max_vertex_size bytes */
+
+   unsigned num_valid;        /**< entries in use */
+   unsigned next;             /**< next entry to replace */
+   unsigned segment;          /**< serial of the current segment */
+   unsigned *remap;           /**< fetch index -> vertex index scratch */
+   unsigned max_remap;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,6 +142,28 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /*
+    * Multithreaded vertex shading: the segments are shaded by the queue
+    * threads, and finished on the draw thread in the order they came in.
+    */
+   unsigned num_threads;
+   struct util_queue queue;
+   struct llvm_segment segments[LLVM_MAX_QUEUED_SEGMENTS];
+   unsigned first_segment;
+   unsigned num_segments;
+
+   /* segment used for the vertex cache when shading on the draw thread */
+   struct llvm_segment segment;
+
+   struct llvm_vcache vcache;
+
+   /* primitive list for llvm_pipeline_clip() */
+   struct {
+      ushort *elts;
+      ubyte *codes;
+      unsigned max_prims;
+   } clip;
 };
 
 
@@ -67,6 +175,49 @@ llvm_middle_end(struct draw_pt_middle_end *middle)
 }
 
 
+#define LLVM_VCACHE_HIT (1u << 31)
+
+
+static inline unsigned
+llvm_vcache_bucket(const struct llvm_vcache *vcache, unsigned elt)
+{
+   return (elt ^ (elt >> 16)) & (vcache->size - 1);
+}
+
+
+/**
+ * Forget all the cached vertices.  Called at the end of each draw, since
+ * the vertex buffers, the instance id, the constants... may all change
+ * between draws.
+ */
+static void
+llvm_vcache_reset(struct llvm_vcache *vcache)
+{
+   if (vcache->num_valid) {
+      memset(vcache->buckets, 0xff, vcache->size * sizeof(int));
+      vcache->num_valid = 0;
+      vcache->next = 0;
+   }
+}
+
+
+/**
+ * Allocate the vertex storage for the current vertex size.
+ */
+static void
+llvm_vcache_prepare(struct llvm_vcache *vcache, unsigned vertex_size)
+{
+   llvm_vcache_reset(vcache);
+
+   if (!vcache->size || vertex_size <= vcache->max_vertex_size)
+      return;
+
+   FREE(vcache->vertices);
+   vcache->vertices = MALLOC(vcache->size * vertex_size);
+   vcache->max_vertex_size = vcache->vertices ? vertex_size : 0;
+}
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -191,6 +342,8 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
     */
    fpme->vertex_size = sizeof(struct vertex_header) + nr * 4 * sizeof(float);
 
+   llvm_vcache_prepare(&fpme->vcache, fpme->vertex_size);
+
    /* return even number */
    *max_vertices = *max_vertices & ~1;
 
@@ -336,46 +489,24 @@ emit(struct pt_emit *emit,
 }
 
 
-static void
-llvm_pipeline_generic(struct draw_pt_middle_end *middle,
-                      const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+/**
+ * Fetch the vertices and run the vertex shader on them.
+ *
+ * This may run on a worker thread (see llvm_pipeline_queue()), so it must
+ * only read state which doesn't change until the end of the draw call.
+ *
+ * \return the clip mask, non-zero if any vertex needs clipping
+ */
+static unsigned
+llvm_pipeline_shade(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    struct draw_vertex_info *vert_info)
 {
-   struct llvm_middle_end *fpme = llvm_middle_end(middle);
    struct draw_context *draw = fpme->draw;
-   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
-   struct draw_prim_info gs_prim_info;
-   struct draw_vertex_info llvm_vert_info;
-   struct draw_vertex_info gs_vert_info;
-   struct draw_vertex_info *vert_info;
-   struct draw_prim_info ia_prim_info;
-   struct draw_vertex_info ia_vert_info;
-   const struct draw_prim_info *prim_info = in_prim_info;
-   boolean free_prim_info = FALSE;
-   unsigned opt = fpme->opt;
-   unsigned clipped = 0;
-
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
-      MALLOC(fpme->vertex_size *
-             align(fetch_info->count, lp_native_vector_width / 32));
-   if (!llvm_vert_info.verts) {
-      assert(0);
-      return;
-   }
-
-   if (draw->collect_statistics) {
-      draw->statistics.ia_vertices += prim_info->count;
-      draw->statistics.ia_primitives +=
-         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
-   }
 
    if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       vert_info->verts,
                                        draw->pt.user.vbuffer,
                                        fetch_info->start,
                                        fetch_info->count,
@@ -385,8 +516,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                        draw->start_index,
                                        draw->start_instance);
    else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            vert_info->verts,
                                             draw->pt.user.vbuffer,
                                             fetch_info->elts,
                                             draw->pt.user.eltMax,
@@ -396,11 +527,406 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                             draw->instance_id,
                                             draw->pt.user.eltBias,
                                             draw->start_instance);
+}
 
-   /* Finished with fetch and vs:
+
+/**
+ * Allocate the vertices for llvm_pipeline_shade(), plus \p num_hits
+ * vertices from the vertex cache after them, and count the statistics of
+ * the segment.
+ */
+static boolean
+llvm_pipeline_begin(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    const struct draw_prim_info *prim_info,
+                    unsigned num_hits,
+                    struct draw_vertex_info *vert_info)
+{
+   struct draw_context *draw = fpme->draw;
+
+   vert_info->count = fetch_info->count + num_hits;
+   vert_info->vertex_size = fpme->vertex_size;
+   vert_info->stride = fpme->vertex_size;
+   vert_info->verts = (struct vertex_header *)
+      MALLOC(fpme->vertex_size *
+             align(vert_info->count, lp_native_vector_width / 32));
+   if (!vert_info->verts) {
+      assert(0);
+      return FALSE;
+   }
+
+   draw->num_vs_invocations += fetch_info->count;
+
+   if (draw->collect_statistics) {
+      draw->statistics.ia_vertices += prim_info->count;
+      draw->statistics.ia_primitives +=
+         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+      draw->statistics.vs_invocations += fetch_info->count;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ * Set up macros for draw_pt_decompose.h template code, to assemble the
+ * primitives draw_jit_clip_prims_func can't (line loops, quads, polygons
+ * and adjacency primitives) into a list of lines or triangles for
+ * llvm_pipeline_clip().
+ */
+
+#define TRIANGLE(flags,i0,i1,i2)                \
+   do {                                         \
+      out[(*num_elts)++] = (ushort) (i0);       \
+      out[(*num_elts)++] = (ushort) (i1);       \
+      out[(*num_elts)++] = (ushort) (i2);       \
+   } while (0)
+
+#define LINE(flags,i0,i1)                       \
+   do {                                         \
+      out[(*num_elts)++] = (ushort) (i0);       \
+      out[(*num_elts)++] = (ushort) (i1);       \
+   } while (0)
+
+#define POINT(i0) do {} while (0)
+
+#define GET_ELT(idx) (elts ? MIN2(elts[idx], max_index) : start + (idx))
+
+#define FUNC_ENTER (void) verts
+
+#define FUNC llvm_assemble_prims
+#define FUNC_VARS                               \
+    struct draw_context *draw,                  \
+    unsigned prim,                              \
+    unsigned prim_flags,                        \
+    struct vertex_header *vertices,             \
+    const ushort *elts,                         \
+    unsigned start,                             \
+    unsigned count,                             \
+    unsigned max_index,                         \
+    ushort *out,                                \
+    unsigned *num_elts
+
+#include "draw_pt_decompose.h"
+
+
+/**
+ * Describe how draw_decompose_tmp.h assembles the lines or triangles of
+ * \p count vertices of \p prim, for draw_jit_clip_prims_func.
+ *
+ * \return the number of primitives, or -1 if their vertices aren't laid
+ *         out regularly enough
+ */
+static int
+llvm_clip_prims_layout(const struct draw_context *draw,
+                       unsigned prim,
+                       unsigned count,
+                       struct draw_clip_prims_layout *layout)
+{
+   const boolean last_vertex_last =
+      !(draw->rasterizer->flatshade && draw->rasterizer->flatshade_first);
+   unsigned i;
+
+   memset(layout, 0, sizeof *layout);
+
+   switch (prim) {
+   case PIPE_PRIM_LINES:
+      /* (2p, 2p + 1) */
+      for (i = 0; i < 2; i++) {
+         layout->step[i] = 2;
+         layout->base[i] = i;
+      }
+      return count / 2;
+
+   case PIPE_PRIM_LINE_STRIP:
+      /* (p, p + 1) */
+      for (i = 0; i < 2; i++) {
+         layout->step[i] = 1;
+         layout->base[i] = i;
+      }
+      return count >= 2 ? count - 1 : 0;
+
+   case PIPE_PRIM_TRIANGLES:
+      /* (3p, 3p + 1, 3p + 2) */
+      for (i = 0; i < 3; i++) {
+         layout->step[i] = 3;
+         layout->base[i] = i;
+      }
+      return count / 3;
+
+   case PIPE_PRIM_TRIANGLE_STRIP:
+      /* (p, p + 1, p + 2), with odd triangles flipped */
+      for (i = 0; i < 3; i++) {
+         layout->step[i] = 1;
+         layout->base[i] = i;
+      }
+      if (last_vertex_last) {
+         /* (p + 1, p, p + 2) */
+         layout->odd[0] = 1;
+         layout->odd[1] = -1;
+      }
+      else {
+         /* (p, p + 2, p + 1) */
+         layout->odd[1] = 1;
+         layout->odd[2] = -1;
+      }
+      return count >= 3 ? count - 2 : 0;
+
+   case PIPE_PRIM_TRIANGLE_FAN:
+      if (last_vertex_last) {
+         /* (0, p + 1, p + 2) */
+         layout->step[1] = layout->step[2] = 1;
+         layout->base[1] = 1;
+         layout->base[2] = 2;
+      }
+      else {
+         /* (p + 1, p + 2, 0) */
+         layout->step[0] = layout->step[1] = 1;
+         layout->base[0] = 1;
+         layout->base[1] = 2;
+      }
+      return count >= 3 ? count - 2 : 0;
+
+   default:
+      return -1;
+   }
+}
+
+
+/**
+ * Emit a run of primitives which need no clipping, or send a run of
+ * primitives which do down the pipeline.
+ *
+ * \param pipeline_used  set when a run is sent down the pipeline, and
+ *                       cleared once the pipeline has been flushed
+ */
+static void
+llvm_pipeline_clip_run(struct llvm_middle_end *fpme,
+                       const struct draw_vertex_info *vert_info,
+                       unsigned prim,
+                       ushort *elts,
+                       unsigned count,
+                       boolean clip,
+                       boolean *pipeline_used)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_vertex_info run_vert_info;
+   struct draw_prim_info prim_info;
+   unsigned min_index = ~0u, max_index = 0;
+   unsigned i;
+
+   prim_info.linear = FALSE;
+   prim_info.start = 0;
+   prim_info.count = count;
+   prim_info.elts = elts;
+   prim_info.prim = prim;
+   prim_info.flags = 0;
+   prim_info.primitive_count = 1;
+   prim_info.primitive_lengths = &count;
+
+   if (clip) {
+      draw_pipeline_run(draw, vert_info, &prim_info);
+      *pipeline_used = TRUE;
+      return;
+   }
+
+   /* draw_pt_emit() flushes the pipeline, but as it isn't running any
+    * more, the vertex ids it left in the vertex headers must be reset
+    * explicitly for the next run to use them.  Only needed if an earlier
+    * run of these vertices went down the pipeline.
     */
-   fetch_info = NULL;
-   vert_info = &llvm_vert_info;
+   if (*pipeline_used) {
+      draw->pipeline.verts = (char *) vert_info->verts;
+      draw->pipeline.vertex_stride = vert_info->stride;
+      draw->pipeline.vertex_count = vert_info->count;
+      draw_do_flush(draw, DRAW_FLUSH_BACKEND);
+      draw->pipeline.verts = NULL;
+      draw->pipeline.vertex_count = 0;
+      *pipeline_used = FALSE;
+   }
+
+   /* only emit the vertices the run uses */
+   for (i = 0; i < count; i++) {
+      min_index = MIN2(min_index, elts[i]);
+      max_index = MAX2(max_index, elts[i]);
+   }
+   for (i = 0; i < count; i++)
+      elts[i] -= min_index;
+
+   run_vert_info = *vert_info;
+   run_vert_info.verts = (struct vertex_header *)
+      ((char *) vert_info->verts + min_index * vert_info->stride);
+   run_vert_info.count = max_index - min_index + 1;
+
+   draw_pt_emit(fpme->emit, &run_vert_info, &prim_info);
+}
+
+
+/**
+ * Run the pipeline on the primitives which need clipping only, and emit
+ * the others directly.
+ *
+ * When clipping is the only reason for running the pipeline, most
+ * primitives are usually entirely inside the clip volume, and sending them
+ * down the pipeline one at a time is a waste.  The lines or triangles are
+ * assembled into a list and classified DRAW_LLVM_CLIP_PRIMS at a time by
+ * generated code.  Runs of accepted primitives are then emitted, and runs
+ * of primitives needing clipping go through the pipeline, in order.  The
+ * clipping itself is still done by draw_pipe_clip.c.
+ *
+ * \return FALSE if the primitives must go through the pipeline as usual
+ */
+static boolean
+llvm_pipeline_clip(struct llvm_middle_end *fpme,
+                   const struct draw_vertex_info *vert_info,
+                   const struct draw_prim_info *prim_info)
+{
+   struct draw_context *draw = fpme->draw;
+   const unsigned reduced_prim = u_reduced_prim(prim_info->prim);
+   const unsigned verts_per_prim =
+      reduced_prim == PIPE_PRIM_TRIANGLES ? 3 : 2;
+   const unsigned max_index = vert_info->count - 1;
+   draw_jit_clip_prims_func clip_prims_linear, clip_prims_indexed;
+   struct draw_clip_prims_layout layout;
+   unsigned max_prims, num_prims;
+   unsigned i, start, out, run_start, run_code;
+   boolean pipeline_used = FALSE;
+
+   /* edge flags are only honoured by the pipeline */
+   if (reduced_prim == PIPE_PRIM_POINTS || draw->vs.edgeflag_output)
+      return FALSE;
+
+   clip_prims_indexed = draw_llvm_get_clip_prims(fpme->llvm, verts_per_prim,
+                                                 TRUE);
+   if (!clip_prims_indexed)
+      return FALSE;
+   clip_prims_linear = draw_llvm_get_clip_prims(fpme->llvm, verts_per_prim,
+                                                FALSE);
+
+   /* line loops add a line per primitive */
+   max_prims = prim_info->count + prim_info->primitive_count;
+   if (max_prims > fpme->clip.max_prims) {
+      FREE(fpme->clip.elts);
+      FREE(fpme->clip.codes);
+      fpme->clip.elts = MALLOC(max_prims * 3 * sizeof(ushort));
+      fpme->clip.codes = MALLOC(max_prims + DRAW_LLVM_CLIP_PRIMS);
+      fpme->clip.max_prims = max_prims;
+      if (!fpme->clip.elts || !fpme->clip.codes) {
+         fpme->clip.max_prims = 0;
+         return FALSE;
+      }
+   }
+
+   num_prims = 0;
+   for (start = i = 0;
+        i < prim_info->primitive_count;
+        start += prim_info->primitive_lengths[i], i++) {
+      ushort *elts = fpme->clip.elts + num_prims * verts_per_prim;
+      ubyte *codes = fpme->clip.codes + num_prims;
+      int count;
+
+      count = llvm_clip_prims_layout(draw, prim_info->prim,
+                                     prim_info->primitive_lengths[i],
+                                     &layout);
+      if (count > 0) {
+         if (prim_info->linear)
+            clip_prims_linear(vert_info->verts, vert_info->stride,
+                              NULL, start, max_index, &layout,
+                              count, elts, codes);
+         else
+            clip_prims_indexed(vert_info->verts, vert_info->stride,
+                               prim_info->elts, start, max_index, &layout,
+                               count, elts, codes);
+      }
+      else if (count < 0) {
+         /* assemble the list here, and only classify it */
+         unsigned num_elts = 0;
+
+         llvm_assemble_prims(draw,
+                             prim_info->prim,
+                             prim_info->flags,
+                             vert_info->verts,
+                             prim_info->linear ? NULL : prim_info->elts + start,
+                             start,
+                             prim_info->primitive_lengths[i],
+                             max_index,
+                             elts,
+                             &num_elts);
+
+         count = llvm_clip_prims_layout(draw, reduced_prim, num_elts,
+                                        &layout);
+         if (count > 0)
+            clip_prims_indexed(vert_info->verts, vert_info->stride,
+                               elts, 0, max_index, &layout,
+                               count, elts, codes);
+      }
+
+      num_prims += count;
+   }
+
+   if (!num_prims)
+      return TRUE;
+
+   /* drop the rejected primitives, and split the others into runs */
+   out = run_start = 0;
+   run_code = DRAW_CLIP_PRIM_REJECT;
+   for (i = 0; i < num_prims; i++) {
+      const unsigned code = fpme->clip.codes[i];
+
+      if (code == DRAW_CLIP_PRIM_REJECT)
+         continue;
+
+      if (code != run_code && out > run_start) {
+         llvm_pipeline_clip_run(fpme, vert_info, reduced_prim,
+                                fpme->clip.elts + run_start,
+                                out - run_start,
+                                run_code == DRAW_CLIP_PRIM_CLIP,
+                                &pipeline_used);
+         run_start = out;
+      }
+      run_code = code;
+
+      memmove(fpme->clip.elts + out,
+              fpme->clip.elts + i * verts_per_prim,
+              verts_per_prim * sizeof(ushort));
+      out += verts_per_prim;
+   }
+
+   if (out > run_start) {
+      llvm_pipeline_clip_run(fpme, vert_info, reduced_prim,
+                             fpme->clip.elts + run_start,
+                             out - run_start,
+                             run_code == DRAW_CLIP_PRIM_CLIP,
+                             &pipeline_used);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Run the rest of the pipeline on the shaded vertices: geometry shader,
+ * stream output, clipping and emit.  Always runs on the draw thread, in
+ * draw order.  Frees the vertices.
+ */
+static void
+llvm_pipeline_end(struct llvm_middle_end *fpme,
+                  struct draw_vertex_info *llvm_vert_info,
+                  const struct draw_prim_info *in_prim_info,
+                  unsigned clipped)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
+   struct draw_prim_info gs_prim_info;
+   struct draw_vertex_info gs_vert_info;
+   struct draw_vertex_info *vert_info;
+   struct draw_prim_info ia_prim_info;
+   struct draw_vertex_info ia_vert_info;
+   const struct draw_prim_info *prim_info = in_prim_info;
+   boolean free_prim_info = FALSE;
+   unsigned opt = fpme->opt;
+
+   vert_info = llvm_vert_info;
 
    if ((opt & PT_SHADE) && gshader) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
@@ -461,7 +987,10 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       /* Do we need to run the pipeline? Now will come here if clipped
        */
       if (opt & PT_PIPELINE) {
-         pipeline( fpme, vert_info, prim_info );
+         /* only the clipped primitives need it, if nothing else does */
+         if ((fpme->opt & PT_PIPELINE) ||
+             !llvm_pipeline_clip(fpme, vert_info, prim_info))
+            pipeline( fpme, vert_info, prim_info );
       }
       else {
          emit( fpme->emit, vert_info, prim_info );
@@ -474,6 +1003,318 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 }
 
 
+static void
+llvm_vcache_unlink(struct llvm_vcache *vcache, int e)
+{
+   int *link = &vcache->buckets[llvm_vcache_bucket(vcache,
+                                                    vcache->entries[e].elt)];
+
+   while (*link != e) {
+      assert(*link >= 0);
+      link = &vcache->entries[*link].next;
+   }
+   *link = vcache->entries[e].next;
+}
+
+
+/**
+ * Look the fetch elements of a segment up in the vertex cache.
+ *
+ * Only the misses are left in seg->fetch_info to be shaded; each of them
+ * replaces the oldest cache entry.  The hits are recorded in
+ * seg->hit_slots[] and placed after the misses, and the draw elements are
+ * remapped to match.
+ */
+static void
+llvm_vcache_lookup(struct llvm_middle_end *fpme,
+                   struct llvm_segment *seg,
+                   const struct draw_fetch_info *fetch_info,
+                   const struct draw_prim_info *prim_info)
+{
+   struct llvm_vcache *vcache = &fpme->vcache;
+   unsigned num_misses = 0, num_hits = 0;
+   unsigned i;
+
+   vcache->segment++;
+
+   for (i = 0; i < fetch_info->count; i++) {
+      const unsigned elt = fetch_info->elts[i];
+      const unsigned bucket = llvm_vcache_bucket(vcache, elt);
+      struct llvm_vcache_entry *entry;
+      int e;
+
+      for (e = vcache->buckets[bucket]; e >= 0; e = vcache->entries[e].next) {
+         if (vcache->entries[e].elt == elt)
+            break;
+      }
+
+      if (e >= 0) {
+         entry = &vcache->entries[e];
+         if (entry->segment == vcache->segment) {
+            /* already shaded by this segment */
+            vcache->remap[i] = entry->pos;
+         }
+         else {
+            vcache->remap[i] = LLVM_VCACHE_HIT | num_hits;
+            seg->hit_slots[num_hits++] = e;
+         }
+         continue;
+      }
+
+      e = vcache->next;
+      vcache->next = (e + 1) & (vcache->size - 1);
+      if ((unsigned) e < vcache->num_valid)
+         llvm_vcache_unlink(vcache, e);
+      else
+         vcache->num_valid++;
+
+      entry = &vcache->entries[e];
+      entry->elt = elt;
+      entry->segment = vcache->segment;
+      entry->pos = num_misses;
+      entry->next = vcache->buckets[bucket];
+      vcache->buckets[bucket] = e;
+
+      vcache->remap[i] = num_misses;
+      seg->fetch_elts[num_misses] = elt;
+      seg->miss_slots[num_misses++] = e;
+   }
+
+   for (i = 0; i < prim_info->count; i++) {
+      unsigned v = vcache->remap[prim_info->elts[i]];
+
+      if (v & LLVM_VCACHE_HIT)
+         v = num_misses + (v & ~LLVM_VCACHE_HIT);
+      seg->draw_elts[i] = v;
+   }
+
+   seg->fetch_info.count = num_misses;
+   seg->num_hits = num_hits;
+}
+
+
+/**
+ * Copy the cache hits of a segment in, and its shaded vertices out.
+ * Runs when the segment ends, so all the earlier segments have stored
+ * their vertices already.
+ */
+static void
+llvm_vcache_update(struct llvm_middle_end *fpme, struct llvm_segment *seg)
+{
+   struct llvm_vcache *vcache = &fpme->vcache;
+   const unsigned vertex_size = fpme->vertex_size;
+   const unsigned num_misses = seg->fetch_info.count;
+   ubyte *verts = (ubyte *) seg->vert_info.verts;
+   unsigned i;
+
+   for (i = 0; i < seg->num_hits; i++) {
+      struct vertex_header *v = (struct vertex_header *)
+         (verts + (num_misses + i) * vertex_size);
+
+      memcpy(v, vcache->vertices + seg->hit_slots[i] * vertex_size,
+             vertex_size);
+
+      /* what the shader would have returned for the vertex */
+      if (v->clipmask || !v->edgeflag)
+         seg->clipped = 1;
+   }
+
+   for (i = 0; i < num_misses; i++) {
+      memcpy(vcache->vertices + seg->miss_slots[i] * vertex_size,
+             verts + i * vertex_size, vertex_size);
+   }
+}
+
+
+/**
+ * Set up a segment for shading: copy or remap the front end's elements,
+ * which it reuses for the next segment, and allocate the vertices.
+ */
+static boolean
+llvm_segment_begin(struct llvm_middle_end *fpme,
+                   struct llvm_segment *seg,
+                   const struct draw_fetch_info *fetch_info,
+                   const struct draw_prim_info *prim_info)
+{
+   struct llvm_vcache *vcache = &fpme->vcache;
+   const boolean cached = vcache->max_vertex_size && !fetch_info->linear;
+
+   if (!fetch_info->linear && fetch_info->count > seg->max_fetch_elts) {
+      FREE(seg->fetch_elts);
+      FREE(seg->hit_slots);
+      FREE(seg->miss_slots);
+      seg->fetch_elts = MALLOC(fetch_info->count * sizeof(unsigned));
+      seg->hit_slots = MALLOC(fetch_info->count * sizeof(unsigned));
+      seg->miss_slots = MALLOC(fetch_info->count * sizeof(unsigned));
+      seg->max_fetch_elts = fetch_info->count;
+      if (!seg->fetch_elts || !seg->hit_slots || !seg->miss_slots)
+         seg->max_fetch_elts = 0;
+   }
+   if (!prim_info->linear && prim_info->count > seg->max_draw_elts) {
+      FREE(seg->draw_elts);
+      seg->draw_elts = MALLOC(prim_info->count * sizeof(ushort));
+      seg->max_draw_elts = seg->draw_elts ? prim_info->count : 0;
+   }
+   if (cached && fetch_info->count > vcache->max_remap) {
+      FREE(vcache->remap);
+      vcache->remap = MALLOC(fetch_info->count * sizeof(unsigned));
+      vcache->max_remap = vcache->remap ? fetch_info->count : 0;
+   }
+   if ((!fetch_info->linear && !seg->max_fetch_elts) ||
+       (!prim_info->linear && !seg->max_draw_elts) ||
+       (cached && !vcache->max_remap)) {
+      assert(0);
+      return FALSE;
+   }
+
+   seg->fetch_info = *fetch_info;
+   seg->num_hits = 0;
+   if (!fetch_info->linear)
+      seg->fetch_info.elts = seg->fetch_elts;
+
+   assert(prim_info->primitive_count == 1);
+   seg->prim_info = *prim_info;
+   seg->prim_length = prim_info->primitive_lengths[0];
+   seg->prim_info.primitive_lengths = &seg->prim_length;
+   if (!prim_info->linear)
+      seg->prim_info.elts = seg->draw_elts;
+
+   if (cached) {
+      llvm_vcache_lookup(fpme, seg, fetch_info, prim_info);
+   }
+   else {
+      if (!fetch_info->linear)
+         memcpy(seg->fetch_elts, fetch_info->elts,
+                fetch_info->count * sizeof(unsigned));
+      if (!prim_info->linear)
+         memcpy(seg->draw_elts, prim_info->elts,
+                prim_info->count * sizeof(ushort));
+   }
+   seg->cached = cached;
+
+   return llvm_pipeline_begin(fpme, &seg->fetch_info, &seg->prim_info,
+                              seg->num_hits, &seg->vert_info);
+}
+
+
+static void
+llvm_segment_execute(void *data, int thread_index)
+{
+   struct llvm_segment *seg = (struct llvm_segment *) data;
+
+   /* everything may have come from the vertex cache */
+   if (!seg->fetch_info.count) {
+      seg->clipped = 0;
+      return;
+   }
+
+   seg->clipped = llvm_pipeline_shade(seg->fpme, &seg->fetch_info,
+                                      &seg->vert_info);
+}
+
+
+static void
+llvm_segment_end(struct llvm_middle_end *fpme, struct llvm_segment *seg)
+{
+   if (seg->cached)
+      llvm_vcache_update(fpme, seg);
+
+   llvm_pipeline_end(fpme, &seg->vert_info, &seg->prim_info, seg->clipped);
+}
+
+
+/**
+ * Wait for the oldest queued segment and finish it.
+ */
+static void
+llvm_pipeline_end_segment(struct llvm_middle_end *fpme)
+{
+   struct llvm_segment *seg = &fpme->segments[fpme->first_segment];
+
+   assert(fpme->num_segments);
+
+   util_queue_job_wait(&seg->fence);
+
+   llvm_segment_end(fpme, seg);
+
+   fpme->first_segment = (fpme->first_segment + 1) % LLVM_MAX_QUEUED_SEGMENTS;
+   fpme->num_segments--;
+}
+
+
+/**
+ * Hand the vertex shading of a segment to the worker threads.
+ *
+ * The fetch and draw elements are copied, since the front end reuses its
+ * buffers for the next segment, but everything else (vertex buffers,
+ * index buffer, instance id, ...) is only guaranteed to stay put until
+ * the end of the draw call, when the front end calls
+ * llvm_middle_end_flush().
+ */
+static void
+llvm_pipeline_queue(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    const struct draw_prim_info *prim_info)
+{
+   struct llvm_segment *seg;
+
+   if (fpme->num_segments == LLVM_MAX_QUEUED_SEGMENTS)
+      llvm_pipeline_end_segment(fpme);
+
+   seg = &fpme->segments[(fpme->first_segment + fpme->num_segments) %
+                         LLVM_MAX_QUEUED_SEGMENTS];
+
+   if (!llvm_segment_begin(fpme, seg, fetch_info, prim_info))
+      return;
+
+   fpme->num_segments++;
+
+   util_queue_add_job(&fpme->queue, seg, &seg->fence,
+                      llvm_segment_execute, NULL);
+}
+
+
+static void
+llvm_pipeline_generic(struct draw_pt_middle_end *middle,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_vertex_info vert_info;
+   unsigned clipped;
+
+   fpme->draw->num_unique_indices += fetch_info->count;
+
+   /* Only worth the synchronization for big enough segments */
+   if (fpme->num_threads &&
+       fetch_info->count >= LLVM_MIN_QUEUED_VERTICES) {
+      llvm_pipeline_queue(fpme, fetch_info, prim_info);
+      return;
+   }
+
+   /* keep the segments in order */
+   while (fpme->num_segments)
+      llvm_pipeline_end_segment(fpme);
+
+   if (fpme->vcache.max_vertex_size && !fetch_info->linear) {
+      struct llvm_segment *seg = &fpme->segment;
+
+      if (llvm_segment_begin(fpme, seg, fetch_info, prim_info)) {
+         llvm_segment_execute(seg, 0);
+         llvm_segment_end(fpme, seg);
+      }
+      return;
+   }
+
+   if (!llvm_pipeline_begin(fpme, fetch_info, prim_info, 0, &vert_info))
+      return;
+
+   clipped = llvm_pipeline_shade(fpme, fetch_info, &vert_info);
+
+   llvm_pipeline_end(fpme, &vert_info, prim_info, clipped);
+}
+
+
 static inline unsigned
 prim_type(unsigned prim, unsigned flags)
 {
@@ -574,10 +1415,36 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 }
 
 
+/**
+ * Finish all the segments still queued, at the end of a draw.
+ */
+static void
+llvm_middle_end_flush(struct draw_pt_middle_end *middle)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+
+   while (fpme->num_segments)
+      llvm_pipeline_end_segment(fpme);
+
+   llvm_vcache_reset(&fpme->vcache);
+}
+
+
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_middle_end_flush(middle);
+}
+
+
+static void
+llvm_segment_destroy(struct llvm_segment *seg)
+{
+   util_queue_fence_destroy(&seg->fence);
+   FREE(seg->fetch_elts);
+   FREE(seg->hit_slots);
+   FREE(seg->miss_slots);
+   FREE(seg->draw_elts);
 }
 
 
@@ -585,6 +1452,24 @@ static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   unsigned i;
+
+   if (util_queue_is_initialized(&fpme->queue)) {
+      llvm_middle_end_flush(middle);
+      util_queue_destroy(&fpme->queue);
+   }
+
+   for (i = 0; i < LLVM_MAX_QUEUED_SEGMENTS; i++)
+      llvm_segment_destroy(&fpme->segments[i]);
+   llvm_segment_destroy(&fpme->segment);
+
+   FREE(fpme->clip.elts);
+   FREE(fpme->clip.codes);
+
+   FREE(fpme->vcache.entries);
+   FREE(fpme->vcache.buckets);
+   FREE(fpme->vcache.vertices);
+   FREE(fpme->vcache.remap);
 
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
@@ -606,6 +1491,7 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned i;
 
    if (!draw->llvm)
       return NULL;
@@ -614,11 +1500,19 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    if (!fpme)
       goto fail;
 
+   for (i = 0; i < LLVM_MAX_QUEUED_SEGMENTS; i++) {
+      fpme->segments[i].fpme = fpme;
+      util_queue_fence_init(&fpme->segments[i].fence);
+   }
+   fpme->segment.fpme = fpme;
+   util_queue_fence_init(&fpme->segment.fence);
+
    fpme->base.prepare         = llvm_middle_end_prepare;
    fpme->base.bind_parameters = llvm_middle_end_bind_parameters;
    fpme->base.run             = llvm_middle_end_run;
    fpme->base.run_linear      = llvm_middle_end_linear_run;
    fpme->base.run_linear_elts = llvm_middle_end_linear_run_elts;
+   fpme->base.flush           = llvm_middle_end_flush;
    fpme->base.finish          = llvm_middle_end_finish;
    fpme->base.destroy         = llvm_middle_end_destroy;
 
@@ -646,6 +1540,28 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* optional multithreaded vertex shading */
+   fpme->num_threads = MIN2(debug_get_option_draw_threads(),
+                            DRAW_MAX_THREADS);
+   if (fpme->num_threads &&
+       !util_queue_init(&fpme->queue, "drawvs", LLVM_MAX_QUEUED_SEGMENTS,
+                        fpme->num_threads))
+      fpme->num_threads = 0;
+
+   /* optional post-transform vertex cache, the storage is allocated by
+    * llvm_middle_end_prepare() once the vertex size is known
+    */
+   fpme->vcache.size = debug_get_option_draw_vcache_size();
+   if (fpme->vcache.size) {
+      fpme->vcache.size = util_next_power_of_two(fpme->vcache.size);
+      fpme->vcache.entries = MALLOC(fpme->vcache.size *
+                                    sizeof(struct llvm_vcache_entry));
+      fpme->vcache.buckets = MALLOC(fpme->vcache.size * sizeof(int));
+      if (!fpme->vcache.entries || !fpme->vcache.buckets)
+         goto fail;
+      memset(fpme->vcache.buckets, 0xff, fpme->vcache.size * sizeof(int));
+   }
+
    return &fpme->base;
 
  fail:
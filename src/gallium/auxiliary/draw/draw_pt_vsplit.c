@@ -44,6 +44,10 @@ struct vsplit_frontend {
 
    struct draw_pt_middle_end *middle;
 
+   /** One of the vsplit_run_x functions, for the index size */
+   void (*run)(struct draw_pt_front_end *frontend,
+               unsigned start, unsigned count);
+
    unsigned max_vertices;
    ushort segment_size;
 
@@ -231,6 +235,23 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
 #include "draw_pt_vsplit_tmp.h"
 
 
+/**
+ * Split the primitive into segments and pass them to the middle end.
+ */
+static void vsplit_run(struct draw_pt_front_end *frontend,
+                       unsigned start,
+                       unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   vsplit->run(frontend, start, count);
+
+   /* the middle end may still be working on the segments */
+   if (vsplit->middle->flush)
+      vsplit->middle->flush(vsplit->middle);
+}
+
+
 static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned in_prim,
                            struct draw_pt_middle_end *middle,
@@ -240,16 +261,16 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
 
    switch (vsplit->draw->pt.user.eltSize) {
    case 0:
-      vsplit->base.run = vsplit_run_linear;
+      vsplit->run = vsplit_run_linear;
       break;
    case 1:
-      vsplit->base.run = vsplit_run_ubyte;
+      vsplit->run = vsplit_run_ubyte;
       break;
    case 2:
-      vsplit->base.run = vsplit_run_ushort;
+      vsplit->run = vsplit_run_ushort;
       break;
    case 4:
-      vsplit->base.run = vsplit_run_uint;
+      vsplit->run = vsplit_run_uint;
       break;
    default:
       assert(0);
@@ -292,7 +313,7 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
       return NULL;
 
    vsplit->base.prepare = vsplit_prepare;
-   vsplit->base.run     = NULL;
+   vsplit->base.run     = vsplit_run;
    vsplit->base.flush   = vsplit_flush;
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
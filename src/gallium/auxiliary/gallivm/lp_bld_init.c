@@ -32,6 +32,8 @@
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
 #include "os/os_time.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
@@ -145,7 +147,19 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMSetDataLayout(gallivm->module, "");
 #endif
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   return TRUE;
+}
+
+
+/**
+ * Install the optimization passes.  This is deferred until the module is
+ * compiled, as the caller may have asked for a fast compile meanwhile.
+ */
+static void
+add_optimization_passes(struct gallivm_state *gallivm)
+{
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 &&
+       !gallivm->fast_compile) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -165,8 +179,6 @@ create_pass_manager(struct gallivm_state *gallivm)
        */
       LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
    }
-
-   return TRUE;
 }
 
 
@@ -188,6 +200,13 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   if (gallivm->cache) {
+      /* The cache belongs to the caller and won't outlive this call. */
+      lp_free_objcache(gallivm->cache->jit_obj_cache);
+      gallivm->cache->jit_obj_cache = NULL;
+      gallivm->cache = NULL;
+   }
+
    FREE(gallivm->module_name);
 
    if (!USE_MCJIT) {
@@ -236,7 +255,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) || gallivm->fast_compile) {
          optlevel = None;
       }
       else {
@@ -249,6 +268,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     USE_MCJIT,
+                                                    gallivm->cache,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -444,6 +464,19 @@ lp_build_init(void)
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   /* 512-bit vectors are only used on request: they come with lower clocks
+    * on current CPUs, so they pay off only for heavy shaders.  Older LLVM
+    * versions don't generate usable AVX-512 code.
+    */
+   if (lp_native_vector_width > 256) {
+#if HAVE_LLVM >= 0x0307
+      if (util_cpu_caps.has_avx512f)
+         lp_native_vector_width = 512;
+      else
+#endif
+         lp_native_vector_width = util_cpu_caps.has_avx ? 256 : 128;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -564,27 +597,33 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   /* Run optimization passes */
-   LLVMInitializeFunctionPassManager(gallivm->passmgr);
-   func = LLVMGetFirstFunction(gallivm->module);
-   while (func) {
-      if (0) {
-         debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
-      }
+   /*
+    * Run optimization passes, unless the object code was found in a cache,
+    * in which case the IR is only needed for looking up the functions.
+    */
+   if (!gallivm->cache || !gallivm->cache->data_size) {
+      add_optimization_passes(gallivm);
+      LLVMInitializeFunctionPassManager(gallivm->passmgr);
+      func = LLVMGetFirstFunction(gallivm->module);
+      while (func) {
+         if (0) {
+            debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
+         }
 
-   /* Disable frame pointer omission on debug/profile builds */
-   /* XXX: And workaround http://llvm.org/PR21435 */
+      /* Disable frame pointer omission on debug/profile builds */
+      /* XXX: And workaround http://llvm.org/PR21435 */
 #if HAVE_LLVM >= 0x0307 && \
-    (defined(DEBUG) || defined(PROFILE) || \
-     defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
-      LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim", "true");
-      LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
+       (defined(DEBUG) || defined(PROFILE) || \
+        defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
+         LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim", "true");
+         LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
 #endif
 
-      LLVMRunFunctionPassManager(gallivm->passmgr, func);
-      func = LLVMGetNextFunction(func);
+         LLVMRunFunctionPassManager(gallivm->passmgr, func);
+         func = LLVMGetNextFunction(func);
+      }
+      LLVMFinalizeFunctionPassManager(gallivm->passmgr);
    }
-   LLVMFinalizeFunctionPassManager(gallivm->passmgr);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
       int64_t time_end = os_time_get();
@@ -664,3 +703,41 @@ gallivm_jit_function(struct gallivm_state *gallivm,
 
    return jit_func;
 }
+
+
+/**
+ * Feed everything besides the IR itself which affects the generated code
+ * into \p ctx: the build of this library, the LLVM version, the CPU
+ * features in use and the debug flags.
+ *
+ * \return FALSE if the build can't be identified, in which case object
+ * code keyed on this hash must not be persisted.
+ */
+boolean
+gallivm_hash_codegen_state(struct mesa_sha1 *ctx)
+{
+#ifdef ENABLE_SHADER_CACHE
+   uint32_t mesa_timestamp;
+   unsigned llvm_version = HAVE_LLVM;
+   unsigned llvm_patch = MESA_LLVM_VERSION_PATCH;
+   unsigned use_mcjit = USE_MCJIT;
+   unsigned debug_flags = gallivm_debug;
+
+   if (!disk_cache_get_function_timestamp(gallivm_hash_codegen_state,
+                                          &mesa_timestamp))
+      return FALSE;
+
+   _mesa_sha1_update(ctx, &mesa_timestamp, sizeof mesa_timestamp);
+   _mesa_sha1_update(ctx, &llvm_version, sizeof llvm_version);
+   _mesa_sha1_update(ctx, &llvm_patch, sizeof llvm_patch);
+   _mesa_sha1_update(ctx, &use_mcjit, sizeof use_mcjit);
+   _mesa_sha1_update(ctx, &debug_flags, sizeof debug_flags);
+   _mesa_sha1_update(ctx, &lp_native_vector_width,
+                     sizeof lp_native_vector_width);
+   _mesa_sha1_update(ctx, &util_cpu_caps, sizeof util_cpu_caps);
+
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
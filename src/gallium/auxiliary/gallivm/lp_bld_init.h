@@ -39,6 +39,29 @@
 extern "C" {
 #endif
 
+struct mesa_sha1;
+
+
+/**
+ * Object code of a module, as handed to or produced by the JIT.
+ *
+ * When data_size is non-zero on entry to gallivm_compile_module() the
+ * optimization passes and code generation are skipped and the object code
+ * is loaded instead.  Otherwise, with MCJIT, data/data_size receive the
+ * freshly generated object code so that the caller can store it.
+ */
+struct lp_cached_code
+{
+   void *data;
+   size_t data_size;
+   /* Set when the IR embeds host addresses, which are only valid within
+    * the current process, so the object code must not be reused.
+    */
+   boolean dont_cache;
+   void *jit_obj_cache;
+};
+
+
 struct gallivm_state
 {
    char *module_name;
@@ -50,6 +73,13 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_cached_code *cache;
+   /**
+    * Skip most IR optimization passes and generate code at the lowest
+    * optimization level, for code which is only needed until a better
+    * version is ready.  Must be set before gallivm_compile_module().
+    */
+   boolean fast_compile;
    unsigned compiled;
 };
 
@@ -78,6 +108,9 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+boolean
+gallivm_hash_codegen_state(struct mesa_sha1 *ctx);
+
 #ifdef __cplusplus
 }
 #endif
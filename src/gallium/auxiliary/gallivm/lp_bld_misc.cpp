@@ -49,6 +49,8 @@
 
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Workaround http://llvm.org/PR23628
 #if HAVE_LLVM >= 0x0307
@@ -70,6 +72,8 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -97,8 +101,12 @@
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 
+#include "lp_bld_init.h"
 #include "lp_bld_misc.h"
 
+/* Declared in lp_bld_type.h, which is not meant for C++ consumption. */
+extern "C" unsigned lp_native_vector_width;
+
 namespace {
 
 class LLVMEnsureMultithreaded {
@@ -455,6 +463,47 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
+/**
+ * MCJIT object cache bridging to a struct lp_cached_code.
+ *
+ * MCJIT asks getObject() before generating code for a module, and reports
+ * freshly generated object code through notifyObjectCompiled().  There is
+ * only ever one module per engine, so the module identity is not checked.
+ */
+class LPObjectCache : public llvm::ObjectCache {
+private:
+   struct lp_cached_code *cache_out;
+
+public:
+   LPObjectCache(struct lp_cached_code *cache) : cache_out(cache) {}
+
+   virtual void notifyObjectCompiled(const llvm::Module *M,
+                                     llvm::MemoryBufferRef Obj) {
+      const size_t size = Obj.getBufferSize();
+
+      free(cache_out->data);
+      cache_out->data = malloc(size);
+      cache_out->data_size = cache_out->data ? size : 0;
+      if (cache_out->data)
+         memcpy(cache_out->data, Obj.getBufferStart(), size);
+   }
+
+   virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+      if (!cache_out->data_size)
+         return nullptr;
+
+      /* MCJIT keeps the buffer around for as long as the engine lives,
+       * which may be longer than the caller's copy.
+       */
+      return llvm::MemoryBuffer::getMemBufferCopy(
+                llvm::StringRef((const char *)cache_out->data,
+                                cache_out->data_size));
+   }
+};
+#endif
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -473,6 +522,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cached_code *cache,
                                         char **OutError)
 {
    using namespace llvm;
@@ -580,19 +630,33 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MAttrs.push_back("-fma");
    }
    MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
-   /* disable avx512 and all subvariants */
+   /*
+    * Only enable avx512 when we actually use 512-bit vectors, as
+    * otherwise llvm may still pick zmm registers for wide ops.  The Xeon
+    * Phi specific subvariants are never used.
+    */
 #if HAVE_LLVM >= 0x0304
    MAttrs.push_back("-avx512cd");
    MAttrs.push_back("-avx512er");
-   MAttrs.push_back("-avx512f");
    MAttrs.push_back("-avx512pf");
 #endif
+#if HAVE_LLVM >= 0x0307
+   {
+      bool avx512 = util_cpu_caps.has_avx512f && lp_native_vector_width > 256;
+      MAttrs.push_back(avx512 ? "+avx512f" : "-avx512f");
+      MAttrs.push_back(avx512 && util_cpu_caps.has_avx512bw ? "+avx512bw" : "-avx512bw");
+      MAttrs.push_back(avx512 && util_cpu_caps.has_avx512dq ? "+avx512dq" : "-avx512dq");
+      MAttrs.push_back(avx512 && util_cpu_caps.has_avx512vl ? "+avx512vl" : "-avx512vl");
+   }
+#elif HAVE_LLVM >= 0x0304
+   MAttrs.push_back("-avx512f");
 #if HAVE_LLVM >= 0x0305
    MAttrs.push_back("-avx512bw");
    MAttrs.push_back("-avx512dq");
    MAttrs.push_back("-avx512vl");
 #endif
 #endif
+#endif
 
 #if defined(PIPE_ARCH_PPC)
    MAttrs.push_back(util_cpu_caps.has_altivec ? "+altivec" : "-altivec");
@@ -660,6 +724,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (cache && useMCJIT) {
+         LPObjectCache *objcache = new LPObjectCache(cache);
+         cache->jit_obj_cache = (void *)objcache;
+         JIT->setObjectCache(objcache);
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -678,6 +749,16 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+extern "C"
+void
+lp_free_objcache(void *objcache_ptr)
+{
+#if HAVE_LLVM >= 0x0306
+   LPObjectCache *objcache = (LPObjectCache *)objcache_ptr;
+   delete objcache;
+#endif
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -708,3 +789,33 @@ lp_add_attr_dereferenceable(LLVMValueRef val, uint64_t bytes)
    A->addAttr(llvm::AttributeSet::get(A->getContext(), A->getArgNo() + 1,  B));
 #endif
 }
+
+
+/**
+ * Atomic compare and exchange, returning the original value.
+ *
+ * LLVMBuildAtomicCmpXchg is only available in recent LLVM versions, and the
+ * result of the instruction changed in 3.5.
+ */
+extern "C"
+LLVMValueRef
+lp_build_atomic_cmpxchg(LLVMBuilderRef builder,
+                        LLVMValueRef ptr,
+                        LLVMValueRef cmp,
+                        LLVMValueRef val)
+{
+   llvm::IRBuilder<> *b = llvm::unwrap(builder);
+#if HAVE_LLVM >= 0x0305
+   llvm::Value *res =
+      b->CreateAtomicCmpXchg(llvm::unwrap(ptr), llvm::unwrap(cmp),
+                             llvm::unwrap(val),
+                             llvm::AtomicOrdering::SequentiallyConsistent,
+                             llvm::AtomicOrdering::SequentiallyConsistent);
+   return llvm::wrap(b->CreateExtractValue(res, 0));
+#else
+   return llvm::wrap(b->CreateAtomicCmpXchg(llvm::unwrap(ptr),
+                                            llvm::unwrap(cmp),
+                                            llvm::unwrap(val),
+                                            llvm::SequentiallyConsistent));
+#endif
+}
@@ -41,6 +41,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_cached_code;
 
 extern void
 gallivm_init_llvm_targets(void);
@@ -62,8 +63,12 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cached_code *cache,
                                         char **OutError);
 
+extern void
+lp_free_objcache(void *objcache);
+
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
@@ -76,6 +81,12 @@ lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 extern void
 lp_add_attr_dereferenceable(LLVMValueRef val, uint64_t bytes);
 
+extern LLVMValueRef
+lp_build_atomic_cmpxchg(LLVMBuilderRef builder,
+                        LLVMValueRef ptr,
+                        LLVMValueRef cmp,
+                        LLVMValueRef val);
+
 #ifdef __cplusplus
 }
 #endif
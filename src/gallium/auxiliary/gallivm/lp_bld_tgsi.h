@@ -67,6 +67,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_cs_iface;
 
 
 enum lp_build_tex_modifier {
@@ -170,6 +171,11 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+   /* compute shaders: thread_id is a vector, the others are scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef grid_size[3];
+   LLVMValueRef block_size[3];
 };
 
 
@@ -230,7 +236,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface);
 
 
 void
@@ -425,6 +432,24 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Compute shader interface.  The shader buffers and the shared memory are
+ * accessed through the pointers below; the driver implements the barrier.
+ */
+struct lp_build_tgsi_cs_iface
+{
+   /** uint32_t *[LP_MAX_TGSI_SHADER_BUFFERS] */
+   LLVMValueRef ssbo_ptr;
+   /** uint32_t [LP_MAX_TGSI_SHADER_BUFFERS], sizes in bytes */
+   LLVMValueRef ssbo_sizes_ptr;
+   /** Workgroup shared memory (uint32_t *) and its size in bytes */
+   LLVMValueRef shared_ptr;
+   LLVMValueRef shared_size;
+
+   void (*emit_barrier)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                        struct lp_build_tgsi_context * bld_base);
+};
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -438,6 +463,8 @@ struct lp_build_tgsi_soa_context
    LLVMValueRef emitted_vertices_vec_ptr;
    LLVMValueRef max_output_vertices_vec;
 
+   const struct lp_build_tgsi_cs_iface *cs_iface;
+
    LLVMValueRef consts_ptr;
    LLVMValueRef const_sizes_ptr;
    LLVMValueRef consts[LP_MAX_TGSI_CONST_BUFFERS];
@@ -65,6 +65,7 @@
 #include "lp_bld_printf.h"
 #include "lp_bld_sample.h"
 #include "lp_bld_struct.h"
+#include "lp_bld_misc.h"
 
 /* SM 4.0 says that subroutines can nest 32 deep and 
  * we need one more for our main function */
@@ -1672,6 +1673,33 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ? lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                                    bld->system_values.block_id[swizzle]) :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ? lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                                    bld->system_values.grid_size[swizzle]) :
+                          bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ? lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                                    bld->system_values.block_size[swizzle]) :
+                          bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -3020,6 +3048,12 @@ lp_emit_declaration_soa(
    }
       break;
 
+   case TGSI_FILE_MEMORY:
+      /* only workgroup shared memory is supported */
+      assert(bld->cs_iface);
+      assert(decl->Declaration.MemType == TGSI_MEMORY_TYPE_SHARED);
+      break;
+
    default:
       /* don't need to declare other vars */
       break;
@@ -3533,6 +3567,287 @@ end_primitive(
    }
 }
 
+/**
+ * Return the base pointer and the size in bytes of the shader buffer or
+ * shared memory operand of a LOAD, STORE, RESQ or ATOM* instruction.
+ */
+static void
+get_memory_ptr(struct lp_build_tgsi_soa_context *bld,
+               unsigned file, unsigned index,
+               LLVMValueRef *ptr, LLVMValueRef *size)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   const struct lp_build_tgsi_cs_iface *cs_iface = bld->cs_iface;
+
+   if (file == TGSI_FILE_MEMORY) {
+      *ptr = cs_iface->shared_ptr;
+      *size = cs_iface->shared_size;
+   }
+   else {
+      LLVMValueRef idx = lp_build_const_int32(gallivm, index);
+
+      assert(file == TGSI_FILE_BUFFER);
+      assert(index < LP_MAX_TGSI_SHADER_BUFFERS);
+      *ptr = lp_build_array_get(gallivm, cs_iface->ssbo_ptr, idx);
+      *size = lp_build_array_get(gallivm, cs_iface->ssbo_sizes_ptr, idx);
+   }
+}
+
+/**
+ * Return the mask of the active lanes whose dword index lies within
+ * a buffer of the given size in bytes.
+ */
+static LLVMValueRef
+memory_bounds_mask(struct lp_build_tgsi_context *bld_base,
+                   LLVMValueRef index,
+                   LLVMValueRef size)
+{
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef num_dwords;
+
+   num_dwords = LLVMBuildLShr(builder, size, lp_build_const_int32(gallivm, 2), "");
+   num_dwords = lp_build_broadcast_scalar(uint_bld, num_dwords);
+
+   return LLVMBuildAnd(builder,
+                       lp_build_cmp(uint_bld, PIPE_FUNC_LESS, index, num_dwords),
+                       mask_vec(bld_base), "");
+}
+
+/**
+ * Per-element load, store or atomic operation on the dwords at the given
+ * indexes, skipping the elements which are not enabled in pred.
+ *
+ * Returns the loaded (or, for atomics, the original) values.
+ */
+static LLVMValueRef
+emit_memory_op(struct lp_build_tgsi_soa_context *bld,
+               unsigned opcode,
+               LLVMValueRef base_ptr,
+               LLVMValueRef indexes,
+               LLVMValueRef values,
+               LLVMValueRef cmp_values,
+               LLVMValueRef pred)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld->bld_base.uint_bld;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMValueRef res_ptr;
+   unsigned i;
+
+   res_ptr = lp_build_alloca(gallivm, uint_bld->vec_type, "");
+
+   for (i = 0; i < uint_bld->type.length; i++) {
+      LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+      LLVMValueRef cond, index, scalar_ptr, val, res;
+      struct lp_build_if_state ifthen;
+
+      cond = LLVMBuildExtractElement(builder, pred, ii, "");
+      cond = LLVMBuildICmp(builder, LLVMIntNE, cond,
+                           LLVMConstNull(int32_type), "");
+      lp_build_if(&ifthen, gallivm, cond);
+
+      index = LLVMBuildExtractElement(builder, indexes, ii, "");
+      scalar_ptr = LLVMBuildGEP(builder, base_ptr, &index, 1, "");
+      val = values ? LLVMBuildBitCast(builder,
+                        LLVMBuildExtractElement(builder, values, ii, ""),
+                        int32_type, "") : NULL;
+
+      switch (opcode) {
+      case TGSI_OPCODE_LOAD:
+         res = LLVMBuildLoad(builder, scalar_ptr, "");
+         break;
+      case TGSI_OPCODE_STORE:
+         LLVMBuildStore(builder, val, scalar_ptr);
+         res = NULL;
+         break;
+      case TGSI_OPCODE_ATOMCAS:
+         res = lp_build_atomic_cmpxchg(builder, scalar_ptr,
+                  LLVMBuildBitCast(builder,
+                     LLVMBuildExtractElement(builder, cmp_values, ii, ""),
+                     int32_type, ""),
+                  val);
+         break;
+      default:
+      {
+         LLVMAtomicRMWBinOp op;
+
+         switch (opcode) {
+         case TGSI_OPCODE_ATOMUADD: op = LLVMAtomicRMWBinOpAdd; break;
+         case TGSI_OPCODE_ATOMXCHG: op = LLVMAtomicRMWBinOpXchg; break;
+         case TGSI_OPCODE_ATOMAND:  op = LLVMAtomicRMWBinOpAnd; break;
+         case TGSI_OPCODE_ATOMOR:   op = LLVMAtomicRMWBinOpOr; break;
+         case TGSI_OPCODE_ATOMXOR:  op = LLVMAtomicRMWBinOpXor; break;
+         case TGSI_OPCODE_ATOMUMIN: op = LLVMAtomicRMWBinOpUMin; break;
+         case TGSI_OPCODE_ATOMUMAX: op = LLVMAtomicRMWBinOpUMax; break;
+         case TGSI_OPCODE_ATOMIMIN: op = LLVMAtomicRMWBinOpMin; break;
+         case TGSI_OPCODE_ATOMIMAX: op = LLVMAtomicRMWBinOpMax; break;
+         default:
+            assert(0);
+            op = LLVMAtomicRMWBinOpAdd;
+            break;
+         }
+         res = LLVMBuildAtomicRMW(builder, op, scalar_ptr, val,
+                                  LLVMAtomicOrderingSequentiallyConsistent,
+                                  FALSE);
+         break;
+      }
+      }
+
+      if (res) {
+         LLVMValueRef res_vec = LLVMBuildLoad(builder, res_ptr, "");
+         res_vec = LLVMBuildInsertElement(builder, res_vec, res, ii, "");
+         LLVMBuildStore(builder, res_vec, res_ptr);
+      }
+
+      lp_build_endif(&ifthen);
+   }
+
+   return LLVMBuildLoad(builder, res_ptr, "");
+}
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef base_ptr, size, index;
+   unsigned chan;
+
+   get_memory_ptr(bld, inst->Src[0].Register.File, inst->Src[0].Register.Index,
+                  &base_ptr, &size);
+
+   /* the address is in bytes, and the data is always dword aligned */
+   index = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   index = lp_build_shr_imm(uint_bld, index, 2);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef chan_index =
+         lp_build_add(uint_bld, index,
+                      lp_build_const_int_vec(bld_base->base.gallivm,
+                                             uint_bld->type, chan));
+
+      emit_data->output[chan] =
+         emit_memory_op(bld, TGSI_OPCODE_LOAD, base_ptr, chan_index,
+                        NULL, NULL,
+                        memory_bounds_mask(bld_base, chan_index, size));
+   }
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef base_ptr, size, index;
+   unsigned chan;
+
+   get_memory_ptr(bld, inst->Dst[0].Register.File, inst->Dst[0].Register.Index,
+                  &base_ptr, &size);
+
+   index = lp_build_emit_fetch(bld_base, inst, 0, TGSI_CHAN_X);
+   index = lp_build_shr_imm(uint_bld, index, 2);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef chan_index =
+         lp_build_add(uint_bld, index,
+                      lp_build_const_int_vec(bld_base->base.gallivm,
+                                             uint_bld->type, chan));
+      LLVMValueRef value = lp_build_emit_fetch(bld_base, inst, 1, chan);
+
+      emit_memory_op(bld, TGSI_OPCODE_STORE, base_ptr, chan_index,
+                     value, NULL,
+                     memory_bounds_mask(bld_base, chan_index, size));
+   }
+}
+
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const unsigned opcode = inst->Instruction.Opcode;
+   LLVMValueRef base_ptr, size, index, value, cmp_value = NULL, res;
+   unsigned chan;
+
+   get_memory_ptr(bld, inst->Src[0].Register.File, inst->Src[0].Register.Index,
+                  &base_ptr, &size);
+
+   index = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   index = lp_build_shr_imm(uint_bld, index, 2);
+
+   if (opcode == TGSI_OPCODE_ATOMCAS) {
+      cmp_value = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+      value = lp_build_emit_fetch(bld_base, inst, 3, TGSI_CHAN_X);
+   }
+   else {
+      value = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+   }
+
+   res = emit_memory_op(bld, opcode, base_ptr, index, value, cmp_value,
+                        memory_bounds_mask(bld_base, index, size));
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = res;
+   }
+}
+
+static void
+resq_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef base_ptr, size;
+   unsigned chan;
+
+   get_memory_ptr(bld, inst->Src[0].Register.File, inst->Src[0].Register.Index,
+                  &base_ptr, &size);
+   size = lp_build_broadcast_scalar(&bld_base->uint_bld, size);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = size;
+   }
+}
+
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   bld->cs_iface->emit_barrier(bld->cs_iface, bld_base);
+}
+
+static void
+membar_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   /* All memory operations are done in program order, and the atomics are
+    * sequentially consistent, so there is nothing to do.
+    */
+}
+
 static void
 cal_emit(
    const struct lp_build_tgsi_action * action,
@@ -3878,7 +4193,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -4019,6 +4335,25 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                                 max_output_vertices);
    }
 
+   if (cs_iface) {
+      bld.cs_iface = cs_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_RESQ].emit = resq_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MEMBAR].emit = membar_emit;
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.int_bld);
 
    bld.system_values = *system_values;
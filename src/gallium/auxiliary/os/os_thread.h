@@ -96,6 +96,27 @@ static inline void pipe_thread_setname( const char *name )
    (void)name;
 }
 
+/**
+ * Restrict the calling thread to run on the given CPU only.
+ * \return FALSE if not supported on this platform or if the call failed.
+ */
+static inline boolean pipe_thread_set_cpu_affinity( unsigned cpu )
+{
+#if defined(HAVE_PTHREAD) && defined(PIPE_OS_LINUX) && defined(CPU_SET)
+   cpu_set_t cpuset;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&cpuset);
+   CPU_SET(cpu, &cpuset);
+   return pthread_setaffinity_np(pthread_self(), sizeof cpuset, &cpuset) == 0;
+#else
+   (void)cpu;
+   return FALSE;
+#endif
+}
+
 
 /* pipe_mutex
  */
@@ -51,6 +51,11 @@ int rtasm_cpu_has_sse2(void)
    return !debug_get_option_nosse() && get_cpu_caps()->has_sse2;
 }
 
+int rtasm_cpu_has_avx2(void)
+{
+   return !debug_get_option_nosse() && get_cpu_caps()->has_avx2;
+}
+
 
 #else
 
@@ -64,4 +69,9 @@ int rtasm_cpu_has_sse2(void)
    return 0;
 }
 
+int rtasm_cpu_has_avx2(void)
+{
+   return 0;
+}
+
 #endif
@@ -38,5 +38,7 @@ int rtasm_cpu_has_sse(void);
 
 int rtasm_cpu_has_sse2(void);
 
+int rtasm_cpu_has_avx2(void);
+
 
 #endif /* _RTASM_CPU_H_ */
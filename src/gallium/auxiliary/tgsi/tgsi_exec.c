@@ -58,6 +58,8 @@
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi_exec.h"
+#include "tgsi_exec_simd.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_half.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
@@ -845,6 +847,10 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
 }
 
 
+static void
+decode_instructions(struct tgsi_exec_machine *mach);
+
+
 /**
  * Initialize machine state by expanding tokens to full instructions,
  * allocating temporary storage, setting up constants, etc.
@@ -887,6 +893,9 @@ tgsi_exec_machine_bind_shader(
       mach->Instructions = NULL;
       mach->NumInstructions = 0;
 
+      FREE(mach->Ops);
+      mach->Ops = NULL;
+
       return;
    }
 
@@ -1033,6 +1042,8 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   decode_instructions(mach);
 }
 
 
@@ -1048,6 +1059,9 @@ tgsi_exec_machine_create(enum pipe_shader_type shader_type)
 
    memset(mach, 0, sizeof(*mach));
 
+   /* for the ISA selection in decode_instructions() */
+   util_cpu_detect();
+
    mach->ShaderType = shader_type;
    mach->Addrs = &mach->Temps[TGSI_EXEC_TEMP_ADDR];
    mach->MaxGeometryShaderOutputs = TGSI_MAX_TOTAL_VERTICES;
@@ -1097,6 +1111,7 @@ tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
       FREE(mach->Instructions);
+      FREE(mach->Ops);
       FREE(mach->Declarations);
 
       align_free(mach->Inputs);
@@ -5806,6 +5821,544 @@ exec_instruction(
    return FALSE;
 }
 
+
+/*
+ * Pre-decoded instructions.
+ *
+ * tgsi_exec_machine_bind_shader() translates the instructions into an
+ * array of tgsi_exec_op, each holding the function which executes it, so
+ * that tgsi_exec_machine_run() jumps straight to it instead of going
+ * through the opcode switch of exec_instruction() for every instruction
+ * of every quad.  The common arithmetic instructions whose operands are
+ * plain registers also get their register pointers resolved up front,
+ * rather than going through fetch_source() and store_dest() for each
+ * channel.  All the other instructions still run exec_instruction().
+ *
+ * Where the CPU supports it, the componentwise instructions which read
+ * and write whole unswizzled registers are further computed a register at
+ * a time, see tgsi_exec_simd.h.
+ */
+
+enum tgsi_exec_op_src_kind {
+   TGSI_EXEC_OP_SRC_REGISTER,    /**< temporary or input */
+   TGSI_EXEC_OP_SRC_IMMEDIATE,   /**< scalars broadcast to the quad */
+   TGSI_EXEC_OP_SRC_CONSTANT
+};
+
+struct tgsi_exec_op;
+
+typedef boolean (*tgsi_exec_op_func)(struct tgsi_exec_machine *mach,
+                                     const struct tgsi_exec_op *op,
+                                     int *pc);
+
+struct tgsi_exec_op_src {
+   enum tgsi_exec_op_src_kind kind;
+   const struct tgsi_exec_vector *reg;
+   const float *imm;
+   unsigned buffer;
+   int index;
+   unsigned swizzle[TGSI_NUM_CHANNELS];
+   boolean abs;
+   boolean neg;
+};
+
+struct tgsi_exec_op {
+   tgsi_exec_op_func func;
+   const struct tgsi_full_instruction *inst;
+
+   union {
+      micro_unary_op unary;
+      micro_binary_op binary;
+      micro_trinary_op trinary;
+   } micro;
+
+   unsigned writemask;
+   boolean saturate;
+   unsigned dst_file;
+   unsigned dst_index;
+   struct tgsi_exec_vector *dst_temp;
+
+   struct tgsi_exec_op_src src[3];
+
+   /* wide path, and the handler to use when some pixels are masked off */
+   tgsi_exec_simd_func simd;
+   tgsi_exec_op_func simd_fallback;
+   const float *simd_src[3];
+};
+
+
+static inline const union tgsi_exec_channel *
+fetch_op_src(const struct tgsi_exec_machine *mach,
+             const struct tgsi_exec_op_src *src,
+             uint chan,
+             union tgsi_exec_channel *tmp)
+{
+   const uint swizzle = src->swizzle[chan];
+   const union tgsi_exec_channel *val = tmp;
+
+   switch (src->kind) {
+   case TGSI_EXEC_OP_SRC_REGISTER:
+      val = &src->reg->xyzw[swizzle];
+      break;
+   case TGSI_EXEC_OP_SRC_IMMEDIATE:
+      tmp->f[0] = tmp->f[1] = tmp->f[2] = tmp->f[3] = src->imm[swizzle];
+      break;
+   case TGSI_EXEC_OP_SRC_CONSTANT:
+      {
+         const int pos = src->index * 4 + swizzle;
+         uint value = 0;
+
+         /* const buffer bounds check, as in fetch_src_file_channel() */
+         if (pos < (int) mach->ConstsSize[src->buffer])
+            value = ((const uint *) mach->Consts[src->buffer])[pos];
+         tmp->u[0] = tmp->u[1] = tmp->u[2] = tmp->u[3] = value;
+      }
+      break;
+   }
+
+   if (src->abs) {
+      micro_abs(tmp, val);
+      val = tmp;
+   }
+   if (src->neg) {
+      micro_neg(tmp, val);
+      val = tmp;
+   }
+
+   return val;
+}
+
+
+static inline void
+store_op_dst(struct tgsi_exec_machine *mach,
+             const struct tgsi_exec_op *op,
+             uint chan,
+             const union tgsi_exec_channel *val)
+{
+   const uint execmask = mach->ExecMask;
+   union tgsi_exec_channel *dst;
+   uint i;
+
+   if (op->dst_temp) {
+      dst = &op->dst_temp->xyzw[chan];
+   }
+   else {
+      const uint index = mach->Temps[TEMP_OUTPUT_I].xyzw[TEMP_OUTPUT_C].u[0]
+         + op->dst_index;
+      dst = &mach->Outputs[index].xyzw[chan];
+   }
+
+   if (op->saturate) {
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i))
+            dst->f[i] = CLAMP(val->f[i], 0.0f, 1.0f);
+   }
+   else if (execmask == 0xf) {
+      *dst = *val;
+   }
+   else {
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i))
+            dst->i[i] = val->i[i];
+   }
+}
+
+
+static boolean
+exec_op_instruction(struct tgsi_exec_machine *mach,
+                    const struct tgsi_exec_op *op,
+                    int *pc)
+{
+   return exec_instruction(mach, op->inst, pc);
+}
+
+
+static boolean
+exec_op_unary(struct tgsi_exec_machine *mach,
+              const struct tgsi_exec_op *op,
+              int *pc)
+{
+   struct tgsi_exec_vector dst;
+   union tgsi_exec_channel tmp;
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         op->micro.unary(&dst.xyzw[chan],
+                         fetch_op_src(mach, &op->src[0], chan, &tmp));
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         store_op_dst(mach, op, chan, &dst.xyzw[chan]);
+   }
+
+   (*pc)++;
+   return FALSE;
+}
+
+
+static boolean
+exec_op_binary(struct tgsi_exec_machine *mach,
+               const struct tgsi_exec_op *op,
+               int *pc)
+{
+   struct tgsi_exec_vector dst;
+   union tgsi_exec_channel tmp[2];
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         op->micro.binary(&dst.xyzw[chan],
+                          fetch_op_src(mach, &op->src[0], chan, &tmp[0]),
+                          fetch_op_src(mach, &op->src[1], chan, &tmp[1]));
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         store_op_dst(mach, op, chan, &dst.xyzw[chan]);
+   }
+
+   (*pc)++;
+   return FALSE;
+}
+
+
+static boolean
+exec_op_trinary(struct tgsi_exec_machine *mach,
+                const struct tgsi_exec_op *op,
+                int *pc)
+{
+   struct tgsi_exec_vector dst;
+   union tgsi_exec_channel tmp[3];
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         op->micro.trinary(&dst.xyzw[chan],
+                           fetch_op_src(mach, &op->src[0], chan, &tmp[0]),
+                           fetch_op_src(mach, &op->src[1], chan, &tmp[1]),
+                           fetch_op_src(mach, &op->src[2], chan, &tmp[2]));
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         store_op_dst(mach, op, chan, &dst.xyzw[chan]);
+   }
+
+   (*pc)++;
+   return FALSE;
+}
+
+
+static boolean
+exec_op_simd(struct tgsi_exec_machine *mach,
+             const struct tgsi_exec_op *op,
+             int *pc)
+{
+   float *dst;
+
+   if (mach->ExecMask != 0xf)
+      return op->simd_fallback(mach, op, pc);
+
+   if (op->dst_temp) {
+      dst = op->dst_temp->xyzw[0].f;
+   }
+   else {
+      const uint index = mach->Temps[TEMP_OUTPUT_I].xyzw[TEMP_OUTPUT_C].u[0]
+         + op->dst_index;
+      dst = mach->Outputs[index].xyzw[0].f;
+   }
+
+   op->simd(dst, op->simd_src[0], op->simd_src[1], op->simd_src[2]);
+
+   (*pc)++;
+   return FALSE;
+}
+
+
+static inline void
+exec_op_dp(struct tgsi_exec_machine *mach,
+           const struct tgsi_exec_op *op,
+           uint num_chans)
+{
+   union tgsi_exec_channel tmp[2], dot;
+   uint chan;
+
+   micro_mul(&dot,
+             fetch_op_src(mach, &op->src[0], TGSI_CHAN_X, &tmp[0]),
+             fetch_op_src(mach, &op->src[1], TGSI_CHAN_X, &tmp[1]));
+
+   for (chan = TGSI_CHAN_Y; chan < num_chans; chan++) {
+      micro_mad(&dot,
+                fetch_op_src(mach, &op->src[0], chan, &tmp[0]),
+                fetch_op_src(mach, &op->src[1], chan, &tmp[1]),
+                &dot);
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (op->writemask & (1 << chan))
+         store_op_dst(mach, op, chan, &dot);
+   }
+}
+
+
+static boolean
+exec_op_dp3(struct tgsi_exec_machine *mach,
+            const struct tgsi_exec_op *op,
+            int *pc)
+{
+   exec_op_dp(mach, op, 3);
+   (*pc)++;
+   return FALSE;
+}
+
+
+static boolean
+exec_op_dp4(struct tgsi_exec_machine *mach,
+            const struct tgsi_exec_op *op,
+            int *pc)
+{
+   exec_op_dp(mach, op, 4);
+   (*pc)++;
+   return FALSE;
+}
+
+
+static boolean
+decode_op_src(const struct tgsi_exec_machine *mach,
+              const struct tgsi_full_src_register *reg,
+              struct tgsi_exec_op_src *src)
+{
+   const int index = reg->Register.Index;
+
+   if (reg->Register.Indirect)
+      return FALSE;
+
+   if (reg->Register.Dimension &&
+       (reg->Register.File != TGSI_FILE_CONSTANT ||
+        reg->Dimension.Indirect))
+      return FALSE;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (index < 0 || index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      src->kind = TGSI_EXEC_OP_SRC_REGISTER;
+      src->reg = &mach->Temps[index];
+      break;
+   case TGSI_FILE_INPUT:
+      if (index < 0 || index >= PIPE_MAX_SHADER_INPUTS || !mach->Inputs)
+         return FALSE;
+      src->kind = TGSI_EXEC_OP_SRC_REGISTER;
+      src->reg = &mach->Inputs[index];
+      break;
+   case TGSI_FILE_IMMEDIATE:
+      if (index < 0 || index >= (int) mach->ImmLimit)
+         return FALSE;
+      src->kind = TGSI_EXEC_OP_SRC_IMMEDIATE;
+      src->imm = mach->Imms[index];
+      break;
+   case TGSI_FILE_CONSTANT:
+      src->kind = TGSI_EXEC_OP_SRC_CONSTANT;
+      src->buffer = reg->Register.Dimension ? reg->Dimension.Index : 0;
+      src->index = index;
+      if (index < 0 || src->buffer >= PIPE_MAX_CONSTANT_BUFFERS)
+         return FALSE;
+      break;
+   default:
+      return FALSE;
+   }
+
+   src->swizzle[0] = reg->Register.SwizzleX;
+   src->swizzle[1] = reg->Register.SwizzleY;
+   src->swizzle[2] = reg->Register.SwizzleZ;
+   src->swizzle[3] = reg->Register.SwizzleW;
+   src->abs = reg->Register.Absolute;
+   src->neg = reg->Register.Negate;
+
+   return TRUE;
+}
+
+
+/**
+ * Try to resolve the operands of an arithmetic instruction.
+ * \return FALSE if the instruction must run exec_instruction()
+ */
+static boolean
+decode_op_operands(struct tgsi_exec_machine *mach,
+                   const struct tgsi_full_instruction *inst,
+                   struct tgsi_exec_op *op)
+{
+   const struct tgsi_full_dst_register *dst = &inst->Dst[0];
+   uint i;
+
+   if (inst->Instruction.Predicate ||
+       inst->Instruction.NumDstRegs != 1 ||
+       inst->Instruction.NumSrcRegs > ARRAY_SIZE(op->src) ||
+       dst->Register.Indirect ||
+       dst->Register.Dimension)
+      return FALSE;
+
+   switch (dst->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (dst->Register.Index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      op->dst_temp = &mach->Temps[dst->Register.Index];
+      break;
+   case TGSI_FILE_OUTPUT:
+      /* the output offset changes as a geometry shader emits vertices */
+      if (!mach->Outputs)
+         return FALSE;
+      op->dst_temp = NULL;
+      break;
+   default:
+      return FALSE;
+   }
+
+   op->dst_file = dst->Register.File;
+   op->dst_index = dst->Register.Index;
+   op->writemask = dst->Register.WriteMask;
+   op->saturate = inst->Instruction.Saturate;
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      if (!decode_op_src(mach, &inst->Src[i], &op->src[i]))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Switch a componentwise instruction over to \p simd if it reads and
+ * writes whole registers without swizzles or modifiers.
+ */
+static void
+decode_op_simd(const struct tgsi_full_instruction *inst,
+               struct tgsi_exec_op *op,
+               tgsi_exec_simd_func simd)
+{
+   uint i, chan;
+
+   if (!simd ||
+       op->writemask != TGSI_WRITEMASK_XYZW ||
+       op->saturate)
+      return;
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      const struct tgsi_exec_op_src *src = &op->src[i];
+
+      if (src->kind != TGSI_EXEC_OP_SRC_REGISTER || src->abs || src->neg)
+         return;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         if (src->swizzle[chan] != chan)
+            return;
+      }
+   }
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++)
+      op->simd_src[i] = op->src[i].reg->xyzw[0].f;
+   op->simd = simd;
+   op->simd_fallback = op->func;
+   op->func = exec_op_simd;
+}
+
+
+static void
+decode_op(struct tgsi_exec_machine *mach,
+          const struct tgsi_full_instruction *inst,
+          const struct tgsi_exec_simd_funcs *simd,
+          struct tgsi_exec_op *op)
+{
+   memset(op, 0, sizeof *op);
+   op->func = exec_op_instruction;
+   op->inst = inst;
+
+   if (!decode_op_operands(mach, inst, op))
+      return;
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_MOV:
+      /* exec_instruction() moves untyped data, with integer modifiers */
+      if (!op->src[0].abs && !op->src[0].neg) {
+         op->func = exec_op_unary;
+         op->micro.unary = micro_mov;
+         decode_op_simd(inst, op, simd ? simd->mov : NULL);
+      }
+      break;
+   case TGSI_OPCODE_ADD:
+      op->func = exec_op_binary;
+      op->micro.binary = micro_add;
+      decode_op_simd(inst, op, simd ? simd->add : NULL);
+      break;
+   case TGSI_OPCODE_SUB:
+      op->func = exec_op_binary;
+      op->micro.binary = micro_sub;
+      decode_op_simd(inst, op, simd ? simd->sub : NULL);
+      break;
+   case TGSI_OPCODE_MUL:
+      op->func = exec_op_binary;
+      op->micro.binary = micro_mul;
+      decode_op_simd(inst, op, simd ? simd->mul : NULL);
+      break;
+   case TGSI_OPCODE_MIN:
+      op->func = exec_op_binary;
+      op->micro.binary = micro_min;
+      decode_op_simd(inst, op, simd ? simd->min : NULL);
+      break;
+   case TGSI_OPCODE_MAX:
+      op->func = exec_op_binary;
+      op->micro.binary = micro_max;
+      decode_op_simd(inst, op, simd ? simd->max : NULL);
+      break;
+   case TGSI_OPCODE_MAD:
+      op->func = exec_op_trinary;
+      op->micro.trinary = micro_mad;
+      decode_op_simd(inst, op, simd ? simd->mad : NULL);
+      break;
+   case TGSI_OPCODE_DP3:
+      op->func = exec_op_dp3;
+      break;
+   case TGSI_OPCODE_DP4:
+      op->func = exec_op_dp4;
+      break;
+   default:
+      break;
+   }
+}
+
+
+/**
+ * Pre-decode the instructions of the bound shader.  On failure
+ * tgsi_exec_machine_run() falls back to exec_instruction().
+ */
+static void
+decode_instructions(struct tgsi_exec_machine *mach)
+{
+   const struct tgsi_exec_simd_funcs *simd = NULL;
+   uint i;
+
+   FREE(mach->Ops);
+   mach->Ops = NULL;
+
+   if (!mach->NumInstructions)
+      return;
+
+   mach->Ops = MALLOC(mach->NumInstructions * sizeof(struct tgsi_exec_op));
+   if (!mach->Ops)
+      return;
+
+#ifdef USE_AVX2
+   if (util_cpu_caps.has_avx2)
+      simd = &tgsi_exec_simd_avx2;
+#endif
+#ifdef USE_AVX512
+   if (util_cpu_caps.has_avx512f)
+      simd = &tgsi_exec_simd_avx512;
+#endif
+
+   for (i = 0; i < mach->NumInstructions; i++)
+      decode_op(mach, &mach->Instructions[i], simd, &mach->Ops[i]);
+}
+
 static void
 tgsi_exec_machine_setup_masks(struct tgsi_exec_machine *mach)
 {
@@ -5884,7 +6437,13 @@ tgsi_exec_machine_run( struct tgsi_exec_machine *mach, int start_pc )
 #endif
 
          assert(mach->pc < (int) mach->NumInstructions);
-         barrier_hit = exec_instruction(mach, mach->Instructions + mach->pc, &mach->pc);
+         if (mach->Ops) {
+            const struct tgsi_exec_op *op = &mach->Ops[mach->pc];
+            barrier_hit = op->func(mach, op, &mach->pc);
+         }
+         else {
+            barrier_hit = exec_instruction(mach, mach->Instructions + mach->pc, &mach->pc);
+         }
 
          /* for compute shaders if we hit a barrier return now for later rescheduling */
          if (barrier_hit && mach->ShaderType == PIPE_SHADER_COMPUTE)
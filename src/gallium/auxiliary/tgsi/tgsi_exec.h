@@ -438,6 +438,9 @@ struct tgsi_exec_machine
    struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
+   /** Pre-decoded Instructions, see tgsi_exec_machine_run() */
+   struct tgsi_exec_op *Ops;
+
    struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
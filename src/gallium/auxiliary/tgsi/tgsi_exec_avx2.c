@@ -0,0 +1,95 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * AVX2 implementation of the wide TGSI instructions: a register is
+ * processed as two 8-lane halves.
+ */
+
+#ifdef USE_AVX2
+
+#include <immintrin.h>
+
+#include "pipe/p_compiler.h"
+
+#include "tgsi_exec_simd.h"
+
+
+#define SIMD_BINARY(name, intrin)                                     \
+static void                                                           \
+simd_##name##_avx2(float *dst, const float *src0, const float *src1,  \
+                   const float *src2)                                 \
+{                                                                     \
+   unsigned i;                                                        \
+   (void) src2;                                                       \
+   for (i = 0; i < TGSI_EXEC_SIMD_WIDTH; i += 8) {                    \
+      _mm256_storeu_ps(dst + i, intrin(_mm256_loadu_ps(src0 + i),     \
+                                       _mm256_loadu_ps(src1 + i)));   \
+   }                                                                  \
+}
+
+/* min/max: like micro_min/micro_max, the second operand wins on NaN */
+SIMD_BINARY(add, _mm256_add_ps)
+SIMD_BINARY(sub, _mm256_sub_ps)
+SIMD_BINARY(mul, _mm256_mul_ps)
+SIMD_BINARY(min, _mm256_min_ps)
+SIMD_BINARY(max, _mm256_max_ps)
+
+
+static void
+simd_mov_avx2(float *dst, const float *src0, const float *src1,
+              const float *src2)
+{
+   unsigned i;
+   (void) src1;
+   (void) src2;
+   for (i = 0; i < TGSI_EXEC_SIMD_WIDTH; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src0 + i));
+}
+
+
+static void
+simd_mad_avx2(float *dst, const float *src0, const float *src1,
+              const float *src2)
+{
+   unsigned i;
+   for (i = 0; i < TGSI_EXEC_SIMD_WIDTH; i += 8) {
+      __m256 prod = _mm256_mul_ps(_mm256_loadu_ps(src0 + i),
+                                  _mm256_loadu_ps(src1 + i));
+      _mm256_storeu_ps(dst + i, _mm256_add_ps(prod,
+                                              _mm256_loadu_ps(src2 + i)));
+   }
+}
+
+
+const struct tgsi_exec_simd_funcs tgsi_exec_simd_avx2 = {
+   simd_mov_avx2,
+   simd_add_avx2,
+   simd_sub_avx2,
+   simd_mul_avx2,
+   simd_min_avx2,
+   simd_max_avx2,
+   simd_mad_avx2
+};
+
+#endif /* USE_AVX2 */
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * AVX-512 implementation of the wide TGSI instructions: a register is
+ * exactly one 16-lane vector.
+ */
+
+#ifdef USE_AVX512
+
+#include <immintrin.h>
+
+#include "pipe/p_compiler.h"
+
+#include "tgsi_exec_simd.h"
+
+
+#define SIMD_BINARY(name, intrin)                                       \
+static void                                                             \
+simd_##name##_avx512(float *dst, const float *src0, const float *src1,  \
+                     const float *src2)                                 \
+{                                                                       \
+   (void) src2;                                                         \
+   _mm512_storeu_ps(dst, intrin(_mm512_loadu_ps(src0),                  \
+                                _mm512_loadu_ps(src1)));                \
+}
+
+/* min/max: like micro_min/micro_max, the second operand wins on NaN */
+SIMD_BINARY(add, _mm512_add_ps)
+SIMD_BINARY(sub, _mm512_sub_ps)
+SIMD_BINARY(mul, _mm512_mul_ps)
+SIMD_BINARY(min, _mm512_min_ps)
+SIMD_BINARY(max, _mm512_max_ps)
+
+
+static void
+simd_mov_avx512(float *dst, const float *src0, const float *src1,
+                const float *src2)
+{
+   (void) src1;
+   (void) src2;
+   _mm512_storeu_ps(dst, _mm512_loadu_ps(src0));
+}
+
+
+static void
+simd_mad_avx512(float *dst, const float *src0, const float *src1,
+                const float *src2)
+{
+   /* The AVX-512 flags also enable FMA.  Use the explicitly rounded forms
+    * so the compiler can't contract this into a fused multiply-add, which
+    * would round differently from micro_mad().
+    */
+   __m512 prod = _mm512_mul_round_ps(_mm512_loadu_ps(src0),
+                                     _mm512_loadu_ps(src1),
+                                     _MM_FROUND_CUR_DIRECTION);
+   _mm512_storeu_ps(dst, _mm512_add_round_ps(prod, _mm512_loadu_ps(src2),
+                                             _MM_FROUND_CUR_DIRECTION));
+}
+
+
+const struct tgsi_exec_simd_funcs tgsi_exec_simd_avx512 = {
+   simd_mov_avx512,
+   simd_add_avx512,
+   simd_sub_avx512,
+   simd_mul_avx512,
+   simd_min_avx512,
+   simd_max_avx512,
+   simd_mad_avx512
+};
+
+#endif /* USE_AVX512 */
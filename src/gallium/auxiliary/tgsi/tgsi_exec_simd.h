@@ -0,0 +1,71 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Wide execution of pre-decoded TGSI instructions.
+ *
+ * A tgsi_exec_vector holds the four channels of a register for the four
+ * pixels of a quad, i.e. TGSI_EXEC_SIMD_WIDTH contiguous floats.  When an
+ * instruction applies the same operation to every channel, uses unswizzled
+ * register operands without modifiers and writes all of xyzw, the whole
+ * register can be computed at once: 8 lanes per step with AVX2, or all 16
+ * with AVX-512.  The implementations are built with the matching compiler
+ * flags and are only selected when util_cpu_caps reports the instruction
+ * set at runtime.
+ */
+
+#ifndef TGSI_EXEC_SIMD_H
+#define TGSI_EXEC_SIMD_H
+
+#include "tgsi_exec.h"
+
+#define TGSI_EXEC_SIMD_WIDTH (TGSI_NUM_CHANNELS * TGSI_QUAD_SIZE)
+
+/**
+ * Compute TGSI_EXEC_SIMD_WIDTH floats of \p dst.  Unused sources are NULL.
+ * \p dst may be the same register as any of the sources.
+ */
+typedef void (*tgsi_exec_simd_func)(float *dst,
+                                    const float *src0,
+                                    const float *src1,
+                                    const float *src2);
+
+struct tgsi_exec_simd_funcs {
+   tgsi_exec_simd_func mov;
+   tgsi_exec_simd_func add;
+   tgsi_exec_simd_func sub;
+   tgsi_exec_simd_func mul;
+   tgsi_exec_simd_func min;
+   tgsi_exec_simd_func max;
+   tgsi_exec_simd_func mad;
+};
+
+#ifdef USE_AVX2
+extern const struct tgsi_exec_simd_funcs tgsi_exec_simd_avx2;
+#endif
+
+#ifdef USE_AVX512
+extern const struct tgsi_exec_simd_funcs tgsi_exec_simd_avx512;
+#endif
+
+#endif /* TGSI_EXEC_SIMD_H */
@@ -32,6 +32,7 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_state.h"
+#include "rtasm/rtasm_cpu.h"
 #include "translate.h"
 
 struct translate *translate_create( const struct translate_key *key )
@@ -39,6 +40,17 @@ struct translate *translate_create( const struct translate_key *key )
    struct translate *translate = NULL;
 
 #if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+#ifdef USE_AVX2
+   /* translate_avx2.c is built with AVX2 enabled, so it can't be entered
+    * at all on other CPUs.
+    */
+   if (rtasm_cpu_has_avx2()) {
+      translate = translate_avx2_create( key );
+      if (translate)
+         return translate;
+   }
+#endif
+
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
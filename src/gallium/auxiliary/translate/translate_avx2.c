@@ -0,0 +1,643 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * AVX2 vertex fetch and convert.
+ *
+ * This file is built with the AVX2 compiler flags, and translate_create()
+ * only tries it when the CPU reports AVX2 support at runtime.
+ *
+ * Vertices are processed 8 at a time: each attribute is gathered for all
+ * 8 vertices at once, converted to float in SoA form (one register per
+ * component), then transposed back and stored to the output vertices.
+ * Only keys where every element has a float output format and one of the
+ * common input formats below are handled; anything else is left to the
+ * SSE and generic translate code.  The results are identical to the
+ * generic path, which uses the same conversions.
+ */
+
+#ifdef USE_AVX2
+
+#include <immintrin.h>
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_cpu_detect.h"
+
+#include "translate.h"
+
+
+/**
+ * Fetch an attribute of 8 vertices and convert it to float, filling in
+ * missing components with (0, 0, 0, 1).  \p off_lo and \p off_hi are the
+ * 64-bit byte offsets of vertices 0-3 and 4-7 from \p ptr.
+ */
+typedef void (*fetch8_func)(const uint8_t *ptr,
+                            __m256i off_lo, __m256i off_hi,
+                            __m256 out[4]);
+
+
+struct translate_avx2 {
+   struct translate translate;
+
+   struct {
+      enum translate_element_type type;
+
+      fetch8_func fetch;
+      unsigned buffer;
+      unsigned input_offset;
+      unsigned instance_divisor;
+
+      unsigned output_offset;
+      unsigned nr_components;   /**< number of float components to store */
+      boolean instance_id_int;  /**< store the instance id as an integer */
+
+      const uint8_t *input_ptr;
+      unsigned input_stride;
+      unsigned max_index;
+   } attrib[TRANSLATE_MAX_ATTRIBS];
+
+   unsigned nr_attrib;
+};
+
+
+static struct translate_avx2 *translate_avx2( struct translate *translate )
+{
+   return (struct translate_avx2 *)translate;
+}
+
+
+/**
+ * Gather one dword per vertex at byte offset \p disp of each vertex.
+ */
+static inline __m256i
+gather8(const uint8_t *ptr, __m256i off_lo, __m256i off_hi, unsigned disp)
+{
+   const int *base = (const int *)(ptr + disp);
+   __m128i lo = _mm256_i64gather_epi32(base, off_lo, 1);
+   __m128i hi = _mm256_i64gather_epi32(base, off_hi, 1);
+
+   return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+
+/**
+ * Convert the low 16 bits of each dword from half to float.
+ */
+static inline __m256
+half8_to_float(__m256i v)
+{
+   /* values are below 0x10000 so the unsigned saturation is a no-op */
+   __m256i packed = _mm256_packus_epi32(v, v);
+
+   packed = _mm256_permute4x64_epi64(packed, 0x08);
+   return _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+}
+
+
+static inline void
+fetch_float32(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+              unsigned nr, __m256 out[4])
+{
+   unsigned i;
+
+   out[1] = _mm256_setzero_ps();
+   out[2] = _mm256_setzero_ps();
+   out[3] = _mm256_set1_ps(1.0f);
+
+   for (i = 0; i < nr; i++)
+      out[i] = _mm256_castsi256_ps(gather8(ptr, off_lo, off_hi, 4 * i));
+}
+
+
+static void
+fetch_r32_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                __m256 out[4])
+{
+   fetch_float32(ptr, off_lo, off_hi, 1, out);
+}
+
+
+static void
+fetch_r32g32_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                   __m256 out[4])
+{
+   fetch_float32(ptr, off_lo, off_hi, 2, out);
+}
+
+
+static void
+fetch_r32g32b32_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                      __m256 out[4])
+{
+   fetch_float32(ptr, off_lo, off_hi, 3, out);
+}
+
+
+static void
+fetch_r32g32b32a32_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                         __m256 out[4])
+{
+   fetch_float32(ptr, off_lo, off_hi, 4, out);
+}
+
+
+static inline void
+fetch_unorm8x4(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+               boolean bgra, __m256 out[4])
+{
+   const __m256i v = gather8(ptr, off_lo, off_hi, 0);
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+   __m256 c[4];
+   unsigned i;
+
+   /* same as ubyte_to_float() */
+   for (i = 0; i < 4; i++) {
+      __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 8 * i), mask);
+      c[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale);
+   }
+
+   out[0] = bgra ? c[2] : c[0];
+   out[1] = c[1];
+   out[2] = bgra ? c[0] : c[2];
+   out[3] = c[3];
+}
+
+
+static void
+fetch_r8g8b8a8_unorm(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                     __m256 out[4])
+{
+   fetch_unorm8x4(ptr, off_lo, off_hi, FALSE, out);
+}
+
+
+static void
+fetch_b8g8r8a8_unorm(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                     __m256 out[4])
+{
+   fetch_unorm8x4(ptr, off_lo, off_hi, TRUE, out);
+}
+
+
+static inline void
+fetch_snorm16(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+              unsigned nr, __m256 out[4])
+{
+   const __m256 scale = _mm256_set1_ps(1.0f / 0x7fff);
+   unsigned i;
+
+   out[2] = _mm256_setzero_ps();
+   out[3] = _mm256_set1_ps(1.0f);
+
+   /* two components per dword, sign extended with arithmetic shifts */
+   for (i = 0; i < nr; i += 2) {
+      __m256i v = gather8(ptr, off_lo, off_hi, 2 * i);
+      __m256i x = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+      __m256i y = _mm256_srai_epi32(v, 16);
+
+      out[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale);
+      out[i + 1] = _mm256_mul_ps(_mm256_cvtepi32_ps(y), scale);
+   }
+}
+
+
+static void
+fetch_r16g16_snorm(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                   __m256 out[4])
+{
+   fetch_snorm16(ptr, off_lo, off_hi, 2, out);
+}
+
+
+static void
+fetch_r16g16b16a16_snorm(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                         __m256 out[4])
+{
+   fetch_snorm16(ptr, off_lo, off_hi, 4, out);
+}
+
+
+static inline void
+fetch_float16(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+              unsigned nr, __m256 out[4])
+{
+   unsigned i;
+
+   out[2] = _mm256_setzero_ps();
+   out[3] = _mm256_set1_ps(1.0f);
+
+   for (i = 0; i < nr; i += 2) {
+      __m256i v = gather8(ptr, off_lo, off_hi, 2 * i);
+
+      out[i] = half8_to_float(_mm256_and_si256(v, _mm256_set1_epi32(0xffff)));
+      out[i + 1] = half8_to_float(_mm256_srli_epi32(v, 16));
+   }
+}
+
+
+static void
+fetch_r16g16_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                   __m256 out[4])
+{
+   fetch_float16(ptr, off_lo, off_hi, 2, out);
+}
+
+
+static void
+fetch_r16g16b16a16_float(const uint8_t *ptr, __m256i off_lo, __m256i off_hi,
+                         __m256 out[4])
+{
+   fetch_float16(ptr, off_lo, off_hi, 4, out);
+}
+
+
+static fetch8_func
+get_fetch8_func(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+      return fetch_r32_float;
+   case PIPE_FORMAT_R32G32_FLOAT:
+      return fetch_r32g32_float;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      return fetch_r32g32b32_float;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return fetch_r32g32b32a32_float;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+      return fetch_r8g8b8a8_unorm;
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+      return fetch_b8g8r8a8_unorm;
+   case PIPE_FORMAT_R16G16_SNORM:
+      return fetch_r16g16_snorm;
+   case PIPE_FORMAT_R16G16B16A16_SNORM:
+      return fetch_r16g16b16a16_snorm;
+   case PIPE_FORMAT_R16G16_FLOAT:
+      return fetch_r16g16_float;
+   case PIPE_FORMAT_R16G16B16A16_FLOAT:
+      return fetch_r16g16b16a16_float;
+   default:
+      return NULL;
+   }
+}
+
+
+static unsigned
+get_nr_float_components(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+      return 1;
+   case PIPE_FORMAT_R32G32_FLOAT:
+      return 2;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      return 3;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+
+static inline boolean
+is_half_format(enum pipe_format format)
+{
+   return format == PIPE_FORMAT_R16G16_FLOAT ||
+          format == PIPE_FORMAT_R16G16B16A16_FLOAT;
+}
+
+
+/**
+ * Store the first \p nr components of 8 vertices, given in SoA form, to
+ * \p count (at most 8) output vertices.
+ */
+static inline void
+store8(uint8_t *dst, unsigned stride, unsigned count,
+       unsigned nr, const __m256 c[4])
+{
+   const __m128i mask = _mm_cmpgt_epi32(_mm_set1_epi32(nr),
+                                        _mm_setr_epi32(0, 1, 2, 3));
+   __m256 t0 = _mm256_unpacklo_ps(c[0], c[1]);
+   __m256 t1 = _mm256_unpackhi_ps(c[0], c[1]);
+   __m256 t2 = _mm256_unpacklo_ps(c[2], c[3]);
+   __m256 t3 = _mm256_unpackhi_ps(c[2], c[3]);
+   __m256 v[4];
+   unsigned i;
+
+   /* v[i] holds vertex i in the low half and vertex i + 4 in the high half */
+   v[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+   v[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+   v[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+   v[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+   for (i = 0; i < count; i++) {
+      __m128 vert = i < 4 ? _mm256_castps256_ps128(v[i]) :
+                            _mm256_extractf128_ps(v[i - 4], 1);
+
+      _mm_maskstore_ps((float *)(dst + i * stride), mask, vert);
+   }
+}
+
+
+/**
+ * Fetch and emit up to 8 vertices with indices \p elts.  Lanes past
+ * \p count must hold valid (e.g. repeated) indices too.
+ */
+static inline void
+avx2_run8(struct translate_avx2 *ta, __m256i elts, unsigned count,
+          unsigned start_instance, unsigned instance_id, uint8_t *vert)
+{
+   const unsigned stride = ta->translate.key.output_stride;
+   unsigned attr;
+
+   for (attr = 0; attr < ta->nr_attrib; attr++) {
+      uint8_t *dst = vert + ta->attrib[attr].output_offset;
+      __m256 c[4];
+
+      if (ta->attrib[attr].type == TRANSLATE_ELEMENT_NORMAL) {
+         __m256i index, off_lo, off_hi, stride64;
+
+         if (ta->attrib[attr].instance_divisor) {
+            index = _mm256_set1_epi32(start_instance +
+                                      instance_id /
+                                      ta->attrib[attr].instance_divisor);
+            /* Not clamped, like in the generic path: max_index bounds
+             * the vertex indices of the draw, not the instanced array.
+             */
+         }
+         else {
+            /* clamp to avoid going out of bounds */
+            index = _mm256_min_epu32(elts, _mm256_set1_epi32(
+                                        ta->attrib[attr].max_index));
+         }
+
+         /* 64-bit offsets, so that large strides and indices cannot
+          * overflow.
+          */
+         stride64 = _mm256_set1_epi64x(ta->attrib[attr].input_stride);
+         off_lo = _mm256_mul_epu32(
+            _mm256_cvtepu32_epi64(_mm256_castsi256_si128(index)), stride64);
+         off_hi = _mm256_mul_epu32(
+            _mm256_cvtepu32_epi64(_mm256_extracti128_si256(index, 1)),
+            stride64);
+
+         ta->attrib[attr].fetch(ta->attrib[attr].input_ptr,
+                                off_lo, off_hi, c);
+      }
+      else {
+         if (ta->attrib[attr].instance_id_int)
+            c[0] = _mm256_castsi256_ps(_mm256_set1_epi32(instance_id));
+         else
+            c[0] = _mm256_set1_ps((float)instance_id);
+         c[1] = c[2] = c[3] = _mm256_setzero_ps();
+      }
+
+      store8(dst, stride, count, ta->attrib[attr].nr_components, c);
+   }
+}
+
+
+static void PIPE_CDECL avx2_run_elts( struct translate *translate,
+                                      const unsigned *elts,
+                                      unsigned count,
+                                      unsigned start_instance,
+                                      unsigned instance_id,
+                                      void *output_buffer )
+{
+   struct translate_avx2 *ta = translate_avx2(translate);
+   const unsigned stride = ta->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      avx2_run8(ta, _mm256_loadu_si256((const __m256i *)(elts + i)), 8,
+                start_instance, instance_id, vert);
+      vert += 8 * stride;
+   }
+
+   if (i < count) {
+      unsigned tail[8], j;
+
+      for (j = 0; j < 8; j++)
+         tail[j] = elts[MIN2(i + j, count - 1)];
+
+      avx2_run8(ta, _mm256_loadu_si256((const __m256i *)tail), count - i,
+                start_instance, instance_id, vert);
+   }
+}
+
+
+static void PIPE_CDECL avx2_run_elts16( struct translate *translate,
+                                        const uint16_t *elts,
+                                        unsigned count,
+                                        unsigned start_instance,
+                                        unsigned instance_id,
+                                        void *output_buffer )
+{
+   struct translate_avx2 *ta = translate_avx2(translate);
+   const unsigned stride = ta->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m128i e = _mm_loadu_si128((const __m128i *)(elts + i));
+
+      avx2_run8(ta, _mm256_cvtepu16_epi32(e), 8,
+                start_instance, instance_id, vert);
+      vert += 8 * stride;
+   }
+
+   if (i < count) {
+      uint16_t tail[8];
+      unsigned j;
+
+      for (j = 0; j < 8; j++)
+         tail[j] = elts[MIN2(i + j, count - 1)];
+
+      avx2_run8(ta, _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)tail)),
+                count - i, start_instance, instance_id, vert);
+   }
+}
+
+
+static void PIPE_CDECL avx2_run_elts8( struct translate *translate,
+                                       const uint8_t *elts,
+                                       unsigned count,
+                                       unsigned start_instance,
+                                       unsigned instance_id,
+                                       void *output_buffer )
+{
+   struct translate_avx2 *ta = translate_avx2(translate);
+   const unsigned stride = ta->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m128i e = _mm_loadl_epi64((const __m128i *)(elts + i));
+
+      avx2_run8(ta, _mm256_cvtepu8_epi32(e), 8,
+                start_instance, instance_id, vert);
+      vert += 8 * stride;
+   }
+
+   if (i < count) {
+      uint8_t tail[8];
+      unsigned j;
+
+      for (j = 0; j < 8; j++)
+         tail[j] = elts[MIN2(i + j, count - 1)];
+
+      avx2_run8(ta, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)tail)),
+                count - i, start_instance, instance_id, vert);
+   }
+}
+
+
+static void PIPE_CDECL avx2_run( struct translate *translate,
+                                 unsigned start,
+                                 unsigned count,
+                                 unsigned start_instance,
+                                 unsigned instance_id,
+                                 void *output_buffer )
+{
+   struct translate_avx2 *ta = translate_avx2(translate);
+   const unsigned stride = ta->translate.key.output_stride;
+   const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   uint8_t *vert = output_buffer;
+   unsigned i;
+
+   for (i = 0; i < count; i += 8) {
+      const unsigned n = MIN2(count - i, 8);
+      __m256i elts = _mm256_add_epi32(_mm256_set1_epi32(start + i), lanes);
+
+      /* repeat the last vertex in the unused lanes */
+      if (n < 8)
+         elts = _mm256_min_epu32(elts, _mm256_set1_epi32(start + count - 1));
+
+      avx2_run8(ta, elts, n, start_instance, instance_id, vert);
+      vert += 8 * stride;
+   }
+}
+
+
+static void avx2_set_buffer( struct translate *translate,
+                             unsigned buf,
+                             const void *ptr,
+                             unsigned stride,
+                             unsigned max_index )
+{
+   struct translate_avx2 *ta = translate_avx2(translate);
+   unsigned i;
+
+   for (i = 0; i < ta->nr_attrib; i++) {
+      if (ta->attrib[i].buffer == buf) {
+         ta->attrib[i].input_ptr = ((const uint8_t *)ptr +
+                                    ta->attrib[i].input_offset);
+         ta->attrib[i].input_stride = stride;
+         ta->attrib[i].max_index = max_index;
+      }
+   }
+}
+
+
+static void avx2_release( struct translate *translate )
+{
+   FREE(translate);
+}
+
+
+/**
+ * Only call this if rtasm_cpu_has_avx2(): the whole file is compiled with
+ * AVX2 enabled.
+ */
+struct translate *translate_avx2_create( const struct translate_key *key )
+{
+   struct translate_avx2 *ta;
+   unsigned i;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   /* Check that all elements are handled before allocating anything */
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+
+      if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (elem->output_format != PIPE_FORMAT_R32_USCALED &&
+             elem->output_format != PIPE_FORMAT_R32_SSCALED &&
+             elem->output_format != PIPE_FORMAT_R32_FLOAT)
+            return NULL;
+         continue;
+      }
+
+      if (!get_fetch8_func(elem->input_format) ||
+          !get_nr_float_components(elem->output_format))
+         return NULL;
+
+      if (is_half_format(elem->input_format) && !util_cpu_caps.has_f16c)
+         return NULL;
+   }
+
+   ta = CALLOC_STRUCT(translate_avx2);
+   if (!ta)
+      return NULL;
+
+   ta->translate.key = *key;
+   ta->translate.release = avx2_release;
+   ta->translate.set_buffer = avx2_set_buffer;
+   ta->translate.run_elts = avx2_run_elts;
+   ta->translate.run_elts16 = avx2_run_elts16;
+   ta->translate.run_elts8 = avx2_run_elts8;
+   ta->translate.run = avx2_run;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+
+      ta->attrib[i].type = elem->type;
+      ta->attrib[i].output_offset = elem->output_offset;
+
+      if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         /* the generic path copies the integer for the scaled formats */
+         ta->attrib[i].nr_components = 1;
+         ta->attrib[i].instance_id_int =
+            elem->output_format != PIPE_FORMAT_R32_FLOAT;
+      }
+      else {
+         ta->attrib[i].fetch = get_fetch8_func(elem->input_format);
+         ta->attrib[i].buffer = elem->input_buffer;
+         ta->attrib[i].input_offset = elem->input_offset;
+         ta->attrib[i].instance_divisor = elem->instance_divisor;
+         ta->attrib[i].nr_components =
+            get_nr_float_components(elem->output_format);
+      }
+   }
+
+   ta->nr_attrib = key->nr_elements;
+
+   return &ta->translate;
+}
+
+#endif /* USE_AVX2 */
@@ -386,6 +386,14 @@ util_cpu_detect(void)
          uint32_t regs7[4];
          cpuid_count(0x00000007, 0x00000000, regs7);
          util_cpu_caps.has_avx2 = (regs7[1] >> 5) & 1;
+
+         /* The OS must also save the opmask and upper ZMM state */
+         if ((xgetbv() & 0xe6) == 0xe6) {
+            util_cpu_caps.has_avx512f  = (regs7[1] >> 16) & 1;
+            util_cpu_caps.has_avx512dq = (regs7[1] >> 17) & 1;
+            util_cpu_caps.has_avx512bw = (regs7[1] >> 30) & 1;
+            util_cpu_caps.has_avx512vl = (regs7[1] >> 31) & 1;
+         }
       }
 
       if (regs[1] == 0x756e6547 && regs[2] == 0x6c65746e && regs[3] == 0x49656e69) {
@@ -448,6 +456,10 @@ util_cpu_detect(void)
       debug_printf("util_cpu_caps.has_sse4_2 = %u\n", util_cpu_caps.has_sse4_2);
       debug_printf("util_cpu_caps.has_avx = %u\n", util_cpu_caps.has_avx);
       debug_printf("util_cpu_caps.has_avx2 = %u\n", util_cpu_caps.has_avx2);
+      debug_printf("util_cpu_caps.has_avx512f = %u\n", util_cpu_caps.has_avx512f);
+      debug_printf("util_cpu_caps.has_avx512dq = %u\n", util_cpu_caps.has_avx512dq);
+      debug_printf("util_cpu_caps.has_avx512bw = %u\n", util_cpu_caps.has_avx512bw);
+      debug_printf("util_cpu_caps.has_avx512vl = %u\n", util_cpu_caps.has_avx512vl);
       debug_printf("util_cpu_caps.has_f16c = %u\n", util_cpu_caps.has_f16c);
       debug_printf("util_cpu_caps.has_popcnt = %u\n", util_cpu_caps.has_popcnt);
       debug_printf("util_cpu_caps.has_3dnow = %u\n", util_cpu_caps.has_3dnow);
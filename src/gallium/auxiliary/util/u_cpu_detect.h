@@ -65,6 +65,10 @@ struct util_cpu_caps {
    unsigned has_popcnt:1;
    unsigned has_avx:1;
    unsigned has_avx2:1;
+   unsigned has_avx512f:1;
+   unsigned has_avx512dq:1;
+   unsigned has_avx512bw:1;
+   unsigned has_avx512vl:1;
    unsigned has_f16c:1;
    unsigned has_fma:1;
    unsigned has_3dnow:1;
@@ -155,7 +155,7 @@ hash_table_find_iter(const struct keymap *map, const void *key,
       item = (struct keymap_item *) cso_hash_iter_data(iter);
       if (!memcmp(item->key, key, map->key_size))
          break;
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    
    return iter;
@@ -25,17 +25,63 @@
  */
 
 #include "u_queue.h"
+#include "u_math.h"
 #include "u_memory.h"
 #include "u_string.h"
 #include "os/os_time.h"
+#include "util/u_atomic.h"
+
+/* The worker running on the current thread, if any. */
+static pipe_tsd util_queue_worker_tsd;
+
+/* A job which waits for the fences it depends on. */
+struct util_queue_pending_job {
+   struct util_queue *queue;
+   struct util_queue_job job;
+   enum util_queue_priority priority;
+   int num_deps; /* unsignalled fences, plus one while it's being added */
+   struct util_queue_fence_waiter *waiters; /* one per dependency */
+};
+
+/* Node in the list of jobs waiting for a fence. */
+struct util_queue_fence_waiter {
+   struct util_queue_fence_waiter *next;
+   struct util_queue_pending_job *pending;
+};
+
+static void
+util_queue_push(struct util_queue *queue, const struct util_queue_job *job,
+                enum util_queue_priority priority);
+
+static void
+util_queue_dependency_done(struct util_queue_pending_job *pending)
+{
+   if (p_atomic_dec_zero(&pending->num_deps)) {
+      util_queue_push(pending->queue, &pending->job, pending->priority);
+      FREE(pending);
+   }
+}
 
 static void
 util_queue_fence_signal(struct util_queue_fence *fence)
 {
+   struct util_queue_fence_waiter *waiter;
+
    pipe_mutex_lock(fence->mutex);
    fence->signalled = true;
+   waiter = fence->waiters;
+   fence->waiters = NULL;
    pipe_condvar_broadcast(fence->cond);
    pipe_mutex_unlock(fence->mutex);
+
+   /* The fence may be reused as soon as it is signalled, so only the
+    * detached list can be looked at from here on.
+    */
+   while (waiter) {
+      struct util_queue_fence_waiter *next = waiter->next;
+      util_queue_dependency_done(waiter->pending);
+      waiter = next;
+   }
 }
 
 void
@@ -47,17 +93,193 @@ util_queue_job_wait(struct util_queue_fence *fence)
    pipe_mutex_unlock(fence->mutex);
 }
 
-struct thread_input {
-   struct util_queue *queue;
-   int thread_index;
-};
+/*
+ * Deques of jobs.
+ */
+
+static bool
+deque_push_back(struct util_queue_deque *dq, const struct util_queue_job *job)
+{
+   if (dq->count == dq->size) {
+      unsigned size = dq->size ? dq->size * 2 : 16;
+      struct util_queue_job *jobs;
+      unsigned i;
+
+      jobs = (struct util_queue_job*)MALLOC(size * sizeof(*jobs));
+      if (!jobs)
+         return false;
+
+      for (i = 0; i < dq->count; i++)
+         jobs[i] = dq->jobs[(dq->head + i) & (dq->size - 1)];
+
+      FREE(dq->jobs);
+      dq->jobs = jobs;
+      dq->size = size;
+      dq->head = 0;
+   }
+
+   dq->jobs[(dq->head + dq->count) & (dq->size - 1)] = *job;
+   dq->count++;
+   return true;
+}
+
+static bool
+deque_pop_front(struct util_queue_deque *dq, struct util_queue_job *job)
+{
+   if (!dq->count)
+      return false;
+
+   *job = dq->jobs[dq->head];
+   dq->head = (dq->head + 1) & (dq->size - 1);
+   dq->count--;
+   return true;
+}
+
+static bool
+deque_pop_back(struct util_queue_deque *dq, struct util_queue_job *job)
+{
+   if (!dq->count)
+      return false;
+
+   dq->count--;
+   *job = dq->jobs[(dq->head + dq->count) & (dq->size - 1)];
+   return true;
+}
+
+static bool
+util_queue_worker_pop(struct util_queue_worker *worker,
+                      enum util_queue_priority priority, bool steal,
+                      struct util_queue_job *job)
+{
+   struct util_queue_deque *dq = &worker->deques[priority];
+   bool found;
+
+   /* Unlocked peek, so that idle threads don't fight over empty deques. */
+   if (!p_atomic_read(&dq->count))
+      return false;
+
+   pipe_mutex_lock(worker->lock);
+   found = steal ? deque_pop_back(dq, job) : deque_pop_front(dq, job);
+   pipe_mutex_unlock(worker->lock);
+   return found;
+}
+
+/**
+ * Take the highest priority job, preferably from the thread's own deques.
+ */
+static bool
+util_queue_get_job(struct util_queue *queue, struct util_queue_worker *self,
+                   struct util_queue_job *job)
+{
+   unsigned num_workers = p_atomic_read(&queue->num_workers);
+   unsigned prio, i;
+
+   for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++) {
+      if (util_queue_worker_pop(self, prio, false, job))
+         goto found;
+
+      for (i = 1; i < num_workers; i++) {
+         struct util_queue_worker *victim =
+            queue->workers[(self->thread_index + i) % num_workers];
+
+         if (util_queue_worker_pop(victim, prio, true, job))
+            goto found;
+      }
+   }
+   return false;
+
+found:
+   p_atomic_dec(&queue->num_queued);
+
+   if (p_atomic_read(&queue->num_space_waiters)) {
+      pipe_mutex_lock(queue->lock);
+      pipe_condvar_broadcast(queue->has_space_cond);
+      pipe_mutex_unlock(queue->lock);
+   }
+   return true;
+}
+
+static void
+util_queue_push(struct util_queue *queue, const struct util_queue_job *job,
+                enum util_queue_priority priority)
+{
+   struct util_queue_worker *self = pipe_tsd_get(&util_queue_worker_tsd);
+   struct util_queue_worker *worker = self;
+   bool pushed;
+
+   /* Jobs added by a thread of the queue stay with it, unless it's going
+    * away. Others are spread over all threads.
+    */
+   if (!worker || worker->queue != queue ||
+       worker->thread_index >= (int)p_atomic_read(&queue->num_threads)) {
+      unsigned i = p_atomic_inc_return(&queue->next_worker);
+      worker = queue->workers[i % MAX2(p_atomic_read(&queue->num_threads), 1)];
+   }
+
+   pipe_mutex_lock(worker->lock);
+   pushed = deque_push_back(&worker->deques[priority], job);
+   pipe_mutex_unlock(worker->lock);
+
+   while (!pushed) {
+      int num_queued = p_atomic_read(&queue->num_queued);
+      unsigned i;
+
+      /* Out of memory. A thread of the queue can't wait, as it may be the
+       * one which has to make space, so it executes the job itself.
+       */
+      if (self && self->queue == queue) {
+         job->execute(job->job, self->thread_index);
+         util_queue_fence_signal(job->fence);
+         if (job->cleanup)
+            job->cleanup(job->job, self->thread_index);
+         return;
+      }
+
+      /* Any other thread waits until a job is taken, which frees a slot in
+       * a deque, and tries again. The deques are preallocated, so a full
+       * one always has jobs to take.
+       */
+      pipe_mutex_lock(queue->lock);
+      p_atomic_inc(&queue->num_space_waiters);
+      if (!queue->kill_threads &&
+          p_atomic_read(&queue->num_queued) >= num_queued)
+         pipe_condvar_wait(queue->has_space_cond, queue->lock);
+      p_atomic_dec(&queue->num_space_waiters);
+      pipe_mutex_unlock(queue->lock);
+
+      if (p_atomic_read(&queue->kill_threads)) {
+         /* as in util_queue_destroy */
+         util_queue_fence_signal(job->fence);
+         return;
+      }
+
+      for (i = 0; i < p_atomic_read(&queue->num_workers) && !pushed; i++) {
+         worker = queue->workers[i];
+         pipe_mutex_lock(worker->lock);
+         pushed = deque_push_back(&worker->deques[priority], job);
+         pipe_mutex_unlock(worker->lock);
+      }
+   }
+
+   /* Only wake up a thread if some are waiting. Together with the atomic
+    * updates in util_queue_thread_func, this can't miss a sleeping thread:
+    * either it sees the new job, or we see it sleeping.
+    */
+   p_atomic_inc(&queue->num_queued);
+   if (p_atomic_read(&queue->num_sleeping)) {
+      pipe_mutex_lock(queue->lock);
+      pipe_condvar_signal(queue->has_queued_cond);
+      pipe_mutex_unlock(queue->lock);
+   }
+}
 
 static PIPE_THREAD_ROUTINE(util_queue_thread_func, input)
 {
-   struct util_queue *queue = ((struct thread_input*)input)->queue;
-   int thread_index = ((struct thread_input*)input)->thread_index;
+   struct util_queue_worker *worker = (struct util_queue_worker*)input;
+   struct util_queue *queue = worker->queue;
+   int thread_index = worker->thread_index;
 
-   FREE(input);
+   pipe_tsd_set(&util_queue_worker_tsd, worker);
 
    if (queue->name) {
       char name[16];
@@ -68,105 +290,172 @@ static PIPE_THREAD_ROUTINE(util_queue_thread_func, input)
    while (1) {
       struct util_queue_job job;
 
-      pipe_mutex_lock(queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
-
-      /* wait if the queue is empty */
-      while (!queue->kill_threads && queue->num_queued == 0)
-         pipe_condvar_wait(queue->has_queued_cond, queue->lock);
-
-      if (queue->kill_threads) {
-         pipe_mutex_unlock(queue->lock);
+      if (p_atomic_read(&queue->kill_threads) ||
+          thread_index >= (int)p_atomic_read(&queue->num_threads))
          break;
-      }
-
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
-
-      queue->num_queued--;
-      pipe_condvar_signal(queue->has_space_cond);
-      pipe_mutex_unlock(queue->lock);
 
-      if (job.job) {
+      if (util_queue_get_job(queue, worker, &job)) {
          job.execute(job.job, thread_index);
          util_queue_fence_signal(job.fence);
          if (job.cleanup)
             job.cleanup(job.job, thread_index);
+         continue;
       }
+
+      /* wait if the queue is empty */
+      pipe_mutex_lock(queue->lock);
+      p_atomic_inc(&queue->num_sleeping);
+      while (!queue->kill_threads &&
+             thread_index < (int)queue->num_threads &&
+             p_atomic_read(&queue->num_queued) <= 0)
+         pipe_condvar_wait(queue->has_queued_cond, queue->lock);
+      p_atomic_dec(&queue->num_sleeping);
+      pipe_mutex_unlock(queue->lock);
    }
 
-   /* signal remaining jobs before terminating */
+   /* If this thread is going away, it may have taken a wakeup which was
+    * meant for one of the remaining threads, so pass it on.
+    */
    pipe_mutex_lock(queue->lock);
-   while (queue->jobs[queue->read_idx].job) {
-      util_queue_fence_signal(queue->jobs[queue->read_idx].fence);
-
-      queue->jobs[queue->read_idx].job = NULL;
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
-   }
+   if (p_atomic_read(&queue->num_queued) > 0)
+      pipe_condvar_signal(queue->has_queued_cond);
    pipe_mutex_unlock(queue->lock);
+
+   pipe_tsd_set(&util_queue_worker_tsd, NULL);
    return 0;
 }
 
+static struct util_queue_worker *
+util_queue_create_worker(struct util_queue *queue, unsigned index)
+{
+   struct util_queue_worker *worker;
+   unsigned prio;
+
+   if (index < queue->num_workers)
+      return queue->workers[index];
+
+   assert(index == queue->num_workers);
+   worker = CALLOC_STRUCT(util_queue_worker);
+   if (!worker)
+      return NULL;
+
+   worker->queue = queue;
+   worker->thread_index = index;
+
+   /* see util_queue_push */
+   for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++) {
+      struct util_queue_deque *dq = &worker->deques[prio];
+
+      dq->jobs = (struct util_queue_job*)MALLOC(16 * sizeof(*dq->jobs));
+      if (!dq->jobs)
+         goto fail;
+      dq->size = 16;
+   }
+
+   pipe_mutex_init(worker->lock);
+
+   queue->workers[index] = worker;
+   p_atomic_inc(&queue->num_workers);
+   return worker;
+
+fail:
+   for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++)
+      FREE(worker->deques[prio].jobs);
+   FREE(worker);
+   return NULL;
+}
+
+void
+util_queue_adjust_num_threads(struct util_queue *queue, unsigned num_threads)
+{
+   unsigned old_num_threads = queue->num_threads;
+   unsigned i;
+
+   num_threads = CLAMP(num_threads, 1, UTIL_QUEUE_MAX_THREADS);
+
+   if (num_threads < old_num_threads) {
+      /* The threads exit after their current job. Whatever is left in
+       * their deques gets stolen by the others.
+       */
+      pipe_mutex_lock(queue->lock);
+      queue->num_threads = num_threads;
+      pipe_condvar_broadcast(queue->has_queued_cond);
+      pipe_mutex_unlock(queue->lock);
+
+      for (i = num_threads; i < old_num_threads; i++)
+         pipe_thread_wait(queue->threads[i]);
+   }
+   else if (num_threads > old_num_threads) {
+      for (i = old_num_threads; i < num_threads; i++) {
+         if (!util_queue_create_worker(queue, i)) {
+            num_threads = i;
+            break;
+         }
+      }
+
+      /* This must be set before the threads start, or they exit at once. */
+      pipe_mutex_lock(queue->lock);
+      queue->num_threads = num_threads;
+      pipe_mutex_unlock(queue->lock);
+
+      for (i = old_num_threads; i < num_threads; i++) {
+         queue->threads[i] = pipe_thread_create(util_queue_thread_func,
+                                                queue->workers[i]);
+         if (!queue->threads[i]) {
+            /* use the threads which could be created */
+            pipe_mutex_lock(queue->lock);
+            queue->num_threads = i;
+            pipe_condvar_broadcast(queue->has_queued_cond);
+            pipe_mutex_unlock(queue->lock);
+            break;
+         }
+      }
+   }
+}
+
 bool
 util_queue_init(struct util_queue *queue,
                 const char *name,
                 unsigned max_jobs,
                 unsigned num_threads)
 {
-   unsigned i;
+   unsigned i, prio;
 
    memset(queue, 0, sizeof(*queue));
    queue->name = name;
-   queue->num_threads = num_threads;
    queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 CALLOC(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
+   /* Make sure the key exists before any thread of the queue uses it. */
+   pipe_tsd_get(&util_queue_worker_tsd);
+
+   queue->threads = (pipe_thread*)
+                    CALLOC(UTIL_QUEUE_MAX_THREADS, sizeof(pipe_thread));
+   if (!queue->threads)
       goto fail;
 
    pipe_mutex_init(queue->lock);
-
-   queue->num_queued = 0;
    pipe_condvar_init(queue->has_queued_cond);
    pipe_condvar_init(queue->has_space_cond);
 
-   queue->threads = (pipe_thread*)CALLOC(num_threads, sizeof(pipe_thread));
-   if (!queue->threads)
-      goto fail;
-
    /* start threads */
-   for (i = 0; i < num_threads; i++) {
-      struct thread_input *input = MALLOC_STRUCT(thread_input);
-      input->queue = queue;
-      input->thread_index = i;
-
-      queue->threads[i] = pipe_thread_create(util_queue_thread_func, input);
-
-      if (!queue->threads[i]) {
-         FREE(input);
-
-         if (i == 0) {
-            /* no threads created, fail */
-            goto fail;
-         } else {
-            /* at least one thread created, so use it */
-            queue->num_threads = i+1;
-            break;
-         }
-      }
+   util_queue_adjust_num_threads(queue, num_threads);
+   if (queue->num_threads == 0) {
+      /* no threads created, fail */
+      pipe_condvar_destroy(queue->has_space_cond);
+      pipe_condvar_destroy(queue->has_queued_cond);
+      pipe_mutex_destroy(queue->lock);
+      goto fail;
    }
    return true;
 
 fail:
    FREE(queue->threads);
 
-   if (queue->jobs) {
-      pipe_condvar_destroy(queue->has_space_cond);
-      pipe_condvar_destroy(queue->has_queued_cond);
-      pipe_mutex_destroy(queue->lock);
-      FREE(queue->jobs);
+   for (i = 0; i < queue->num_workers; i++) {
+      for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++)
+         FREE(queue->workers[i]->deques[prio].jobs);
+      pipe_mutex_destroy(queue->workers[i]->lock);
+      FREE(queue->workers[i]);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -176,7 +465,9 @@ fail:
 void
 util_queue_destroy(struct util_queue *queue)
 {
-   unsigned i;
+   struct util_queue_job job;
+   unsigned i, prio;
+   bool found;
 
    /* Signal all threads to terminate. */
    pipe_mutex_lock(queue->lock);
@@ -187,10 +478,30 @@ util_queue_destroy(struct util_queue *queue)
    for (i = 0; i < queue->num_threads; i++)
       pipe_thread_wait(queue->threads[i]);
 
+   /* Signal remaining jobs, and the jobs which were waiting for them. */
+   do {
+      found = false;
+      for (i = 0; i < queue->num_workers; i++) {
+         for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++) {
+            while (util_queue_worker_pop(queue->workers[i], prio, false,
+                                         &job)) {
+               util_queue_fence_signal(job.fence);
+               found = true;
+            }
+         }
+      }
+   } while (found);
+
+   for (i = 0; i < queue->num_workers; i++) {
+      for (prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++)
+         FREE(queue->workers[i]->deques[prio].jobs);
+      pipe_mutex_destroy(queue->workers[i]->lock);
+      FREE(queue->workers[i]);
+   }
+
    pipe_condvar_destroy(queue->has_space_cond);
    pipe_condvar_destroy(queue->has_queued_cond);
    pipe_mutex_destroy(queue->lock);
-   FREE(queue->jobs);
    FREE(queue->threads);
 }
 
@@ -207,10 +518,95 @@ void
 util_queue_fence_destroy(struct util_queue_fence *fence)
 {
    assert(fence->signalled);
+   assert(!fence->waiters);
    pipe_condvar_destroy(fence->cond);
    pipe_mutex_destroy(fence->mutex);
 }
 
+void
+util_queue_add_job_full(struct util_queue *queue,
+                        void *job,
+                        struct util_queue_fence *fence,
+                        util_queue_execute_func execute,
+                        util_queue_execute_func cleanup,
+                        enum util_queue_priority priority,
+                        struct util_queue_fence **deps,
+                        unsigned num_deps)
+{
+   struct util_queue_worker *self = pipe_tsd_get(&util_queue_worker_tsd);
+   struct util_queue_pending_job *pending = NULL;
+   struct util_queue_job ptr;
+   unsigned i, num_waiters = 0;
+
+   assert(fence->signalled);
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
+   fence->signalled = false;
+
+   ptr.job = job;
+   ptr.fence = fence;
+   ptr.execute = execute;
+   ptr.cleanup = cleanup;
+
+   /* If the queue is full, wait until there is space. Threads of the queue
+    * never wait, as they might be the ones which have to make space.
+    */
+   if (queue->max_jobs && (!self || self->queue != queue) &&
+       p_atomic_read(&queue->num_queued) >= queue->max_jobs) {
+      pipe_mutex_lock(queue->lock);
+      p_atomic_inc(&queue->num_space_waiters);
+      while (!queue->kill_threads &&
+             p_atomic_read(&queue->num_queued) >= queue->max_jobs)
+         pipe_condvar_wait(queue->has_space_cond, queue->lock);
+      p_atomic_dec(&queue->num_space_waiters);
+      pipe_mutex_unlock(queue->lock);
+   }
+
+   for (i = 0; i < num_deps; i++) {
+      struct util_queue_fence *dep = deps[i];
+
+      if (util_queue_fence_is_signalled(dep))
+         continue;
+
+      if (!pending) {
+         pending = (struct util_queue_pending_job*)
+            MALLOC(sizeof(*pending) +
+                   num_deps * sizeof(struct util_queue_fence_waiter));
+         if (!pending) {
+            /* Out of memory, wait for the dependencies right here. */
+            for (; i < num_deps; i++)
+               util_queue_job_wait(deps[i]);
+            break;
+         }
+
+         pending->queue = queue;
+         pending->job = ptr;
+         pending->priority = priority;
+         pending->num_deps = 1;
+         pending->waiters = (struct util_queue_fence_waiter*)(pending + 1);
+      }
+
+      pipe_mutex_lock(dep->mutex);
+      if (!dep->signalled) {
+         struct util_queue_fence_waiter *waiter =
+            &pending->waiters[num_waiters++];
+
+         waiter->pending = pending;
+         waiter->next = dep->waiters;
+         dep->waiters = waiter;
+         p_atomic_inc(&pending->num_deps);
+      }
+      pipe_mutex_unlock(dep->mutex);
+   }
+
+   if (pending) {
+      /* The last signalled dependency queues the job. */
+      util_queue_dependency_done(pending);
+      return;
+   }
+
+   util_queue_push(queue, &ptr, priority);
+}
+
 void
 util_queue_add_job(struct util_queue *queue,
                    void *job,
@@ -218,27 +614,6 @@ util_queue_add_job(struct util_queue *queue,
                    util_queue_execute_func execute,
                    util_queue_execute_func cleanup)
 {
-   struct util_queue_job *ptr;
-
-   assert(fence->signalled);
-   fence->signalled = false;
-
-   pipe_mutex_lock(queue->lock);
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
-
-   /* if the queue is full, wait until there is space */
-   while (queue->num_queued == queue->max_jobs)
-      pipe_condvar_wait(queue->has_space_cond, queue->lock);
-
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
-
-   queue->num_queued++;
-   pipe_condvar_signal(queue->has_queued_cond);
-   pipe_mutex_unlock(queue->lock);
+   util_queue_add_job_full(queue, job, fence, execute, cleanup,
+                           UTIL_QUEUE_PRIORITY_NORMAL, NULL, 0);
 }
@@ -24,10 +24,22 @@
  * of the Software.
  */
 
-/* Job queue with execution in a separate thread.
+/* Job queue with execution in a pool of threads.
  *
- * Jobs can be added from any thread. After that, the wait call can be used
- * to wait for completion of the job.
+ * Jobs can be added from any thread, including the threads of the queue
+ * itself. After that, the wait call can be used to wait for completion of
+ * the job.
+ *
+ * Each thread has its own deque of jobs per priority. Jobs added by a
+ * thread of the queue go to that thread's deque, jobs added from outside
+ * are spread over the threads round-robin. Threads take jobs from the front
+ * of their own deques, and when those are empty, steal from the back of the
+ * other threads' deques. Higher priority jobs are always looked for first.
+ * With a single thread, jobs of the same priority execute in the order they
+ * were added.
+ *
+ * A job can depend on the fences of other jobs, it isn't queued before all
+ * of them are signalled.
  */
 
 #ifndef U_QUEUE_H
@@ -35,6 +47,17 @@
 
 #include "os/os_thread.h"
 
+#define UTIL_QUEUE_MAX_THREADS 32
+
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_NUM_PRIORITIES
+};
+
+struct util_queue_fence_waiter;
+
 /* Job completion fence.
  * Put this into your job structure.
  */
@@ -42,6 +65,7 @@ struct util_queue_fence {
    pipe_mutex mutex;
    pipe_condvar cond;
    int signalled;
+   struct util_queue_fence_waiter *waiters; /* jobs depending on this */
 };
 
 typedef void (*util_queue_execute_func)(void *job, int thread_index);
@@ -53,6 +77,22 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+/* Growable ring of jobs. */
+struct util_queue_deque {
+   struct util_queue_job *jobs;
+   unsigned size;  /* power of two */
+   unsigned head;  /* index of the first job */
+   unsigned count;
+};
+
+/* Per-thread state. */
+struct util_queue_worker {
+   struct util_queue *queue;
+   int thread_index;
+   pipe_mutex lock;
+   struct util_queue_deque deques[UTIL_QUEUE_NUM_PRIORITIES];
+};
+
 /* Put this into your context. */
 struct util_queue {
    const char *name;
@@ -60,12 +100,15 @@ struct util_queue {
    pipe_condvar has_queued_cond;
    pipe_condvar has_space_cond;
    pipe_thread *threads;
-   int num_queued;
+   struct util_queue_worker *workers[UTIL_QUEUE_MAX_THREADS];
    unsigned num_threads;
+   unsigned num_workers;     /* number of workers[] ever created */
    int kill_threads;
    int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
-   struct util_queue_job *jobs;
+   int num_queued;           /* jobs in the deques, atomic */
+   int num_sleeping;         /* threads waiting for jobs, atomic */
+   int num_space_waiters;    /* threads waiting for space, atomic */
+   unsigned next_worker;     /* round-robin for jobs added from outside */
 };
 
 bool util_queue_init(struct util_queue *queue,
@@ -76,6 +119,13 @@ void util_queue_destroy(struct util_queue *queue);
 void util_queue_fence_init(struct util_queue_fence *fence);
 void util_queue_fence_destroy(struct util_queue_fence *fence);
 
+/* Change the number of threads, between 1 and UTIL_QUEUE_MAX_THREADS.
+ * Jobs already queued on the threads which go away are taken over by the
+ * others. Must not be called from a thread of the queue.
+ */
+void util_queue_adjust_num_threads(struct util_queue *queue,
+                                   unsigned num_threads);
+
 /* optional cleanup callback is called after fence is signaled: */
 void util_queue_add_job(struct util_queue *queue,
                         void *job,
@@ -83,6 +133,19 @@ void util_queue_add_job(struct util_queue *queue,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
 
+/* Same as above, with a priority, and the fences of the jobs which have to
+ * complete before this one can start. The dependency fences have to belong
+ * to jobs of the same queue, or be signalled before it is destroyed.
+ */
+void util_queue_add_job_full(struct util_queue *queue,
+                             void *job,
+                             struct util_queue_fence *fence,
+                             util_queue_execute_func execute,
+                             util_queue_execute_func cleanup,
+                             enum util_queue_priority priority,
+                             struct util_queue_fence **deps,
+                             unsigned num_deps);
+
 void util_queue_job_wait(struct util_queue_fence *fence);
 
 /* util_queue needs to be cleared to zeroes for this to work */
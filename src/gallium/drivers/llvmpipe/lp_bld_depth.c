@@ -545,6 +545,45 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
    struct lp_type zs_load_type = zs_type;
 
+   if (z_src_type.length == 16) {
+      /*
+       * A 16-wide vector covers the whole 4x4 stamp, with the upper and
+       * lower half laid out like two iterations of the 8-wide loop.
+       */
+      struct lp_type half_type = z_src_type;
+      LLVMValueRef z_half[2], s_half[2];
+      LLVMValueRef counter;
+      unsigned i;
+
+      half_type.length = 8;
+      counter = LLVMBuildShl(builder, loop_counter,
+                             lp_build_const_int32(gallivm, 1), "");
+
+      lp_build_depth_stencil_load_swizzled(gallivm, half_type, format_desc,
+                                           is_1d, depth_ptr, depth_stride,
+                                           &z_half[0], &s_half[0], counter);
+      if (is_1d) {
+         z_half[1] = LLVMGetUndef(LLVMTypeOf(z_half[0]));
+         s_half[1] = LLVMGetUndef(LLVMTypeOf(s_half[0]));
+      }
+      else {
+         counter = LLVMBuildAdd(builder, counter,
+                                lp_build_const_int32(gallivm, 1), "");
+         lp_build_depth_stencil_load_swizzled(gallivm, half_type, format_desc,
+                                              is_1d, depth_ptr, depth_stride,
+                                              &z_half[1], &s_half[1], counter);
+      }
+
+      for (i = 0; i < 16; i++) {
+         shuffles[i] = lp_build_const_int32(gallivm, i);
+      }
+      *z_fb = LLVMBuildShuffleVector(builder, z_half[0], z_half[1],
+                                     LLVMConstVector(shuffles, 16), "");
+      *s_fb = LLVMBuildShuffleVector(builder, s_half[0], s_half[1],
+                                     LLVMConstVector(shuffles, 16), "");
+      return;
+   }
+
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
@@ -691,6 +730,48 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
 
    lp_build_context_init(&z_bld, gallivm, z_type);
 
+   if (format_desc->block.bits > 32) {
+      s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
+   }
+
+   if (mask) {
+      mask_value = lp_build_mask_value(mask);
+      z_value = lp_build_select(&z_bld, mask_value, z_value, z_fb);
+      if (format_desc->block.bits > 32) {
+         s_fb = LLVMBuildBitCast(builder, s_fb, z_bld.vec_type, "");
+         s_value = lp_build_select(&z_bld, mask_value, s_value, s_fb);
+      }
+   }
+
+   if (z_src_type.length == 16) {
+      /* Store the halves separately, see lp_build_depth_stencil_load_swizzled */
+      struct lp_type half_type = z_src_type;
+      LLVMValueRef counter;
+      unsigned i;
+
+      half_type.length = 8;
+      counter = LLVMBuildShl(builder, loop_counter,
+                             lp_build_const_int32(gallivm, 1), "");
+
+      for (i = 0; i < (is_1d ? 1 : 2); i++) {
+         LLVMValueRef s_half = NULL;
+
+         if (format_desc->block.bits > 32) {
+            s_half = lp_build_extract_range(gallivm, s_value, i * 8, 8);
+         }
+         lp_build_depth_stencil_write_swizzled(gallivm, half_type, format_desc,
+                                               is_1d, NULL, NULL, NULL,
+                                               counter, depth_ptr, depth_stride,
+                                               lp_build_extract_range(gallivm,
+                                                                      z_value,
+                                                                      i * 8, 8),
+                                               s_half);
+         counter = LLVMBuildAdd(builder, counter,
+                                lp_build_const_int32(gallivm, 1), "");
+      }
+      return;
+   }
+
    /*
     * This is far from ideal, at least for late depth write we should do this
     * outside the fs loop to avoid all the swizzle stuff.
@@ -728,19 +809,6 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
    zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
    zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
 
-   if (format_desc->block.bits > 32) {
-      s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
-   }
-
-   if (mask) {
-      mask_value = lp_build_mask_value(mask);
-      z_value = lp_build_select(&z_bld, mask_value, z_value, z_fb);
-      if (format_desc->block.bits > 32) {
-         s_fb = LLVMBuildBitCast(builder, s_fb, z_bld.vec_type, "");
-         s_value = lp_build_select(&z_bld, mask_value, s_value, s_fb);
-      }
-   }
-
    if (zs_type.width < z_src_type.width) {
       /* Truncate ZS values (e.g., when writing to Z16_UNORM) */
       z_value = LLVMBuildTrunc(builder, z_value,
@@ -42,6 +42,7 @@
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
+#include "lp_state_cs.h"
 #include "lp_surface.h"
 #include "lp_query.h"
 #include "lp_setup.h"
@@ -91,11 +92,18 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       }
    }
 
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos); i++) {
+      for (j = 0; j < ARRAY_SIZE(llvmpipe->ssbos[i]); j++) {
+         pipe_resource_reference(&llvmpipe->ssbos[i][j].buffer, NULL);
+      }
+   }
+
    for (i = 0; i < llvmpipe->num_vertex_buffers; i++) {
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
    lp_delete_setup_variants(llvmpipe);
+   llvmpipe_cleanup_compute(llvmpipe);
 
 #ifndef USE_GLOBAL_LLVM_CONTEXT
    LLVMContextDispose(llvmpipe->context);
@@ -167,6 +175,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
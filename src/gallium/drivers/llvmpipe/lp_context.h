@@ -48,6 +48,8 @@ struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_compute_shader;
+struct lp_cs_worker;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
@@ -67,6 +69,7 @@ struct llvmpipe_context {
    const struct lp_geometry_shader *gs;
    const struct lp_velems_state *velems;
    const struct lp_so_state *so;
+   struct lp_compute_shader *cs;
 
    /** Other rendering state */
    unsigned sample_mask;
@@ -78,6 +81,7 @@ struct llvmpipe_context {
    struct pipe_poly_stipple poly_stipple;
    struct pipe_scissor_state scissors[PIPE_MAX_VIEWPORTS];
    struct pipe_sampler_view *sampler_views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   struct pipe_shader_buffer ssbos[PIPE_SHADER_TYPES][LP_MAX_TGSI_SHADER_BUFFERS];
 
    struct pipe_viewport_state viewports[PIPE_MAX_VIEWPORTS];
    struct pipe_vertex_buffer vertex_buffer[PIPE_MAX_ATTRIBS];
@@ -139,14 +143,25 @@ struct llvmpipe_context {
    unsigned tex_timestamp;
    boolean no_rast;
 
+   /** The variant bound by the last llvmpipe_update_fs() */
+   struct lp_fragment_shader_variant *fs_variant;
+
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Fragment shader variant lookups, for the driver queries */
+   uint64_t nr_fs_variant_hits;
+   uint64_t nr_fs_variant_misses;
+
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
 
+   /** Per thread memory of launch_grid, see lp_state_cs.c */
+   struct lp_cs_worker *cs_workers;
+   unsigned num_cs_workers;
+
    /** Conditional query object and mode */
    struct pipe_query *render_cond_query;
    uint render_cond_mode;
@@ -38,6 +38,7 @@
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_format.h"
 #include "lp_context.h"
+#include "lp_state_cs.h"
 #include "lp_jit.h"
 
 
@@ -247,3 +248,92 @@ lp_jit_init_types(struct lp_fragment_shader_variant *lp)
    if (!lp->jit_context_ptr_type)
       lp_jit_create_types(lp);
 }
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   struct gallivm_state *gallivm = lp->gallivm;
+   LLVMContextRef lc = gallivm->context;
+
+   if (lp->jit_cs_context_ptr_type)
+      return;
+
+   /* struct lp_jit_cs_context */
+   {
+      LLVMTypeRef elem_types[LP_JIT_CS_CTX_COUNT];
+      LLVMTypeRef context_type;
+
+      elem_types[LP_JIT_CS_CTX_CONSTANTS] =
+         LLVMArrayType(LLVMPointerType(LLVMFloatTypeInContext(lc), 0), LP_MAX_TGSI_CONST_BUFFERS);
+      elem_types[LP_JIT_CS_CTX_NUM_CONSTANTS] =
+         LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TGSI_CONST_BUFFERS);
+      elem_types[LP_JIT_CS_CTX_SSBOS] =
+         LLVMArrayType(LLVMPointerType(LLVMInt32TypeInContext(lc), 0), LP_MAX_TGSI_SHADER_BUFFERS);
+      elem_types[LP_JIT_CS_CTX_SSBO_SIZES] =
+         LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TGSI_SHADER_BUFFERS);
+      elem_types[LP_JIT_CS_CTX_GRID_SIZE] =
+      elem_types[LP_JIT_CS_CTX_BLOCK_SIZE] =
+         LLVMArrayType(LLVMInt32TypeInContext(lc), 3);
+      elem_types[LP_JIT_CS_CTX_SHARED_SIZE] = LLVMInt32TypeInContext(lc);
+
+      context_type = LLVMStructTypeInContext(lc, elem_types,
+                                             ARRAY_SIZE(elem_types), 0);
+
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, constants,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_CONSTANTS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, num_constants,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_NUM_CONSTANTS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, ssbos,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_SSBOS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, ssbo_sizes,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_SSBO_SIZES);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, grid_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_GRID_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, block_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_BLOCK_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, shared_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_SHARED_SIZE);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_context,
+                           gallivm->target, context_type);
+
+      lp->jit_cs_context_ptr_type = LLVMPointerType(context_type, 0);
+   }
+
+   /* struct lp_jit_cs_thread_data */
+   {
+      LLVMTypeRef elem_types[LP_JIT_CS_THREAD_DATA_COUNT];
+      LLVMTypeRef thread_data_type, barrier_type, barrier_arg_type;
+
+      thread_data_type = LLVMStructCreateNamed(lc, "lp_jit_cs_thread_data");
+      barrier_arg_type = LLVMPointerType(thread_data_type, 0);
+      barrier_type = LLVMFunctionType(LLVMVoidTypeInContext(lc),
+                                      &barrier_arg_type, 1, 0);
+
+      elem_types[LP_JIT_CS_THREAD_DATA_SHARED] =
+         LLVMPointerType(LLVMInt32TypeInContext(lc), 0);
+      elem_types[LP_JIT_CS_THREAD_DATA_BARRIER] =
+         LLVMPointerType(barrier_type, 0);
+
+      LLVMStructSetBody(thread_data_type, elem_types,
+                        ARRAY_SIZE(elem_types), 0);
+
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_thread_data, shared,
+                             gallivm->target, thread_data_type,
+                             LP_JIT_CS_THREAD_DATA_SHARED);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_thread_data, barrier,
+                             gallivm->target, thread_data_type,
+                             LP_JIT_CS_THREAD_DATA_BARRIER);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_thread_data,
+                           gallivm->target, thread_data_type);
+
+      lp->jit_cs_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
+   }
+}
@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -254,6 +255,114 @@ typedef void
                     unsigned depth_stride);
 
 
+/**
+ * This structure is passed directly to the generated compute shader.
+ *
+ * Changes here must be reflected in the lp_jit_cs_context_* macros and
+ * lp_jit_init_cs_types function.
+ */
+struct lp_jit_cs_context
+{
+   const float *constants[LP_MAX_TGSI_CONST_BUFFERS];
+   int num_constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   uint32_t *ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+   uint32_t ssbo_sizes[LP_MAX_TGSI_SHADER_BUFFERS];
+
+   uint32_t grid_size[3];
+   uint32_t block_size[3];
+   uint32_t shared_size;
+};
+
+
+enum {
+   LP_JIT_CS_CTX_CONSTANTS = 0,
+   LP_JIT_CS_CTX_NUM_CONSTANTS,
+   LP_JIT_CS_CTX_SSBOS,
+   LP_JIT_CS_CTX_SSBO_SIZES,
+   LP_JIT_CS_CTX_GRID_SIZE,
+   LP_JIT_CS_CTX_BLOCK_SIZE,
+   LP_JIT_CS_CTX_SHARED_SIZE,
+   LP_JIT_CS_CTX_COUNT
+};
+
+
+#define lp_jit_cs_context_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_CONSTANTS, "constants")
+
+#define lp_jit_cs_context_num_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_NUM_CONSTANTS, "num_constants")
+
+#define lp_jit_cs_context_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_SSBOS, "ssbos")
+
+#define lp_jit_cs_context_ssbo_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_SSBO_SIZES, "ssbo_sizes")
+
+#define lp_jit_cs_context_grid_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GRID_SIZE, "grid_size")
+
+#define lp_jit_cs_context_block_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BLOCK_SIZE, "block_size")
+
+#define lp_jit_cs_context_shared_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_SHARED_SIZE, "shared_size")
+
+
+struct lp_jit_cs_thread_data;
+
+typedef void
+(*lp_jit_cs_barrier_func)(struct lp_jit_cs_thread_data *thread_data);
+
+/**
+ * Per-worker data of the compute shader.
+ */
+struct lp_jit_cs_thread_data
+{
+   /** Shared memory of the workgroup being executed */
+   void *shared;
+
+   /** Called by the shader on TGSI BARRIER */
+   lp_jit_cs_barrier_func barrier;
+};
+
+
+enum {
+   LP_JIT_CS_THREAD_DATA_SHARED = 0,
+   LP_JIT_CS_THREAD_DATA_BARRIER,
+   LP_JIT_CS_THREAD_DATA_COUNT
+};
+
+
+#define lp_jit_cs_thread_data_shared(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_THREAD_DATA_SHARED, "shared")
+
+#define lp_jit_cs_thread_data_barrier(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_THREAD_DATA_BARRIER, "barrier")
+
+
+/**
+ * typedef for compute shader function
+ *
+ * Runs the invocations [first_invocation, first_invocation + vector length)
+ * of a workgroup, invocations being numbered in x, y, z order.
+ *
+ * @param context           jit context
+ * @param block_x           workgroup x
+ * @param block_y           workgroup y
+ * @param block_z           workgroup z
+ * @param first_invocation  first invocation within the workgroup
+ * @param thread_data       worker thread data
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_cs_context *context,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z,
+                  uint32_t first_invocation,
+                  struct lp_jit_cs_thread_data *thread_data);
+
+
 void
 lp_jit_screen_cleanup(struct llvmpipe_screen *screen);
 
@@ -266,4 +375,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
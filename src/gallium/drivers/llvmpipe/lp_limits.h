@@ -61,7 +61,12 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Max number of rasterizer threads.  The actual number defaults to the
+ * number of CPUs, and the per-thread state of scenes and queries is sized
+ * for it.  This only clamps LP_NUM_THREADS and sizes the debug counters.
+ */
+#define LP_MAX_THREADS 1024
 
 
 /**
@@ -93,4 +98,11 @@
  */
 #define LP_MAX_SETUP_VARIANTS 64
 
+/**
+ * Compute shader limits.  Each workgroup runs on a single thread, and its
+ * shared memory is allocated per thread.
+ */
+#define LP_MAX_CS_THREADS_PER_BLOCK 1024
+#define LP_MAX_CS_SHARED_SIZE (32 * 1024)
+
 #endif /* LP_LIMITS_H */
@@ -46,6 +46,7 @@ lp_print_counters(void)
 {
    if (LP_DEBUG & DEBUG_COUNTERS) {
       unsigned total_64, total_16, total_4;
+      unsigned i;
       float p1, p2, p3, p4, p5, p6;
 
       debug_printf("llvmpipe: nr_triangles:                 %9u\n", lp_count.nr_tris);
@@ -102,6 +103,13 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      for (i = 0; i < LP_MAX_THREADS; i++) {
+         if (lp_count.nr_bins[i] == 0)
+            continue;
+         debug_printf("llvmpipe: thread %2u nr_bins:           %9u (%u stolen)\n",
+                      i, lp_count.nr_bins[i], lp_count.nr_bins_stolen[i]);
+      }
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
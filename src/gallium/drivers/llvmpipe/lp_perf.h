@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "lp_limits.h"
 
 /**
  * Various counters
@@ -62,6 +63,10 @@ struct lp_counters
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   /** per rasterizer thread */
+   unsigned nr_bins[LP_MAX_THREADS];
+   unsigned nr_bins_stolen[LP_MAX_THREADS];
 };
 
 
@@ -53,13 +53,27 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_query *pq;
+   /* The driver queries use the first two counters whatever the number of
+    * threads.
+    */
+   unsigned num_counters = MAX2(2, screen->num_threads);
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          type == LP_QUERY_FS_VARIANT_HITS ||
+          type == LP_QUERY_FS_VARIANT_MISSES ||
+          type == LP_QUERY_FS_VARIANT_PENDING ||
+          type == LP_QUERY_DRAW_UNIQUE_INDICES ||
+          type == LP_QUERY_DRAW_VS_INVOCATIONS);
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The counters follow the query, in the same allocation. */
+   pq = CALLOC(1, sizeof *pq + 2 * num_counters * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *) (pq + 1);
+      pq->end = pq->start + num_counters;
+      pq->num_counters = num_counters;
       pq->type = type;
    }
 
@@ -175,6 +189,13 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
       *stats = pq->stats;
    }
       break;
+   case LP_QUERY_FS_VARIANT_HITS:
+   case LP_QUERY_FS_VARIANT_MISSES:
+   case LP_QUERY_FS_VARIANT_PENDING:
+   case LP_QUERY_DRAW_UNIQUE_INDICES:
+   case LP_QUERY_DRAW_VS_INVOCATIONS:
+      *result = pq->end[0];
+      break;
    default:
       assert(0);
       break;
@@ -199,8 +220,28 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_counters * sizeof(pq->start[0]));
+   memset(pq->end, 0, pq->num_counters * sizeof(pq->end[0]));
+
+   /* The driver queries count CPU side events only, nothing is binned. */
+   switch (pq->type) {
+   case LP_QUERY_FS_VARIANT_HITS:
+      pq->start[0] = llvmpipe->nr_fs_variant_hits;
+      return true;
+   case LP_QUERY_FS_VARIANT_MISSES:
+      pq->start[0] = llvmpipe->nr_fs_variant_misses;
+      return true;
+   case LP_QUERY_FS_VARIANT_PENDING:
+      return true;
+   case LP_QUERY_DRAW_UNIQUE_INDICES:
+   case LP_QUERY_DRAW_VS_INVOCATIONS:
+      draw_get_vertex_cache_stats(llvmpipe->draw, &pq->start[0],
+                                  &pq->start[1]);
+      return true;
+   default:
+      break;
+   }
+
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -245,6 +286,32 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   switch (pq->type) {
+   case LP_QUERY_FS_VARIANT_HITS:
+      pq->end[0] = llvmpipe->nr_fs_variant_hits - pq->start[0];
+      return true;
+   case LP_QUERY_FS_VARIANT_MISSES:
+      pq->end[0] = llvmpipe->nr_fs_variant_misses - pq->start[0];
+      return true;
+   case LP_QUERY_FS_VARIANT_PENDING:
+      /* a running total rather than a count of events */
+      pq->end[0] = llvmpipe_num_pending_fs_variants(llvmpipe);
+      return true;
+   case LP_QUERY_DRAW_UNIQUE_INDICES:
+   case LP_QUERY_DRAW_VS_INVOCATIONS: {
+      uint64_t unique_indices, vs_invocations;
+      draw_get_vertex_cache_stats(llvmpipe->draw, &unique_indices,
+                                  &vs_invocations);
+      if (pq->type == LP_QUERY_DRAW_UNIQUE_INDICES)
+         pq->end[0] = unique_indices - pq->start[0];
+      else
+         pq->end[0] = vs_invocations - pq->start[1];
+   }
+      return true;
+   default:
+      break;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -41,9 +41,18 @@
 struct llvmpipe_context;
 
 
+/** Driver specific queries, see llvmpipe_get_driver_query_info() */
+#define LP_QUERY_FS_VARIANT_HITS    (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_FS_VARIANT_MISSES  (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_FS_VARIANT_PENDING (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_DRAW_UNIQUE_INDICES (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+#define LP_QUERY_DRAW_VS_INVOCATIONS (PIPE_QUERY_DRIVER_SPECIFIC + 4)
+
+
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
+   unsigned num_counters;           /* entries in start and end */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned num_primitives_generated;
@@ -26,6 +26,9 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "util/u_cpu_detect.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -69,7 +72,7 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, MAX2(1, rast->num_threads) );
 }
 
 
@@ -683,7 +686,8 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
          }
@@ -705,10 +709,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -737,6 +737,10 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_end( rast );
 
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
+
       util_fpstate_set(fpstate);
 
       rast->curr_scene = NULL;
@@ -757,20 +761,44 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Run func(data, thread_index) once on every rasterizer thread, or once
+ * on the calling thread if there are no threads, and wait for all of them
+ * to return.
+ *
+ * The threads must be idle, i.e. the caller must have waited for the
+ * fence of the last scene queued, and must keep other scenes from being
+ * queued until this returns.
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_run_job(struct lp_rasterizer *rast,
+                lp_rast_job_func func,
+                void *data)
 {
+   unsigned i;
+
    if (rast->num_threads == 0) {
-      /* nothing to do */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+      func(data, 0);
+      util_fpstate_set(fpstate);
+      return;
    }
-   else {
-      int i;
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+   rast->job_func = func;
+   rast->job_data = data;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      pipe_semaphore_signal(&rast->tasks[i].work_ready);
    }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      pipe_semaphore_wait(&rast->job_done);
+   }
+
+   rast->job_func = NULL;
+   rast->job_data = NULL;
 }
 
 
@@ -785,6 +813,7 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
    struct lp_rasterizer_task *task = (struct lp_rasterizer_task *) init_data;
    struct lp_rasterizer *rast = task->rast;
+   struct lp_scene *scene;
    boolean debug = false;
    char thread_name[16];
    unsigned fpstate;
@@ -792,6 +821,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    pipe_thread_setname(thread_name);
 
+   if (rast->thread_cpus &&
+       !pipe_thread_set_cpu_affinity(rast->thread_cpus[task->thread_index]) &&
+       debug)
+      debug_printf("thread %d could not be pinned to cpu %d\n",
+                   task->thread_index, rast->thread_cpus[task->thread_index]);
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -807,6 +842,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (rast->exit_flag)
          break;
 
+      if (rast->job_func) {
+         rast->job_func(rast->job_data, task->thread_index);
+         pipe_semaphore_signal(&rast->job_done);
+         continue;
+      }
+
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
@@ -821,12 +862,13 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
        */
       pipe_barrier_wait( &rast->barrier );
 
+      scene = rast->curr_scene;
+
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task,
-                      rast->curr_scene);
+      rasterize_scene(task, scene);
       
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
@@ -837,11 +879,17 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
+      /* Signal the scene's fence.  Thread 0 only gets here once the
+       * framebuffer has been unmapped, and the fence only completes once
+       * every thread has signalled it, so the setup code may recycle the
+       * scene as soon as the fence is signalled.
+       */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
 
-      pipe_semaphore_signal(&task->work_done);
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
    }
 
 #ifdef _WIN32
@@ -852,6 +900,127 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
 }
 
 
+#define LP_MAX_NUMA_NODES 64
+
+/**
+ * Parse a sysfs cpu list such as "0-7,16-23" and append the CPUs to cpus.
+ * \return the new number of CPUs in the array
+ */
+static unsigned
+parse_cpu_list(const char *list, int *cpus, unsigned num_cpus,
+               unsigned max_cpus)
+{
+   const char *p = list;
+
+   while (*p && *p != '\n') {
+      char *end;
+      long first, last, cpu;
+
+      first = strtol(p, &end, 10);
+      if (end == p)
+         break;
+      last = first;
+      p = end;
+      if (*p == '-') {
+         p++;
+         last = strtol(p, &end, 10);
+         if (end == p)
+            break;
+         p = end;
+      }
+      for (cpu = first; cpu <= last && num_cpus < max_cpus; cpu++)
+         cpus[num_cpus++] = cpu;
+      if (*p == ',')
+         p++;
+   }
+
+   return num_cpus;
+}
+
+
+/**
+ * Choose the CPU each rasterizer thread gets pinned to.
+ *
+ * On Linux the NUMA topology is read from sysfs and the threads are dealt
+ * out round-robin over the nodes, so that the threads, and the memory
+ * they first touch, are spread over all the memory controllers even when
+ * there are fewer threads than CPUs.  Elsewhere, or without NUMA
+ * information, thread i simply goes to CPU i.
+ */
+static void
+choose_thread_cpus(int *thread_cpus, unsigned num_threads)
+{
+   unsigned nr_cpus = MAX2(util_cpu_caps.nr_cpus, 1);
+   unsigned i;
+
+#if defined(PIPE_OS_LINUX)
+   int *cpus = MALLOC(nr_cpus * sizeof *cpus);
+   unsigned node_start[LP_MAX_NUMA_NODES + 1];
+   unsigned node_next[LP_MAX_NUMA_NODES];
+   unsigned num_nodes = 0, num_cpus = 0, node;
+
+   for (node = 0; cpus && node < LP_MAX_NUMA_NODES; node++) {
+      char path[64], list[1024];
+      FILE *f;
+
+      util_snprintf(path, sizeof path,
+                    "/sys/devices/system/node/node%u/cpulist", node);
+      f = fopen(path, "r");
+      if (!f)
+         continue;
+
+      if (fgets(list, sizeof list, f)) {
+         unsigned n = parse_cpu_list(list, cpus, num_cpus, nr_cpus);
+         if (n > num_cpus) {
+            node_start[num_nodes] = num_cpus;
+            node_next[num_nodes] = num_cpus;
+            num_nodes++;
+            num_cpus = n;
+         }
+      }
+      fclose(f);
+   }
+   node_start[num_nodes] = num_cpus;
+
+   if (num_nodes > 1) {
+      LP_DBG(DEBUG_RAST, "%s: %u NUMA nodes, %u cpus\n", __FUNCTION__,
+             num_nodes, num_cpus);
+
+      node = 0;
+      for (i = 0; i < num_threads; i++) {
+         unsigned tries;
+
+         /* skip the nodes which have no CPU left, start over once every
+          * CPU has a thread
+          */
+         for (tries = 0; tries < num_nodes; tries++) {
+            if (node_next[node] < node_start[node + 1])
+               break;
+            node = (node + 1) % num_nodes;
+         }
+         if (tries == num_nodes) {
+            for (node = 0; node < num_nodes; node++)
+               node_next[node] = node_start[node];
+            node = 0;
+         }
+
+         thread_cpus[i] = cpus[node_next[node]++];
+         node = (node + 1) % num_nodes;
+      }
+
+      FREE(cpus);
+      return;
+   }
+
+   FREE(cpus);
+#endif
+
+   for (i = 0; i < num_threads; i++) {
+      thread_cpus[i] = i % nr_cpus;
+   }
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -860,6 +1029,8 @@ create_rast_threads(struct lp_rasterizer *rast)
 {
    unsigned i;
 
+   pipe_semaphore_init(&rast->job_done, 0);
+
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
@@ -887,6 +1058,19 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
+   if (num_threads > 0 &&
+       debug_get_bool_option("LP_THREAD_AFFINITY", FALSE)) {
+      rast->thread_cpus = MALLOC(num_threads * sizeof *rast->thread_cpus);
+      if (rast->thread_cpus)
+         choose_thread_cpus(rast->thread_cpus, num_threads);
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -907,6 +1091,16 @@ lp_rast_create( unsigned num_threads )
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
+#ifdef USE_AVX512
+   /* The SIMD16 versions only cover the 3-plane, 32-bit triangles, which
+    * are the common case.
+    */
+   if (util_cpu_caps.has_avx512f) {
+      dispatch[LP_RAST_OP_TRIANGLE_32_3_4] = lp_rast_triangle_32_3_4_avx512;
+      dispatch[LP_RAST_OP_TRIANGLE_32_3_16] = lp_rast_triangle_32_3_16_avx512;
+   }
+#endif
+
    create_rast_threads(rast);
 
    /* for synchronizing rasterization threads */
@@ -927,6 +1121,10 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+   FREE(rast->thread_cpus);
+no_tasks:
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 no_rast:
    return NULL;
@@ -964,6 +1162,7 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
       pipe_semaphore_destroy(&rast->tasks[i].work_ready);
       pipe_semaphore_destroy(&rast->tasks[i].work_done);
    }
+   pipe_semaphore_destroy(&rast->job_done);
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
       align_free(rast->tasks[i].thread_data.cache);
    }
@@ -975,6 +1174,9 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->thread_cpus);
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 }
 
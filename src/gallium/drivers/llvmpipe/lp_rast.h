@@ -166,8 +166,12 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
+typedef void (*lp_rast_job_func)(void *data, unsigned thread_index);
+
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_run_job(struct lp_rasterizer *rast,
+                lp_rast_job_func func,
+                void *data);
 
 
 union lp_rast_cmd_arg {
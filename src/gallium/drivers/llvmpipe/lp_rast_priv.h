@@ -123,14 +123,22 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread (at least one) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
+
+   /** CPU each thread is pinned to, or NULL if threads aren't pinned */
+   int *thread_cpus;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
+
+   /** Job run by all threads instead of a scene, see lp_rast_run_job() */
+   lp_rast_job_func job_func;
+   void *job_data;
+   pipe_semaphore job_done;
 };
 
 
@@ -337,6 +345,14 @@ void lp_rast_triangle_32_3_16( struct lp_rasterizer_task *,
 void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *, 
                             const union lp_rast_cmd_arg );
 
+#ifdef USE_AVX512
+void lp_rast_triangle_32_3_4_avx512(struct lp_rasterizer_task *,
+                                    const union lp_rast_cmd_arg);
+
+void lp_rast_triangle_32_3_16_avx512(struct lp_rasterizer_task *,
+                                     const union lp_rast_cmd_arg);
+#endif
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg);
@@ -0,0 +1,190 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * AVX-512 rasterization of 3-plane triangles within a 16x16 or 4x4 block.
+ *
+ * This file is built with the AVX-512 compiler flags, and the functions
+ * are only put in the rasterizer dispatch table when the CPU reports
+ * AVX-512F support at runtime (see lp_rast_create()).
+ *
+ * The results are identical to the SSE versions in lp_rast_tri.c, but all
+ * 16 sub-blocks (or pixels) of a plane are evaluated in a single vector:
+ * lane k corresponds to column k % 4 and row k / 4, which is also the bit
+ * order of the pixel masks passed to lp_rast_shade_quads_mask().
+ */
+
+#ifdef USE_AVX512
+
+#include <immintrin.h>
+
+#include "util/bitscan.h"
+#include "util/u_math.h"
+#include "lp_rast_priv.h"
+
+
+#define NR_PLANES 3
+
+
+/**
+ * Set up the edge function value at (x, y), the step vector for the 16
+ * lanes, and the trivial reject offset of each plane.
+ */
+static inline void
+setup_planes(const struct lp_rast_plane *plane, int x, int y,
+             __m512i c[NR_PLANES],
+             __m512i span[NR_PLANES],
+             __m512i rej4[NR_PLANES])
+{
+   const __m512i lane_x = _mm512_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3,
+                                            0, 1, 2, 3, 0, 1, 2, 3);
+   const __m512i lane_y = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 3, 3, 3, 3);
+   const __m512i zero = _mm512_setzero_si512();
+   const __m512i one = _mm512_set1_epi32(1);
+   unsigned p;
+
+   for (p = 0; p < NR_PLANES; p++) {
+      __m512i dcdx = _mm512_set1_epi32(plane[p].dcdx);
+      __m512i dcdy = _mm512_set1_epi32(plane[p].dcdy);
+
+      /* recalc eo, as in the SSE version */
+      rej4[p] = _mm512_sub_epi32(_mm512_max_epi32(dcdy, zero),
+                                 _mm512_min_epi32(dcdx, zero));
+      rej4[p] = _mm512_add_epi32(_mm512_slli_epi32(rej4[p], 2), one);
+
+      dcdx = _mm512_sub_epi32(zero, dcdx);
+
+      /* Only the low 32 bits of c are significant for these triangles.
+       * Subtract one so we can check the sign bit (< 0) instead of <= 0.
+       */
+      c[p] = _mm512_set1_epi32((int32_t)plane[p].c);
+      c[p] = _mm512_add_epi32(c[p], _mm512_mullo_epi32(dcdx, _mm512_set1_epi32(x)));
+      c[p] = _mm512_add_epi32(c[p], _mm512_mullo_epi32(dcdy, _mm512_set1_epi32(y)));
+      c[p] = _mm512_sub_epi32(c[p], one);
+
+      span[p] = _mm512_add_epi32(_mm512_mullo_epi32(lane_x, dcdx),
+                                 _mm512_mullo_epi32(lane_y, dcdy));
+   }
+}
+
+
+/**
+ * Return the mask of the 16 pixels which are outside of the triangle,
+ * given the edge function values at the top-left pixel of a 4x4 block.
+ */
+static inline unsigned
+outside_mask_4x4(const __m512i c[NR_PLANES],
+                 const __m512i span[NR_PLANES])
+{
+   __m512i c0 = _mm512_add_epi32(c[0], span[0]);
+   __m512i c1 = _mm512_add_epi32(c[1], span[1]);
+   __m512i c2 = _mm512_add_epi32(c[2], span[2]);
+   __m512i c_or = _mm512_or_si512(_mm512_or_si512(c0, c1), c2);
+
+   return _mm512_cmplt_epi32_mask(c_or, _mm512_setzero_si512());
+}
+
+
+void
+lp_rast_triangle_32_3_16_avx512(struct lp_rasterizer_task *task,
+                                const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   int x = (arg.triangle.plane_mask & 0xff) + task->x;
+   int y = (arg.triangle.plane_mask >> 8) + task->y;
+   const __m512i zero = _mm512_setzero_si512();
+
+   struct { unsigned mask:16; unsigned k:8; } out[16];
+   unsigned nr = 0;
+
+   __m512i c[NR_PLANES], span[NR_PLANES], rej4[NR_PLANES];
+   PIPE_ALIGN_VAR(64) int32_t cblk[NR_PLANES][16];
+   unsigned reject = 0, accept;
+   unsigned p, i;
+
+   setup_planes(plane, x, y, c, span, rej4);
+
+   /* Trivially reject the 4x4 blocks of the 16x16 block: the block
+    * corners are 4 pixels apart, so use the span scaled by 4.
+    */
+   for (p = 0; p < NR_PLANES; p++) {
+      __m512i blk = _mm512_add_epi32(c[p], _mm512_slli_epi32(span[p], 2));
+      reject |= _mm512_cmplt_epi32_mask(_mm512_add_epi32(blk, rej4[p]), zero);
+      _mm512_store_si512((void *)cblk[p], blk);
+   }
+   accept = ~reject & 0xffff;
+
+   while (accept) {
+      unsigned k = u_bit_scan(&accept);
+      __m512i cx[NR_PLANES];
+      unsigned mask;
+
+      for (p = 0; p < NR_PLANES; p++)
+         cx[p] = _mm512_set1_epi32(cblk[p][k]);
+
+      mask = outside_mask_4x4(cx, span);
+      if (mask != 0xffff) {
+         out[nr].k = k;
+         out[nr].mask = mask;
+         nr++;
+      }
+   }
+
+   for (i = 0; i < nr; i++)
+      lp_rast_shade_quads_mask(task,
+                               &tri->inputs,
+                               x + 4 * (out[i].k & 3),
+                               y + 4 * (out[i].k >> 2),
+                               0xffff & ~out[i].mask);
+}
+
+
+void
+lp_rast_triangle_32_3_4_avx512(struct lp_rasterizer_task *task,
+                               const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   unsigned x = (arg.triangle.plane_mask & 0xff) + task->x;
+   unsigned y = (arg.triangle.plane_mask >> 8) + task->y;
+
+   __m512i c[NR_PLANES], span[NR_PLANES], rej4[NR_PLANES];
+   unsigned mask;
+
+   setup_planes(plane, x, y, c, span, rej4);
+
+   mask = outside_mask_4x4(c, span);
+   if (mask != 0xffff)
+      lp_rast_shade_quads_mask(task,
+                               &tri->inputs,
+                               x,
+                               y,
+                               0xffff & ~mask);
+}
+
+#endif /* USE_AVX512 */
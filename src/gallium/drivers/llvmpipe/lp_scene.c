@@ -31,9 +31,14 @@
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
 #include "util/u_format.h"
+#include "util/u_atomic.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
+#include "lp_state_fs.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -46,6 +51,16 @@ struct resource_ref {
 };
 
 
+#define SHADER_REF_SZ 32
+
+/** List of fragment shader variant references */
+struct shader_ref {
+   struct lp_fragment_shader_variant *variant[SHADER_REF_SZ];
+   int count;
+   struct shader_ref *next;
+};
+
+
 /**
  * Create a new scene object.
  * \param queue  the queue to put newly rendered/emptied scenes into
@@ -59,11 +74,17 @@ lp_scene_create( struct pipe_context *pipe )
 
    scene->pipe = pipe;
 
+   scene->num_bin_shares = MAX2(1, llvmpipe_screen(pipe->screen)->num_threads);
+   scene->bin_share = CALLOC(scene->num_bin_shares,
+                             sizeof scene->bin_share[0]);
+   if (!scene->bin_share) {
+      FREE(scene);
+      return NULL;
+   }
+
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,9 +111,9 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
-   assert(scene->data.head->next == NULL);
+   assert(!scene->data.head || scene->data.head->next == NULL);
    FREE(scene->data.head);
+   FREE(scene->bin_share);
    FREE(scene);
 }
 
@@ -204,12 +225,15 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer surfaces mapped by lp_scene_begin_rasterization().
+ * Called by the rasterizer once all threads are done with the scene.  The
+ * rest of the scene's data stays valid until lp_scene_reset() is called by
+ * the setup code.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -232,6 +256,18 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+/**
+ * Free all the temporary data in a scene so that it can be binned again.
+ * Called by the setup code, either once the scene's fence has signalled
+ * or for a scene which was never handed to the rasterizer.
+ */
+void
+lp_scene_reset(struct lp_scene *scene )
+{
+   int i, j;
 
    /* Reset all command lists:
     */
@@ -274,6 +310,18 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                       j, scene->resource_reference_size);
    }
 
+   /* Decrement fragment shader variant ref counts
+    */
+   {
+      struct shader_ref *ref;
+      int i;
+
+      for (ref = scene->frag_shaders; ref; ref = ref->next) {
+         for (i = 0; i < ref->count; i++)
+            lp_fs_variant_reference(&ref->variant[i], NULL);
+      }
+   }
+
    /* Free all scene data blocks:
     */
    {
@@ -292,6 +340,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    lp_fence_reference(&scene->fence, NULL);
 
    scene->resources = NULL;
+   scene->frag_shaders = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
 
@@ -428,82 +477,219 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
 
 /**
- * Does this scene have a reference to the given resource?
+ * Add a reference to a fragment shader variant by the scene.
  */
 boolean
+lp_scene_add_frag_shader_reference(struct lp_scene *scene,
+                                   struct lp_fragment_shader_variant *variant)
+{
+   struct shader_ref *ref, **last = &scene->frag_shaders;
+   int i;
+
+   /* Look at existing shader blocks:
+    */
+   for (ref = scene->frag_shaders; ref; ref = ref->next) {
+      last = &ref->next;
+
+      /* Search for this shader:
+       */
+      for (i = 0; i < ref->count; i++)
+         if (ref->variant[i] == variant)
+            return TRUE;
+
+      if (ref->count < SHADER_REF_SZ) {
+         /* If the block is half-empty, then append the reference here.
+          */
+         break;
+      }
+   }
+
+   /* Create a new block if no half-empty block was found.
+    */
+   if (!ref) {
+      assert(*last == NULL);
+      *last = lp_scene_alloc(scene, sizeof *ref);
+      if (*last == NULL)
+          return FALSE;
+
+      ref = *last;
+      memset(ref, 0, sizeof *ref);
+   }
+
+   /* Append the reference to the reference block.
+    */
+   lp_fs_variant_reference(&ref->variant[ref->count++], variant);
+
+   return TRUE;
+}
+
+
+/**
+ * Does this scene have a reference to the given resource?
+ * \return bitmask of LP_REFERENCED_FOR_READ/WRITE
+ */
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
    int i;
 
+   /* the render targets are written by the scene */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
    for (ref = scene->resources; ref; ref = ref->next) {
       for (i = 0; i < ref->count; i++)
          if (ref->resource[i] == resource)
-            return TRUE;
+            return LP_REFERENCED_FOR_READ;
    }
 
-   return FALSE;
+   return LP_UNREFERENCED;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/* The bin_order entries hold the bin's weight in the upper bits and the
+ * complement of its index in the lower bits, so that sorting them in
+ * decreasing order yields the heaviest bins first, and bins of equal weight
+ * in raster order.
+ */
+#define BIN_INDEX_BITS 14
+#define BIN_INDEX_MASK ((1 << BIN_INDEX_BITS) - 1)
+#define BIN_WEIGHT_MAX ((1 << (32 - BIN_INDEX_BITS)) - 1)
+
+
+static int
+compare_bin_order(const void *a, const void *b)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   uint32_t ka = *(const uint32_t *)a;
+   uint32_t kb = *(const uint32_t *)b;
+   return ka < kb ? 1 : (ka > kb ? -1 : 0);
+}
+
+
+/**
+ * Number of commands in a bin, used as an estimate of the work it
+ * represents.
+ */
+static unsigned
+bin_weight(const struct cmd_bin *bin)
+{
+   const struct cmd_block *block;
+   unsigned weight = 0;
+
+   for (block = bin->head; block; block = block->next) {
+      weight += block->count;
    }
-   return TRUE;
+
+   return MIN2(weight, BIN_WEIGHT_MAX);
 }
 
 
+/**
+ * Prepare the bin iterator.  Called by a single thread before the
+ * rasterizer threads start calling lp_scene_bin_iter_next().
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned x, y, i;
+
+   STATIC_ASSERT(TILES_X * TILES_Y <= BIN_INDEX_MASK + 1);
+   assert(num_threads >= 1 && num_threads <= scene->num_bin_shares);
+
+   scene->num_bins = 0;
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         unsigned index = y * scene->tiles_x + x;
+
+         if (!bin->head)
+            continue;
+
+         scene->bin_order[scene->num_bins++] =
+            (bin_weight(bin) << BIN_INDEX_BITS) | (BIN_INDEX_MASK - index);
+      }
+   }
+
+   qsort(scene->bin_order, scene->num_bins, sizeof scene->bin_order[0],
+         compare_bin_order);
+
+   /* Thread i gets entries i, i + num_threads, i + 2 * num_threads, ...
+    * so every thread starts with one of the heaviest bins.
+    */
+   scene->num_iter_threads = num_threads;
+   for (i = 0; i < num_threads; i++) {
+      scene->bin_share[i].next = 0;
+      scene->bin_share[i].count =
+         (scene->num_bins + num_threads - 1 - i) / num_threads;
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Try to take the next bin of the given thread's share.
+ * \return index into bin_order or -1 if the share is exhausted
+ */
+static inline int
+take_bin(struct lp_scene *scene, unsigned share)
+{
+   int n;
+
+   if (p_atomic_read(&scene->bin_share[share].next) >=
+       scene->bin_share[share].count)
+      return -1;
+
+   n = p_atomic_inc_return(&scene->bin_share[share].next) - 1;
+   if (n >= scene->bin_share[share].count)
+      return -1;
+
+   return share + n * scene->num_iter_threads;
+}
+
+
+/**
+ * Return pointer to next bin to be rendered, or NULL once all bins have
+ * been handed out.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Empty bins are never returned.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y )
 {
-   struct cmd_bin *bin = NULL;
+   unsigned num_threads = scene->num_iter_threads;
+   unsigned index, i;
+   int k;
 
-   pipe_mutex_lock(scene->mutex);
+   assert(thread_index < num_threads);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   k = take_bin(scene, thread_index);
+
+   /* Our own share is done, steal from the others */
+   for (i = 1; k < 0 && i < num_threads; i++) {
+      k = take_bin(scene, (thread_index + i) % num_threads);
+      if (k >= 0) {
+         LP_COUNT(nr_bins_stolen[thread_index]);
+      }
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   if (k < 0)
+      return NULL;
+
+   LP_COUNT(nr_bins[thread_index]);
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   index = BIN_INDEX_MASK - (scene->bin_order[k] & BIN_INDEX_MASK);
+   *x = index % scene->tiles_x;
+   *y = index / scene->tiles_x;
+
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
@@ -549,6 +735,160 @@ void lp_scene_begin_binning( struct lp_scene *scene,
 }
 
 
+/**
+ * Prepare a sub-scene for binning primitives which will end up in the
+ * given scene.  The sub-scene has its own bins and data blocks so that
+ * it can be filled on another thread, while the state it refers to
+ * (framebuffer, rasterizer state, shader inputs) stays in the parent.
+ */
+boolean
+lp_scene_begin_sub_binning(struct lp_scene *sub,
+                           const struct lp_scene *scene)
+{
+   assert(lp_scene_is_empty(sub));
+
+   if (!sub->data.head) {
+      sub->data.head = MALLOC_STRUCT(data_block);
+      if (!sub->data.head)
+         return FALSE;
+      sub->data.head->used = 0;
+      sub->data.head->next = NULL;
+   }
+
+   /* Only read while binning, so no need to hold references: */
+   sub->fb = scene->fb;
+   sub->fb_max_layer = scene->fb_max_layer;
+   sub->tiles_x = scene->tiles_x;
+   sub->tiles_y = scene->tiles_y;
+   sub->had_queries = scene->had_queries;
+   sub->discard = scene->discard;
+
+   /* The sub-scene counts towards the size limit of the parent */
+   sub->scene_size = scene->scene_size;
+   sub->parent_size = scene->scene_size;
+   sub->alloc_failed = FALSE;
+
+   return TRUE;
+}
+
+
+/**
+ * Append the sub-scene's bins to those of the parent scene and hand over
+ * its full data blocks.  Sub-scenes must be merged in primitive order.
+ *
+ * The sub-scene keeps its current data block, so that the next range it
+ * bins for the same parent doesn't start a new block.  That block must be
+ * handed over with lp_scene_end_sub_binning() before the parent scene is
+ * rasterized or reset.
+ */
+void
+lp_scene_merge_sub_binning(struct lp_scene *scene,
+                           struct lp_scene *sub)
+{
+   struct data_block *block;
+   unsigned x, y;
+
+   assert(sub->tiles_x == scene->tiles_x);
+   assert(sub->tiles_y == scene->tiles_y);
+
+   for (y = 0; y < sub->tiles_y; y++) {
+      for (x = 0; x < sub->tiles_x; x++) {
+         struct cmd_bin *sub_bin = lp_scene_get_bin(sub, x, y);
+         struct cmd_bin *bin;
+
+         if (!sub_bin->head)
+            continue;
+
+         bin = lp_scene_get_bin(scene, x, y);
+         if (bin->tail)
+            bin->tail->next = sub_bin->head;
+         else
+            bin->head = sub_bin->head;
+         bin->tail = sub_bin->tail;
+         if (sub_bin->last_state)
+            bin->last_state = sub_bin->last_state;
+
+         sub_bin->head = NULL;
+         sub_bin->tail = NULL;
+         sub_bin->last_state = NULL;
+      }
+   }
+
+   /* Insert the sub-scene's full blocks behind the parent's current
+    * block, which stays the one the parent allocates from.
+    */
+   block = sub->data.head->next;
+   if (block) {
+      struct data_block *last = block;
+      while (last->next)
+         last = last->next;
+      last->next = scene->data.head->next;
+      scene->data.head->next = block;
+      sub->data.head->next = NULL;
+   }
+
+   scene->scene_size += sub->scene_size - sub->parent_size;
+   if (sub->alloc_failed)
+      scene->alloc_failed = TRUE;
+
+   memset(&sub->fb, 0, sizeof sub->fb);
+}
+
+
+/**
+ * Throw away everything binned into a sub-scene since the last
+ * lp_scene_begin_sub_binning().
+ */
+void
+lp_scene_discard_sub_binning(struct lp_scene *sub)
+{
+   struct data_block *block, *tmp;
+   unsigned x, y;
+
+   for (y = 0; y < sub->tiles_y; y++) {
+      for (x = 0; x < sub->tiles_x; x++) {
+         struct cmd_bin *bin = lp_scene_get_bin(sub, x, y);
+         bin->head = NULL;
+         bin->tail = NULL;
+         bin->last_state = NULL;
+      }
+   }
+
+   /* The current block may still hold data of ranges merged earlier, so
+    * only the blocks started since then can go.
+    */
+   for (block = sub->data.head->next; block; block = tmp) {
+      tmp = block->next;
+      FREE(block);
+   }
+   sub->data.head->next = NULL;
+
+   memset(&sub->fb, 0, sizeof sub->fb);
+}
+
+
+/**
+ * Hand the sub-scene's current data block over to the parent scene.
+ */
+void
+lp_scene_end_sub_binning(struct lp_scene *scene,
+                         struct lp_scene *sub)
+{
+   struct data_block *block = sub->data.head;
+
+   if (!block)
+      return;
+
+   assert(block->next == NULL);
+   assert(lp_scene_is_empty(sub));
+
+   block->next = scene->data.head->next;
+   scene->data.head->next = block;
+   scene->scene_size += sizeof *block;
+   sub->data.head = NULL;
+}
+
+
 void lp_scene_end_binning( struct lp_scene *scene )
 {
    if (LP_DEBUG & DEBUG_SCENE) {
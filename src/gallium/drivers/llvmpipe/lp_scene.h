@@ -116,6 +116,8 @@ struct data_block_list {
 };
 
 struct resource_ref;
+struct shader_ref;
+struct lp_fragment_shader_variant;
 
 /**
  * All bins and bin data are contained here.
@@ -154,6 +156,9 @@ struct lp_scene {
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /** list of frag shader variants referenced by the scene commands */
+   struct shader_ref *frag_shaders;
+
    /** Total memory used by the scene (in bytes).  This sums all the
     * data blocks and counts all bins, state, resource references and
     * other random allocations within the scene.
@@ -165,6 +170,9 @@ struct lp_scene {
     */
    unsigned resource_reference_size;
 
+   /** scene_size of the parent scene when sub-binning began */
+   unsigned parent_size;
+
    boolean alloc_failed;
    boolean discard;
    /**
@@ -173,8 +181,20 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /**
+    * For iterating over bins.  The non-empty bins are sorted by decreasing
+    * command count into bin_order, and dealt out round-robin to the
+    * rasterizer threads.  Each thread walks its own share through an atomic
+    * cursor and steals from the other threads once its share is exhausted.
+    */
+   unsigned num_bins;             /**< number of entries in bin_order */
+   unsigned num_iter_threads;
+   unsigned num_bin_shares;       /**< one per rasterizer thread */
+   struct {
+      int32_t next;               /**< bins of this share handed out so far */
+      int32_t count;              /**< number of bins in this share */
+   } *bin_share;
+   uint32_t bin_order[TILES_X * TILES_Y];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -199,8 +219,11 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
                                         boolean initializing_scene);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+boolean lp_scene_add_frag_shader_reference(struct lp_scene *scene,
+                                           struct lp_fragment_shader_variant *variant);
+
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -379,10 +402,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y );
 
 
 
@@ -405,6 +429,28 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene );
+
+
+/* Binning of a range of primitives on another thread into a private
+ * sub-scene, which is then merged into the parent scene.
+ */
+boolean
+lp_scene_begin_sub_binning(struct lp_scene *sub,
+                           const struct lp_scene *scene);
+
+void
+lp_scene_merge_sub_binning(struct lp_scene *scene,
+                           struct lp_scene *sub);
+
+void
+lp_scene_discard_sub_binning(struct lp_scene *sub);
+
+void
+lp_scene_end_sub_binning(struct lp_scene *scene,
+                         struct lp_scene *sub);
+
 
 
 
@@ -38,7 +38,12 @@
 
 
 
-#define MAX_SCENE_QUEUE 4
+/* The queue belongs to the screen's rasterizer and is shared by all the
+ * contexts of the screen, each with up to MAX_SCENES scenes in flight.
+ * Once it is full, lp_scene_enqueue() blocks until the rasterizer has
+ * taken a scene off it.
+ */
+#define MAX_SCENE_QUEUE 8
 
 struct scene_packet {
    struct util_packet header;
@@ -32,10 +32,12 @@
 #include "util/u_format.h"
 #include "util/u_string.h"
 #include "util/u_format_s3tc.h"
+#include "util/disk_cache.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 #include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_init.h"
 
 #include "os/os_misc.h"
 #include "os/os_time.h"
@@ -48,6 +50,7 @@
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_query.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -210,6 +213,10 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
+      /* Clover also probes this screen, and needs the global memory caps
+       * and the set_global_binding/set_compute_resources hooks, which
+       * aren't implemented yet.
+       */
       return 0;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
@@ -366,11 +373,93 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      /* no texturing or images in compute shaders yet */
+      case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
+      case PIPE_SHADER_CAP_MAX_SAMPLER_VIEWS:
+      case PIPE_SHADER_CAP_MAX_SHADER_IMAGES:
+      case PIPE_SHADER_CAP_MAX_INPUTS:
+      case PIPE_SHADER_CAP_MAX_OUTPUTS:
+         return 0;
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return LP_MAX_TGSI_SHADER_BUFFERS;
+      default:
+         return gallivm_get_shader_param(param);
+      }
    default:
       return 0;
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_shader_ir ir_type,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      return 0;
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+      if (ret) {
+         uint64_t *grid_dimension = ret;
+         *grid_dimension = 3;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      if (ret) {
+         uint64_t *grid_size = ret;
+         grid_size[0] = 65535;
+         grid_size[1] = 65535;
+         grid_size[2] = 65535;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      if (ret) {
+         uint64_t *block_size = ret;
+         block_size[0] = LP_MAX_CS_THREADS_PER_BLOCK;
+         block_size[1] = LP_MAX_CS_THREADS_PER_BLOCK;
+         block_size[2] = LP_MAX_CS_THREADS_PER_BLOCK;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      if (ret) {
+         uint64_t *max_threads_per_block = ret;
+         *max_threads_per_block = LP_MAX_CS_THREADS_PER_BLOCK;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      if (ret) {
+         uint64_t *max_local_size = ret;
+         *max_local_size = LP_MAX_CS_SHARED_SIZE;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+      if (ret) {
+         uint32_t *max_compute_units = ret;
+         *max_compute_units = MAX2(screen->num_threads, 1);
+      }
+      return sizeof(uint32_t);
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+      if (ret) {
+         uint32_t *subgroup_size = ret;
+         *subgroup_size = MIN2(lp_native_vector_width / 32, 16);
+      }
+      return sizeof(uint32_t);
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+      break;
+   }
+   return 0;
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -524,6 +613,18 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+
+   /* Scenes are rasterized asynchronously, so make sure all the rendering
+    * queued so far has landed before presenting.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   pipe_mutex_unlock(screen->rast_mutex);
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 
    assert(texture->dt);
    if (texture->dt)
@@ -539,6 +640,14 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
+   if (util_queue_is_initialized(&screen->compile_queue))
+      util_queue_destroy(&screen->compile_queue);
+
+   disk_cache_destroy(screen->disk_cache);
+   pipe_mutex_destroy(screen->disk_cache_mutex);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
@@ -552,6 +661,38 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
 
 
+/**
+ * Driver specific queries, for the HUD.
+ */
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, ENUM) \
+   {NAME, ENUM, {0}, PIPE_DRIVER_QUERY_TYPE_UINT64, \
+    PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE, 0, 0x0}
+
+   static const struct pipe_driver_query_info queries[] = {
+      QUERY("fs-variant-hits", LP_QUERY_FS_VARIANT_HITS),
+      QUERY("fs-variant-misses", LP_QUERY_FS_VARIANT_MISSES),
+      QUERY("fs-variants-pending", LP_QUERY_FS_VARIANT_PENDING),
+      QUERY("draw-unique-indices", LP_QUERY_DRAW_UNIQUE_INDICES),
+      QUERY("draw-vs-invocations", LP_QUERY_DRAW_VS_INVOCATIONS),
+   };
+#undef QUERY
+
+   if (!info)
+      return ARRAY_SIZE(queries);
+
+   if (index >= ARRAY_SIZE(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+
 /**
  * Fence reference counting.
  */
@@ -599,6 +740,7 @@ struct pipe_screen *
 llvmpipe_create_screen(struct sw_winsys *winsys)
 {
    struct llvmpipe_screen *screen;
+   unsigned num_compile_threads;
 
    util_cpu_detect();
 
@@ -626,6 +768,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_device_vendor = llvmpipe_get_vendor; // TODO should be the CPU vendor
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
@@ -636,6 +779,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
 
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
+
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
    screen->num_threads = util_cpu_caps.nr_cpus > 1 ? util_cpu_caps.nr_cpus : 0;
@@ -653,7 +798,63 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    pipe_mutex_init(screen->rast_mutex);
 
+   screen->disk_cache = disk_cache_create("llvmpipe");
+   pipe_mutex_init(screen->disk_cache_mutex);
+
+   /* Without compiler threads (or if they can't be created) all shader
+    * variants are compiled synchronously at full optimization.
+    */
+   num_compile_threads = debug_get_num_option("LP_ASYNC_COMPILE", 0);
+   if (num_compile_threads) {
+      util_queue_init(&screen->compile_queue, "lpcc", 32,
+                      MIN2(num_compile_threads, LP_MAX_THREADS));
+      screen->tier_up_draws = debug_get_num_option("LP_TIER_UP_DRAWS", 8);
+   }
+
    util_format_s3tc_init();
 
    return &screen->base;
 }
+
+
+/**
+ * Look up the object code of a shader variant stored by an earlier run.
+ * On a hit cache->data/data_size are filled in, otherwise they are left
+ * empty and the variant is compiled as usual.
+ *
+ * This and lp_disk_cache_insert_shader() are called by the compiler
+ * threads too.  The eviction in disk_cache_put() isn't meant to run
+ * concurrently within a process, so the cache calls are serialized.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char *sha1)
+{
+   if (!screen->disk_cache)
+      return;
+
+   pipe_mutex_lock(screen->disk_cache_mutex);
+   cache->data = disk_cache_get(screen->disk_cache, sha1, &cache->data_size);
+   pipe_mutex_unlock(screen->disk_cache_mutex);
+   if (!cache->data)
+      cache->data_size = 0;
+}
+
+
+/**
+ * Store the object code of a freshly compiled shader variant, unless it
+ * depends on state of the current process.
+ */
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char *sha1)
+{
+   if (!screen->disk_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   pipe_mutex_lock(screen->disk_cache_mutex);
+   disk_cache_put(screen->disk_cache, sha1, cache->data, cache->data_size);
+   pipe_mutex_unlock(screen->disk_cache_mutex);
+}
@@ -37,10 +37,14 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 
 
 struct sw_winsys;
+struct lp_fence;
+struct lp_cached_code;
+struct disk_cache;
 
 
 struct llvmpipe_screen
@@ -57,6 +61,19 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Fence of the last scene queued to the rasterizer, by any context */
+   struct lp_fence *last_fence;
+
+   /** Object code of shader variants compiled by earlier runs, or NULL */
+   struct disk_cache *disk_cache;
+   /** Serializes the disk cache calls of the context and compiler threads */
+   pipe_mutex disk_cache_mutex;
+
+   /** Threads compiling optimized shader variants, see LP_ASYNC_COMPILE */
+   struct util_queue compile_queue;
+   /** Draws after which a variant is hot enough to optimize */
+   unsigned tier_up_draws;
 };
 
 
@@ -69,5 +86,15 @@ llvmpipe_screen( struct pipe_screen *pipe )
 }
 
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char *sha1);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char *sha1);
+
 
 #endif /* LP_SCREEN_H */
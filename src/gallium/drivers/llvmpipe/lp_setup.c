@@ -73,12 +73,16 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    setup->scene = setup->scenes[setup->scene_idx];
 
+   /* The scenes are handed to the rasterizer in order, so the oldest one
+    * is the most likely to have been completed already.
+    */
    if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
       lp_fence_wait(setup->scene->fence);
+      lp_scene_reset(setup->scene);
    }
 
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
@@ -164,23 +168,15 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   pipe_mutex_lock(screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* We don't wait for the rasterizer here: binning of the next scene
+    * proceeds while this one is rasterized.  The scene is only recycled
+    * once its fence has signalled, see lp_setup_get_empty_scene().
     */
+   pipe_mutex_lock(screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
+   lp_fence_reference(&screen->last_fence, scene->fence);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -327,6 +323,7 @@ set_scene_state( struct lp_setup_context *setup,
          if (!execute_clears( setup ))
             goto fail;
 
+      lp_setup_end_sub_binning( setup );
       lp_setup_rasterize_scene( setup );
       assert(setup->scene == NULL);
       break;
@@ -341,7 +338,8 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_setup_end_sub_binning(setup);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -635,9 +633,8 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __FUNCTION__,
           variant);
-   /* FIXME: reference count */
 
-   setup->fs.current.variant = variant;
+   lp_fs_variant_reference(&setup->fs.current.variant, variant);
    setup->dirty |= LP_SETUP_NEW_FS;
 }
 
@@ -989,11 +986,20 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
+   /* check the scene being binned and the scenes still being rasterized,
+    * which may have been binned against a different framebuffer
+    */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      const struct lp_scene *scene = setup->scenes[i];
+      unsigned ref;
+
+      if (scene != setup->scene &&
+          (!scene->fence || lp_fence_signalled(scene->fence)))
+         continue;
+
+      ref = lp_scene_is_resource_referenced(scene, texture);
+      if (ref)
+         return ref;
    }
 
    return LP_UNREFERENCED;
@@ -1163,9 +1169,16 @@ try_update_scene_state( struct lp_setup_context *setup )
                 sizeof setup->fs.current);
          setup->fs.stored = stored;
          
-         /* The scene now references the textures in the rasterization
-          * state record.  Note that now.
+         /* The scene now references the shader variant and the textures
+          * in the rasterization state record.  Note that now.
           */
+         if (setup->fs.current.variant &&
+             !lp_scene_add_frag_shader_reference(scene,
+                                                 setup->fs.current.variant)) {
+            assert(!new_scene);
+            return FALSE;
+         }
+
          for (i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
@@ -1281,6 +1294,8 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    lp_setup_reset( setup );
 
+   lp_setup_destroy_bin_jobs(setup);
+
    util_unreference_framebuffer_state(&setup->fb);
 
    for (i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
@@ -1291,13 +1306,16 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
+   lp_fs_variant_reference(&setup->fs.current.variant, NULL);
+
    /* free the scenes in the 'empty' queue */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene->fence && lp_fence_issued(scene->fence))
          lp_fence_wait(scene->fence);
 
+      lp_scene_reset(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1349,6 +1367,13 @@ lp_setup_create( struct pipe_context *pipe,
       }
    }
 
+   /* optional multithreaded triangle setup and binning */
+   if (!lp_setup_init_bin_jobs(setup,
+                               MIN2(debug_get_num_option("LP_SETUP_THREADS", 0),
+                                    LP_MAX_THREADS))) {
+      goto no_scenes;
+   }
+
    setup->triangle = first_triangle;
    setup->line     = first_line;
    setup->point    = first_point;
@@ -1493,6 +1518,15 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
    if (0) debug_printf("%s\n", __FUNCTION__);
 
+   if (setup->sub_binning) {
+      /* Binning into a sub-scene on a bin_queue thread, where the scene
+       * can't be flushed.  The caller will bin the rest of the range
+       * serially once the sub-scene has been merged.
+       */
+      setup->sub_binning_failed = TRUE;
+      return FALSE;
+   }
+
    assert(setup->state == SETUP_ACTIVE);
 
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
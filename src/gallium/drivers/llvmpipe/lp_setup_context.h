@@ -43,6 +43,7 @@
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
+#include "util/u_queue.h"
 
 #define LP_SETUP_NEW_FS          0x01
 #define LP_SETUP_NEW_CONSTANTS   0x02
@@ -52,11 +53,14 @@
 
 
 struct lp_setup_variant;
+struct lp_setup_bin_job;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/**
+ * Max number of scenes per context.  While one scene is being rasterized
+ * the setup code bins into the next one, see lp_setup_get_empty_scene().
+ */
+#define MAX_SCENES 4
 
 
 
@@ -155,6 +159,19 @@ struct lp_setup_context
 
    unsigned dirty;   /**< bitmask of LP_SETUP_NEW_x bits */
 
+   /**
+    * Multithreaded triangle setup and binning, see
+    * lp_setup_draw_triangles_mt().  bin_jobs has num_bin_threads + 1
+    * entries, the last range of a draw is binned by the calling thread.
+    */
+   unsigned num_bin_threads;
+   struct util_queue bin_queue;
+   struct lp_setup_bin_job *bin_jobs;
+
+   /** This is a copy binning into a private sub-scene, can't flush */
+   boolean sub_binning;
+   boolean sub_binning_failed;
+
    void (*point)( struct lp_setup_context *,
                   const float (*v0)[4]);
 
@@ -189,6 +206,30 @@ void lp_setup_choose_point( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
+/**
+ * A range of triangles set up and binned into a private sub-scene by one
+ * of the bin_queue threads.
+ */
+struct lp_setup_bin_job
+{
+   struct lp_setup_context setup;   /**< private copy, bins into scene */
+   struct lp_scene *scene;
+   struct util_queue_fence fence;
+
+   const void *vertex_buffer;
+   const ushort *indices;           /**< NULL for non-indexed draws */
+   unsigned stride;
+   unsigned first, last;            /**< range of triangles */
+   unsigned failed_at;              /**< first triangle not fully binned */
+};
+
+boolean lp_setup_init_bin_jobs(struct lp_setup_context *setup,
+                               unsigned num_bin_threads);
+
+void lp_setup_destroy_bin_jobs(struct lp_setup_context *setup);
+
+void lp_setup_end_sub_binning(struct lp_setup_context *setup);
+
 boolean lp_setup_update_state( struct lp_setup_context *setup,
                             boolean update_scene);
 
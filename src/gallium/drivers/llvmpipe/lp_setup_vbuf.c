@@ -129,6 +129,219 @@ static inline const_float4_ptr get_vert( const void *vertex_buffer,
    return (const_float4_ptr)((char *)vertex_buffer + index * stride);
 }
 
+/**
+ * Triangle lists with at least this many triangles per thread are set up
+ * and binned on the bin_queue threads.
+ */
+#define LP_SETUP_MT_MIN_TRIS 64
+
+
+static void
+bin_triangles_job(void *data, int thread_index)
+{
+   struct lp_setup_bin_job *job = (struct lp_setup_bin_job *) data;
+   struct lp_setup_context *setup = &job->setup;
+   const ushort *indices = job->indices;
+   unsigned i;
+
+   for (i = job->first; i < job->last; i++) {
+      unsigned i0 = indices ? indices[3 * i + 0] : 3 * i + 0;
+      unsigned i1 = indices ? indices[3 * i + 1] : 3 * i + 1;
+      unsigned i2 = indices ? indices[3 * i + 2] : 3 * i + 2;
+
+      setup->triangle( setup,
+                       get_vert(job->vertex_buffer, i0, job->stride),
+                       get_vert(job->vertex_buffer, i1, job->stride),
+                       get_vert(job->vertex_buffer, i2, job->stride) );
+
+      if (setup->sub_binning_failed)
+         break;
+   }
+
+   job->failed_at = i;
+}
+
+
+/**
+ * Set up and bin a triangle list on several threads.
+ *
+ * The triangles are split into contiguous ranges, and each range is binned
+ * into a private sub-scene.  The sub-scenes are then merged into the
+ * current scene in range order, so the commands in each bin end up in API
+ * order and the result is the same as with serial binning.
+ *
+ * If a range runs out of scene memory, it is merged up to the triangle it
+ * failed on, the following ranges are dropped, and the remaining triangles
+ * are binned serially, flushing the scene as usual.
+ *
+ * \param indices  triangle list indices, or NULL for non-indexed
+ * \return FALSE if the draw should be binned serially instead
+ */
+static boolean
+lp_setup_draw_triangles_mt(struct lp_setup_context *setup,
+                           const void *vertex_buffer,
+                           unsigned stride,
+                           const ushort *indices,
+                           unsigned num_tris)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   unsigned num_jobs = setup->num_bin_threads + 1;
+   unsigned tris_per_job, first_failed = 0, i, j;
+   boolean failed = FALSE;
+
+   if (!setup->bin_jobs ||
+       num_tris < num_jobs * LP_SETUP_MT_MIN_TRIS ||
+       setup->state != SETUP_ACTIVE ||
+       lp->active_statistics_queries)
+      return FALSE;
+
+   tris_per_job = DIV_ROUND_UP(num_tris, num_jobs);
+
+   for (j = 0; j < num_jobs; j++) {
+      struct lp_setup_bin_job *job = &setup->bin_jobs[j];
+
+      if (!lp_scene_begin_sub_binning(job->scene, setup->scene)) {
+         while (j--)
+            lp_scene_discard_sub_binning(setup->bin_jobs[j].scene);
+         return FALSE;
+      }
+
+      job->setup = *setup;
+      job->setup.scene = job->scene;
+      job->setup.sub_binning = TRUE;
+      job->setup.sub_binning_failed = FALSE;
+      job->vertex_buffer = vertex_buffer;
+      job->indices = indices;
+      job->stride = stride;
+      job->first = MIN2(j * tris_per_job, num_tris);
+      job->last = MIN2(job->first + tris_per_job, num_tris);
+   }
+
+   for (j = 0; j < num_jobs - 1; j++) {
+      util_queue_add_job(&setup->bin_queue, &setup->bin_jobs[j],
+                         &setup->bin_jobs[j].fence, bin_triangles_job, NULL);
+   }
+   bin_triangles_job(&setup->bin_jobs[num_jobs - 1], 0);
+
+   for (j = 0; j < num_jobs; j++) {
+      struct lp_setup_bin_job *job = &setup->bin_jobs[j];
+
+      if (j < num_jobs - 1)
+         util_queue_job_wait(&job->fence);
+
+      if (failed) {
+         lp_scene_discard_sub_binning(job->scene);
+         continue;
+      }
+
+      lp_scene_merge_sub_binning(setup->scene, job->scene);
+      if (job->setup.sub_binning_failed) {
+         failed = TRUE;
+         first_failed = job->failed_at;
+      }
+   }
+
+   /* A range ran out of scene memory.  The triangle it failed on has been
+    * disabled, so bin it again along with all the following ones,
+    * restarting the scene as needed.
+    */
+   if (failed) {
+      for (i = first_failed; i < num_tris; i++) {
+         unsigned i0 = indices ? indices[3 * i + 0] : 3 * i + 0;
+         unsigned i1 = indices ? indices[3 * i + 1] : 3 * i + 1;
+         unsigned i2 = indices ? indices[3 * i + 2] : 3 * i + 2;
+
+         setup->triangle( setup,
+                          get_vert(vertex_buffer, i0, stride),
+                          get_vert(vertex_buffer, i1, stride),
+                          get_vert(vertex_buffer, i2, stride) );
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Create the threads and sub-scenes for multithreaded binning.
+ */
+boolean
+lp_setup_init_bin_jobs(struct lp_setup_context *setup,
+                       unsigned num_bin_threads)
+{
+   unsigned num_jobs = num_bin_threads + 1;
+   unsigned j;
+
+   if (num_bin_threads == 0)
+      return TRUE;
+
+   setup->bin_jobs = CALLOC(num_jobs, sizeof *setup->bin_jobs);
+   if (!setup->bin_jobs)
+      return FALSE;
+
+   setup->num_bin_threads = num_bin_threads;
+
+   for (j = 0; j < num_jobs; j++) {
+      setup->bin_jobs[j].scene = lp_scene_create(setup->pipe);
+      if (!setup->bin_jobs[j].scene)
+         goto fail;
+      util_queue_fence_init(&setup->bin_jobs[j].fence);
+   }
+
+   if (!util_queue_init(&setup->bin_queue, "lpbin", num_jobs,
+                        num_bin_threads))
+      goto fail;
+
+   return TRUE;
+
+fail:
+   lp_setup_destroy_bin_jobs(setup);
+   return FALSE;
+}
+
+
+/**
+ * Hand the data still held by the binning sub-scenes over to the current
+ * scene.  Called before the scene is rasterized or reset.
+ */
+void
+lp_setup_end_sub_binning(struct lp_setup_context *setup)
+{
+   unsigned j;
+
+   if (!setup->bin_jobs || !setup->scene)
+      return;
+
+   for (j = 0; j < setup->num_bin_threads + 1; j++) {
+      lp_scene_end_sub_binning(setup->scene, setup->bin_jobs[j].scene);
+   }
+}
+
+
+void
+lp_setup_destroy_bin_jobs(struct lp_setup_context *setup)
+{
+   unsigned j;
+
+   if (!setup->bin_jobs)
+      return;
+
+   if (util_queue_is_initialized(&setup->bin_queue))
+      util_queue_destroy(&setup->bin_queue);
+
+   for (j = 0; j < setup->num_bin_threads + 1; j++) {
+      if (setup->bin_jobs[j].scene) {
+         lp_scene_destroy(setup->bin_jobs[j].scene);
+         util_queue_fence_destroy(&setup->bin_jobs[j].fence);
+      }
+   }
+
+   FREE(setup->bin_jobs);
+   setup->bin_jobs = NULL;
+   setup->num_bin_threads = 0;
+}
+
+
 /**
  * draw elements / indexed primitives
  */
@@ -184,6 +397,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      if (lp_setup_draw_triangles_mt(setup, vertex_buffer, stride,
+                                     indices, nr / 3))
+         break;
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-2], stride),
@@ -382,6 +598,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      if (lp_setup_draw_triangles_mt(setup, vertex_buffer, stride,
+                                     NULL, nr / 3))
+         break;
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, i-2, stride),
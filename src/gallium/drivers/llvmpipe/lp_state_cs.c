@@ -0,0 +1,835 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/**
+ * Compute shaders.
+ *
+ * The shader is compiled into a function which runs one SoA vector worth
+ * of invocations of a workgroup.  launch_grid() hands the workgroups out
+ * to the rasterizer threads, which run all the vectors of a workgroup
+ * back to back.
+ *
+ * TGSI BARRIER can't be implemented within the generated code, since all
+ * the vectors of the workgroup must reach it before any of them goes on.
+ * Instead the shader calls back into the driver, which runs each vector of
+ * such workgroups on its own fiber (ucontext), and switches to the next
+ * fiber on every barrier.  Where ucontext is not available every vector
+ * gets its own thread, which is correct but slow.
+ */
+
+#include "pipe/p_defines.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_string.h"
+#include "util/u_atomic.h"
+#include "os/os_thread.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_struct.h"
+
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
+#include "lp_flush.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
+#include "lp_state_cs.h"
+
+#ifdef HAVE_SWAPCONTEXT
+#include <ucontext.h>
+#endif
+
+
+/** Compute shader number (for debugging) */
+static unsigned cs_no = 0;
+
+
+struct lp_cs_llvm_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+
+   LLVMValueRef thread_data_ptr;
+};
+
+
+static void
+cs_iface_emit_barrier(const struct lp_build_tgsi_cs_iface *cs_iface,
+                      struct lp_build_tgsi_context *bld_base)
+{
+   const struct lp_cs_llvm_iface *iface = (const struct lp_cs_llvm_iface *)cs_iface;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMValueRef thread_data_ptr = iface->thread_data_ptr;
+   LLVMValueRef barrier;
+
+   barrier = lp_jit_cs_thread_data_barrier(gallivm, thread_data_ptr);
+   LLVMBuildCall(gallivm->builder, barrier, &thread_data_ptr, 1, "");
+}
+
+
+/**
+ * Generate the compute shader function.  Any change to the prototype must
+ * be reflected in lp_jit.h's lp_jit_cs_func, and vice-versa.
+ */
+static void
+generate_compute(struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef arg_types[6];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef context_ptr, thread_data_ptr, first_invocation;
+   LLVMValueRef block_size_ptr, grid_size_ptr;
+   LLVMValueRef offsets[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef invocation, tmp, num_invocations;
+   LLVMValueRef block_size[3];
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMBasicBlockRef block;
+   struct lp_type type;
+   struct lp_build_context uint_bld;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_cs_llvm_iface cs_iface;
+   char func_name[64];
+   unsigned i;
+
+   memset(&type, 0, sizeof type);
+   type.floating = TRUE;      /* floating point values */
+   type.sign = TRUE;          /* values are signed */
+   type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
+   type.width = 32;           /* 32-bit float */
+   type.length = MIN2(lp_native_vector_width / 32, 16);
+
+   variant->vector_length = type.length;
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u", shader->no);
+
+   arg_types[0] = variant->jit_cs_context_ptr_type;     /* context */
+   arg_types[1] = int32_type;                           /* block_x */
+   arg_types[2] = int32_type;                           /* block_y */
+   arg_types[3] = int32_type;                           /* block_z */
+   arg_types[4] = int32_type;                           /* first_invocation */
+   arg_types[5] = variant->jit_cs_thread_data_ptr_type; /* thread_data */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   LLVMAddAttribute(LLVMGetParam(function, 0), LLVMNoAliasAttribute);
+
+   context_ptr      = LLVMGetParam(function, 0);
+   first_invocation = LLVMGetParam(function, 4);
+   thread_data_ptr  = LLVMGetParam(function, 5);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(LLVMGetParam(function, 1), "block_x");
+   lp_build_name(LLVMGetParam(function, 2), "block_y");
+   lp_build_name(LLVMGetParam(function, 3), "block_z");
+   lp_build_name(first_invocation, "first_invocation");
+   lp_build_name(thread_data_ptr, "thread_data");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(type));
+
+   memset(&system_values, 0, sizeof system_values);
+
+   block_size_ptr = lp_jit_cs_context_block_size(gallivm, context_ptr);
+   grid_size_ptr = lp_jit_cs_context_grid_size(gallivm, context_ptr);
+   for (i = 0; i < 3; i++) {
+      LLVMValueRef idx = lp_build_const_int32(gallivm, i);
+
+      system_values.block_id[i] = LLVMGetParam(function, 1 + i);
+      system_values.block_size[i] = lp_build_array_get(gallivm, block_size_ptr, idx);
+      system_values.grid_size[i] = lp_build_array_get(gallivm, grid_size_ptr, idx);
+      block_size[i] = lp_build_broadcast_scalar(&uint_bld,
+                                                system_values.block_size[i]);
+   }
+
+   /* invocation = first_invocation + {0, 1, 2, ...} */
+   for (i = 0; i < type.length; i++)
+      offsets[i] = lp_build_const_int32(gallivm, i);
+   invocation = lp_build_broadcast_scalar(&uint_bld, first_invocation);
+   invocation = LLVMBuildAdd(builder, invocation,
+                             LLVMConstVector(offsets, type.length), "invocation");
+
+   /* invocations are numbered in x, y, z order */
+   system_values.thread_id[0] = LLVMBuildURem(builder, invocation, block_size[0], "");
+   tmp = LLVMBuildUDiv(builder, invocation, block_size[0], "");
+   system_values.thread_id[1] = LLVMBuildURem(builder, tmp, block_size[1], "");
+   system_values.thread_id[2] = LLVMBuildUDiv(builder, tmp, block_size[1], "");
+
+   /* the last vector of a workgroup may be partially used */
+   num_invocations = LLVMBuildMul(builder, block_size[0], block_size[1], "");
+   num_invocations = LLVMBuildMul(builder, num_invocations, block_size[2], "");
+   lp_build_mask_begin(&mask, gallivm, type,
+                       lp_build_cmp(&uint_bld, PIPE_FUNC_LESS,
+                                    invocation, num_invocations));
+
+   memset(&cs_iface, 0, sizeof cs_iface);
+   cs_iface.base.ssbo_ptr = lp_jit_cs_context_ssbos(gallivm, context_ptr);
+   cs_iface.base.ssbo_sizes_ptr = lp_jit_cs_context_ssbo_sizes(gallivm, context_ptr);
+   cs_iface.base.shared_ptr = lp_jit_cs_thread_data_shared(gallivm, thread_data_ptr);
+   cs_iface.base.shared_size = lp_jit_cs_context_shared_size(gallivm, context_ptr);
+   cs_iface.base.emit_barrier = cs_iface_emit_barrier;
+   cs_iface.thread_data_ptr = thread_data_ptr;
+
+   memset(outputs, 0, sizeof outputs);
+
+   lp_build_tgsi_soa(gallivm, shader->tokens, type, &mask,
+                     lp_jit_cs_context_constants(gallivm, context_ptr),
+                     lp_jit_cs_context_num_constants(gallivm, context_ptr),
+                     &system_values,
+                     NULL,
+                     outputs, context_ptr, thread_data_ptr,
+                     NULL, &shader->info, NULL, &cs_iface.base);
+
+   lp_build_mask_end(&mask);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   util_snprintf(module_name, sizeof(module_name), "cs%u", shader->no);
+
+   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
+      debug_printf("llvmpipe: Compute shader #%u:\n", shader->no);
+      tgsi_dump(shader->tokens, 0);
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs = lp_build_count_ir_module(variant->gallivm->module);
+
+   variant->jit_function = (lp_jit_cs_func)
+      gallivm_jit_function(variant->gallivm, variant->function);
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader;
+
+   if (templ->ir_type != PIPE_SHADER_IR_TGSI)
+      return NULL;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+   shader->base = *templ;
+
+   /* we need to keep a local copy of the tokens */
+   shader->tokens = tgsi_dup_tokens(templ->prog);
+   shader->base.prog = shader->tokens;
+
+   tgsi_scan_shader(shader->tokens, &shader->info);
+
+   shader->variant = generate_variant(llvmpipe, shader);
+   if (!shader->variant) {
+      FREE((void *) shader->tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *)cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct lp_compute_shader *shader = cs;
+
+   gallivm_destroy(shader->variant->gallivm);
+   FREE(shader->variant);
+   FREE((void *) shader->tokens);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_shader_buffers(struct pipe_context *pipe, unsigned shader,
+                            unsigned start_slot, unsigned count,
+                            const struct pipe_shader_buffer *buffers)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(shader < PIPE_SHADER_TYPES);
+   assert(start_slot + count <= LP_MAX_TGSI_SHADER_BUFFERS);
+
+   for (i = 0; i < count; i++) {
+      struct pipe_shader_buffer *dst = &llvmpipe->ssbos[shader][start_slot + i];
+
+      if (buffers && buffers[i].buffer) {
+         pipe_resource_reference(&dst->buffer, buffers[i].buffer);
+         dst->buffer_offset = buffers[i].buffer_offset;
+         dst->buffer_size = buffers[i].buffer_size;
+      }
+      else {
+         pipe_resource_reference(&dst->buffer, NULL);
+         dst->buffer_offset = 0;
+         dst->buffer_size = 0;
+      }
+   }
+}
+
+
+/*
+ * Execution
+ */
+
+#define LP_CS_STACK_SIZE (128 * 1024)
+
+/** Most vectors a workgroup can take, see llvmpipe_get_compute_param() */
+#define LP_MAX_CS_CHUNKS (LP_MAX_CS_THREADS_PER_BLOCK / 4)
+
+
+struct lp_cs_job
+{
+   const struct lp_compute_shader_variant *variant;
+   struct lp_jit_cs_context jit_context;
+
+   unsigned grid[3];
+   uint64_t num_blocks;
+
+   /** Invocations per workgroup, and the number of vectors they take */
+   unsigned num_invocations;
+   unsigned num_chunks;
+
+   boolean use_barrier;
+
+   /** Next workgroup to run, shared by all the workers */
+   int64_t next_block;
+
+   /** Per worker data, indexed by thread */
+   struct lp_cs_worker *workers;
+};
+
+
+/**
+ * State of one vector of invocations of a workgroup with barriers.
+ */
+struct lp_cs_fiber
+{
+   /** Must come first, the barrier callback casts it back */
+   struct lp_jit_cs_thread_data thread_data;
+
+   const struct lp_cs_job *job;
+   unsigned block[3];
+   unsigned first_invocation;
+   boolean done;
+
+#ifdef HAVE_SWAPCONTEXT
+   ucontext_t context;
+   ucontext_t *scheduler;
+#else
+   pipe_barrier *barrier;
+#endif
+};
+
+
+/**
+ * Per thread memory of launch_grid.  It is kept by the context from one
+ * grid to the next, and only grows.
+ */
+struct lp_cs_worker
+{
+   /** Must come first, see lp_cs_fiber */
+   struct lp_jit_cs_thread_data thread_data;
+
+   void *shared;
+   unsigned shared_size;
+
+   /** Only allocated for shaders with barriers, max_chunks of each */
+   struct lp_cs_fiber *fibers;
+#ifdef HAVE_SWAPCONTEXT
+   char *stacks;
+#endif
+   unsigned max_chunks;
+};
+
+
+static void
+cs_barrier_noop(struct lp_jit_cs_thread_data *thread_data)
+{
+   /* All the invocations of the workgroup fit in a single vector. */
+}
+
+
+static inline void
+cs_run_fiber(struct lp_cs_fiber *fiber)
+{
+   const struct lp_cs_job *job = fiber->job;
+
+   job->variant->jit_function(&job->jit_context,
+                              fiber->block[0],
+                              fiber->block[1],
+                              fiber->block[2],
+                              fiber->first_invocation,
+                              &fiber->thread_data);
+   fiber->done = TRUE;
+}
+
+
+#ifdef HAVE_SWAPCONTEXT
+
+static void
+cs_barrier_fiber(struct lp_jit_cs_thread_data *thread_data)
+{
+   struct lp_cs_fiber *fiber = (struct lp_cs_fiber *)thread_data;
+
+   swapcontext(&fiber->context, fiber->scheduler);
+}
+
+
+/**
+ * makecontext() only passes int arguments, so split the pointer.
+ */
+static void
+cs_fiber_entry(int hi, int lo)
+{
+   uintptr_t ptr = ((uintptr_t)(unsigned)hi << 16 << 16) | (unsigned)lo;
+
+   cs_run_fiber((struct lp_cs_fiber *)ptr);
+}
+
+
+static void
+cs_run_block_with_barrier(struct lp_cs_worker *worker,
+                          const struct lp_cs_job *job)
+{
+   uintptr_t ptr;
+   ucontext_t scheduler;
+   unsigned i, remaining;
+
+   for (i = 0; i < job->num_chunks; i++) {
+      struct lp_cs_fiber *fiber = &worker->fibers[i];
+
+      fiber->done = FALSE;
+      fiber->scheduler = &scheduler;
+
+      getcontext(&fiber->context);
+      fiber->context.uc_stack.ss_sp = worker->stacks + i * LP_CS_STACK_SIZE;
+      fiber->context.uc_stack.ss_size = LP_CS_STACK_SIZE;
+      fiber->context.uc_link = &scheduler;
+
+      ptr = (uintptr_t)fiber;
+      makecontext(&fiber->context, (void (*)(void))cs_fiber_entry, 2,
+                  (int)(unsigned)(ptr >> 16 >> 16), (int)(unsigned)ptr);
+   }
+
+   /* Every pass takes each vector to its next barrier, or to the end. */
+   do {
+      remaining = 0;
+      for (i = 0; i < job->num_chunks; i++) {
+         struct lp_cs_fiber *fiber = &worker->fibers[i];
+
+         if (!fiber->done) {
+            swapcontext(&scheduler, &fiber->context);
+            if (!fiber->done)
+               remaining++;
+         }
+      }
+   } while (remaining);
+}
+
+#else /* !HAVE_SWAPCONTEXT */
+
+static void
+cs_barrier_thread(struct lp_jit_cs_thread_data *thread_data)
+{
+   struct lp_cs_fiber *fiber = (struct lp_cs_fiber *)thread_data;
+
+   pipe_barrier_wait(fiber->barrier);
+}
+
+
+static PIPE_THREAD_ROUTINE(cs_fiber_thread, data)
+{
+   cs_run_fiber((struct lp_cs_fiber *)data);
+   return 0;
+}
+
+
+static void
+cs_run_block_with_barrier(struct lp_cs_worker *worker,
+                          const struct lp_cs_job *job)
+{
+   pipe_thread threads[LP_MAX_CS_CHUNKS];
+   pipe_barrier barrier;
+   unsigned i;
+
+   pipe_barrier_init(&barrier, job->num_chunks);
+
+   for (i = 0; i < job->num_chunks; i++) {
+      worker->fibers[i].done = FALSE;
+      worker->fibers[i].barrier = &barrier;
+      threads[i] = pipe_thread_create(cs_fiber_thread, &worker->fibers[i]);
+   }
+
+   for (i = 0; i < job->num_chunks; i++)
+      pipe_thread_wait(threads[i]);
+
+   pipe_barrier_destroy(&barrier);
+}
+
+#endif /* !HAVE_SWAPCONTEXT */
+
+
+static void
+cs_run_block(struct lp_cs_worker *worker,
+             const struct lp_cs_job *job,
+             const unsigned block[3])
+{
+   unsigned vector_length = job->variant->vector_length;
+   unsigned i;
+
+   if (job->use_barrier) {
+      for (i = 0; i < job->num_chunks; i++) {
+         struct lp_cs_fiber *fiber = &worker->fibers[i];
+
+         fiber->job = job;
+         fiber->block[0] = block[0];
+         fiber->block[1] = block[1];
+         fiber->block[2] = block[2];
+         fiber->first_invocation = i * vector_length;
+      }
+
+      cs_run_block_with_barrier(worker, job);
+   }
+   else {
+      for (i = 0; i < job->num_invocations; i += vector_length) {
+         job->variant->jit_function(&job->jit_context,
+                                    block[0], block[1], block[2], i,
+                                    &worker->thread_data);
+      }
+   }
+}
+
+
+/**
+ * Rasterizer thread entrypoint: run workgroups until there are none left.
+ */
+static void
+cs_exec(void *data, unsigned thread_index)
+{
+   struct lp_cs_job *job = (struct lp_cs_job *)data;
+   struct lp_cs_worker *worker = &job->workers[thread_index];
+   unsigned block[3];
+   int64_t index;
+
+   while ((index = p_atomic_inc_return(&job->next_block) - 1) <
+          (int64_t)job->num_blocks) {
+      uint64_t tmp = index;
+
+      block[0] = tmp % job->grid[0];
+      tmp /= job->grid[0];
+      block[1] = tmp % job->grid[1];
+      block[2] = tmp / job->grid[1];
+
+      cs_run_block(worker, job, block);
+   }
+}
+
+
+/**
+ * Make the worker's memory big enough for the job.
+ */
+static boolean
+init_worker(struct lp_cs_worker *worker,
+            const struct lp_cs_job *job)
+{
+   unsigned shared_size = MAX2(job->jit_context.shared_size, 4);
+   unsigned i;
+
+   if (shared_size > worker->shared_size) {
+      align_free(worker->shared);
+      worker->shared = align_malloc(shared_size, 16);
+      worker->shared_size = worker->shared ? shared_size : 0;
+      if (!worker->shared)
+         return FALSE;
+   }
+
+   worker->thread_data.shared = worker->shared;
+   worker->thread_data.barrier = cs_barrier_noop;
+
+   if (!job->use_barrier)
+      return TRUE;
+
+   if (job->num_chunks > worker->max_chunks) {
+      FREE(worker->fibers);
+      worker->fibers = CALLOC(job->num_chunks, sizeof *worker->fibers);
+#ifdef HAVE_SWAPCONTEXT
+      FREE(worker->stacks);
+      worker->stacks = MALLOC(job->num_chunks * LP_CS_STACK_SIZE);
+      if (!worker->stacks) {
+         FREE(worker->fibers);
+         worker->fibers = NULL;
+      }
+#endif
+      worker->max_chunks = worker->fibers ? job->num_chunks : 0;
+      if (!worker->fibers)
+         return FALSE;
+   }
+
+   for (i = 0; i < job->num_chunks; i++) {
+      worker->fibers[i].thread_data.shared = worker->shared;
+#ifdef HAVE_SWAPCONTEXT
+      worker->fibers[i].thread_data.barrier = cs_barrier_fiber;
+#else
+      worker->fibers[i].thread_data.barrier = cs_barrier_thread;
+#endif
+   }
+
+   return TRUE;
+}
+
+
+static void
+destroy_worker(struct lp_cs_worker *worker)
+{
+   align_free(worker->shared);
+   FREE(worker->fibers);
+#ifdef HAVE_SWAPCONTEXT
+   FREE(worker->stacks);
+#endif
+}
+
+
+static void
+update_cs_context(struct llvmpipe_context *llvmpipe,
+                  const struct lp_compute_shader *shader,
+                  struct lp_jit_cs_context *jit_context)
+{
+   static const float fake_const_buf[4];
+   unsigned i;
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      const struct pipe_constant_buffer *cb =
+         &llvmpipe->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         jit_context->constants[i] = (const float *)(data + cb->buffer_offset);
+         jit_context->num_constants[i] = cb->buffer_size / (4 * sizeof(float));
+      }
+      else {
+         jit_context->constants[i] = fake_const_buf;
+         jit_context->num_constants[i] = 0;
+      }
+   }
+
+   for (i = 0; i < LP_MAX_TGSI_SHADER_BUFFERS; i++) {
+      const struct pipe_shader_buffer *sb =
+         &llvmpipe->ssbos[PIPE_SHADER_COMPUTE][i];
+
+      if (sb->buffer) {
+         ubyte *data = (ubyte *) llvmpipe_resource_data(sb->buffer);
+         unsigned size = sb->buffer->width0 - MIN2(sb->buffer_offset,
+                                                   sb->buffer->width0);
+
+         jit_context->ssbos[i] = (uint32_t *)(data + sb->buffer_offset);
+         jit_context->ssbo_sizes[i] = MIN2(sb->buffer_size, size);
+      }
+      else {
+         jit_context->ssbos[i] = NULL;
+         jit_context->ssbo_sizes[i] = 0;
+      }
+   }
+
+   jit_context->shared_size = shader->base.req_local_mem;
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const struct pipe_grid_info *info)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   const struct lp_compute_shader *shader = llvmpipe->cs;
+   unsigned num_workers = MAX2(screen->num_threads, 1);
+   struct lp_cs_job job;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   /* The shader may read and write what previous draws wrote. */
+   llvmpipe_flush(pipe, NULL, __FUNCTION__);
+
+   memset(&job, 0, sizeof job);
+   job.variant = shader->variant;
+
+   if (info->indirect) {
+      const ubyte *data = (const ubyte *) llvmpipe_resource_data(info->indirect);
+
+      memcpy(job.grid, data + info->indirect_offset, sizeof job.grid);
+   }
+   else {
+      job.grid[0] = info->grid[0];
+      job.grid[1] = info->grid[1];
+      job.grid[2] = info->grid[2];
+   }
+
+   job.num_blocks = (uint64_t)job.grid[0] * job.grid[1] * job.grid[2];
+   job.num_invocations = info->block[0] * info->block[1] * info->block[2];
+   if (!job.num_blocks || !job.num_invocations)
+      return;
+
+   job.num_chunks = DIV_ROUND_UP(job.num_invocations,
+                                 shader->variant->vector_length);
+   job.use_barrier = shader->info.opcode_count[TGSI_OPCODE_BARRIER] &&
+                     job.num_chunks > 1;
+
+   update_cs_context(llvmpipe, shader, &job.jit_context);
+   for (i = 0; i < 3; i++) {
+      job.jit_context.grid_size[i] = job.grid[i];
+      job.jit_context.block_size[i] = info->block[i];
+   }
+
+   if (!llvmpipe->cs_workers) {
+      llvmpipe->cs_workers = CALLOC(num_workers, sizeof *job.workers);
+      if (!llvmpipe->cs_workers)
+         return;
+      llvmpipe->num_cs_workers = num_workers;
+   }
+   job.workers = llvmpipe->cs_workers;
+
+   for (i = 0; i < num_workers; i++) {
+      if (!init_worker(&job.workers[i], &job))
+         return;
+   }
+
+   if (llvmpipe->active_statistics_queries) {
+      llvmpipe->pipeline_statistics.cs_invocations +=
+         job.num_blocks * job.num_invocations;
+   }
+
+   /* The rasterizer threads are shared by all the contexts of the screen,
+    * so keep scenes from being queued while they run the workgroups.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   if (screen->last_fence)
+      lp_fence_wait(screen->last_fence);
+   lp_rast_run_job(screen->rast, cs_exec, &job);
+   pipe_mutex_unlock(screen->rast_mutex);
+}
+
+
+/**
+ * Free the memory kept for launch_grid.
+ */
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i;
+
+   for (i = 0; i < llvmpipe->num_cs_workers; i++)
+      destroy_worker(&llvmpipe->cs_workers[i]);
+   FREE(llvmpipe->cs_workers);
+   llvmpipe->cs_workers = NULL;
+   llvmpipe->num_cs_workers = 0;
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_shader_buffers = llvmpipe_set_shader_buffers;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
@@ -0,0 +1,87 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+
+#ifndef LP_STATE_CS_H_
+#define LP_STATE_CS_H_
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "gallivm/lp_bld.h"
+#include "lp_jit.h"
+
+
+struct llvmpipe_context;
+
+
+struct lp_compute_shader_variant
+{
+   struct gallivm_state *gallivm;
+
+   LLVMTypeRef jit_cs_context_ptr_type;
+   LLVMTypeRef jit_cs_thread_data_ptr_type;
+
+   LLVMValueRef function;
+   lp_jit_cs_func jit_function;
+
+   /** Number of invocations run by each call of jit_function */
+   unsigned vector_length;
+
+   /* Total number of LLVM instructions generated */
+   unsigned nr_instrs;
+};
+
+
+/** Subclass of pipe_compute_state */
+struct lp_compute_shader
+{
+   struct pipe_compute_state base;
+
+   const struct tgsi_token *tokens;
+   struct tgsi_shader_info info;
+
+   /*
+    * Compute shaders have no state dependent key (no samplers or images
+    * yet), so there is a single variant, compiled at creation.
+    */
+   struct lp_compute_shader_variant *variant;
+
+   /* For debugging/profiling purposes */
+   unsigned no;
+};
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe);
+
+
+#endif /* LP_STATE_CS_H_ */
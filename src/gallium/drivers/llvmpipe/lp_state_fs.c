@@ -67,6 +67,8 @@
 #include "util/u_string.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/hash_table.h"
+#include "util/mesa-sha1.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -101,6 +103,7 @@
 #include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -422,7 +425,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -1685,7 +1688,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* The blending code below doesn't go wider than 256 bits */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256) :
+                                         lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2160,9 +2165,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
+                  const char *module_name,
                   unsigned partial_mask)
 {
    struct gallivm_state *gallivm = variant->gallivm;
@@ -2249,8 +2254,8 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   util_snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-                 shader->no, variant->no, partial_mask ? "partial" : "whole");
+   util_snprintf(func_name, sizeof(func_name), "%s_%s",
+                 module_name, partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2322,7 +2327,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
    num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
    /* for 1d resources only run "upper half" of stamp */
-   if (key->resource_1d)
+   if (key->resource_1d && num_fs > 1)
       num_fs /= 2;
 
    {
@@ -2407,6 +2412,42 @@ generate_fragment(struct llvmpipe_context *lp,
 
    sampler->destroy(sampler);
 
+   /*
+    * With 512-bit vectors the shader runs the whole stamp at once, but
+    * blending handles at most 8 pixels at a time, so split the outputs.
+    */
+   if (fs_type.length == 16) {
+      struct lp_type half_type = fs_type;
+      LLVMTypeRef half_vec_type;
+      unsigned num_rts = dual_source_blend ? MAX2(key->nr_cbufs, 2) :
+                                             key->nr_cbufs;
+
+      half_type.length = 8;
+      half_vec_type = lp_build_vec_type(gallivm, half_type);
+
+      for (cbuf = 0; cbuf < num_rts; cbuf++) {
+         if (cbuf >= key->nr_cbufs && cbuf != 1)
+            continue;
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+            LLVMValueRef color = LLVMBuildLoad(builder,
+                                               fs_out_color[cbuf][chan][0], "");
+            for (i = 0; i < 2; i++) {
+               LLVMValueRef ptr = lp_build_alloca(gallivm, half_vec_type, "");
+               LLVMBuildStore(builder,
+                              lp_build_extract_range(gallivm, color, i * 8, 8),
+                              ptr);
+               fs_out_color[cbuf][chan][i] = ptr;
+            }
+         }
+      }
+
+      fs_mask[1] = lp_build_extract_range(gallivm, fs_mask[0], 8, 8);
+      fs_mask[0] = lp_build_extract_range(gallivm, fs_mask[0], 0, 8);
+
+      fs_type = half_type;
+      num_fs = key->resource_1d ? 1 : 2;
+   }
+
    /* Loop over color outputs / color buffers to do blending.
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
@@ -2548,17 +2589,69 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
 }
 
 
+/**
+ * Compute the name under which the object code of a variant is kept in the
+ * disk cache.  The generated code is fully determined by the variant key
+ * and the shader tokens, besides the state of gallivm itself.
+ *
+ * Functions in object code are looked up by name, so the module is named
+ * after the hash too rather than after the order shaders were created in.
+ *
+ * \return FALSE if the variant must not be cached.
+ */
+static boolean
+get_variant_cache_key(const struct lp_fragment_shader *shader,
+                      const struct lp_fragment_shader_variant_key *key,
+                      unsigned char sha1[20],
+                      char *module_name, size_t module_name_size)
+{
+#ifdef ENABLE_SHADER_CACHE
+   struct mesa_sha1 *ctx;
+   char sha1_str[41];
+   boolean ok;
+
+   ctx = _mesa_sha1_init();
+   if (!ctx)
+      return FALSE;
+
+   ok = gallivm_hash_codegen_state(ctx);
+   _mesa_sha1_update(ctx, "fs", 2);
+   _mesa_sha1_update(ctx, key, shader->variant_key_size);
+   _mesa_sha1_update(ctx, shader->base.tokens,
+                     tgsi_num_tokens(shader->base.tokens) *
+                     sizeof(struct tgsi_token));
+   _mesa_sha1_final(ctx, sha1);
+
+   _mesa_sha1_format(sha1_str, sha1);
+   util_snprintf(module_name, module_name_size, "fs_%.16s", sha1_str);
+
+   return ok;
+#else
+   return FALSE;
+#endif
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * This only reads the shader, so it may run on a compiler thread, as long
+ * as it is given an LLVMContext of its own.
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
+generate_variant(struct llvmpipe_screen *screen,
+                 LLVMContextRef context,
                  struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+                 const struct lp_fragment_shader_variant_key *key,
+                 unsigned variant_no,
+                 boolean fast_compile)
 {
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
+   struct lp_cached_code cached = { 0 };
+   unsigned char sha1[20];
+   boolean use_cache, cache_hit;
    boolean fullcolormask;
    char module_name[64];
 
@@ -2566,19 +2659,44 @@ generate_variant(struct llvmpipe_context *lp,
    if (!variant)
       return NULL;
 
-   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-                 shader->no, shader->variants_created);
+   use_cache = screen->disk_cache &&
+               get_variant_cache_key(shader, key, sha1,
+                                     module_name, sizeof(module_name));
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (use_cache) {
+      lp_disk_cache_find_shader(screen, &cached, sha1);
+   }
+   else {
+      util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                    shader->no, variant_no);
+   }
+   cache_hit = cached.data_size != 0;
+
+   variant->gallivm = gallivm_create(module_name, context);
    if (!variant->gallivm) {
+      free(cached.data);
       FREE(variant);
       return NULL;
    }
 
+   /* Optimized code from the disk cache is as fast to load as anything.
+    * Fast code on the other hand is only a stopgap, so never persist it.
+    */
+   if (cache_hit)
+      fast_compile = FALSE;
+   else if (fast_compile)
+      use_cache = FALSE;
+
+   if (use_cache)
+      variant->gallivm->cache = &cached;
+   variant->gallivm->fast_compile = fast_compile;
+
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+   variant->no = variant_no;
+   pipe_reference_init(&variant->reference, 1);
+   util_queue_fence_init(&variant->compile_fence);
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
@@ -2616,12 +2734,12 @@ generate_variant(struct llvmpipe_context *lp,
    lp_jit_init_types(variant);
    
    if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      generate_fragment(shader, variant, module_name, RAST_EDGE_TEST);
 
    if (variant->jit_function[RAST_WHOLE] == NULL) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+         generate_fragment(shader, variant, module_name, RAST_WHOLE);
       }
    }
 
@@ -2647,12 +2765,163 @@ generate_variant(struct llvmpipe_context *lp,
       variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
    }
 
+   /* The object code is only produced once the functions are looked up. */
+   if (use_cache && !cache_hit)
+      lp_disk_cache_insert_shader(screen, &cached, sha1);
+
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    return variant;
 }
 
 
+struct lp_fs_compile_job
+{
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+};
+
+
+/**
+ * Compiler thread: produce the optimized code of a variant which currently
+ * runs fast-compiled code, and swap it in.
+ */
+static void
+compile_variant_job(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = (struct lp_fs_compile_job *)data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader_variant *optimized;
+   LLVMContextRef context;
+
+   context = LLVMContextCreate();
+   if (!context)
+      return;
+
+   optimized = generate_variant(job->screen, context, variant->shader,
+                                &variant->key, variant->no, FALSE);
+   if (optimized) {
+      /* The rasterizer threads may be calling through jit_function[] at
+       * any time; each pointer store is atomic and both versions stay
+       * valid until the variant is destroyed.
+       */
+      variant->fallback_gallivm = variant->gallivm;
+      variant->gallivm = optimized->gallivm;
+      p_atomic_set(&variant->jit_function[RAST_EDGE_TEST],
+                   optimized->jit_function[RAST_EDGE_TEST]);
+      p_atomic_set(&variant->jit_function[RAST_WHOLE],
+                   optimized->jit_function[RAST_WHOLE]);
+
+      util_queue_fence_destroy(&optimized->compile_fence);
+      FREE(optimized);
+   }
+
+   /* Only the IR lived in this context, and it has been freed already. */
+   LLVMContextDispose(context);
+}
+
+
+/**
+ * Drop the job's variant reference.  This runs after the compile fence has
+ * been signalled, which is why it isn't done in compile_variant_job().
+ */
+static void
+compile_variant_job_cleanup(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = (struct lp_fs_compile_job *)data;
+
+   lp_fs_variant_reference(&job->variant, NULL);
+   FREE(job);
+}
+
+
+/**
+ * Queue the compilation of the optimized code of a fast-compiled variant.
+ * If the job can't be queued the variant simply keeps its fast code.
+ */
+static void
+queue_variant_compile(struct llvmpipe_screen *screen,
+                      struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_compile_job *job;
+
+   job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job)
+      return;
+
+   job->screen = screen;
+   lp_fs_variant_reference(&job->variant, variant);
+
+   util_queue_add_job(&screen->compile_queue, job, &variant->compile_fence,
+                      compile_variant_job, compile_variant_job_cleanup);
+}
+
+
+/**
+ * Count a draw with the currently bound variant, and have it optimized
+ * once it turns out to be hot.
+ */
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+
+   if (variant && variant->draws_to_tier_up) {
+      if (--variant->draws_to_tier_up == 0)
+         queue_variant_compile(llvmpipe_screen(lp->pipe.screen), variant);
+   }
+}
+
+
+/**
+ * Return the number of variants whose optimized code is still being
+ * compiled.
+ */
+unsigned
+llvmpipe_num_pending_fs_variants(struct llvmpipe_context *lp)
+{
+   struct lp_fs_variant_list_item *li;
+   unsigned count = 0;
+
+   li = first_elem(&lp->fs_variants_list);
+   while (!at_end(&lp->fs_variants_list, li)) {
+      if (!util_queue_fence_is_signalled(&li->base->compile_fence))
+         count++;
+      li = next_elem(li);
+   }
+
+   return count;
+}
+
+
+/**
+ * Size of the used part of a variant key.  This is the same for all keys
+ * of a shader (see shader->variant_key_size), but the hash table callbacks
+ * below only get to see the keys.
+ */
+static inline unsigned
+lp_fs_variant_key_size(const struct lp_fragment_shader_variant_key *key)
+{
+   return Offset(struct lp_fragment_shader_variant_key,
+                 state[MAX2(key->nr_samplers, key->nr_sampler_views)]);
+}
+
+
+static uint32_t
+lp_fs_variant_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, lp_fs_variant_key_size(key));
+}
+
+
+static bool
+lp_fs_variant_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, lp_fs_variant_key_size(a)) == 0;
+}
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -2683,6 +2952,15 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       return NULL;
    }
 
+   shader->variant_table = _mesa_hash_table_create(NULL, lp_fs_variant_key_hash,
+                                                   lp_fs_variant_key_equal);
+   if (shader->variant_table == NULL) {
+      draw_delete_fragment_shader(llvmpipe->draw, shader->draw_data);
+      FREE((void *) shader->base.tokens);
+      FREE(shader);
+      return NULL;
+   }
+
    nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
    nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
 
@@ -2768,12 +3046,21 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 
 /**
  * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * and the context's variant list, and from the shader's hash table.
+ * The variant is destroyed once the last scene using it has been
+ * rasterized.
+ *
+ * A pending optimized compile reads the shader, which may be deleted as
+ * soon as its variants are removed, so wait for it first.
  */
 void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   struct hash_entry *entry;
+
+   util_queue_job_wait(&variant->compile_fence);
+
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       debug_printf("llvmpipe: del fs #%u var #%u v created #%u v cached"
                    " #%u v total cached #%u\n",
@@ -2784,17 +3071,39 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
-   gallivm_destroy(variant->gallivm);
-
-   /* remove from shader's list */
+   /* remove from shader's hash table and list */
+   entry = _mesa_hash_table_search_pre_hashed(variant->shader->variant_table,
+                                              variant->hash, &variant->key);
+   assert(entry);
+   _mesa_hash_table_remove(variant->shader->variant_table, entry);
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
 
    /* remove from context's list */
    remove_from_list(&variant->list_item_global);
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
 
+   lp_fs_variant_reference(&variant, NULL);
+}
+
+
+/**
+ * Free a shader variant once its last reference is gone.  This may happen
+ * on a rasterizer or compiler thread, so it must not touch the context or
+ * the shader, which may not even exist anymore.
+ */
+void
+llvmpipe_destroy_shader_variant(struct lp_fragment_shader_variant *variant)
+{
+   util_queue_fence_destroy(&variant->compile_fence);
+
+   gallivm_destroy(variant->gallivm);
+   if (variant->fallback_gallivm)
+      gallivm_destroy(variant->fallback_gallivm);
+
    FREE(variant);
 }
 
@@ -2809,13 +3118,9 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
    assert(fs != llvmpipe->fs);
 
    /*
-    * XXX: we need to flush the context until we have some sort of reference
-    * counting in fragment shaders as they may still be binned
-    * Flushing alone might not sufficient we need to wait on it too.
+    * Delete all the variants.  Binned scenes hold references to the ones
+    * they use, so there is no need to flush here.
     */
-   llvmpipe_finish(pipe, __FUNCTION__);
-
-   /* Delete all the variants */
    li = first_elem(&shader->variants);
    while(!at_end(&shader->variants, li)) {
       struct lp_fs_variant_list_item *next = next_elem(li);
@@ -2823,6 +3128,8 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
       li = next;
    }
 
+   _mesa_hash_table_destroy(shader->variant_table, NULL);
+
    /* Delete draw module's data */
    draw_delete_fragment_shader(llvmpipe->draw, shader->draw_data);
 
@@ -2876,7 +3183,7 @@ llvmpipe_set_constant_buffer(struct pipe_context *pipe,
       draw_set_mapped_constant_buffer(llvmpipe->draw, shader,
                                       index, data, size);
    }
-   else {
+   else if (shader == PIPE_SHADER_FRAGMENT) {
       llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
    }
 
@@ -3102,34 +3409,37 @@ make_variant_key(struct llvmpipe_context *lp,
 void 
 llvmpipe_update_fs(struct llvmpipe_context *lp)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader *shader = lp->fs;
    struct lp_fragment_shader_variant_key key;
    struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
+   struct hash_entry *entry;
+   uint32_t hash;
 
    make_variant_key(lp, shader, &key);
 
    /* Search the variants for one which matches the key */
-   li = first_elem(&shader->variants);
-   while(!at_end(&shader->variants, li)) {
-      if(memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-      li = next_elem(li);
-   }
+   hash = lp_fs_variant_key_hash(&key);
+   entry = _mesa_hash_table_search_pre_hashed(shader->variant_table,
+                                              hash, &key);
+   if (entry)
+      variant = entry->data;
 
    if (variant) {
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
       move_to_head(&lp->fs_variants_list, &variant->list_item_global);
+      lp->nr_fs_variant_hits++;
    }
    else {
       /* variant not found, create it now */
       int64_t t0, t1, dt;
       unsigned i;
       unsigned variants_to_cull;
+      boolean async = util_queue_is_initialized(&screen->compile_queue);
+
+      lp->nr_fs_variant_misses++;
 
       if (0) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
@@ -3145,21 +3455,10 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
       if (variants_to_cull ||
           lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         struct pipe_context *pipe = &lp->pipe;
-
-         /*
-          * XXX: we need to flush the context until we have some sort of
-          * reference counting in fragment shaders as they may still be binned
-          * Flushing alone might not be sufficient we need to wait on it too.
-          */
-         llvmpipe_finish(pipe, __FUNCTION__);
-
          /*
-          * We need to re-check lp->nr_fs_variants because an arbitrarliy large
-          * number of shader variants (potentially all of them) could be
-          * pending for destruction on flush.
+          * Variants still used by binned scenes are kept alive by their
+          * references, so no flush is needed here.
           */
-
          for (i = 0; i < variants_to_cull || lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS; i++) {
             struct lp_fs_variant_list_item *item;
             if (is_empty_list(&lp->fs_variants_list)) {
@@ -3173,10 +3472,13 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       }
 
       /*
-       * Generate the new variant.
+       * Generate the new variant.  In async mode only fast code is generated
+       * here, and the optimized code is left to the compiler threads once
+       * the variant gets hot.
        */
       t0 = os_time_get();
-      variant = generate_variant(lp, shader, &key);
+      variant = generate_variant(screen, lp->context, shader, &key,
+                                 shader->variants_created++, async);
       t1 = os_time_get();
       dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
@@ -3184,15 +3486,26 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
       /* Put the new variant into the list */
       if (variant) {
+         variant->hash = hash;
+         _mesa_hash_table_insert_pre_hashed(shader->variant_table, hash,
+                                            &variant->key, variant);
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
          lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
+
+         if (variant->gallivm->fast_compile) {
+            if (screen->tier_up_draws)
+               variant->draws_to_tier_up = screen->tier_up_draws;
+            else
+               queue_variant_compile(screen, variant);
+         }
       }
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
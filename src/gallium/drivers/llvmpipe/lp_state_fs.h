@@ -33,12 +33,15 @@
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 
 
 struct tgsi_token;
+struct hash_table;
 struct lp_fragment_shader;
 
 
@@ -95,8 +98,18 @@ struct lp_fs_variant_list_item
 
 struct lp_fragment_shader_variant
 {
+   /*
+    * The context's variant lists hold one reference, and each scene which
+    * binned primitives with this variant holds another, so a variant can be
+    * evicted from the lists while scenes are still using it.
+    */
+   struct pipe_reference reference;
+
    struct lp_fragment_shader_variant_key key;
 
+   /** Hash of the key, see lp_fs_variant_key_hash() */
+   uint32_t hash;
+
    boolean opaque;
    uint8_t ps_inv_multiplier;
 
@@ -113,6 +126,17 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /*
+    * With LP_ASYNC_COMPILE a variant is first compiled quickly.  Once it
+    * has been used for draws_to_tier_up draws, a compiler thread produces
+    * the optimized code, which replaces jit_function[].  The fast code is
+    * kept in fallback_gallivm until the variant is destroyed, as binned
+    * scenes may still be running it.
+    */
+   unsigned draws_to_tier_up;
+   struct gallivm_state *fallback_gallivm;
+   struct util_queue_fence compile_fence;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
@@ -130,6 +154,9 @@ struct lp_fragment_shader
 
    struct lp_fs_variant_list_item variants;
 
+   /** The variants, keyed by lp_fragment_shader_variant::key */
+   struct hash_table *variant_table;
+
    struct draw_fragment_shader *draw_data;
 
    /* For debugging/profiling purposes */
@@ -146,10 +173,31 @@ struct lp_fragment_shader
 void
 lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant);
 
+unsigned
+llvmpipe_num_pending_fs_variants(struct llvmpipe_context *lp);
+
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp);
+
 void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_destroy_shader_variant(struct lp_fragment_shader_variant *variant);
+
+static inline void
+lp_fs_variant_reference(struct lp_fragment_shader_variant **ptr,
+                        struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fragment_shader_variant *old = *ptr;
+
+   if (pipe_reference(old ? &old->reference : NULL,
+                      variant ? &variant->reference : NULL))
+      llvmpipe_destroy_shader_variant(old);
+   *ptr = variant;
+}
+
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/mesa-sha1.h"
 #include "os/os_time.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
@@ -700,6 +701,42 @@ init_args(struct gallivm_state *gallivm,
    emit_linear_coef(gallivm, args, 0, attr_pos);
 }
 
+/**
+ * Compute the name under which the object code of a setup variant is kept
+ * in the disk cache, and name the function after it, see
+ * get_variant_cache_key() in lp_state_fs.c.
+ *
+ * \return FALSE if the variant must not be cached.
+ */
+static boolean
+get_setup_cache_key(const struct lp_setup_variant_key *key,
+                    unsigned char sha1[20],
+                    char *func_name, size_t func_name_size)
+{
+#ifdef ENABLE_SHADER_CACHE
+   struct mesa_sha1 *ctx;
+   char sha1_str[41];
+   boolean ok;
+
+   ctx = _mesa_sha1_init();
+   if (!ctx)
+      return FALSE;
+
+   ok = gallivm_hash_codegen_state(ctx);
+   _mesa_sha1_update(ctx, "setup", 5);
+   _mesa_sha1_update(ctx, key, key->size);
+   _mesa_sha1_final(ctx, sha1);
+
+   _mesa_sha1_format(sha1_str, sha1);
+   util_snprintf(func_name, func_name_size, "setup_%.16s", sha1_str);
+
+   return ok;
+#else
+   return FALSE;
+#endif
+}
+
+
 /**
  * Generate the runtime callable function for the coefficient calculation.
  *
@@ -708,9 +745,13 @@ static struct lp_setup_variant *
 generate_setup_variant(struct lp_setup_variant_key *key,
                        struct llvmpipe_context *lp)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_setup_variant *variant = NULL;
    struct gallivm_state *gallivm;
    struct lp_setup_args args;
+   struct lp_cached_code cached = { 0 };
+   unsigned char sha1[20];
+   boolean use_cache, cache_hit;
    char func_name[64];
    LLVMTypeRef vec4f_type;
    LLVMTypeRef func_type;
@@ -728,14 +769,26 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   util_snprintf(func_name, sizeof(func_name), "setup_variant_%u",
-                 variant->no);
+   use_cache = screen->disk_cache &&
+               get_setup_cache_key(key, sha1, func_name, sizeof(func_name));
+
+   if (use_cache) {
+      lp_disk_cache_find_shader(screen, &cached, sha1);
+   }
+   else {
+      util_snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+                    variant->no);
+   }
+   cache_hit = cached.data_size != 0;
 
    variant->gallivm = gallivm = gallivm_create(func_name, lp->context);
    if (!variant->gallivm) {
       goto fail;
    }
 
+   if (use_cache)
+      gallivm->cache = &cached;
+
    builder = gallivm->builder;
 
    if (LP_DEBUG & DEBUG_COUNTERS) {
@@ -806,7 +859,11 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (use_cache && !cache_hit)
+      lp_disk_cache_insert_shader(screen, &cached, sha1);
+
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    /*
     * Update timing information:
@@ -826,6 +883,7 @@ fail:
       }
       FREE(variant);
    }
+   free(cached.data);
 
    return NULL;
 }
@@ -0,0 +1,357 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and benchmark for compute shader dispatch.
+ *
+ * Every invocation writes its local index to shared memory, waits on a
+ * barrier, stores the value written by the mirrored invocation to a
+ * buffer, and counts itself with an atomic add.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_text.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+struct compute_test_case
+{
+   boolean barrier;
+   unsigned block_size;
+   unsigned grid_size;
+};
+
+
+static const struct compute_test_case
+test_cases[] = {
+   { FALSE,   64,  1024 },
+   { FALSE,  256,   256 },
+   { FALSE, 1024,    64 },
+   { TRUE,    64,  1024 },
+   { TRUE,   256,   256 },
+   { TRUE,  1024,    64 },
+};
+
+
+static const char *
+shader_text =
+   "COMP\n"
+   "DCL SV[0], THREAD_ID\n"
+   "DCL SV[1], BLOCK_ID\n"
+   "DCL SV[2], BLOCK_SIZE\n"
+   "DCL BUFFER[0]\n"
+   "DCL BUFFER[1]\n"
+   "DCL MEMORY[0], SHARED\n"
+   "DCL TEMP[0..2]\n"
+   "IMM[0] UINT32 {4, 1, 0, 4294967295}\n"
+   /* shared[tid] = tid */
+   "  0: UMUL TEMP[0].x, SV[0].xxxx, IMM[0].xxxx\n"
+   "  1: STORE MEMORY[0].x, TEMP[0].xxxx, SV[0].xxxx\n"
+   "  2: BARRIER\n"
+   /* TEMP[1] = shared[block_size - 1 - tid] */
+   "  3: UADD TEMP[1].x, SV[2].xxxx, IMM[0].wwww\n"
+   "  4: INEG TEMP[2].x, SV[0].xxxx\n"
+   "  5: UADD TEMP[1].x, TEMP[1].xxxx, TEMP[2].xxxx\n"
+   "  6: UMUL TEMP[1].x, TEMP[1].xxxx, IMM[0].xxxx\n"
+   "  7: LOAD TEMP[1].x, MEMORY[0], TEMP[1].xxxx\n"
+   /* buffer0[block_id * block_size + tid] = TEMP[1] */
+   "  8: UMAD TEMP[2].x, SV[1].xxxx, SV[2].xxxx, SV[0].xxxx\n"
+   "  9: UMUL TEMP[2].x, TEMP[2].xxxx, IMM[0].xxxx\n"
+   " 10: STORE BUFFER[0].x, TEMP[2].xxxx, TEMP[1].xxxx\n"
+   /* buffer1[0] += 1 */
+   " 11: ATOMUADD TEMP[0].x, BUFFER[1], IMM[0].zzzz, IMM[0].yyyy\n"
+   " 12: END\n";
+
+
+/* Same as above, without the shared memory round trip. */
+static const char *
+shader_text_no_barrier =
+   "COMP\n"
+   "DCL SV[0], THREAD_ID\n"
+   "DCL SV[1], BLOCK_ID\n"
+   "DCL SV[2], BLOCK_SIZE\n"
+   "DCL BUFFER[0]\n"
+   "DCL BUFFER[1]\n"
+   "DCL TEMP[0..2]\n"
+   "IMM[0] UINT32 {4, 1, 0, 4294967295}\n"
+   "  0: UADD TEMP[1].x, SV[2].xxxx, IMM[0].wwww\n"
+   "  1: INEG TEMP[2].x, SV[0].xxxx\n"
+   "  2: UADD TEMP[1].x, TEMP[1].xxxx, TEMP[2].xxxx\n"
+   "  3: UMAD TEMP[2].x, SV[1].xxxx, SV[2].xxxx, SV[0].xxxx\n"
+   "  4: UMUL TEMP[2].x, TEMP[2].xxxx, IMM[0].xxxx\n"
+   "  5: STORE BUFFER[0].x, TEMP[2].xxxx, TEMP[1].xxxx\n"
+   "  6: ATOMUADD TEMP[0].x, BUFFER[1], IMM[0].zzzz, IMM[0].yyyy\n"
+   "  7: END\n";
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_invocation\t"
+           "barrier\t"
+           "block_size\t"
+           "grid_size\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              const struct compute_test_case *test,
+              double cycles,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles);
+
+   fprintf(fp, "%u\t%u\t%u\n",
+           test->barrier, test->block_size, test->grid_size);
+
+   fflush(fp);
+}
+
+
+static struct pipe_resource *
+create_buffer(struct pipe_screen *screen, unsigned size)
+{
+   struct pipe_resource templ;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_BUFFER;
+   templ.format = PIPE_FORMAT_R8_UNORM;
+   templ.bind = PIPE_BIND_SHADER_BUFFER;
+   templ.usage = PIPE_USAGE_DEFAULT;
+   templ.width0 = size;
+   templ.height0 = 1;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+
+   return screen->resource_create(screen, &templ);
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_one(unsigned verbose, FILE *fp,
+         struct pipe_context *pipe,
+         const struct compute_test_case *test,
+         unsigned n)
+{
+   struct pipe_screen *screen = pipe->screen;
+   const unsigned num_invocations = test->block_size * test->grid_size;
+   struct tgsi_token tokens[1024];
+   struct pipe_compute_state state;
+   struct pipe_shader_buffer buffers[2];
+   struct pipe_grid_info info;
+   struct pipe_transfer *transfer;
+   uint64_t cycles[LP_TEST_NUM_SAMPLES];
+   double cycles_avg = 0.0;
+   boolean success = TRUE;
+   const uint32_t *data;
+   void *cs;
+   unsigned i, j;
+
+   if (!tgsi_text_translate(test->barrier ? shader_text : shader_text_no_barrier,
+                            tokens, ARRAY_SIZE(tokens))) {
+      fprintf(stderr, "failed to translate the shader\n");
+      return FALSE;
+   }
+
+   memset(&state, 0, sizeof state);
+   state.ir_type = PIPE_SHADER_IR_TGSI;
+   state.prog = tokens;
+   state.req_local_mem = test->barrier ? test->block_size * 4 : 0;
+
+   cs = pipe->create_compute_state(pipe, &state);
+   if (!cs) {
+      fprintf(stderr, "failed to create the compute shader\n");
+      return FALSE;
+   }
+   pipe->bind_compute_state(pipe, cs);
+
+   memset(buffers, 0, sizeof buffers);
+   buffers[0].buffer = create_buffer(screen, num_invocations * 4);
+   buffers[0].buffer_size = num_invocations * 4;
+   buffers[1].buffer = create_buffer(screen, 4);
+   buffers[1].buffer_size = 4;
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 2, buffers);
+
+   memset(&info, 0, sizeof info);
+   info.work_dim = 1;
+   info.block[0] = test->block_size;
+   info.block[1] = 1;
+   info.block[2] = 1;
+   info.grid[0] = test->grid_size;
+   info.grid[1] = 1;
+   info.grid[2] = 1;
+
+   n = MIN2(n, LP_TEST_NUM_SAMPLES);
+   for (i = 0; i < n; i++) {
+      uint64_t start_counter = rdtsc();
+      pipe->launch_grid(pipe, &info);
+      cycles[i] = rdtsc() - start_counter;
+   }
+
+   /* buffer0 holds the mirrored indices, and every launch counted itself */
+   data = pipe_buffer_map(pipe, buffers[0].buffer, PIPE_TRANSFER_READ, &transfer);
+   for (i = 0; i < num_invocations && success; i++) {
+      uint32_t expected = test->block_size - 1 - i % test->block_size;
+      if (data[i] != expected) {
+         if (verbose)
+            fprintf(stderr, "  buffer0[%u] = %u, expected %u\n",
+                    i, data[i], expected);
+         success = FALSE;
+      }
+   }
+   pipe_buffer_unmap(pipe, transfer);
+
+   data = pipe_buffer_map(pipe, buffers[1].buffer, PIPE_TRANSFER_READ, &transfer);
+   if (data[0] != n * num_invocations) {
+      if (verbose)
+         fprintf(stderr, "  counter = %u, expected %u\n",
+                 data[0], n * num_invocations);
+      success = FALSE;
+   }
+   pipe_buffer_unmap(pipe, transfer);
+
+   /* Average the samples, discarding the outliers like lp_test_conv. */
+   if (n) {
+      double sum = 0.0, sum2 = 0.0, avg, std;
+      unsigned m = 0;
+
+      for (i = 0; i < n; i++) {
+         sum += cycles[i];
+         sum2 += cycles[i] * cycles[i];
+      }
+      avg = sum / n;
+      std = sqrtf((sum2 - n * avg * avg) / n);
+
+      sum = 0.0;
+      for (i = 0; i < n; i++) {
+         if (fabs(cycles[i] - avg) <= 4.0 * std) {
+            sum += cycles[i];
+            ++m;
+         }
+      }
+      cycles_avg = (m ? sum / m : avg) / num_invocations;
+   }
+
+   if (verbose >= 1 || !success) {
+      fprintf(stdout, "%s: barrier=%u block=%u grid=%u %.1f cycles/invocation\n",
+              success ? "PASS" : "FAIL",
+              test->barrier, test->block_size, test->grid_size, cycles_avg);
+   }
+
+   if (fp)
+      write_tsv_row(fp, test, cycles_avg, success);
+
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 2, NULL);
+   for (j = 0; j < 2; j++)
+      pipe_resource_reference(&buffers[j].buffer, NULL);
+   pipe->bind_compute_state(pipe, NULL);
+   pipe->delete_compute_state(pipe, cs);
+
+   return success;
+}
+
+
+static boolean
+test_cases_run(unsigned verbose, FILE *fp, unsigned n)
+{
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   boolean success = TRUE;
+   unsigned i;
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe) {
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_one(verbose, fp, pipe, &test_cases[i], n))
+         success = FALSE;
+   }
+
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_cases_run(verbose, fp, LP_TEST_NUM_SAMPLES);
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_cases_run(verbose, fp, MAX2(n, 1));
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
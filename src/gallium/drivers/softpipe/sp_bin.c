@@ -0,0 +1,546 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Binned, multithreaded rasterization.
+ *
+ * Instead of running the quad pipeline, setup records the batches of quads
+ * of a draw together with a copy of their primitive's coefficients.  At the
+ * end of the draw, the batches are handed out to SOFTPIPE_NUM_THREADS
+ * threads, each with its own quad pipeline and fragment shader machine.
+ *
+ * The threads share the context's color and depth/stencil tile caches.
+ * A thread owns the tiles at a subset of the cache positions, and runs
+ * the batches of its tiles in the order setup emitted them.  Tiles at
+ * different positions never evict each other, so every cache entry sees
+ * the same sequence of loads, quads and write-backs as with the serial
+ * quad pipeline, and the results are bit-identical.
+ *
+ * Fragment shaders using textures, images or buffers are run serially, as
+ * the texture tile caches and the resources are shared by all threads.
+ */
+
+#include <stddef.h>
+
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_exec.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_queue.h"
+
+#include "sp_bin.h"
+#include "sp_context.h"
+#include "sp_quad.h"
+#include "sp_quad_pipe.h"
+#include "sp_state.h"
+#include "sp_tile_cache.h"
+
+
+#define SP_BIN_MAX_THREADS 16
+
+/** Size of the blocks batches and coefficients are allocated from */
+#define SP_BIN_BLOCK_SIZE (64 * 1024)
+
+/**
+ * Draws with fewer quads are rasterized on the calling thread, waking up
+ * the other threads would cost more than it saves.
+ */
+#define SP_BIN_MIN_QUADS 256
+
+
+struct sp_bin_block {
+   struct sp_bin_block *next;
+   size_t used;
+   ubyte data[SP_BIN_BLOCK_SIZE];
+};
+
+
+struct sp_bin_quad {
+   struct quad_header_input input;
+   unsigned mask;
+};
+
+
+/**
+ * A batch of quads, as passed to the quad pipeline by setup.
+ */
+struct sp_bin_batch {
+   struct sp_bin_batch *next;
+   const struct tgsi_interp_coef *coefs;  /**< posCoef, then the inputs' */
+   unsigned thread;                        /**< owner of the batch's tile */
+   unsigned nr;
+   struct sp_bin_quad quads[SP_BIN_MAX_QUADS];
+};
+
+
+struct sp_bin_thread {
+   struct sp_bin *bin;
+   unsigned index;
+
+   struct quad_stage *shade;
+   struct quad_stage *depth_test;
+   struct quad_stage *blend;
+   struct quad_stage *first;
+
+   struct tgsi_exec_machine *fs_machine;
+   uint64_t occlusion_count;
+   uint64_t ps_invocations;
+   struct quad_thread quad_thread;
+
+   struct quad_header quad[SP_BIN_MAX_QUADS];
+   struct quad_header *quad_ptrs[SP_BIN_MAX_QUADS];
+
+   struct util_queue_fence fence;
+};
+
+
+struct sp_bin {
+   struct softpipe_context *softpipe;
+
+   unsigned num_threads;
+   struct sp_bin_thread *threads;
+   struct util_queue queue;
+
+   /** Coefficients per primitive, as the fragment shader has inputs */
+   unsigned num_coefs;
+
+   struct sp_bin_batch *head;
+   struct sp_bin_batch **tail;
+   unsigned num_quads;
+
+   struct sp_bin_block *blocks;       /**< in use, most recent first */
+   struct sp_bin_block *free_blocks;
+};
+
+
+DEBUG_GET_ONCE_NUM_OPTION(num_threads, "SOFTPIPE_NUM_THREADS", 0)
+
+
+static void *
+sp_bin_alloc(struct sp_bin *bin, size_t size)
+{
+   struct sp_bin_block *block = bin->blocks;
+   void *ptr;
+
+   size = align(size, 8);
+   assert(size <= SP_BIN_BLOCK_SIZE);
+
+   if (!block || block->used + size > SP_BIN_BLOCK_SIZE) {
+      block = bin->free_blocks;
+      if (block) {
+         bin->free_blocks = block->next;
+      }
+      else {
+         block = MALLOC_STRUCT(sp_bin_block);
+         if (!block)
+            return NULL;
+      }
+
+      block->used = 0;
+      block->next = bin->blocks;
+      bin->blocks = block;
+   }
+
+   ptr = block->data + block->used;
+   block->used += size;
+   return ptr;
+}
+
+
+/**
+ * Called before setup emits the quads of a primitive run.
+ * \return TRUE if the quads may be binned with the current state.
+ */
+boolean
+sp_bin_prepare(struct sp_bin *bin)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   const struct tgsi_shader_info *info;
+
+   assert(!bin->head);
+
+   if (!sp->fs_variant)
+      return FALSE;
+
+   info = &sp->fs_variant->info;
+   if (info->file_count[TGSI_FILE_SAMPLER] ||
+       info->file_count[TGSI_FILE_SAMPLER_VIEW] ||
+       info->file_count[TGSI_FILE_IMAGE] ||
+       info->file_count[TGSI_FILE_BUFFER] ||
+       info->file_count[TGSI_FILE_MEMORY])
+      return FALSE;
+
+#if !DO_PSTIPPLE_IN_DRAW_MODULE && !DO_PSTIPPLE_IN_HELPER_MODULE
+   if (sp->rasterizer->poly_stipple_enable)
+      return FALSE;
+#endif
+
+   bin->num_coefs = info->num_inputs;
+   return TRUE;
+}
+
+
+/**
+ * Copy the coefficients of the primitive being set up.
+ * \return NULL if out of memory.
+ */
+const struct tgsi_interp_coef *
+sp_bin_coefs(struct sp_bin *bin,
+             const struct tgsi_interp_coef *posCoef,
+             const struct tgsi_interp_coef *coef)
+{
+   struct tgsi_interp_coef *coefs;
+
+   coefs = sp_bin_alloc(bin, (1 + bin->num_coefs) * sizeof *coefs);
+   if (!coefs)
+      return NULL;
+
+   coefs[0] = *posCoef;
+   memcpy(&coefs[1], coef, bin->num_coefs * sizeof *coefs);
+   return coefs;
+}
+
+
+/**
+ * Record a batch of quads, which are all in the same tile.
+ * \return FALSE if out of memory.
+ */
+boolean
+sp_bin_quads(struct sp_bin *bin,
+             const struct tgsi_interp_coef *coefs,
+             struct quad_header *quads[],
+             unsigned nr)
+{
+   struct sp_bin_batch *batch;
+   union tile_address addr;
+   unsigned i;
+
+   assert(nr <= SP_BIN_MAX_QUADS);
+
+   batch = sp_bin_alloc(bin, offsetof(struct sp_bin_batch, quads) +
+                             nr * sizeof batch->quads[0]);
+   if (!batch)
+      return FALSE;
+
+   addr = tile_address(quads[0]->input.x0, quads[0]->input.y0,
+                       quads[0]->input.layer);
+
+   batch->next = NULL;
+   batch->coefs = coefs;
+   batch->thread = sp_tile_cache_pos(addr) % bin->num_threads;
+   batch->nr = nr;
+   for (i = 0; i < nr; i++) {
+      batch->quads[i].input = quads[i]->input;
+      batch->quads[i].mask = quads[i]->inout.mask;
+   }
+
+   *bin->tail = batch;
+   bin->tail = &batch->next;
+   bin->num_quads += nr;
+   return TRUE;
+}
+
+
+/**
+ * Run the batches owned by \p thread (or all of them) through the quad
+ * pipeline starting at \p first, in the order they were binned.
+ */
+static void
+sp_bin_replay(struct sp_bin *bin, struct quad_stage *first,
+              struct sp_bin_thread *thread, boolean all)
+{
+   const struct sp_bin_batch *batch;
+   unsigned i;
+
+   for (batch = bin->head; batch; batch = batch->next) {
+      if (!all && batch->thread != thread->index)
+         continue;
+
+      for (i = 0; i < batch->nr; i++) {
+         struct quad_header *quad = &thread->quad[i];
+
+         quad->input = batch->quads[i].input;
+         quad->inout.mask = batch->quads[i].mask;
+         quad->posCoef = &batch->coefs[0];
+         quad->coef = &batch->coefs[1];
+         thread->quad_ptrs[i] = quad;
+      }
+
+      first->run(first, thread->quad_ptrs, batch->nr);
+   }
+}
+
+
+static void
+sp_bin_execute(void *job, int thread_index)
+{
+   struct sp_bin_thread *thread = (struct sp_bin_thread *) job;
+
+   sp_bin_replay(thread->bin, thread->first, thread, FALSE);
+}
+
+
+/**
+ * Set up the quad pipeline of a thread for the current state, like
+ * sp_build_quad_pipeline() and sp_setup_prepare() do for the context's.
+ */
+static void
+sp_bin_begin_thread(struct sp_bin *bin, struct sp_bin_thread *thread)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   struct sp_fragment_shader_variant *var = sp->fs_variant;
+
+   if (thread->fs_machine->Tokens != var->tokens) {
+      var->prepare(var, thread->fs_machine,
+                   (struct tgsi_sampler *)
+                      sp->tgsi.sampler[PIPE_SHADER_FRAGMENT],
+                   (struct tgsi_image *)
+                      sp->tgsi.image[PIPE_SHADER_FRAGMENT],
+                   (struct tgsi_buffer *)
+                      sp->tgsi.buffer[PIPE_SHADER_FRAGMENT]);
+   }
+
+   if (sp->early_depth) {
+      thread->depth_test->next = thread->shade;
+      thread->shade->next = thread->blend;
+      thread->first = thread->depth_test;
+   }
+   else {
+      thread->shade->next = thread->depth_test;
+      thread->depth_test->next = thread->blend;
+      thread->first = thread->shade;
+   }
+
+   thread->first->begin(thread->first);
+
+   thread->occlusion_count = 0;
+   thread->ps_invocations = 0;
+}
+
+
+/**
+ * Start or stop sharing the framebuffer tile caches between the threads.
+ */
+static boolean
+sp_bin_share_caches(struct sp_bin *bin, boolean shared)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   boolean ret = TRUE;
+   unsigned i;
+
+   for (i = 0; i < sp->framebuffer.nr_cbufs; i++) {
+      if (sp->framebuffer.cbufs[i])
+         ret = sp_tile_cache_share(sp->cbuf_cache[i], shared) && ret;
+   }
+
+   if (sp->framebuffer.zsbuf)
+      ret = sp_tile_cache_share(sp->zsbuf_cache, shared) && ret;
+
+   if (!ret && shared)
+      sp_bin_share_caches(bin, FALSE);
+
+   return ret;
+}
+
+
+/**
+ * Rasterize the binned quads and wait for the threads to finish.
+ */
+void
+sp_bin_flush(struct sp_bin *bin)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   unsigned i;
+
+   if (!bin->head)
+      return;
+
+   if (bin->num_quads < SP_BIN_MIN_QUADS ||
+       !sp_bin_share_caches(bin, TRUE)) {
+      sp_bin_replay(bin, sp->quad.first, &bin->threads[0], TRUE);
+   }
+   else {
+      for (i = 0; i < bin->num_threads; i++)
+         sp_bin_begin_thread(bin, &bin->threads[i]);
+
+      for (i = 1; i < bin->num_threads; i++)
+         util_queue_add_job(&bin->queue, &bin->threads[i],
+                            &bin->threads[i].fence, sp_bin_execute, NULL);
+
+      /* the calling thread takes the first share */
+      sp_bin_execute(&bin->threads[0], 0);
+
+      for (i = 1; i < bin->num_threads; i++)
+         util_queue_job_wait(&bin->threads[i].fence);
+
+      for (i = 0; i < bin->num_threads; i++) {
+         sp->occlusion_count += bin->threads[i].occlusion_count;
+         sp->pipeline_statistics.ps_invocations +=
+            bin->threads[i].ps_invocations;
+      }
+
+      sp_bin_share_caches(bin, FALSE);
+   }
+
+   /* keep the blocks around for the next draw */
+   while (bin->blocks) {
+      struct sp_bin_block *block = bin->blocks;
+
+      bin->blocks = block->next;
+      block->next = bin->free_blocks;
+      bin->free_blocks = block;
+   }
+
+   bin->head = NULL;
+   bin->tail = &bin->head;
+   bin->num_quads = 0;
+}
+
+
+/**
+ * Called before a fragment shader variant is deleted.
+ */
+void
+sp_bin_release_fs_variant(struct sp_bin *bin,
+                          struct sp_fragment_shader_variant *var)
+{
+   unsigned i;
+
+   for (i = 0; i < bin->num_threads; i++) {
+      struct tgsi_exec_machine *machine = bin->threads[i].fs_machine;
+
+      if (machine->Tokens == var->tokens)
+         tgsi_exec_machine_bind_shader(machine, NULL, NULL, NULL, NULL);
+   }
+}
+
+
+void
+sp_bin_destroy(struct sp_bin *bin)
+{
+   unsigned i;
+
+   if (util_queue_is_initialized(&bin->queue))
+      util_queue_destroy(&bin->queue);
+
+   for (i = 0; i < bin->num_threads; i++) {
+      struct sp_bin_thread *thread = &bin->threads[i];
+
+      if (thread->shade)
+         thread->shade->destroy(thread->shade);
+      if (thread->depth_test)
+         thread->depth_test->destroy(thread->depth_test);
+      if (thread->blend)
+         thread->blend->destroy(thread->blend);
+      if (thread->fs_machine)
+         tgsi_exec_machine_destroy(thread->fs_machine);
+
+      util_queue_fence_destroy(&thread->fence);
+   }
+
+   while (bin->blocks) {
+      struct sp_bin_block *block = bin->blocks;
+      bin->blocks = block->next;
+      FREE(block);
+   }
+
+   while (bin->free_blocks) {
+      struct sp_bin_block *block = bin->free_blocks;
+      bin->free_blocks = block->next;
+      FREE(block);
+   }
+
+   FREE(bin->threads);
+   FREE(bin);
+}
+
+
+/**
+ * Create the binned rasterizer of a context.
+ * \return NULL if SOFTPIPE_NUM_THREADS is less than two (or on failure),
+ *         in which case the context rasterizes on the calling thread.
+ */
+struct sp_bin *
+sp_bin_create(struct softpipe_context *softpipe)
+{
+   long num_threads = debug_get_option_num_threads();
+   struct sp_bin *bin;
+   unsigned i;
+
+   if (num_threads < 2)
+      return NULL;
+
+   num_threads = MIN2(num_threads, SP_BIN_MAX_THREADS);
+
+   bin = CALLOC_STRUCT(sp_bin);
+   if (!bin)
+      return NULL;
+
+   bin->softpipe = softpipe;
+   bin->tail = &bin->head;
+
+   bin->threads = CALLOC(num_threads, sizeof *bin->threads);
+   if (!bin->threads)
+      goto fail;
+
+   bin->num_threads = num_threads;
+   for (i = 0; i < num_threads; i++)
+      util_queue_fence_init(&bin->threads[i].fence);
+
+   for (i = 0; i < num_threads; i++) {
+      struct sp_bin_thread *thread = &bin->threads[i];
+
+      thread->bin = bin;
+      thread->index = i;
+
+      thread->fs_machine = tgsi_exec_machine_create(PIPE_SHADER_FRAGMENT);
+      thread->shade = sp_quad_shade_stage(softpipe);
+      thread->depth_test = sp_quad_depth_test_stage(softpipe);
+      thread->blend = sp_quad_blend_stage(softpipe);
+      if (!thread->fs_machine || !thread->shade ||
+          !thread->depth_test || !thread->blend)
+         goto fail;
+
+      thread->quad_thread.fs_machine = thread->fs_machine;
+      thread->quad_thread.occlusion_count = &thread->occlusion_count;
+      thread->quad_thread.ps_invocations = &thread->ps_invocations;
+
+      thread->shade->thread = &thread->quad_thread;
+      thread->depth_test->thread = &thread->quad_thread;
+      thread->blend->thread = &thread->quad_thread;
+   }
+
+   if (!util_queue_init(&bin->queue, "softpipe",
+                        num_threads - 1, num_threads - 1))
+      goto fail;
+
+   return bin;
+
+fail:
+   sp_bin_destroy(bin);
+   return NULL;
+}
@@ -0,0 +1,71 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef SP_BIN_H
+#define SP_BIN_H
+
+#include "pipe/p_compiler.h"
+
+
+struct softpipe_context;
+struct sp_fragment_shader_variant;
+struct quad_header;
+struct tgsi_interp_coef;
+
+
+/** Max number of quads setup passes to the quad pipeline at once */
+#define SP_BIN_MAX_QUADS 16
+
+
+struct sp_bin *
+sp_bin_create(struct softpipe_context *softpipe);
+
+void
+sp_bin_destroy(struct sp_bin *bin);
+
+boolean
+sp_bin_prepare(struct sp_bin *bin);
+
+const struct tgsi_interp_coef *
+sp_bin_coefs(struct sp_bin *bin,
+             const struct tgsi_interp_coef *posCoef,
+             const struct tgsi_interp_coef *coef);
+
+boolean
+sp_bin_quads(struct sp_bin *bin,
+             const struct tgsi_interp_coef *coefs,
+             struct quad_header *quads[],
+             unsigned nr);
+
+void
+sp_bin_flush(struct sp_bin *bin);
+
+void
+sp_bin_release_fs_variant(struct sp_bin *bin,
+                          struct sp_fragment_shader_variant *var);
+
+
+#endif /* SP_BIN_H */
@@ -38,6 +38,7 @@
 #include "util/u_pstipple.h"
 #include "util/u_inlines.h"
 #include "tgsi/tgsi_exec.h"
+#include "sp_bin.h"
 #include "sp_buffer.h"
 #include "sp_clear.h"
 #include "sp_context.h"
@@ -86,6 +87,9 @@ softpipe_destroy( struct pipe_context *pipe )
    if (softpipe->quad.pstipple)
       softpipe->quad.pstipple->destroy( softpipe->quad.pstipple );
 
+   if (softpipe->bin)
+      sp_bin_destroy( softpipe->bin );
+
    for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
       sp_destroy_tile_cache(softpipe->cbuf_cache[i]);
       pipe_surface_reference(&softpipe->framebuffer.cbufs[i], NULL);
@@ -261,12 +265,19 @@ softpipe_create_context(struct pipe_screen *screen,
 
    softpipe->fs_machine = tgsi_exec_machine_create(PIPE_SHADER_FRAGMENT);
 
+   softpipe->quad.thread.fs_machine = softpipe->fs_machine;
+   softpipe->quad.thread.occlusion_count = &softpipe->occlusion_count;
+   softpipe->quad.thread.ps_invocations =
+      &softpipe->pipeline_statistics.ps_invocations;
+
    /* setup quad rendering stages */
    softpipe->quad.shade = sp_quad_shade_stage(softpipe);
    softpipe->quad.depth_test = sp_quad_depth_test_stage(softpipe);
    softpipe->quad.blend = sp_quad_blend_stage(softpipe);
    softpipe->quad.pstipple = sp_quad_polygon_stipple_stage(softpipe);
 
+   /* optional binned rasterization, see sp_bin.c */
+   softpipe->bin = sp_bin_create(softpipe);
 
    /*
     * Create drawing context and plug our rendering stage into it.
@@ -56,6 +56,7 @@ struct sp_fragment_shader;
 struct sp_vertex_shader;
 struct sp_velems_state;
 struct sp_so_state;
+struct sp_bin;
 
 struct softpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -170,8 +171,12 @@ struct softpipe_context {
       struct quad_stage *blend;
       struct quad_stage *pstipple;
       struct quad_stage *first; /**< points to one of the above stages */
+      struct quad_thread thread;
    } quad;
 
+   /** Binned, multithreaded rasterization (NULL if disabled) */
+   struct sp_bin *bin;
+
    /** TGSI exec things */
    struct {
       struct sp_tgsi_sampler *sampler[PIPE_SHADER_TYPES];
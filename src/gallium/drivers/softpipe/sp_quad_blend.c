@@ -1303,6 +1303,7 @@ struct quad_stage *sp_quad_blend_stage( struct softpipe_context *softpipe )
       return NULL;
 
    stage->base.softpipe = softpipe;
+   stage->base.thread = &softpipe->quad.thread;
    stage->base.begin = blend_begin;
    stage->base.run = choose_blend_quad;
    stage->base.destroy = blend_destroy;
@@ -843,7 +843,7 @@ depth_test_quads_fallback(struct quad_stage *qs,
 
    if (qs->softpipe->active_query_count) {
       for (i = 0; i < nr; i++) 
-         qs->softpipe->occlusion_count += mask_count[quads[i]->inout.mask];
+         *qs->thread->occlusion_count += mask_count[quads[i]->inout.mask];
    }
 
    if (nr)
@@ -1000,6 +1000,7 @@ sp_quad_depth_test_stage(struct softpipe_context *softpipe)
    struct quad_stage *stage = CALLOC_STRUCT(quad_stage);
 
    stage->softpipe = softpipe;
+   stage->thread = &softpipe->quad.thread;
    stage->begin = depth_test_begin;
    stage->run = choose_depth_test;
    stage->destroy = depth_test_destroy;
@@ -31,9 +31,24 @@
 #ifndef SP_QUAD_PIPE_H
 #define SP_QUAD_PIPE_H
 
+#include "pipe/p_compiler.h"
+
 
 struct softpipe_context;
 struct quad_header;
+struct tgsi_exec_machine;
+
+
+/**
+ * The resources quad pipelines running concurrently can't share.  The
+ * context's own pipeline uses the context's machine and counters, each
+ * thread of the binned rasterizer has its own set (see sp_bin.c).
+ */
+struct quad_thread {
+   struct tgsi_exec_machine *fs_machine;
+   uint64_t *occlusion_count;
+   uint64_t *ps_invocations;
+};
 
 
 /**
@@ -43,6 +58,7 @@ struct quad_header;
  */
 struct quad_stage {
    struct softpipe_context *softpipe;
+   const struct quad_thread *thread;
 
    struct quad_stage *next;
 
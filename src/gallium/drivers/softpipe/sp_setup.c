@@ -32,6 +32,7 @@
  * \author  Brian Paul
  */
 
+#include "sp_bin.h"
 #include "sp_context.h"
 #include "sp_quad.h"
 #include "sp_quad_pipe.h"
@@ -64,7 +65,7 @@ struct edge {
  * This can't be arbitrarily increased since we depend on some 32-bit
  * bitmasks (two bits per quad).
  */
-#define MAX_QUADS 16
+#define MAX_QUADS SP_BIN_MAX_QUADS
 
 
 /**
@@ -100,6 +101,10 @@ struct setup_context {
    struct tgsi_interp_coef coef[PIPE_MAX_SHADER_INPUTS];
    struct tgsi_interp_coef posCoef;  /* For Z, W */
 
+   /** Binned rasterization: the bin, and its copy of the coefs above */
+   struct sp_bin *bin;
+   const struct tgsi_interp_coef *bin_coefs;
+
    struct {
       int left[2];   /**< [0] = row0, [1] = row1 */
       int right[2];
@@ -153,6 +158,34 @@ quad_clip(struct setup_context *setup, struct quad_header *quad)
 }
 
 
+/**
+ * Pass a batch of quads to the quad pipeline, or bin them for the
+ * rasterizer threads.  The quads of a batch are all in the same tile.
+ */
+static inline void
+emit_quads(struct setup_context *setup, struct quad_header *quads[],
+           unsigned nr)
+{
+   struct quad_stage *pipe = setup->softpipe->quad.first;
+
+   if (setup->bin) {
+      if (!setup->bin_coefs)
+         setup->bin_coefs = sp_bin_coefs(setup->bin,
+                                         &setup->posCoef, setup->coef);
+
+      if (setup->bin_coefs &&
+          sp_bin_quads(setup->bin, setup->bin_coefs, quads, nr))
+         return;
+
+      /* out of memory: rasterize what was binned, then these quads */
+      sp_bin_flush(setup->bin);
+      setup->bin_coefs = NULL;
+   }
+
+   pipe->run( pipe, quads, nr );
+}
+
+
 /**
  * Emit a quad (pass to next stage) with clipping.
  */
@@ -162,13 +195,11 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
    quad_clip(setup, quad);
 
    if (quad->inout.mask) {
-      struct softpipe_context *sp = setup->softpipe;
-
 #if DEBUG_FRAGS
       setup->numFragsEmitted += util_bitcount(quad->inout.mask);
 #endif
 
-      sp->quad.first->run( sp->quad.first, &quad, 1 );
+      emit_quads(setup, &quad, 1);
    }
 }
 
@@ -203,7 +234,6 @@ flush_spans(struct setup_context *setup)
    const int xleft1 = setup->span.left[1];
    const int xright0 = setup->span.right[0];
    const int xright1 = setup->span.right[1];
-   struct quad_stage *pipe = setup->softpipe->quad.first;
 
    const int minleft = block_x(MIN2(xleft0, xleft1));
    const int maxright = MAX2(xright0, xright1);
@@ -248,7 +278,7 @@ flush_spans(struct setup_context *setup)
             lx += 2;
          } while (mask0 | mask1);
 
-         pipe->run( pipe, setup->quad_ptrs, q );
+         emit_quads(setup, setup->quad_ptrs, q);
       }
    }
 
@@ -821,6 +851,9 @@ sp_setup_tri(struct setup_context *setup,
 
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
+
+   /* the coefficients are about to change */
+   setup->bin_coefs = NULL;
    
    det = calc_det(v0, v1, v2);
    /*
@@ -1107,6 +1140,9 @@ sp_setup_line(struct setup_context *setup,
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
 
+   /* the coefficients are about to change */
+   setup->bin_coefs = NULL;
+
    if (dx == 0 && dy == 0)
       return;
 
@@ -1254,6 +1290,9 @@ sp_setup_point(struct setup_context *setup,
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
 
+   /* the coefficients are about to change */
+   setup->bin_coefs = NULL;
+
    assert(setup->softpipe->reduced_prim == PIPE_PRIM_POINTS);
 
    if (setup->softpipe->layer_slot > 0) {
@@ -1480,6 +1519,11 @@ sp_setup_prepare(struct setup_context *setup)
 
    sp->quad.first->begin( sp->quad.first );
 
+   if (sp->bin && sp_bin_prepare(sp->bin))
+      setup->bin = sp->bin;
+   else
+      setup->bin = NULL;
+
    if (sp->reduced_api_prim == PIPE_PRIM_TRIANGLES &&
        sp->rasterizer->fill_front == PIPE_POLYGON_MODE_FILL &&
        sp->rasterizer->fill_back == PIPE_POLYGON_MODE_FILL) {
@@ -1493,6 +1537,18 @@ sp_setup_prepare(struct setup_context *setup)
 }
 
 
+/**
+ * Called by vbuf code at the end of each draw: rasterize the quads binned
+ * for the rasterizer threads, if any.
+ */
+void
+sp_setup_flush(struct setup_context *setup)
+{
+   if (setup->bin)
+      sp_bin_flush(setup->bin);
+}
+
+
 void
 sp_setup_destroy_context(struct setup_context *setup)
 {
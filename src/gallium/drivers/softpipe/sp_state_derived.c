@@ -285,11 +285,17 @@ set_shader_sampler(struct softpipe_context *softpipe,
                    unsigned shader,
                    int max_sampler)
 {
+   struct sp_tgsi_sampler *tgsi_sampler = softpipe->tgsi.sampler[shader];
    int i;
    for (i = 0; i <= max_sampler; i++) {
-      softpipe->tgsi.sampler[shader]->sp_sampler[i] =
+      tgsi_sampler->sp_sampler[i] =
          (struct sp_sampler *)(softpipe->samplers[shader][i]);
+      sp_sampler_view_select_filters(&tgsi_sampler->sp_sview[i],
+                                     tgsi_sampler->sp_sampler[i]);
    }
+   /* drop selections made for samplers which may have been deleted since */
+   for (; i < PIPE_MAX_SAMPLERS; i++)
+      tgsi_sampler->sp_sview[i].filter_sampler = NULL;
 }
 
 void
@@ -1002,13 +1002,18 @@ print_sample_4(const char *function, float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZ
 }
 
 
-/* Some image-filter fastpaths:
+/* Some image-filter fastpaths.
+ *
+ * These fetch straight from the texture tile cache, without the border
+ * checks of get_texel_2d(), so they may only be used with wrap modes which
+ * keep the texel coordinates within the image.  The filter_2d_*() helpers
+ * take the layer to sample and are shared by the 2D and 2D array filters.
  */
 static inline void
-img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
-                                const struct sp_sampler *sp_samp,
-                                const struct img_filter_args *args,
-                                float *rgba)
+filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
+                            const struct img_filter_args *args,
+                            unsigned layer,
+                            float *rgba)
 {
    const unsigned xpot = pot_level_size(sp_sview->xpot, args->level);
    const unsigned ypot = pot_level_size(sp_sview->ypot, args->level);
@@ -1033,7 +1038,7 @@ img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
       
    addr.value = 0;
    addr.bits.level = args->level;
-   addr.bits.z = sp_sview->base.u.tex.first_layer;
+   addr.bits.z = layer;
 
    /* Can we fetch all four at once:
     */
@@ -1060,10 +1065,10 @@ img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
 
 
 static inline void
-img_filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
-                                 const struct sp_sampler *sp_samp,
-                                 const struct img_filter_args *args,
-                                 float *rgba)
+filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
+                             const struct img_filter_args *args,
+                             unsigned layer,
+                             float *rgba)
 {
    const unsigned xpot = pot_level_size(sp_sview->xpot, args->level);
    const unsigned ypot = pot_level_size(sp_sview->ypot, args->level);
@@ -1082,7 +1087,110 @@ img_filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
 
    addr.value = 0;
    addr.bits.level = args->level;
-   addr.bits.z = sp_sview->base.u.tex.first_layer;
+   addr.bits.z = layer;
+
+   out = get_texel_2d_no_border(sp_sview, addr, x0, y0);
+   for (c = 0; c < TGSI_NUM_CHANNELS; c++)
+      rgba[TGSI_NUM_CHANNELS*c] = out[c];
+
+   if (DEBUG_TEX) {
+      print_sample(__FUNCTION__, rgba);
+   }
+}
+
+
+static inline void
+filter_2d_linear_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                               const struct img_filter_args *args,
+                               unsigned layer,
+                               float *rgba)
+{
+   const struct pipe_resource *texture = sp_sview->base.texture;
+   const int width = u_minify(texture->width0, args->level);
+   const int height = u_minify(texture->height0, args->level);
+   union tex_tile_address addr;
+   const float *tx[4];
+   int c;
+
+   /* Same as wrap_linear_clamp_to_edge() */
+   const float u = CLAMP(args->s * width + args->offset[0],
+                         0.0F, (float)width) - 0.5F;
+   const float v = CLAMP(args->t * height + args->offset[1],
+                         0.0F, (float)height) - 0.5F;
+
+   const int uflr = util_ifloor(u);
+   const int vflr = util_ifloor(v);
+
+   const float xw = frac(u);
+   const float yw = frac(v);
+
+   const int x0 = MAX2(uflr, 0);
+   const int y0 = MAX2(vflr, 0);
+   const int x1 = MIN2(uflr + 1, width - 1);
+   const int y1 = MIN2(vflr + 1, height - 1);
+
+   addr.value = 0;
+   addr.bits.level = args->level;
+   addr.bits.z = layer;
+
+   /* Can we fetch all four at once:
+    */
+   if (x1 == x0 + 1 && (x0 & (TEX_TILE_SIZE - 1)) != TEX_TILE_SIZE - 1 &&
+       y1 == y0 + 1 && (y0 & (TEX_TILE_SIZE - 1)) != TEX_TILE_SIZE - 1) {
+      get_texel_quad_2d_no_border_single_tile(sp_sview, addr, x0, y0, tx);
+   }
+   else {
+      get_texel_quad_2d_no_border(sp_sview, addr, x0, y0, x1, y1, tx);
+   }
+
+   /* interpolate R, G, B, A */
+   for (c = 0; c < TGSI_NUM_CHANNELS; c++) {
+      rgba[TGSI_NUM_CHANNELS*c] = lerp_2d(xw, yw,
+                                       tx[0][c], tx[1][c],
+                                       tx[2][c], tx[3][c]);
+   }
+
+   if (DEBUG_TEX) {
+      print_sample(__FUNCTION__, rgba);
+   }
+}
+
+
+static inline void
+filter_2d_nearest_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                                const struct img_filter_args *args,
+                                unsigned layer,
+                                float *rgba)
+{
+   const struct pipe_resource *texture = sp_sview->base.texture;
+   const int width = u_minify(texture->width0, args->level);
+   const int height = u_minify(texture->height0, args->level);
+   union tex_tile_address addr;
+   const float *out;
+   int x0, y0;
+   int c;
+
+   /* Same as wrap_nearest_clamp_to_edge() */
+   const float u = args->s * width + args->offset[0];
+   const float v = args->t * height + args->offset[1];
+
+   if (u < 0.5F)
+      x0 = 0;
+   else if (u > (float)width - 0.5F)
+      x0 = width - 1;
+   else
+      x0 = util_ifloor(u);
+
+   if (v < 0.5F)
+      y0 = 0;
+   else if (v > (float)height - 0.5F)
+      y0 = height - 1;
+   else
+      y0 = util_ifloor(v);
+
+   addr.value = 0;
+   addr.bits.level = args->level;
+   addr.bits.z = layer;
 
    out = get_texel_2d_no_border(sp_sview, addr, x0, y0);
    for (c = 0; c < TGSI_NUM_CHANNELS; c++)
@@ -1094,6 +1202,106 @@ img_filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
 }
 
 
+static void
+img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
+                                const struct sp_sampler *sp_samp,
+                                const struct img_filter_args *args,
+                                float *rgba)
+{
+   filter_2d_linear_repeat_POT(sp_sview, args,
+                               sp_sview->base.u.tex.first_layer, rgba);
+}
+
+
+static void
+img_filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
+                                 const struct sp_sampler *sp_samp,
+                                 const struct img_filter_args *args,
+                                 float *rgba)
+{
+   filter_2d_nearest_repeat_POT(sp_sview, args,
+                                sp_sview->base.u.tex.first_layer, rgba);
+}
+
+
+static void
+img_filter_2d_linear_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                                   const struct sp_sampler *sp_samp,
+                                   const struct img_filter_args *args,
+                                   float *rgba)
+{
+   filter_2d_linear_clamp_to_edge(sp_sview, args,
+                                  sp_sview->base.u.tex.first_layer, rgba);
+}
+
+
+static void
+img_filter_2d_nearest_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                                    const struct sp_sampler *sp_samp,
+                                    const struct img_filter_args *args,
+                                    float *rgba)
+{
+   filter_2d_nearest_clamp_to_edge(sp_sview, args,
+                                   sp_sview->base.u.tex.first_layer, rgba);
+}
+
+
+static void
+img_filter_2d_array_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
+                                      const struct sp_sampler *sp_samp,
+                                      const struct img_filter_args *args,
+                                      float *rgba)
+{
+   filter_2d_linear_repeat_POT(sp_sview, args,
+                               coord_to_layer(args->p,
+                                              sp_sview->base.u.tex.first_layer,
+                                              sp_sview->base.u.tex.last_layer),
+                               rgba);
+}
+
+
+static void
+img_filter_2d_array_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
+                                       const struct sp_sampler *sp_samp,
+                                       const struct img_filter_args *args,
+                                       float *rgba)
+{
+   filter_2d_nearest_repeat_POT(sp_sview, args,
+                                coord_to_layer(args->p,
+                                               sp_sview->base.u.tex.first_layer,
+                                               sp_sview->base.u.tex.last_layer),
+                                rgba);
+}
+
+
+static void
+img_filter_2d_array_linear_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                                         const struct sp_sampler *sp_samp,
+                                         const struct img_filter_args *args,
+                                         float *rgba)
+{
+   filter_2d_linear_clamp_to_edge(sp_sview, args,
+                                  coord_to_layer(args->p,
+                                                 sp_sview->base.u.tex.first_layer,
+                                                 sp_sview->base.u.tex.last_layer),
+                                  rgba);
+}
+
+
+static void
+img_filter_2d_array_nearest_clamp_to_edge(const struct sp_sampler_view *sp_sview,
+                                          const struct sp_sampler *sp_samp,
+                                          const struct img_filter_args *args,
+                                          float *rgba)
+{
+   filter_2d_nearest_clamp_to_edge(sp_sview, args,
+                                   coord_to_layer(args->p,
+                                                  sp_sview->base.u.tex.first_layer,
+                                                  sp_sview->base.u.tex.last_layer),
+                                   rgba);
+}
+
+
 static inline void
 img_filter_2d_nearest_clamp_POT(const struct sp_sampler_view *sp_sview,
                                 const struct sp_sampler *sp_samp,
@@ -2538,19 +2746,18 @@ mip_rel_level_linear_2d_linear_repeat_POT(
 /**
  * Specialized version of mip_filter_linear with hard-wired calls to
  * 2d lambda calculation and 2d_linear_repeat_POT img filters.
+ * \param array  whether the layer comes from the p coord (2D array views)
  */
-static void
-mip_filter_linear_2d_linear_repeat_POT(
+static inline void
+mip_filter_linear_linear_repeat_POT(
    const struct sp_sampler_view *sp_sview,
    const struct sp_sampler *sp_samp,
-   img_filter_func min_filter,
-   img_filter_func mag_filter,
    const float s[TGSI_QUAD_SIZE],
    const float t[TGSI_QUAD_SIZE],
    const float p[TGSI_QUAD_SIZE],
-   const float c0[TGSI_QUAD_SIZE],
    const float lod_in[TGSI_QUAD_SIZE],
    const struct filter_args *filt_args,
+   boolean array,
    float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
 {
    const struct pipe_sampler_view *psview = &sp_sview->base;
@@ -2561,6 +2768,10 @@ mip_filter_linear_2d_linear_repeat_POT(
 
    for (j = 0; j < TGSI_QUAD_SIZE; j++) {
       const int level0 = psview->u.tex.first_level + (int)lod[j];
+      const unsigned layer = array ?
+         coord_to_layer(p[j], psview->u.tex.first_layer,
+                        psview->u.tex.last_layer) :
+         psview->u.tex.first_layer;
       struct img_filter_args args;
       /* Catches both negative and large values of level0:
        */
@@ -2575,8 +2786,7 @@ mip_filter_linear_2d_linear_repeat_POT(
             args.level = psview->u.tex.first_level;
          else
             args.level = psview->u.tex.last_level;
-         img_filter_2d_linear_repeat_POT(sp_sview, sp_samp, &args,
-                                         &rgba[0][j]);
+         filter_2d_linear_repeat_POT(sp_sview, &args, layer, &rgba[0][j]);
 
       }
       else {
@@ -2585,9 +2795,9 @@ mip_filter_linear_2d_linear_repeat_POT(
          int c;
 
          args.level = level0;
-         img_filter_2d_linear_repeat_POT(sp_sview, sp_samp, &args, &rgbax[0][0]);
+         filter_2d_linear_repeat_POT(sp_sview, &args, layer, &rgbax[0][0]);
          args.level = level0+1;
-         img_filter_2d_linear_repeat_POT(sp_sview, sp_samp, &args, &rgbax[0][1]);
+         filter_2d_linear_repeat_POT(sp_sview, &args, layer, &rgbax[0][1]);
 
          for (c = 0; c < TGSI_NUM_CHANNELS; c++)
             rgba[c][j] = lerp(levelBlend, rgbax[c][0], rgbax[c][1]);
@@ -2599,6 +2809,42 @@ mip_filter_linear_2d_linear_repeat_POT(
    }
 }
 
+static void
+mip_filter_linear_2d_linear_repeat_POT(
+   const struct sp_sampler_view *sp_sview,
+   const struct sp_sampler *sp_samp,
+   img_filter_func min_filter,
+   img_filter_func mag_filter,
+   const float s[TGSI_QUAD_SIZE],
+   const float t[TGSI_QUAD_SIZE],
+   const float p[TGSI_QUAD_SIZE],
+   const float c0[TGSI_QUAD_SIZE],
+   const float lod_in[TGSI_QUAD_SIZE],
+   const struct filter_args *filt_args,
+   float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
+{
+   mip_filter_linear_linear_repeat_POT(sp_sview, sp_samp, s, t, p, lod_in,
+                                       filt_args, FALSE, rgba);
+}
+
+static void
+mip_filter_linear_2d_array_linear_repeat_POT(
+   const struct sp_sampler_view *sp_sview,
+   const struct sp_sampler *sp_samp,
+   img_filter_func min_filter,
+   img_filter_func mag_filter,
+   const float s[TGSI_QUAD_SIZE],
+   const float t[TGSI_QUAD_SIZE],
+   const float p[TGSI_QUAD_SIZE],
+   const float c0[TGSI_QUAD_SIZE],
+   const float lod_in[TGSI_QUAD_SIZE],
+   const struct filter_args *filt_args,
+   float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
+{
+   mip_filter_linear_linear_repeat_POT(sp_sview, sp_samp, s, t, p, lod_in,
+                                       filt_args, TRUE, rgba);
+}
+
 static const struct sp_filter_funcs funcs_linear = {
    mip_rel_level_linear,
    mip_filter_linear
@@ -2629,6 +2875,11 @@ static const struct sp_filter_funcs funcs_linear_2d_linear_repeat_POT = {
    mip_filter_linear_2d_linear_repeat_POT
 };
 
+static const struct sp_filter_funcs funcs_linear_2d_array_linear_repeat_POT = {
+   mip_rel_level_linear_2d_linear_repeat_POT,
+   mip_filter_linear_2d_array_linear_repeat_POT
+};
+
 /**
  * Do shadow/depth comparisons.
  */
@@ -2935,11 +3186,72 @@ any_swizzle(const struct pipe_sampler_view *view)
 }
 
 
+/**
+ * The image filter fast paths, for 2D and 2D array views sampled with
+ * normalized coords and the same wrap mode in s and t.  The texture tile
+ * cache holds unpacked float texels whatever the format of the texture, so
+ * these cover all color formats.
+ */
+static const struct {
+   unsigned wrap;       /**< PIPE_TEX_WRAP_x of both s and t */
+   unsigned filter;     /**< PIPE_TEX_FILTER_x */
+   boolean pot;         /**< needs power of two width and height */
+   img_filter_func filter_2d;
+   img_filter_func filter_2d_array;
+} img_filter_fast[] = {
+   { PIPE_TEX_WRAP_REPEAT, PIPE_TEX_FILTER_NEAREST, TRUE,
+     img_filter_2d_nearest_repeat_POT,
+     img_filter_2d_array_nearest_repeat_POT },
+   { PIPE_TEX_WRAP_REPEAT, PIPE_TEX_FILTER_LINEAR, TRUE,
+     img_filter_2d_linear_repeat_POT,
+     img_filter_2d_array_linear_repeat_POT },
+   { PIPE_TEX_WRAP_CLAMP, PIPE_TEX_FILTER_NEAREST, TRUE,
+     img_filter_2d_nearest_clamp_POT,
+     NULL },
+   { PIPE_TEX_WRAP_CLAMP_TO_EDGE, PIPE_TEX_FILTER_NEAREST, FALSE,
+     img_filter_2d_nearest_clamp_to_edge,
+     img_filter_2d_array_nearest_clamp_to_edge },
+   { PIPE_TEX_WRAP_CLAMP_TO_EDGE, PIPE_TEX_FILTER_LINEAR, FALSE,
+     img_filter_2d_linear_clamp_to_edge,
+     img_filter_2d_array_linear_clamp_to_edge },
+};
+
+
+/**
+ * Look for an image filter fast path, return NULL if there is none.
+ */
+static img_filter_func
+get_img_filter_fast(const struct sp_sampler_view *sp_sview,
+                    const struct pipe_sampler_state *sampler,
+                    unsigned filter)
+{
+   const boolean array = sp_sview->base.target == PIPE_TEXTURE_2D_ARRAY;
+   const boolean pot = array ? sp_sview->pot2d_array : sp_sview->pot2d;
+   unsigned i;
+
+   if (sampler->wrap_s != sampler->wrap_t || !sampler->normalized_coords)
+      return NULL;
+
+   for (i = 0; i < ARRAY_SIZE(img_filter_fast); i++) {
+      if (img_filter_fast[i].wrap == sampler->wrap_s &&
+          img_filter_fast[i].filter == filter &&
+          (pot || !img_filter_fast[i].pot)) {
+         return array ? img_filter_fast[i].filter_2d_array :
+                        img_filter_fast[i].filter_2d;
+      }
+   }
+
+   return NULL;
+}
+
+
 static img_filter_func
 get_img_filter(const struct sp_sampler_view *sp_sview,
                const struct pipe_sampler_state *sampler,
                unsigned filter, bool gather)
 {
+   img_filter_func fast;
+
    switch (sp_sview->base.target) {
    case PIPE_BUFFER:
    case PIPE_TEXTURE_1D:
@@ -2958,30 +3270,8 @@ get_img_filter(const struct sp_sampler_view *sp_sview,
    case PIPE_TEXTURE_RECT:
       /* Try for fast path:
        */
-      if (!gather && sp_sview->pot2d &&
-          sampler->wrap_s == sampler->wrap_t &&
-          sampler->normalized_coords) 
-      {
-         switch (sampler->wrap_s) {
-         case PIPE_TEX_WRAP_REPEAT:
-            switch (filter) {
-            case PIPE_TEX_FILTER_NEAREST:
-               return img_filter_2d_nearest_repeat_POT;
-            case PIPE_TEX_FILTER_LINEAR:
-               return img_filter_2d_linear_repeat_POT;
-            default:
-               break;
-            }
-            break;
-         case PIPE_TEX_WRAP_CLAMP:
-            switch (filter) {
-            case PIPE_TEX_FILTER_NEAREST:
-               return img_filter_2d_nearest_clamp_POT;
-            default:
-               break;
-            }
-         }
-      }
+      if (!gather && (fast = get_img_filter_fast(sp_sview, sampler, filter)))
+         return fast;
       /* Otherwise use default versions:
        */
       if (filter == PIPE_TEX_FILTER_NEAREST) 
@@ -2990,6 +3280,8 @@ get_img_filter(const struct sp_sampler_view *sp_sview,
          return img_filter_2d_linear;
       break;
    case PIPE_TEXTURE_2D_ARRAY:
+      if (!gather && (fast = get_img_filter_fast(sp_sview, sampler, filter)))
+         return fast;
       if (filter == PIPE_TEX_FILTER_NEAREST) 
          return img_filter_2d_array_nearest;
       else
@@ -3039,8 +3331,18 @@ get_filters(const struct sp_sampler_view *sp_sview,
          *min = get_img_filter(sp_sview, &sp_samp->base,
                                PIPE_TEX_FILTER_LINEAR, true);
       }
+   } else if (sp_sview->filter_sampler == sp_samp) {
+      /* selected at bind time */
+      *funcs = sp_sview->filter_funcs;
+      if (min) {
+         assert(mag);
+         *min = sp_sview->min_img_filter;
+         *mag = sp_sview->mag_img_filter;
+      }
    } else if (sp_sview->pot2d & sp_samp->min_mag_equal_repeat_linear) {
       *funcs = &funcs_linear_2d_linear_repeat_POT;
+   } else if (sp_sview->pot2d_array & sp_samp->min_mag_equal_repeat_linear) {
+      *funcs = &funcs_linear_2d_array_linear_repeat_POT;
    } else {
       *funcs = sp_samp->filter_funcs;
       if (min) {
@@ -3057,6 +3359,29 @@ get_filters(const struct sp_sampler_view *sp_sview,
    }
 }
 
+/**
+ * Choose the filter functions for sampling \p sp_sview with \p sp_samp
+ * once, at bind time, rather than on each sample.  Called whenever the
+ * samplers or sampler views of a shader change; any other sampler and
+ * view pairing falls back to get_filters() at sample time.
+ */
+void
+sp_sampler_view_select_filters(struct sp_sampler_view *sp_sview,
+                               const struct sp_sampler *sp_samp)
+{
+   sp_sview->filter_sampler = NULL;
+   sp_sview->min_img_filter = NULL;
+   sp_sview->mag_img_filter = NULL;
+
+   if (!sp_samp || !sp_sview->base.texture)
+      return;
+
+   get_filters(sp_sview, sp_samp, TGSI_SAMPLER_LOD_NONE,
+               &sp_sview->filter_funcs,
+               &sp_sview->min_img_filter, &sp_sview->mag_img_filter);
+   sp_sview->filter_sampler = sp_samp;
+}
+
 static void
 sample_mip(const struct sp_sampler_view *sp_sview,
            const struct sp_sampler *sp_samp,
@@ -3518,6 +3843,8 @@ softpipe_create_sampler_view(struct pipe_context *pipe,
       sview->pot2d = spr->pot &&
                      (view->target == PIPE_TEXTURE_2D ||
                       view->target == PIPE_TEXTURE_RECT);
+      sview->pot2d_array = spr->pot &&
+                           view->target == PIPE_TEXTURE_2D_ARRAY;
 
       sview->xpot = util_logbase2( resource->width0 );
       sview->ypot = util_logbase2( resource->height0 );
@@ -35,6 +35,7 @@
 
 struct sp_sampler_view;
 struct sp_sampler;
+struct sp_filter_funcs;
 
 typedef void (*wrap_nearest_func)(float s,
                                   unsigned size,
@@ -111,12 +112,20 @@ struct sp_sampler_view
 
    boolean need_swizzle;
    boolean pot2d;
+   boolean pot2d_array;
    boolean need_cube_convert;
 
    /* these are different per shader type */
    struct softpipe_tex_tile_cache *cache;
    compute_lambda_func compute_lambda;
 
+   /* Filters for sampling with filter_sampler, chosen at bind time by
+    * sp_sampler_view_select_filters():
+    */
+   const struct sp_sampler *filter_sampler;
+   const struct sp_filter_funcs *filter_funcs;
+   img_filter_func min_img_filter;
+   img_filter_func mag_img_filter;
 };
 
 struct sp_filter_funcs {
@@ -173,4 +182,9 @@ struct sp_tgsi_sampler *
 sp_create_tgsi_sampler(void);
 
 
+void
+sp_sampler_view_select_filters(struct sp_sampler_view *sp_sview,
+                               const struct sp_sampler *sp_samp);
+
+
 #endif /* SP_TEX_SAMPLE_H */
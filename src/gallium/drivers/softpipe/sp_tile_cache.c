@@ -32,6 +32,7 @@
  *    Brian Paul
  */
 
+#include "util/u_atomic.h"
 #include "util/u_inlines.h"
 #include "util/u_format.h"
 #include "util/u_memory.h"
@@ -42,16 +43,6 @@ static struct softpipe_cached_tile *
 sp_alloc_tile(struct softpipe_tile_cache *tc);
 
 
-/**
- * Return the position in the cache for the tile that contains win pos (x,y).
- * We currently use a direct mapped cache so this is like a hack key.
- * At some point we should investige something more sophisticated, like
- * a LRU replacement policy.
- */
-#define CACHE_POS(x, y, l)                        \
-   (((x) + (y) * 5 + (l) * 10) % NUM_ENTRIES)
-
-
 static inline int addr_to_clear_pos(union tile_address addr)
 {
    int pos;
@@ -76,14 +67,20 @@ is_clear_flag_set(const uint *bitvec, union tile_address addr, unsigned max)
 
 /**
  * Mark the tile at (x,y) as not cleared.
+ * The flags of neighbouring tiles share a word, and these may be owned by
+ * other threads when the cache is shared.
  */
 static inline void
 clear_clear_flag(uint *bitvec, union tile_address addr, unsigned max)
 {
    int pos;
+   uint old;
    pos = addr_to_clear_pos(addr);
    assert(pos / 32 < max);
-   bitvec[pos / 32] &= ~(1 << (pos & 31));
+   do {
+      old = p_atomic_read(&bitvec[pos / 32]);
+   } while (p_atomic_cmpxchg(&bitvec[pos / 32], old,
+                             old & ~(1 << (pos & 31))) != old);
 }
    
 
@@ -617,12 +614,45 @@ sp_find_cached_tile(struct softpipe_tile_cache *tc,
       }
    }
 
-   tc->last_tile = tile;
-   tc->last_tile_addr = addr;
+   if (!tc->shared) {
+      tc->last_tile = tile;
+      tc->last_tile_addr = addr;
+   }
    return tile;
 }
 
 
+/**
+ * Start or stop sharing the cache between several rasterizer threads.
+ *
+ * While the cache is shared, each thread must only look up the tiles at
+ * the cache positions (see sp_tile_cache_pos()) it owns.  Lookups then
+ * touch nothing but the entry of their tile: the last retrieved tile
+ * isn't tracked and all the entries are allocated up front.
+ *
+ * \return FALSE if the entries couldn't be allocated.
+ */
+boolean
+sp_tile_cache_share(struct softpipe_tile_cache *tc, boolean shared)
+{
+   uint pos;
+
+   if (shared) {
+      for (pos = 0; pos < ARRAY_SIZE(tc->entries); pos++) {
+         if (!tc->entries[pos]) {
+            tc->entries[pos] = MALLOC_STRUCT(softpipe_cached_tile);
+            if (!tc->entries[pos])
+               return FALSE;
+         }
+      }
+      tc->last_tile_addr.bits.invalid = 1;
+   }
+
+   tc->shared = shared;
+   return TRUE;
+}
+
+
 
 
 
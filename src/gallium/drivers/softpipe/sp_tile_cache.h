@@ -79,6 +79,16 @@ struct softpipe_cached_tile
 #define NUM_ENTRIES 50
 
 
+/**
+ * Return the position in the cache for the tile that contains win pos (x,y).
+ * We currently use a direct mapped cache so this is like a hack key.
+ * At some point we should investige something more sophisticated, like
+ * a LRU replacement policy.
+ */
+#define CACHE_POS(x, y, l)                        \
+   (((x) + (y) * 5 + (l) * 10) % NUM_ENTRIES)
+
+
 struct softpipe_tile_cache
 {
    struct pipe_context *pipe;
@@ -99,6 +109,8 @@ struct softpipe_tile_cache
 
    union tile_address last_tile_addr;
    struct softpipe_cached_tile *last_tile;  /**< most recently retrieved tile */
+
+   boolean shared;  /**< used by several threads, see sp_tile_cache_share() */
 };
 
 
@@ -127,6 +139,9 @@ extern struct softpipe_cached_tile *
 sp_find_cached_tile(struct softpipe_tile_cache *tc, 
                     union tile_address addr );
 
+extern boolean
+sp_tile_cache_share(struct softpipe_tile_cache *tc, boolean shared);
+
 
 static inline union tile_address
 tile_address( unsigned x,
@@ -141,6 +156,17 @@ tile_address( unsigned x,
    return addr;
 }
 
+/**
+ * Return the cache position of the tile at \p addr.  Tiles at different
+ * positions never evict each other.
+ */
+static inline unsigned
+sp_tile_cache_pos(union tile_address addr)
+{
+   return CACHE_POS(addr.bits.x, addr.bits.y, addr.bits.layer);
+}
+
+
 /* Quickly retrieve tile if it matches last lookup.
  */
 static inline struct softpipe_cached_tile *
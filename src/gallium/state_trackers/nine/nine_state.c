@@ -1083,6 +1083,10 @@ nine_update_state(struct NineDevice9 *device)
         }
     }
 
+    /* Samplers and sampler views set through the cso_context are only
+     * sent to the driver on request, as we draw with the pipe directly. */
+    cso_emit_state(device->cso);
+
     device->state.changed.group &=
         (NINE_STATE_FF | NINE_STATE_VS_CONST | NINE_STATE_PS_CONST);
 
@@ -0,0 +1,226 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Microbenchmark for the CSO cache.
+ *
+ * This mimics what cso_set_blend() / cso_set_sampler() and friends do for
+ * every state change: hash the state template, look it up in the cache,
+ * and create and insert a new object on a miss.  The throughput of those
+ * lookups is reported for a few working set sizes, together with the cost
+ * of populating the cache in the first place.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cso_cache/cso_cache.h"
+#include "cso_cache/cso_hash.h"
+#include "os/os_time.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+
+#define NUM_SETS (1 << 22)
+
+
+static void
+make_blend(struct pipe_blend_state *blend, unsigned i)
+{
+   memset(blend, 0, sizeof *blend);
+   blend->rt[0].blend_enable = 1;
+   blend->rt[0].rgb_func = i % 5;
+   blend->rt[0].rgb_src_factor = (i / 5) % 32;
+   blend->rt[0].rgb_dst_factor = (i / 160) % 32;
+   blend->rt[0].alpha_src_factor = (i / 5120) % 32;
+   blend->rt[0].colormask = 0xf;
+}
+
+
+static void
+make_sampler(struct pipe_sampler_state *samp, unsigned i)
+{
+   memset(samp, 0, sizeof *samp);
+   samp->wrap_s = i % 7;
+   samp->wrap_t = (i / 7) % 7;
+   samp->min_img_filter = (i / 49) % 2;
+   samp->mag_img_filter = (i / 98) % 2;
+   samp->lod_bias = (float)(i / 196);
+   samp->max_lod = 1000.0f;
+   samp->normalized_coords = 1;
+}
+
+
+/**
+ * Set \p num_sets states picked from a working set of \p count distinct
+ * blend states, the way cso_set_blend() does.
+ *
+ * \return  the number of cache misses
+ */
+static unsigned
+set_blend_states(struct cso_cache *cache, unsigned count, unsigned num_sets)
+{
+   struct pipe_blend_state templ;
+   unsigned misses = 0;
+   unsigned i;
+
+   for (i = 0; i < num_sets; i++) {
+      unsigned hash_key;
+      struct cso_hash_iter iter;
+
+      /* Step through the working set with a stride coprime to its size, so
+       * that consecutive sets hit different states.
+       */
+      make_blend(&templ, (i * 7919u) % count);
+      hash_key = cso_construct_key(&templ, sizeof templ);
+      iter = cso_find_state_template(cache, hash_key, CSO_BLEND,
+                                     &templ, sizeof templ);
+      if (cso_hash_iter_is_null(iter)) {
+         struct cso_blend *cso = MALLOC(sizeof(struct cso_blend));
+         if (!cso)
+            abort();
+
+         memcpy(&cso->state, &templ, sizeof templ);
+         cso->data = NULL;
+         cso->delete_state = NULL;
+         cso->context = NULL;
+
+         iter = cso_insert_state(cache, hash_key, CSO_BLEND, cso);
+         if (cso_hash_iter_is_null(iter))
+            abort();
+         misses++;
+      }
+      else if (memcmp(&((struct cso_blend *)cso_hash_iter_data(iter))->state,
+                      &templ, sizeof templ) != 0) {
+         abort();
+      }
+   }
+
+   return misses;
+}
+
+
+/**
+ * As above, for sampler states.
+ */
+static unsigned
+set_sampler_states(struct cso_cache *cache, unsigned count, unsigned num_sets)
+{
+   struct pipe_sampler_state templ;
+   unsigned misses = 0;
+   unsigned i;
+
+   for (i = 0; i < num_sets; i++) {
+      unsigned hash_key;
+      struct cso_hash_iter iter;
+
+      make_sampler(&templ, (i * 7919u) % count);
+      hash_key = cso_construct_key(&templ, sizeof templ);
+      iter = cso_find_state_template(cache, hash_key, CSO_SAMPLER,
+                                     &templ, sizeof templ);
+      if (cso_hash_iter_is_null(iter)) {
+         struct cso_sampler *cso = MALLOC(sizeof(struct cso_sampler));
+         if (!cso)
+            abort();
+
+         memcpy(&cso->state, &templ, sizeof templ);
+         cso->data = NULL;
+         cso->delete_state = NULL;
+         cso->context = NULL;
+
+         iter = cso_insert_state(cache, hash_key, CSO_SAMPLER, cso);
+         if (cso_hash_iter_is_null(iter))
+            abort();
+         misses++;
+      }
+      else if (memcmp(&((struct cso_sampler *)cso_hash_iter_data(iter))->state,
+                      &templ, sizeof templ) != 0) {
+         abort();
+      }
+   }
+
+   return misses;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+   static const unsigned counts[] = { 4, 64, 1024, 4096 };
+   unsigned num_sets = NUM_SETS;
+   unsigned i;
+
+   if (argc > 1)
+      num_sets = strtoul(argv[1], NULL, 0);
+
+   printf("%-8s %8s %10s %14s %14s\n",
+          "type", "states", "misses", "fill (us)", "sets/s");
+
+   for (i = 0; i < ARRAY_SIZE(counts); i++) {
+      struct cso_cache *cache;
+      int64_t start, fill, end;
+      unsigned misses;
+
+      /* Blend states */
+      cache = cso_cache_create();
+      if (!cache)
+         return 1;
+
+      start = os_time_get();
+      misses = set_blend_states(cache, counts[i], counts[i]);
+      fill = os_time_get();
+      misses += set_blend_states(cache, counts[i], num_sets);
+      end = os_time_get();
+
+      printf("%-8s %8u %10u %14.0f %14.0f\n", "blend", counts[i], misses,
+             (double)(fill - start),
+             num_sets * 1e6 / (double)MAX2(end - fill, 1));
+
+      cso_cache_delete(cache);
+
+      /* Sampler states */
+      cache = cso_cache_create();
+      if (!cache)
+         return 1;
+
+      start = os_time_get();
+      misses = set_sampler_states(cache, counts[i], counts[i]);
+      fill = os_time_get();
+      misses += set_sampler_states(cache, counts[i], num_sets);
+      end = os_time_get();
+
+      printf("%-8s %8u %10u %14.0f %14.0f\n", "sampler", counts[i], misses,
+             (double)(fill - start),
+             num_sets * 1e6 / (double)MAX2(end - fill, 1));
+
+      cso_cache_delete(cache);
+   }
+
+   return 0;
+}
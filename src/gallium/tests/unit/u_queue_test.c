@@ -0,0 +1,328 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ *  Test case for util_queue.
+ *
+ *  Runs a random graph of dependent jobs while the number of threads
+ *  changes, and checks that every job runs exactly once and only after the
+ *  jobs it depends on.  Also checks the execution order of priorities, and
+ *  reports the throughput of empty jobs.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os/os_thread.h"
+#include "os/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_queue.h"
+
+
+#define NUM_JOBS 20000
+#define MAX_DEPS 3
+
+static int verbosity = 0;
+
+
+#define LOG(fmt, ...) \
+   if (verbosity > 0) { \
+      fprintf(stdout, fmt, ##__VA_ARGS__); \
+   }
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      _exit(EXIT_FAILURE); \
+   }
+
+
+/*
+ * Dependency stress test.
+ */
+
+struct stress_job {
+   unsigned index;
+   unsigned deps[MAX_DEPS];
+   unsigned num_deps;
+   struct util_queue_fence fence;
+};
+
+static struct util_queue stress_queue;
+static struct stress_job stress_jobs[2 * NUM_JOBS];
+static int executed[2 * NUM_JOBS];
+static int cleaned[2 * NUM_JOBS];
+
+
+static void
+stress_execute(void *data, int thread_index)
+{
+   struct stress_job *job = (struct stress_job *)data;
+   unsigned i;
+
+   for (i = 0; i < job->num_deps; i++)
+      CHECK(p_atomic_read(&executed[job->deps[i]]) == 1);
+
+   CHECK(p_atomic_inc_return(&executed[job->index]) == 1);
+
+   /* Half of the jobs add a job from the thread they run on. */
+   if (job->index < NUM_JOBS && (job->index & 1)) {
+      struct stress_job *child = &stress_jobs[NUM_JOBS + job->index];
+
+      child->index = NUM_JOBS + job->index;
+      child->num_deps = 0;
+      util_queue_add_job_full(&stress_queue, child, &child->fence,
+                              stress_execute, NULL,
+                              UTIL_QUEUE_PRIORITY_HIGH, NULL, 0);
+   }
+}
+
+
+static void
+stress_cleanup(void *data, int thread_index)
+{
+   struct stress_job *job = (struct stress_job *)data;
+
+   CHECK(p_atomic_read(&executed[job->index]) == 1);
+   CHECK(p_atomic_inc_return(&cleaned[job->index]) == 1);
+}
+
+
+static void
+test_stress(void)
+{
+   unsigned i, j;
+
+   CHECK(util_queue_init(&stress_queue, "stress", 64, 4));
+
+   for (i = 0; i < 2 * NUM_JOBS; i++)
+      util_queue_fence_init(&stress_jobs[i].fence);
+
+   for (i = 0; i < NUM_JOBS; i++) {
+      struct stress_job *job = &stress_jobs[i];
+      struct util_queue_fence *deps[MAX_DEPS];
+
+      job->index = i;
+      job->num_deps = i ? rand() % (MAX_DEPS + 1) : 0;
+      for (j = 0; j < job->num_deps; j++) {
+         /* mostly recent jobs, which are likely still pending */
+         unsigned dist = 1 + rand() % MIN2(i, 32);
+         job->deps[j] = i - dist;
+         deps[j] = &stress_jobs[i - dist].fence;
+      }
+
+      util_queue_add_job_full(&stress_queue, job, &job->fence,
+                              stress_execute, stress_cleanup,
+                              rand() % UTIL_QUEUE_NUM_PRIORITIES,
+                              deps, job->num_deps);
+
+      if (i % 1000 == 999) {
+         unsigned num_threads = 1 + rand() % 8;
+         LOG("%u jobs added, %u threads\n", i + 1, num_threads);
+         util_queue_adjust_num_threads(&stress_queue, num_threads);
+      }
+   }
+
+   /* Parents are signalled after they added their children. */
+   for (i = 0; i < NUM_JOBS; i++)
+      util_queue_job_wait(&stress_jobs[i].fence);
+   for (i = NUM_JOBS; i < 2 * NUM_JOBS; i++)
+      util_queue_job_wait(&stress_jobs[i].fence);
+
+   util_queue_destroy(&stress_queue);
+
+   for (i = 0; i < 2 * NUM_JOBS; i++) {
+      bool spawned = i < NUM_JOBS || (i & 1);
+
+      CHECK(executed[i] == spawned);
+      /* The cleanup callback may still be running when the fence is
+       * signalled, but it has returned once the queue is destroyed.
+       */
+      CHECK(cleaned[i] == (i < NUM_JOBS));
+      util_queue_fence_destroy(&stress_jobs[i].fence);
+   }
+}
+
+
+/*
+ * Priority test.
+ */
+
+static volatile int gate_entered = 0;
+static volatile int gate_open = 0;
+static int order[8];
+static int order_count = 0;
+
+
+static void
+gate_execute(void *data, int thread_index)
+{
+   p_atomic_set(&gate_entered, 1);
+   while (!p_atomic_read(&gate_open))
+      os_time_sleep(1000);
+}
+
+
+static void
+order_execute(void *data, int thread_index)
+{
+   order[order_count++] = (int)(intptr_t)data;
+}
+
+
+static void
+test_priorities(void)
+{
+   static const enum util_queue_priority prio[6] = {
+      UTIL_QUEUE_PRIORITY_LOW,
+      UTIL_QUEUE_PRIORITY_NORMAL,
+      UTIL_QUEUE_PRIORITY_HIGH,
+      UTIL_QUEUE_PRIORITY_LOW,
+      UTIL_QUEUE_PRIORITY_NORMAL,
+      UTIL_QUEUE_PRIORITY_HIGH,
+   };
+   static const int expected[6] = { 2, 5, 1, 4, 0, 3 };
+   struct util_queue queue;
+   struct util_queue_fence gate, fences[6];
+   unsigned i;
+
+   CHECK(util_queue_init(&queue, "prio", 16, 1));
+
+   /* Keep the only thread busy until everything is queued. */
+   util_queue_fence_init(&gate);
+   util_queue_add_job(&queue, NULL, &gate, gate_execute, NULL);
+   while (!p_atomic_read(&gate_entered))
+      os_time_sleep(1000);
+
+   for (i = 0; i < 6; i++) {
+      util_queue_fence_init(&fences[i]);
+      util_queue_add_job_full(&queue, (void *)(intptr_t)i, &fences[i],
+                              order_execute, NULL, prio[i], NULL, 0);
+   }
+
+   p_atomic_set(&gate_open, 1);
+
+   for (i = 0; i < 6; i++) {
+      util_queue_job_wait(&fences[i]);
+      util_queue_fence_destroy(&fences[i]);
+   }
+   util_queue_job_wait(&gate);
+   util_queue_fence_destroy(&gate);
+   util_queue_destroy(&queue);
+
+   CHECK(order_count == 6);
+   for (i = 0; i < 6; i++)
+      CHECK(order[i] == expected[i]);
+}
+
+
+/*
+ * Throughput of empty jobs.
+ */
+
+#define BATCH_SIZE 1024
+
+
+static void
+empty_execute(void *data, int thread_index)
+{
+}
+
+
+static void
+test_throughput(unsigned num_threads, unsigned num_batches)
+{
+   struct util_queue queue;
+   struct util_queue_fence *fences;
+   int64_t start, end;
+   unsigned i, j;
+
+   fences = CALLOC(BATCH_SIZE, sizeof(*fences));
+   CHECK(fences);
+   for (j = 0; j < BATCH_SIZE; j++)
+      util_queue_fence_init(&fences[j]);
+
+   CHECK(util_queue_init(&queue, "tput", BATCH_SIZE, num_threads));
+
+   start = os_time_get_nano();
+   for (i = 0; i < num_batches; i++) {
+      for (j = 0; j < BATCH_SIZE; j++)
+         util_queue_add_job(&queue, NULL, &fences[j], empty_execute, NULL);
+      for (j = 0; j < BATCH_SIZE; j++)
+         util_queue_job_wait(&fences[j]);
+   }
+   end = os_time_get_nano();
+
+   util_queue_destroy(&queue);
+
+   for (j = 0; j < BATCH_SIZE; j++)
+      util_queue_fence_destroy(&fences[j]);
+   FREE(fences);
+
+   printf("%u threads: %.0f jobs/s\n", num_threads,
+          (double)num_batches * BATCH_SIZE * 1e9 / (double)(end - start));
+}
+
+
+int main(int argc, char *argv[])
+{
+   unsigned num_batches = 16;
+   int i;
+
+   for (i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      if (strcmp(arg, "-v") == 0) {
+         ++verbosity;
+      } else if (strcmp(arg, "-b") == 0) {
+         /* benchmark */
+         num_batches = 1024;
+      } else {
+         fprintf(stderr, "error: unrecognized option `%s`\n", arg);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   // Disable buffering
+   setbuf(stdout, NULL);
+
+   LOG("u_queue_test starting\n");
+
+   srand(0);
+   test_stress();
+   test_priorities();
+
+   test_throughput(1, num_batches);
+   test_throughput(4, num_batches);
+
+   LOG("u_queue_test exiting\n");
+
+   return 0;
+}
@@ -120,6 +120,7 @@
 #include "shared.h"
 #include "shaderobj.h"
 #include "shaderimage.h"
+#include "shader_queue.h"
 #include "util/strtod.h"
 #include "state.h"
 #include "stencil.h"
@@ -1282,6 +1283,9 @@ _mesa_free_context_data( struct gl_context *ctx )
       _mesa_make_current(ctx, NULL, NULL);
    }
 
+   /* finish the deferred shader compiles, which use the context */
+   _mesa_destroy_shader_queue(ctx);
+
    /* unreference WinSysDraw/Read buffers */
    _mesa_reference_framebuffer(&ctx->WinSysDrawBuffer, NULL);
    _mesa_reference_framebuffer(&ctx->WinSysReadBuffer, NULL);
@@ -35,6 +35,8 @@
 
 #include "glheader.h"
 
+struct blob;
+struct blob_reader;
 struct gl_bitmap_atlas;
 struct gl_buffer_object;
 struct gl_context;
@@ -515,6 +517,23 @@ struct dd_function_table {
     */
    GLboolean (*LinkShader)(struct gl_context *ctx,
                            struct gl_shader_program *shader);
+
+   /**
+    * Append the driver's compiled code for a linked program to the shader
+    * cache entry in \p blob.  Return false if the program can't be cached.
+    */
+   bool (*ShaderCacheSerializeDriverBlob)(struct gl_context *ctx,
+                                          struct gl_program *prog,
+                                          struct blob *blob);
+
+   /**
+    * Restore the driver's compiled code written by
+    * ShaderCacheSerializeDriverBlob, in place of ProgramStringNotify.
+    * Return false if the data can't be used.
+    */
+   bool (*ShaderCacheDeserializeDriverBlob)(struct gl_context *ctx,
+                                            struct gl_program *prog,
+                                            struct blob_reader *blob);
    /*@}*/
 
    /**
@@ -1256,7 +1256,7 @@ create_new_program(struct gl_context *ctx, struct state_key *key)
       ;
    reparent_ir(p.shader->ir, p.shader->ir);
 
-   p.shader->CompileStatus = true;
+   p.shader->CompileStatus = compile_success;
    p.shader->Version = state->language_version;
    p.shader->info.uses_builtin_functions = state->uses_builtin_functions;
    p.shader_program->Shaders =
@@ -767,6 +767,12 @@ find_custom_value(struct gl_context *ctx, const struct value_desc *d, union valu
       assert(v->value_int_n.n <= (int) ARRAY_SIZE(v->value_int_n.ints));
       break;
 
+   case GL_PROGRAM_BINARY_FORMATS:
+      assert(ctx->Const.NumProgramBinaryFormats <= 1);
+      v->value_int_n.n = ctx->Const.NumProgramBinaryFormats;
+      v->value_int_n.ints[0] = GL_PROGRAM_BINARY_FORMAT_MESA;
+      break;
+
    case GL_MAX_VARYING_FLOATS_ARB:
       v->value_int = ctx->Const.MaxVarying * 4;
       break;
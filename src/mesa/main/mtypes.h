@@ -87,6 +87,10 @@ struct gl_program_parameter_list;
 struct set;
 struct set_entry;
 struct vbo_context;
+struct disk_cache;
+struct shader_queue;
+struct shader_compile_job;
+union gl_constant_value;
 /*@}*/
 
 
@@ -2439,6 +2443,21 @@ struct gl_linked_shader
    struct gl_shader_info info;
 };
 
+/**
+ * Result of compiling a gl_shader.
+ *
+ * \c compile_skipped means that an identical source was compiled
+ * successfully before (as recorded in the shader cache), so the actual
+ * compile is deferred until link time, where it only happens if the linked
+ * program isn't found in the cache either.
+ */
+enum gl_compile_status
+{
+   compile_failure = 0,
+   compile_success,
+   compile_skipped
+};
+
 /**
  * A GLSL shader object.
  */
@@ -2454,14 +2473,28 @@ struct gl_shader
    GLint RefCount;  /**< Reference count */
    GLchar *Label;   /**< GL_KHR_debug */
    GLboolean DeletePending;
-   GLboolean CompileStatus;
+   enum gl_compile_status CompileStatus;
    bool IsES;              /**< True if this shader uses GLSL ES */
 
    GLuint SourceChecksum;       /**< for debug/logging purposes */
+   unsigned char sha1[20];      /**< SHA1 of the last compiled source */
    const GLchar *Source;  /**< Source code string */
 
+   /**
+    * Source of a skipped compile that was replaced by glShaderSource()
+    * before the deferred compile happened.
+    */
+   const GLchar *FallbackSource;
+
    GLchar *InfoLog;
 
+   /**
+    * Deferred compile of the shader, or NULL once the compile has been
+    * waited for.  Contexts sharing the shader may wait for it from other
+    * threads, so it is protected by a mutex, see shader_queue.c.
+    */
+   struct shader_compile_job *CompileJob;
+
    unsigned Version;       /**< GLSL version used for linking */
 
    struct exec_list *ir;
@@ -2797,6 +2830,13 @@ struct gl_shader_program
    unsigned NumHiddenUniforms;
    struct gl_uniform_storage *UniformStorage;
 
+   /**
+    * Backing store of gl_uniform_storage::storage for all the uniforms.
+    * Owned by \c UniformStorage.
+    */
+   unsigned NumUniformDataSlots;
+   union gl_constant_value *UniformDataSlots;
+
    /**
     * Mapping from GL uniform locations returned by \c glUniformLocation to
     * UniformStorage entries. Arrays will have multiple contiguous slots
@@ -2877,6 +2917,7 @@ struct gl_shader_program
 #define GLSL_USE_PROG 0x80  /**< Log glUseProgram calls */
 #define GLSL_REPORT_ERRORS 0x100  /**< Print compilation errors */
 #define GLSL_DUMP_ON_ERROR 0x200 /**< Dump shaders to stderr on compile error */
+#define GLSL_NO_THREADS 0x400 /**< Compile and optimize on the calling thread */
 
 
 /**
@@ -3625,6 +3666,12 @@ struct gl_constants
    bool GLSLFragCoordIsSysVal;
    bool GLSLFrontFacingIsSysVal;
 
+   /**
+    * GL_ARB_get_program_binary: number of program binary formats, either 0
+    * or 1 for GL_PROGRAM_BINARY_FORMAT_MESA.
+    */
+   GLuint NumProgramBinaryFormats;
+
    /**
     * Always use the GetTransformFeedbackVertexCount() driver hook, rather
     * than passing the transform feedback object to the drawing function.
@@ -4484,6 +4531,20 @@ struct gl_context
     */
    struct gl_pipeline_object *_Shader;
 
+   /**
+    * On-disk cache of compiled shaders and linked programs, or NULL if
+    * the driver doesn't support it or it is disabled.
+    */
+   struct disk_cache *Cache;
+   /** Identifies the driver build and hardware in the cache keys */
+   unsigned char CacheDriverSha1[20];
+
+   /**
+    * Worker threads for deferred glCompileShader() calls and the linker,
+    * created lazily
+    */
+   struct shader_queue *ShaderQueue;
+
    struct gl_query_state Query;  /**< occlusion, timer queries */
 
    struct gl_transform_feedback_state TransformFeedback;
@@ -0,0 +1,224 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * \file program_binary.c
+ *
+ * GL_ARB_get_program_binary, in the GL_PROGRAM_BINARY_FORMAT_MESA format:
+ * a header identifying the driver and context state the program was linked
+ * for, followed by the program as serialized by serialize_glsl_program().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler/glsl/blob.h"
+#include "compiler/glsl/shader_cache.h"
+#include "main/errors.h"
+#include "main/mtypes.h"
+#include "main/program_binary.h"
+#include "util/macros.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+
+
+/** Bump whenever the header or the serialized program changes */
+#define PROGRAM_BINARY_VERSION 1
+
+struct program_binary_header {
+   uint32_t version;
+   uint32_t payload_size;
+   unsigned char context_sha1[20];
+   unsigned char payload_sha1[20];
+};
+
+
+static struct blob *
+write_program_binary(struct gl_context *ctx,
+                     struct gl_shader_program *sh_prog)
+{
+   struct program_binary_header hdr;
+   struct blob *blob;
+
+   /* The blob aligns values relative to its start, so the payload must
+    * start at an offset aligned for any of them.
+    */
+   STATIC_ASSERT(sizeof(struct program_binary_header) % 8 == 0);
+
+   if (ctx->Const.NumProgramBinaryFormats == 0 || !sh_prog->LinkStatus)
+      return NULL;
+
+   blob = blob_create(NULL);
+   if (!blob)
+      return NULL;
+
+   memset(&hdr, 0, sizeof(hdr));
+   if (!blob_write_bytes(blob, &hdr, sizeof(hdr)) ||
+       !serialize_glsl_program(blob, ctx, sh_prog) ||
+       !shader_cache_context_sha1(ctx, hdr.context_sha1))
+      goto fail;
+
+   hdr.version = PROGRAM_BINARY_VERSION;
+   hdr.payload_size = blob->size - sizeof(hdr);
+   _mesa_sha1_compute(blob->data + sizeof(hdr), hdr.payload_size,
+                      hdr.payload_sha1);
+
+   if (!blob_overwrite_bytes(blob, 0, &hdr, sizeof(hdr)))
+      goto fail;
+
+   return blob;
+
+fail:
+   ralloc_free(blob);
+   return NULL;
+}
+
+/**
+ * Return the value of GL_PROGRAM_BINARY_LENGTH: the size of the binary
+ * glGetProgramBinary would return, or 0 if the program can't be saved.
+ */
+GLint
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *sh_prog)
+{
+   struct blob *blob = write_program_binary(ctx, sh_prog);
+   GLint length;
+
+   if (!blob)
+      return 0;
+
+   length = blob->size;
+   ralloc_free(blob);
+
+   return length;
+}
+
+void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *sh_prog,
+                         GLsizei buf_size, GLsizei *length,
+                         GLenum *binary_format, GLvoid *binary)
+{
+   struct blob *blob = write_program_binary(ctx, sh_prog);
+
+   /* Programs which can't be serialized have an empty binary, which
+    * glProgramBinary will refuse.
+    */
+   if (!blob) {
+      *length = 0;
+      return;
+   }
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "If <bufSize> is less than the number of bytes of the binary, an
+    *     INVALID_OPERATION error is generated."
+    */
+   if (blob->size > (size_t) buf_size) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(buffer too small)");
+      *length = 0;
+   } else {
+      memcpy(binary, blob->data, blob->size);
+      *length = blob->size;
+      *binary_format = GL_PROGRAM_BINARY_FORMAT_MESA;
+   }
+
+   ralloc_free(blob);
+}
+
+static bool
+read_program_binary(struct gl_context *ctx,
+                    struct gl_shader_program *sh_prog,
+                    const GLvoid *binary, GLsizei length)
+{
+   const uint8_t *data = binary;
+   const uint8_t *payload;
+   uint8_t *copy = NULL;
+   struct program_binary_header hdr;
+   unsigned char sha1[20];
+   struct blob_reader reader;
+   bool ok;
+
+   if (length < (GLsizei) sizeof(hdr))
+      return false;
+
+   memcpy(&hdr, data, sizeof(hdr));
+   if (hdr.version != PROGRAM_BINARY_VERSION ||
+       hdr.payload_size != length - sizeof(hdr))
+      return false;
+
+   /* Binaries saved by another driver, another build of this one, or a
+    * context with different limits or extensions are refused.
+    */
+   if (!shader_cache_context_sha1(ctx, sha1) ||
+       memcmp(sha1, hdr.context_sha1, sizeof(sha1)) != 0)
+      return false;
+
+   _mesa_sha1_compute(data + sizeof(hdr), hdr.payload_size, sha1);
+   if (memcmp(sha1, hdr.payload_sha1, sizeof(sha1)) != 0)
+      return false;
+
+   /* The blob reader loads values in place, aligned relative to the start
+    * of the payload, but the application's buffer may have any alignment.
+    * Deserializing copies everything out of the payload, so a misaligned
+    * one is read from a temporary copy.
+    */
+   payload = data + sizeof(hdr);
+   if ((uintptr_t) payload % 8 != 0) {
+      copy = malloc(hdr.payload_size);
+      if (!copy)
+         return false;
+      memcpy(copy, payload, hdr.payload_size);
+      payload = copy;
+   }
+
+   blob_reader_init(&reader, (uint8_t *) payload, hdr.payload_size);
+
+   ok = deserialize_glsl_program(&reader, ctx, sh_prog) &&
+        reader.current == reader.end;
+
+   free(copy);
+   return ok;
+}
+
+/**
+ * Restore a program from a binary returned by _mesa_get_program_binary(),
+ * skipping compiling and linking.  If the binary can't be used, the program
+ * is left unlinked and the application has to link it from source.
+ */
+void
+_mesa_program_binary(struct gl_context *ctx,
+                     struct gl_shader_program *sh_prog,
+                     const GLvoid *binary, GLsizei length)
+{
+   if (read_program_binary(ctx, sh_prog, binary, length))
+      return;
+
+   sh_prog->LinkStatus = GL_FALSE;
+   ralloc_free(sh_prog->InfoLog);
+   sh_prog->InfoLog =
+      ralloc_strdup(sh_prog, "program binary is not valid for this driver\n");
+}
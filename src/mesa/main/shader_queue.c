@@ -0,0 +1,402 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * \file shader_queue.c
+ *
+ * Deferred glCompileShader(), and worker threads for the linker.
+ *
+ * The GLSL front end only reads constant context state, so compiles can
+ * run on worker threads while the application carries on submitting GL
+ * commands, in the manner of GL_ARB_parallel_shader_compile.  A compile
+ * is finished before anything looks at its results: the shader queries,
+ * glShaderSource(), the next compile, linking and deleting the shader.
+ *
+ * The workers only run the compile itself.  The shader cache is not
+ * thread-safe and its key depends on mutable context state, so the key is
+ * computed when the compile is queued, and the compile is recorded in the
+ * cache of the context which waits for it, on that context's thread.
+ *
+ * Shaders are shared by the contexts of a share group, so a compile queued
+ * by one context may be waited for by another, on another thread.
+ * gl_shader::CompileJob is protected by compile_job_mutex, which is held
+ * until the job is finished, so that a job is finished exactly once and
+ * the other waiters see its results.
+ */
+
+#include <unistd.h>
+
+#include "c11/threads.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/shader_queue.h"
+#include "compiler/glsl/program.h"
+#include "compiler/glsl/shader_cache.h"
+#include "util/list.h"
+
+
+#define MAX_SHADER_QUEUE_THREADS 4
+
+/** Protects gl_shader::CompileJob.  Never taken by the workers. */
+static mtx_t compile_job_mutex = _MTX_INITIALIZER_NP;
+
+struct shader_queue_job {
+   /** Link in shader_queue::jobs while the job waits for a worker */
+   struct list_head link;
+   void (*execute)(struct shader_queue_job *job);
+   /** Set once execute() has returned.  Protected by the queue's mutex. */
+   bool done;
+};
+
+struct shader_compile_job {
+   struct shader_queue_job base;
+   /** Link in shader_queue::compiles until the job is finished */
+   struct list_head compile_link;
+   struct shader_queue *queue;
+   struct gl_context *ctx;
+   struct gl_shader *shader;
+
+   bool record;
+   unsigned char cache_key[20];
+};
+
+struct shader_run_job {
+   struct shader_queue_job base;
+   shader_queue_func func;
+   void *data;
+};
+
+struct shader_queue {
+   mtx_t mutex;
+   cnd_t has_job;
+   cnd_t job_done;
+   struct list_head jobs;
+   /** Compile jobs which haven't been finished yet */
+   struct list_head compiles;
+   bool kill;
+
+   unsigned num_threads;
+   thrd_t threads[MAX_SHADER_QUEUE_THREADS];
+};
+
+
+static void
+execute_compile_job(struct shader_queue_job *base)
+{
+   struct shader_compile_job *job = (struct shader_compile_job *) base;
+
+   _mesa_glsl_compile_shader(job->ctx, job->shader, false, false, false);
+}
+
+static void
+execute_run_job(struct shader_queue_job *base)
+{
+   struct shader_run_job *job = (struct shader_run_job *) base;
+
+   job->func(job->data);
+}
+
+/**
+ * Wait for \p job to be done, running it on the calling thread if no
+ * worker has picked it up yet.  Called with the mutex locked.
+ */
+static void
+wait_job(struct shader_queue *queue, struct shader_queue_job *job)
+{
+   if (!job->done && !list_empty(&job->link)) {
+      list_delinit(&job->link);
+      mtx_unlock(&queue->mutex);
+
+      job->execute(job);
+
+      mtx_lock(&queue->mutex);
+      job->done = true;
+   }
+
+   while (!job->done)
+      cnd_wait(&queue->job_done, &queue->mutex);
+}
+
+/**
+ * Record the compile in the shader cache of \p ctx and free the job.
+ * Called on the thread of \p ctx, with compile_job_mutex locked and the
+ * queue's mutex unlocked, once the job is done and has been removed from
+ * the compiles list.
+ */
+static void
+finish_compile_job(struct gl_context *ctx, struct shader_compile_job *job)
+{
+   if (job->record)
+      shader_cache_put_compile(ctx, job->shader, job->cache_key);
+
+   job->shader->CompileJob = NULL;
+   free(job);
+}
+
+static int
+shader_queue_thread(void *data)
+{
+   struct shader_queue *queue = (struct shader_queue *) data;
+
+   mtx_lock(&queue->mutex);
+   for (;;) {
+      struct shader_queue_job *job;
+
+      while (list_empty(&queue->jobs) && !queue->kill)
+         cnd_wait(&queue->has_job, &queue->mutex);
+
+      /* Jobs still queued at destruction are run, not dropped. */
+      if (list_empty(&queue->jobs))
+         break;
+
+      job = LIST_ENTRY(struct shader_queue_job, queue->jobs.next, link);
+      list_delinit(&job->link);
+      mtx_unlock(&queue->mutex);
+
+      job->execute(job);
+
+      mtx_lock(&queue->mutex);
+      job->done = true;
+      cnd_broadcast(&queue->job_done);
+   }
+   mtx_unlock(&queue->mutex);
+
+   return 0;
+}
+
+static unsigned
+get_num_threads(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+   long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+   /* Leave one CPU to the application's thread. */
+   if (cpus > 1)
+      return MIN2(cpus - 1, MAX_SHADER_QUEUE_THREADS);
+#endif
+   return 0;
+}
+
+static struct shader_queue *
+create_shader_queue(void)
+{
+   struct shader_queue *queue = CALLOC_STRUCT(shader_queue);
+   unsigned num_threads = get_num_threads();
+   unsigned i;
+
+   if (!queue)
+      return NULL;
+
+   mtx_init(&queue->mutex, mtx_plain);
+   cnd_init(&queue->has_job);
+   cnd_init(&queue->job_done);
+   list_inithead(&queue->jobs);
+   list_inithead(&queue->compiles);
+
+   for (i = 0; i < num_threads; i++) {
+      if (thrd_create(&queue->threads[i], shader_queue_thread,
+                      queue) != thrd_success)
+         break;
+   }
+   queue->num_threads = i;
+
+   return queue;
+}
+
+/**
+ * Return the queue of \p ctx if it has worker threads, or NULL.
+ */
+static struct shader_queue *
+get_shader_queue(struct gl_context *ctx)
+{
+   /* The queue is kept even without threads, so that creating it isn't
+    * retried every time.
+    */
+   if (!ctx->ShaderQueue)
+      ctx->ShaderQueue = create_shader_queue();
+
+   if (!ctx->ShaderQueue || ctx->ShaderQueue->num_threads == 0)
+      return NULL;
+
+   return ctx->ShaderQueue;
+}
+
+
+/**
+ * Queue a compile of \p sh.
+ *
+ * \return  false if the compile has to be done synchronously, because
+ *          worker threads aren't available.
+ */
+bool
+_mesa_shader_queue_compile(struct gl_context *ctx, struct gl_shader *sh)
+{
+   struct shader_queue *queue = get_shader_queue(ctx);
+   struct shader_compile_job *job;
+
+   if (!queue)
+      return false;
+
+   job = CALLOC_STRUCT(shader_compile_job);
+   if (!job)
+      return false;
+
+   job->base.execute = execute_compile_job;
+   job->queue = queue;
+   job->ctx = ctx;
+   job->shader = sh;
+   job->record = shader_cache_compile_key(ctx, sh, job->cache_key);
+
+   mtx_lock(&compile_job_mutex);
+   sh->CompileJob = job;
+   mtx_unlock(&compile_job_mutex);
+
+   mtx_lock(&queue->mutex);
+   list_addtail(&job->compile_link, &queue->compiles);
+   list_addtail(&job->base.link, &queue->jobs);
+   cnd_signal(&queue->has_job);
+   mtx_unlock(&queue->mutex);
+
+   return true;
+}
+
+
+/**
+ * Wait for a deferred compile of \p sh to finish, from \p ctx, which may
+ * be another context than the one which queued it.
+ *
+ * If no worker has picked the compile up yet, it is run on the calling
+ * thread instead, rather than waiting behind the other queued compiles.
+ */
+void
+_mesa_shader_queue_wait(struct gl_context *ctx, struct gl_shader *sh)
+{
+   struct shader_compile_job *job;
+
+   mtx_lock(&compile_job_mutex);
+   job = sh->CompileJob;
+   if (job) {
+      struct shader_queue *queue = job->queue;
+
+      mtx_lock(&queue->mutex);
+      wait_job(queue, &job->base);
+      list_del(&job->compile_link);
+      mtx_unlock(&queue->mutex);
+
+      finish_compile_job(ctx, job);
+   }
+   mtx_unlock(&compile_job_mutex);
+}
+
+
+/**
+ * Call \p func on each of the \p count elements of \p size bytes of the
+ * \p data array, concurrently on the worker threads and the calling
+ * thread, and return when all the calls have returned.
+ *
+ * The calls run ahead of the queued compiles, since the caller waits for
+ * them.
+ */
+void
+_mesa_shader_queue_run(struct gl_context *ctx, shader_queue_func func,
+                       void *data, unsigned count, size_t size)
+{
+   struct shader_queue *queue = NULL;
+   struct shader_run_job *jobs = NULL;
+   unsigned i;
+
+   if (count > 1 && !(ctx->_Shader->Flags & GLSL_NO_THREADS))
+      queue = get_shader_queue(ctx);
+   if (queue)
+      jobs = calloc(count - 1, sizeof(*jobs));
+
+   if (!jobs) {
+      for (i = 0; i < count; i++)
+         func((char *) data + i * size);
+      return;
+   }
+
+   mtx_lock(&queue->mutex);
+   for (i = 1; i < count; i++) {
+      struct shader_run_job *job = &jobs[i - 1];
+
+      job->base.execute = execute_run_job;
+      job->func = func;
+      job->data = (char *) data + i * size;
+      list_add(&job->base.link, &queue->jobs);
+   }
+   cnd_broadcast(&queue->has_job);
+   mtx_unlock(&queue->mutex);
+
+   func(data);
+
+   mtx_lock(&queue->mutex);
+   for (i = 1; i < count; i++)
+      wait_job(queue, &jobs[i - 1].base);
+   mtx_unlock(&queue->mutex);
+
+   free(jobs);
+}
+
+
+/**
+ * Finish all deferred compiles and stop the worker threads.
+ */
+void
+_mesa_destroy_shader_queue(struct gl_context *ctx)
+{
+   struct shader_queue *queue = ctx->ShaderQueue;
+   struct shader_compile_job *job, *next;
+   unsigned i;
+
+   if (!queue)
+      return;
+
+   mtx_lock(&queue->mutex);
+   queue->kill = true;
+   cnd_broadcast(&queue->has_job);
+   mtx_unlock(&queue->mutex);
+
+   for (i = 0; i < queue->num_threads; i++)
+      thrd_join(queue->threads[i], NULL);
+
+   /* The workers ran all the queued jobs before exiting.  Another context
+    * may be finishing one of them, which is why the list is only walked
+    * with compile_job_mutex held.
+    */
+   mtx_lock(&compile_job_mutex);
+   LIST_FOR_EACH_ENTRY_SAFE(job, next, &queue->compiles, compile_link) {
+      list_del(&job->compile_link);
+      finish_compile_job(ctx, job);
+   }
+   mtx_unlock(&compile_job_mutex);
+
+   cnd_destroy(&queue->job_done);
+   cnd_destroy(&queue->has_job);
+   mtx_destroy(&queue->mutex);
+   free(queue);
+   ctx->ShaderQueue = NULL;
+}
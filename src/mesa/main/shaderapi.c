@@ -40,11 +40,14 @@
 #include <stdbool.h>
 #include "main/glheader.h"
 #include "main/context.h"
+#include "main/debug_output.h"
 #include "main/dispatch.h"
 #include "main/enums.h"
 #include "main/hash.h"
 #include "main/mtypes.h"
 #include "main/pipelineobj.h"
+#include "main/program_binary.h"
+#include "main/shader_queue.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
 #include "main/transformfeedback.h"
@@ -53,6 +56,7 @@
 #include "compiler/glsl/ir.h"
 #include "compiler/glsl/ir_uniform.h"
 #include "compiler/glsl/program.h"
+#include "compiler/glsl/shader_cache.h"
 #include "program/program.h"
 #include "program/prog_print.h"
 #include "program/prog_parameter.h"
@@ -95,6 +99,8 @@ _mesa_get_shader_flags(void)
          flags |= GLSL_USE_PROG;
       if (strstr(env, "errors"))
          flags |= GLSL_REPORT_ERRORS;
+      if (strstr(env, "nothreads"))
+         flags |= GLSL_NO_THREADS;
    }
 
    return flags;
@@ -797,7 +803,7 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname,
       *params = shProg->BinaryRetreivableHint;
       return;
    case GL_PROGRAM_BINARY_LENGTH:
-      *params = 0;
+      *params = _mesa_get_program_binary_length(ctx, shProg);
       return;
    case GL_ACTIVE_ATOMIC_COUNTER_BUFFERS:
       if (!ctx->Extensions.ARB_shader_atomic_counters)
@@ -891,6 +897,8 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
       return;
    }
 
+   _mesa_shader_queue_wait(ctx, shader);
+
    switch (pname) {
    case GL_SHADER_TYPE:
       *params = shader->Type;
@@ -899,7 +907,7 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
       *params = shader->DeletePending;
       break;
    case GL_COMPILE_STATUS:
-      *params = shader->CompileStatus;
+      *params = shader->CompileStatus ? GL_TRUE : GL_FALSE;
       break;
    case GL_INFO_LOG_LENGTH:
       *params = shader->InfoLog ? strlen(shader->InfoLog) + 1 : 0;
@@ -963,6 +971,7 @@ get_shader_info_log(struct gl_context *ctx, GLuint shader, GLsizei bufSize,
       return;
    }
 
+   _mesa_shader_queue_wait(ctx, sh);
    _mesa_copy_string(infoLog, bufSize, length, sh->InfoLog);
 }
 
@@ -994,12 +1003,20 @@ get_shader_source(struct gl_context *ctx, GLuint shader, GLsizei maxLength,
  * glShaderSource[ARB].
  */
 static void
-shader_source(struct gl_shader *sh, const GLchar *source)
+shader_source(struct gl_context *ctx, struct gl_shader *sh,
+              const GLchar *source)
 {
    assert(sh);
 
-   /* free old shader source string and install new one */
-   free((void *)sh->Source);
+   _mesa_shader_queue_wait(ctx, sh);
+
+   /* free old shader source string and install new one, unless a skipped
+    * compile of it is still pending (see _mesa_glsl_link_shader())
+    */
+   if (sh->CompileStatus == compile_skipped && !sh->FallbackSource)
+      sh->FallbackSource = sh->Source;
+   else
+      free((void *)sh->Source);
    sh->Source = source;
 #ifdef DEBUG
    sh->SourceChecksum = _mesa_str_checksum(sh->Source);
@@ -1007,6 +1024,28 @@ shader_source(struct gl_shader *sh, const GLchar *source)
 }
 
 
+/**
+ * Whether glCompileShader() may return before the compile is done.  Not
+ * when the results are logged, nor when debug messages have to be
+ * delivered before the call returns.
+ */
+static bool
+can_defer_compile(struct gl_context *ctx)
+{
+   const GLbitfield flags = ctx->_Shader->Flags;
+
+   if (flags & (GLSL_DUMP | GLSL_LOG | GLSL_DUMP_ON_ERROR |
+                GLSL_REPORT_ERRORS | GLSL_NO_THREADS))
+      return false;
+
+   if (ctx->Debug &&
+       _mesa_get_debug_state_int(ctx, GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB))
+      return false;
+
+   return true;
+}
+
+
 /**
  * Compile a shader.
  */
@@ -1016,11 +1055,13 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
    if (!sh)
       return;
 
+   _mesa_shader_queue_wait(ctx, sh);
+
    if (!sh->Source) {
       /* If the user called glCompileShader without first calling
        * glShaderSource, we should fail to compile, but not raise a GL_ERROR.
        */
-      sh->CompileStatus = GL_FALSE;
+      sh->CompileStatus = compile_failure;
    } else {
       if (ctx->_Shader->Flags & GLSL_DUMP) {
          _mesa_log("GLSL source for %s shader %d:\n",
@@ -1029,9 +1070,17 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
       }
 
       /* this call will set the shader->CompileStatus field to indicate if
-       * compilation was successful.
+       * compilation was successful.  If the same source was compiled
+       * successfully before, the compile is skipped until link time.
+       * Otherwise it may be left to a worker thread.
        */
-      _mesa_glsl_compile_shader(ctx, sh, false, false);
+      if (!shader_cache_skip_compile(ctx, sh)) {
+         if (can_defer_compile(ctx) && _mesa_shader_queue_compile(ctx, sh))
+            return;
+
+         _mesa_glsl_compile_shader(ctx, sh, false, false, false);
+         shader_cache_record_compile(ctx, sh);
+      }
 
       if (ctx->_Shader->Flags & GLSL_LOG) {
          _mesa_write_shader_to_file(sh);
@@ -1090,6 +1139,9 @@ _mesa_link_program(struct gl_context *ctx, struct gl_shader_program *shProg)
 
    FLUSH_VERTICES(ctx, _NEW_PROGRAM);
 
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      _mesa_shader_queue_wait(ctx, shProg->Shaders[i]);
+
    _mesa_glsl_link_shader(ctx, shProg);
 
    /* Capture .shader_test files. */
@@ -1797,7 +1849,7 @@ _mesa_ShaderSource(GLuint shaderObj, GLsizei count,
    }
 #endif /* HAVE_SHA1 */
 
-   shader_source(sh, source);
+   shader_source(ctx, sh, source);
 
    free(offsets);
 }
@@ -2008,12 +2060,15 @@ _mesa_GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
       return;
    }
 
-   *length = 0;
-   _mesa_error(ctx, GL_INVALID_OPERATION,
-               "glGetProgramBinary(driver supports zero binary formats)");
+   if (ctx->Const.NumProgramBinaryFormats == 0) {
+      *length = 0;
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(driver supports zero binary formats)");
+      return;
+   }
 
-   (void) binaryFormat;
-   (void) binary;
+   _mesa_get_program_binary(ctx, shProg, bufSize, length, binaryFormat,
+                            binary);
 }
 
 void GLAPIENTRY
@@ -2027,9 +2082,6 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
    if (!shProg)
       return;
 
-   (void) binaryFormat;
-   (void) binary;
-
    /* Section 2.3.1 (Errors) of the OpenGL 4.5 spec says:
     *
     *     "If a negative number is provided where an argument of type sizei or
@@ -2049,11 +2101,27 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
     *     setting the LINK_STATUS of <program> to FALSE, if these conditions
     *     are not met."
     *
-    * Since any value of binaryFormat passed "is not one of those specified as
-    * allowable for [this] command, an INVALID_ENUM error is generated."
+    * A binaryFormat which isn't one of those we return "is not one of those
+    * specified as allowable for [this] command, an INVALID_ENUM error is
+    * generated."
     */
-   shProg->LinkStatus = GL_FALSE;
-   _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+   if (ctx->Const.NumProgramBinaryFormats == 0 ||
+       binaryFormat != GL_PROGRAM_BINARY_FORMAT_MESA) {
+      shProg->LinkStatus = GL_FALSE;
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+      return;
+   }
+
+   /* As for glLinkProgram: */
+   if (_mesa_transform_feedback_is_using_program(ctx, shProg)) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glProgramBinary(transform feedback is using the program)");
+      return;
+   }
+
+   FLUSH_VERTICES(ctx, _NEW_PROGRAM);
+
+   _mesa_program_binary(ctx, shProg, binary, length);
 }
 
 
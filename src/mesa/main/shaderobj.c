@@ -36,6 +36,7 @@
 #include "main/mtypes.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
+#include "main/shader_queue.h"
 #include "main/uniforms.h"
 #include "program/program.h"
 #include "program/prog_parameter.h"
@@ -136,7 +137,10 @@ _mesa_new_linked_shader(gl_shader_stage stage)
 void
 _mesa_delete_shader(struct gl_context *ctx, struct gl_shader *sh)
 {
+   _mesa_shader_queue_wait(ctx, sh);
+
    free((void *)sh->Source);
+   free((void *)sh->FallbackSource);
    free(sh->Label);
    ralloc_free(sh);
 }
@@ -299,6 +303,8 @@ _mesa_clear_shader_program_data(struct gl_shader_program *shProg)
       ralloc_free(shProg->UniformStorage);
       shProg->NumUniformStorage = 0;
       shProg->UniformStorage = NULL;
+      shProg->NumUniformDataSlots = 0;
+      shProg->UniformDataSlots = NULL;
    }
 
    if (shProg->UniformRemapTable) {
@@ -46,6 +46,7 @@
 #include "compiler/glsl_types.h"
 #include "compiler/glsl/linker.h"
 #include "compiler/glsl/program.h"
+#include "compiler/glsl/shader_cache.h"
 #include "program/hash_table.h"
 #include "program/prog_instruction.h"
 #include "program/prog_optimize.h"
@@ -3062,6 +3063,22 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
+   if (prog->LinkStatus && shader_cache_read_program_metadata(ctx, prog))
+      return;
+
+   /* The program isn't in the cache, so do the compiles that were skipped
+    * because the shaders were.
+    */
+   for (i = 0; i < prog->NumShaders && prog->LinkStatus; i++) {
+      struct gl_shader *sh = prog->Shaders[i];
+
+      if (sh->CompileStatus == compile_skipped) {
+         _mesa_glsl_compile_shader(ctx, sh, false, false, true);
+         if (!sh->CompileStatus)
+            linker_error(prog, "linking with uncompiled shader");
+      }
+   }
+
    if (prog->LinkStatus) {
       link_shaders(ctx, prog);
    }
@@ -3072,6 +3089,9 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
+   if (prog->LinkStatus)
+      shader_cache_write_program_metadata(ctx, prog);
+
    if (ctx->_Shader->Flags & GLSL_DUMP) {
       if (!prog->LinkStatus) {
 	 fprintf(stderr, "GLSL shader program %d failed to link\n", prog->Name);
@@ -34,6 +34,8 @@
 
 #include "pipe/p_context.h"
 
+#include "cso_cache/cso_context.h"
+
 static void st_dispatch_compute_common(struct gl_context *ctx,
                                        const GLuint *num_groups,
                                        struct pipe_resource *indirect,
@@ -65,6 +67,7 @@ static void st_dispatch_compute_common(struct gl_context *ctx,
       info.indirect_offset = indirect_offset;
    }
 
+   cso_emit_state(st->cso_context);
    pipe->launch_grid(pipe, &info);
 }
 
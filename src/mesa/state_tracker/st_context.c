@@ -70,6 +70,7 @@
 #include "st_gen_mipmap.h"
 #include "st_pbo.h"
 #include "st_program.h"
+#include "st_shader_cache.h"
 #include "st_vdpau.h"
 #include "st_texture.h"
 #include "pipe/p_context.h"
@@ -461,6 +462,9 @@ st_create_context_priv( struct gl_context *ctx, struct pipe_context *pipe,
       return NULL;
    }
 
+   /* The cache keys depend on the final constants and extensions. */
+   st_init_shader_cache(st);
+
    _mesa_initialize_dispatch_tables(ctx);
    _mesa_initialize_vbo_vtxfmt(ctx);
 
@@ -560,6 +564,9 @@ void st_destroy_context( struct st_context *st )
 
    _mesa_free_context_data(ctx);
 
+   /* after the deferred compiles have written to the cache */
+   st_destroy_shader_cache(st);
+
    /* This will free the st_context too, so 'st' must not be accessed
     * afterwards. */
    st_destroy_context_priv(st);
@@ -603,6 +610,7 @@ void st_init_driver_functions(struct pipe_screen *screen,
    st_init_query_functions(functions);
    st_init_cond_render_functions(functions);
    st_init_readpixels_functions(functions);
+   st_init_shader_cache_functions(functions);
    st_init_texture_functions(functions);
    st_init_texture_barrier_functions(functions);
    st_init_flush_functions(screen, functions);
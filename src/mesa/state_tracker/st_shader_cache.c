@@ -0,0 +1,247 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file st_shader_cache.c
+ *
+ * The state tracker's part of the GLSL shader cache: the TGSI tokens of
+ * linked programs, and the setup of the cache for the context.
+ */
+
+#include "compiler/glsl/blob.h"
+#include "main/mtypes.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_parse.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+
+#include "st_context.h"
+#include "st_debug.h"
+#include "st_program.h"
+#include "st_shader_cache.h"
+
+
+/**
+ * The TGSI state of a program, or NULL for compute programs, which keep
+ * their tokens in a pipe_compute_state.
+ */
+static struct pipe_shader_state *
+get_shader_state(struct gl_program *prog)
+{
+   switch (prog->Target) {
+   case GL_VERTEX_PROGRAM_ARB:
+      return &((struct st_vertex_program *) prog)->tgsi;
+   case GL_TESS_CONTROL_PROGRAM_NV:
+      return &((struct st_tessctrl_program *) prog)->tgsi;
+   case GL_TESS_EVALUATION_PROGRAM_NV:
+      return &((struct st_tesseval_program *) prog)->tgsi;
+   case GL_GEOMETRY_PROGRAM_NV:
+      return &((struct st_geometry_program *) prog)->tgsi;
+   case GL_FRAGMENT_PROGRAM_ARB:
+      return &((struct st_fragment_program *) prog)->tgsi;
+   default:
+      return NULL;
+   }
+}
+
+static void
+write_tokens(struct blob *blob, const struct tgsi_token *tokens)
+{
+   const unsigned num_tokens = tgsi_num_tokens(tokens);
+
+   blob_write_uint32(blob, num_tokens);
+   blob_write_bytes(blob, tokens, num_tokens * sizeof(struct tgsi_token));
+}
+
+static struct tgsi_token *
+read_tokens(struct blob_reader *blob)
+{
+   const unsigned num_tokens = blob_read_uint32(blob);
+   const size_t size = num_tokens * sizeof(struct tgsi_token);
+   struct tgsi_token *tokens;
+
+   if (blob->overrun || num_tokens == 0 ||
+       (size_t) (blob->end - blob->current) < size)
+      return NULL;
+
+   tokens = tgsi_alloc_tokens(num_tokens);
+   if (tokens)
+      blob_copy_bytes(blob, (uint8_t *) tokens, size);
+
+   return tokens;
+}
+
+bool
+st_serialize_program(struct gl_context *ctx, struct gl_program *prog,
+                     struct blob *blob)
+{
+   struct pipe_shader_state *tgsi = get_shader_state(prog);
+
+   if (prog->Target == GL_COMPUTE_PROGRAM_NV) {
+      struct st_compute_program *stcp = (struct st_compute_program *) prog;
+
+      if (stcp->tgsi.ir_type != PIPE_SHADER_IR_TGSI || !stcp->tgsi.prog)
+         return false;
+
+      blob_write_uint32(blob, stcp->tgsi.req_local_mem);
+      blob_write_uint32(blob, stcp->tgsi.req_private_mem);
+      blob_write_uint32(blob, stcp->tgsi.req_input_mem);
+      write_tokens(blob, stcp->tgsi.prog);
+      return true;
+   }
+
+   /* NIR programs aren't cached. */
+   if (tgsi == NULL || tgsi->type != PIPE_SHADER_IR_TGSI || !tgsi->tokens)
+      return false;
+
+   if (prog->Target == GL_VERTEX_PROGRAM_ARB) {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+      blob_write_uint32(blob, stvp->num_inputs);
+      blob_write_bytes(blob, stvp->index_to_input,
+                       sizeof(stvp->index_to_input));
+      blob_write_bytes(blob, stvp->result_to_output,
+                       sizeof(stvp->result_to_output));
+   }
+
+   blob_write_bytes(blob, &tgsi->stream_output, sizeof(tgsi->stream_output));
+   write_tokens(blob, tgsi->tokens);
+
+   return true;
+}
+
+bool
+st_deserialize_program(struct gl_context *ctx, struct gl_program *prog,
+                       struct blob_reader *blob)
+{
+   struct st_context *st = st_context(ctx);
+   struct pipe_shader_state *tgsi = get_shader_state(prog);
+   gl_shader_stage stage = _mesa_program_enum_to_shader_stage(prog->Target);
+
+   if (prog->Target == GL_COMPUTE_PROGRAM_NV) {
+      struct st_compute_program *stcp = (struct st_compute_program *) prog;
+
+      stcp->tgsi.req_local_mem = blob_read_uint32(blob);
+      stcp->tgsi.req_private_mem = blob_read_uint32(blob);
+      stcp->tgsi.req_input_mem = blob_read_uint32(blob);
+      stcp->tgsi.ir_type = PIPE_SHADER_IR_TGSI;
+      stcp->tgsi.prog = read_tokens(blob);
+      if (!stcp->tgsi.prog)
+         return false;
+   } else {
+      if (tgsi == NULL)
+         return false;
+
+      if (prog->Target == GL_VERTEX_PROGRAM_ARB) {
+         struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+         stvp->num_inputs = blob_read_uint32(blob);
+         blob_copy_bytes(blob, (uint8_t *) stvp->index_to_input,
+                         sizeof(stvp->index_to_input));
+         blob_copy_bytes(blob, (uint8_t *) stvp->result_to_output,
+                         sizeof(stvp->result_to_output));
+
+         if (stvp->num_inputs > PIPE_MAX_SHADER_INPUTS)
+            return false;
+      }
+
+      blob_copy_bytes(blob, (uint8_t *) &tgsi->stream_output,
+                      sizeof(tgsi->stream_output));
+      tgsi->type = PIPE_SHADER_IR_TGSI;
+      tgsi->tokens = read_tokens(blob);
+      if (!tgsi->tokens)
+         return false;
+   }
+
+   if (blob->overrun)
+      return false;
+
+   /* As st_program_string_notify() does after translating. */
+   if (ST_DEBUG & DEBUG_PRECOMPILE ||
+       st->shader_has_one_variant[stage])
+      st_precompile_shader_variant(st, prog);
+
+   return true;
+}
+
+void
+st_init_shader_cache_functions(struct dd_function_table *functions)
+{
+   functions->ShaderCacheSerializeDriverBlob = st_serialize_program;
+   functions->ShaderCacheDeserializeDriverBlob = st_deserialize_program;
+}
+
+/**
+ * Open the shader cache and enable program binaries, unless a stage
+ * prefers NIR.
+ *
+ * Cache entries and program binaries are only valid for the driver that
+ * wrote them, so the driver's name and the timestamp of the library are
+ * part of every key.
+ */
+void
+st_init_shader_cache(struct st_context *st)
+{
+   struct gl_context *ctx = st->ctx;
+   struct pipe_screen *screen = st->pipe->screen;
+   struct mesa_sha1 *sha1_ctx;
+   const char *vendor, *name;
+   uint32_t timestamp;
+   unsigned i;
+
+   for (i = 0; i < PIPE_SHADER_TYPES; i++) {
+      if (screen->get_shader_param(screen, i, PIPE_SHADER_CAP_PREFERRED_IR) ==
+          PIPE_SHADER_IR_NIR)
+         return;
+   }
+
+   if (!disk_cache_get_function_timestamp(st_init_shader_cache, &timestamp))
+      return;
+
+   sha1_ctx = _mesa_sha1_init();
+   if (!sha1_ctx)
+      return;
+
+   vendor = screen->get_vendor(screen);
+   name = screen->get_name(screen);
+   _mesa_sha1_update(sha1_ctx, vendor, strlen(vendor) + 1);
+   _mesa_sha1_update(sha1_ctx, name, strlen(name) + 1);
+   _mesa_sha1_update(sha1_ctx, &timestamp, sizeof(timestamp));
+   _mesa_sha1_final(sha1_ctx, ctx->CacheDriverSha1);
+
+   ctx->Const.NumProgramBinaryFormats = 1;
+   ctx->Cache = disk_cache_create("glsl");
+}
+
+void
+st_destroy_shader_cache(struct st_context *st)
+{
+   struct gl_context *ctx = st->ctx;
+
+   if (ctx->Cache) {
+      disk_cache_destroy(ctx->Cache);
+      ctx->Cache = NULL;
+   }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef ST_SHADER_CACHE_H
+#define ST_SHADER_CACHE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct blob;
+struct blob_reader;
+struct dd_function_table;
+struct gl_context;
+struct gl_program;
+struct st_context;
+
+void
+st_init_shader_cache(struct st_context *st);
+
+void
+st_destroy_shader_cache(struct st_context *st);
+
+void
+st_init_shader_cache_functions(struct dd_function_table *functions);
+
+bool
+st_serialize_program(struct gl_context *ctx, struct gl_program *prog,
+                     struct blob *blob);
+
+bool
+st_deserialize_program(struct gl_context *ctx, struct gl_program *prog,
+                       struct blob_reader *blob);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ST_SHADER_CACHE_H */
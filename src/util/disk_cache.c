@@ -0,0 +1,658 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <errno.h>
+#include <dirent.h>
+
+#include "util/u_atomic.h"
+#include "ralloc.h"
+#include "debug.h"
+
+#include "disk_cache.h"
+
+/* Number of bits to mask off from a cache key to get an index. */
+#define CACHE_INDEX_KEY_BITS 8
+
+/* Mask for computing an index from a key. */
+#define CACHE_INDEX_KEY_MASK ((1 << CACHE_INDEX_KEY_BITS) - 1)
+
+/* The number of keys that can be stored in the index. */
+#define CACHE_INDEX_MAX_KEYS (1 << CACHE_INDEX_KEY_BITS)
+
+/* Default bound on the size of a single cache directory. */
+#define CACHE_DEFAULT_MAX_SIZE (1024 * 1024 * 1024)
+
+/* Written in front of every item so that truncated or foreign files are
+ * never handed back to the caller.
+ */
+#define CACHE_ITEM_MAGIC 0x4d455341 /* "MESA" */
+
+struct cache_item_header {
+   uint32_t magic;
+   uint32_t size;
+   cache_key key;
+};
+
+struct disk_cache {
+   /* The path to the cache directory. */
+   char *path;
+
+   /* A pointer to the mmapped index file within the cache directory. */
+   uint8_t *index_mmap;
+   size_t index_mmap_size;
+
+   /* Pointer to total size of all objects in cache (within index_mmap) */
+   uint64_t *size;
+
+   /* Maximum size of all cached objects (in bytes). */
+   uint64_t max_size;
+};
+
+/* Create a directory named 'path' if it does not already exist.
+ *
+ * Returns: 0 if path already exists as a directory or if created.
+ *         -1 in all other cases.
+ */
+static int
+mkdir_if_needed(const char *path)
+{
+   struct stat sb;
+
+   /* If the path exists already, then our work is done if it's a
+    * directory, but it's an error if it is not.
+    */
+   if (stat(path, &sb) == 0) {
+      if (S_ISDIR(sb.st_mode)) {
+         return 0;
+      } else {
+         fprintf(stderr, "Cannot use %s for shader cache (not a directory)"
+                         "---disabling.\n", path);
+         return -1;
+      }
+   }
+
+   if (mkdir(path, 0755) == 0 || errno == EEXIST)
+      return 0;
+
+   fprintf(stderr, "Failed to create %s for shader cache (%s)---disabling.\n",
+           path, strerror(errno));
+
+   return -1;
+}
+
+/* Create every missing component of 'path', which is modified in place
+ * while walking it but restored before returning.
+ *
+ * Returns: 0 if the full path exists as a directory afterwards.
+ *         -1 in all other cases.
+ */
+static int
+mkdir_with_parents(char *path)
+{
+   char *p;
+
+   for (p = path + 1; *p; p++) {
+      if (*p != '/')
+         continue;
+
+      *p = '\0';
+      if (mkdir_if_needed(path) == -1) {
+         *p = '/';
+         return -1;
+      }
+      *p = '/';
+   }
+
+   return mkdir_if_needed(path);
+}
+
+static uint64_t
+parse_max_size(const char *str)
+{
+   char *end;
+   uint64_t size;
+
+   size = strtoul(str, &end, 10);
+   if (end == str)
+      return 0;
+
+   switch (toupper(*end)) {
+   case 'G':
+      size *= 1024;
+      /* fallthrough */
+   case 'M':
+      size *= 1024;
+      /* fallthrough */
+   case 'K':
+   case '\0':
+      /* A bare number is in bytes, the suffix scales from kilobytes. */
+      if (*end)
+         size *= 1024;
+      break;
+   default:
+      return 0;
+   }
+
+   return size;
+}
+
+struct disk_cache *
+disk_cache_create(const char *name)
+{
+   void *local;
+   struct disk_cache *cache = NULL;
+   char *path, *max_size_str;
+   int fd = -1;
+   struct stat sb;
+   size_t size;
+
+   /* A ralloc context for transient data during this invocation. */
+   local = ralloc_context(NULL);
+   if (local == NULL)
+      goto fail;
+
+   /* At user request, disable shader cache entirely. */
+   if (env_var_as_boolean("MESA_SHADER_CACHE_DISABLE", false))
+      goto fail;
+
+   /* Determine path for cache based on the first defined name as follows:
+    *
+    *   $MESA_SHADER_CACHE_DIR
+    *   $XDG_CACHE_HOME/mesa
+    *   <pwd.pw_dir>/.cache/mesa
+    */
+   path = getenv("MESA_SHADER_CACHE_DIR");
+   if (path) {
+      path = ralloc_asprintf(local, "%s/%s", path, name);
+   }
+   else if (getenv("XDG_CACHE_HOME")) {
+      path = ralloc_asprintf(local, "%s/mesa/%s",
+                             getenv("XDG_CACHE_HOME"), name);
+   }
+   else {
+      char *buf;
+      size_t buf_size;
+      struct passwd pwd, *result;
+
+      buf_size = sysconf(_SC_GETPW_R_SIZE_MAX);
+      if (buf_size == (size_t) -1)
+         buf_size = 512;
+
+      /* Loop until buf_size is large enough to query the directory */
+      while (1) {
+         buf = ralloc_size(local, buf_size);
+
+         getpwuid_r(getuid(), &pwd, buf, buf_size, &result);
+         if (result)
+            break;
+
+         if (errno == ERANGE) {
+            ralloc_free(buf);
+            buf = NULL;
+            buf_size *= 2;
+         } else {
+            goto fail;
+         }
+      }
+
+      path = ralloc_asprintf(local, "%s/.cache/mesa/%s", pwd.pw_dir, name);
+   }
+
+   if (path == NULL || mkdir_with_parents(path) == -1)
+      goto fail;
+
+   cache = ralloc(NULL, struct disk_cache);
+   if (cache == NULL)
+      goto fail;
+   memset(cache, 0, sizeof *cache);
+
+   cache->path = ralloc_strdup(cache, path);
+   if (cache->path == NULL)
+      goto fail;
+
+   /* The index file only holds the running total of the cache size, so that
+    * every process sharing the directory can keep it bounded without having
+    * to walk the directory tree.
+    */
+   path = ralloc_asprintf(local, "%s/index", cache->path);
+   if (path == NULL)
+      goto fail;
+
+   fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   size = sizeof(*cache->size);
+
+   /* Force the index file to be the expected size. */
+   if (sb.st_size != size) {
+      if (ftruncate(fd, size) == -1)
+         goto fail;
+   }
+
+   cache->index_mmap = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+   if (cache->index_mmap == MAP_FAILED) {
+      cache->index_mmap = NULL;
+      goto fail;
+   }
+   cache->index_mmap_size = size;
+
+   close(fd);
+   fd = -1;
+
+   cache->size = (uint64_t *) cache->index_mmap;
+
+   cache->max_size = 0;
+   max_size_str = getenv("MESA_SHADER_CACHE_MAX_SIZE");
+   if (max_size_str)
+      cache->max_size = parse_max_size(max_size_str);
+
+   /* Default to 1GB for maximum cache size. */
+   if (cache->max_size == 0)
+      cache->max_size = CACHE_DEFAULT_MAX_SIZE;
+
+   ralloc_free(local);
+
+   return cache;
+
+ fail:
+   if (fd != -1)
+      close(fd);
+   if (cache)
+      ralloc_free(cache);
+   ralloc_free(local);
+
+   return NULL;
+}
+
+void
+disk_cache_destroy(struct disk_cache *cache)
+{
+   if (!cache)
+      return;
+
+   if (cache->index_mmap)
+      munmap(cache->index_mmap, cache->index_mmap_size);
+
+   ralloc_free(cache);
+}
+
+/* Return a filename within the cache's directory corresponding to 'key'. The
+ * returned filename is ralloced with 'mem_ctx' as the parent context.
+ *
+ * The cache itself is never used as a ralloc parent after creation, since
+ * it is shared between threads.
+ *
+ * Returns NULL if out of memory.
+ */
+static char *
+get_cache_file(void *mem_ctx, struct disk_cache *cache, const cache_key key)
+{
+   char buf[41];
+   unsigned i;
+
+   for (i = 0; i < CACHE_KEY_SIZE; i++)
+      sprintf(buf + 2 * i, "%02x", key[i]);
+
+   return ralloc_asprintf(mem_ctx, "%s/%c%c/%s",
+                          cache->path, buf[0], buf[1], buf + 2);
+}
+
+/* Create the directory that will be needed for the cache file for \key.
+ *
+ * Obviously, the implementation here must closely match
+ * _get_cache_file above.
+*/
+static void
+make_cache_file_directory(struct disk_cache *cache, const cache_key key)
+{
+   char *dir;
+
+   dir = ralloc_asprintf(NULL, "%s/%02x", cache->path, key[0]);
+   if (dir == NULL)
+      return;
+
+   mkdir_if_needed(dir);
+   ralloc_free(dir);
+}
+
+/* Given a directory path, find the least recently used regular file in
+ * it, ignoring any in-flight temporary files.
+ *
+ * Returns: A newly allocated, ralloc'ed filename (with 'ctx' as the
+ *          parent), or NULL if the directory holds no candidate.
+ */
+static char *
+choose_lru_file(void *ctx, const char *dir_path, off_t *lru_size)
+{
+   DIR *dir;
+   struct dirent *entry;
+   struct stat sb;
+   char *lru_name = NULL;
+   time_t lru_atime = 0;
+
+   dir = opendir(dir_path);
+   if (dir == NULL)
+      return NULL;
+
+   while ((entry = readdir(dir)) != NULL) {
+      size_t len = strlen(entry->d_name);
+
+      if (entry->d_name[0] == '.')
+         continue;
+
+      if (len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0)
+         continue;
+
+      if (fstatat(dirfd(dir), entry->d_name, &sb, 0) == -1)
+         continue;
+
+      if (!S_ISREG(sb.st_mode))
+         continue;
+
+      if (lru_name == NULL || sb.st_atime < lru_atime) {
+         char *tmp = ralloc_asprintf(ctx, "%s/%s", dir_path, entry->d_name);
+         if (tmp == NULL)
+            continue;
+         ralloc_free(lru_name);
+         lru_name = tmp;
+         lru_atime = sb.st_atime;
+         *lru_size = sb.st_size;
+      }
+   }
+
+   closedir(dir);
+
+   return lru_name;
+}
+
+/* Evict the least recently used item of a randomly chosen subdirectory.
+ *
+ * Returns: true if an item was evicted.
+ */
+static bool
+evict_random_item(struct disk_cache *cache)
+{
+   unsigned start = rand() & CACHE_INDEX_KEY_MASK;
+   unsigned i;
+
+   /* Start at a random directory and walk on until one holds something,
+    * so that a sparsely populated cache can still shrink.
+    */
+   for (i = 0; i < CACHE_INDEX_MAX_KEYS; i++) {
+      unsigned index = (start + i) & CACHE_INDEX_KEY_MASK;
+      char *dir_path, *filename;
+      off_t size = 0;
+
+      dir_path = ralloc_asprintf(NULL, "%s/%02x", cache->path, index);
+      if (dir_path == NULL)
+         return false;
+
+      filename = choose_lru_file(dir_path, dir_path, &size);
+      if (filename && unlink(filename) == 0) {
+         p_atomic_add(cache->size, - (uint64_t) size);
+         ralloc_free(dir_path);
+         return true;
+      }
+
+      ralloc_free(dir_path);
+   }
+
+   return false;
+}
+
+void
+disk_cache_put(struct disk_cache *cache, const cache_key key,
+               const void *data, size_t size)
+{
+   int fd = -1, fd_final, err, ret;
+   size_t len;
+   void *mem_ctx;
+   char *filename, *filename_tmp;
+   struct cache_item_header header;
+   uint64_t total = sizeof header + size;
+   const char *p;
+
+   if (!cache || size > UINT32_MAX || total > cache->max_size)
+      return;
+
+   mem_ctx = ralloc_context(NULL);
+   if (mem_ctx == NULL)
+      return;
+
+   filename = get_cache_file(mem_ctx, cache, key);
+   if (filename == NULL)
+      goto done;
+
+   /* Write to a temporary file to allow for an atomic rename to the
+    * final destination filename, (to prevent any readers from seeing
+    * a partially written file).
+    */
+   filename_tmp = ralloc_asprintf(mem_ctx, "%s.tmp", filename);
+   if (filename_tmp == NULL)
+      goto done;
+
+   fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT, 0644);
+
+   /* Make the two-character subdirectory within the cache as needed. */
+   if (fd == -1) {
+      if (errno != ENOENT)
+         goto done;
+
+      make_cache_file_directory(cache, key);
+
+      fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT, 0644);
+      if (fd == -1)
+         goto done;
+   }
+
+   /* With the temporary file open, we take an exclusive flock on
+    * it. If the flock fails, then another process still has the file
+    * open with the flock held. So just let that file be responsible
+    * for writing the file.
+    */
+   err = flock(fd, LOCK_EX | LOCK_NB);
+   if (err == -1)
+      goto done;
+
+   /* Now that we have the lock on the open temporary file, we can
+    * check to see if the destination file already exists. If so,
+    * another process won the race between when we saw that the file
+    * didn't exist and now. In this case, we don't do anything more,
+    * (to ensure the size accounting of the cache doesn't get off).
+    */
+   fd_final = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd_final != -1) {
+      close(fd_final);
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   /* A previous writer may have died halfway through. */
+   if (ftruncate(fd, 0) == -1) {
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   /* Make room for the new item before it becomes visible. */
+   while (p_atomic_read(cache->size) + total > cache->max_size) {
+      if (!evict_random_item(cache))
+         break;
+   }
+
+   header.magic = CACHE_ITEM_MAGIC;
+   header.size = size;
+   memcpy(header.key, key, CACHE_KEY_SIZE);
+
+   for (len = 0; len < sizeof header; len += ret) {
+      ret = write(fd, (const char *) &header + len, sizeof header - len);
+      if (ret == -1) {
+         unlink(filename_tmp);
+         goto done;
+      }
+   }
+
+   for (len = 0, p = data; len < size; len += ret) {
+      ret = write(fd, p + len, size - len);
+      if (ret == -1) {
+         unlink(filename_tmp);
+         goto done;
+      }
+   }
+
+   /* Now that the whole file has been written successfully, move it to its
+    * final filename.  Lastly, we release the flock on the file, (which
+    * closing the file does for us).
+    */
+   if (rename(filename_tmp, filename) == -1) {
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   p_atomic_add(cache->size, total);
+
+ done:
+   if (fd != -1)
+      close(fd);
+   ralloc_free(mem_ctx);
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   int fd = -1, ret;
+   size_t len;
+   struct stat sb;
+   struct cache_item_header header;
+   char *filename = NULL;
+   uint8_t *data = NULL;
+   struct timespec times[2];
+
+   if (size)
+      *size = 0;
+
+   if (!cache)
+      return NULL;
+
+   filename = get_cache_file(NULL, cache, key);
+   if (filename == NULL)
+      goto fail;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   for (len = 0; len < sizeof header; len += ret) {
+      ret = read(fd, (char *) &header + len, sizeof header - len);
+      if (ret <= 0)
+         goto fail;
+   }
+
+   if (header.magic != CACHE_ITEM_MAGIC ||
+       memcmp(header.key, key, CACHE_KEY_SIZE) != 0 ||
+       sb.st_size != sizeof header + header.size)
+      goto fail;
+
+   data = malloc(header.size ? header.size : 1);
+   if (data == NULL)
+      goto fail;
+
+   for (len = 0; len < header.size; len += ret) {
+      ret = read(fd, data + len, header.size - len);
+      if (ret <= 0)
+         goto fail;
+   }
+
+   /* Mark the item as recently used for eviction purposes; relatime mounts
+    * would otherwise leave the access time stale.
+    */
+   times[0].tv_sec = 0;
+   times[0].tv_nsec = UTIME_NOW;
+   times[1].tv_sec = 0;
+   times[1].tv_nsec = UTIME_OMIT;
+   futimens(fd, times);
+
+   ralloc_free(filename);
+   close(fd);
+
+   if (size)
+      *size = header.size;
+
+   return data;
+
+ fail:
+   if (data)
+      free(data);
+   if (filename)
+      ralloc_free(filename);
+   if (fd != -1)
+      close(fd);
+
+   return NULL;
+}
+
+void
+disk_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+   struct stat sb;
+   char *filename;
+
+   if (!cache)
+      return;
+
+   filename = get_cache_file(NULL, cache, key);
+   if (filename == NULL)
+      return;
+
+   if (stat(filename, &sb) == -1) {
+      ralloc_free(filename);
+      return;
+   }
+
+   if (unlink(filename) == 0)
+      p_atomic_add(cache->size, - (uint64_t) sb.st_size);
+
+   ralloc_free(filename);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of cache keys in bytes (a SHA-1 digest). */
+#define CACHE_KEY_SIZE 20
+
+typedef uint8_t cache_key[CACHE_KEY_SIZE];
+
+struct disk_cache;
+
+/**
+ * Return the modification time of the shared object (or executable) that
+ * contains \p ptr, which makes a cheap identifier of the build that
+ * produced the cached data.
+ */
+static inline bool
+disk_cache_get_function_timestamp(void *ptr, uint32_t *timestamp)
+{
+#ifdef HAVE_DLADDR
+   Dl_info info;
+   struct stat st;
+
+   if (!dladdr(ptr, &info) || !info.dli_fname)
+      return false;
+
+   if (stat(info.dli_fname, &st))
+      return false;
+
+   *timestamp = st.st_mtime;
+   return true;
+#else
+   return false;
+#endif
+}
+
+#ifdef ENABLE_SHADER_CACHE
+
+/**
+ * Create a new cache object.
+ *
+ * The cache lives in a directory called \p name below the first of
+ * the following that is set:
+ *
+ *   $MESA_SHADER_CACHE_DIR
+ *   $XDG_CACHE_HOME/mesa
+ *   <pwd.pw_dir>/.cache/mesa
+ *
+ * Setting MESA_SHADER_CACHE_DISABLE to a true value disables the cache
+ * entirely.  MESA_SHADER_CACHE_MAX_SIZE bounds the size of the cache
+ * directory, in bytes or with a K/M/G suffix (default 1G).  Once the
+ * bound is reached, least recently used entries are evicted.
+ *
+ * \return  NULL if the cache is disabled or cannot be set up.
+ */
+struct disk_cache *
+disk_cache_create(const char *name);
+
+/**
+ * Destroy a cache object, (freeing all associated resources).
+ */
+void
+disk_cache_destroy(struct disk_cache *cache);
+
+/**
+ * Store an item in the cache under the name \p key.
+ *
+ * The item can be retrieved later with disk_cache_get(), (unless the item
+ * has been evicted in the interim).
+ *
+ * Any call to disk_cache_put() may cause an existing, random item to be
+ * evicted from the cache.  Writes are atomic: a concurrent reader (in this
+ * or another process) sees either nothing or the complete item.
+ */
+void
+disk_cache_put(struct disk_cache *cache, const cache_key key,
+               const void *data, size_t size);
+
+/**
+ * Retrieve an item previously stored in the cache with the name \p key.
+ *
+ * The item must have been previously stored with a call to disk_cache_put().
+ *
+ * If \p size is non-NULL, then, on successful return, it will be set to the
+ * size of the object.
+ *
+ * \return A pointer to the stored object if found.  NULL if the object
+ * is not found, or if any error occurs, (memory allocation failure,
+ * filesystem error, etc.).  The returned data is malloc'ed so the
+ * caller should call free() it when finished.
+ */
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
+
+/**
+ * Remove the item named \p key from the cache, if present.
+ */
+void
+disk_cache_remove(struct disk_cache *cache, const cache_key key);
+
+#else
+
+static inline struct disk_cache *
+disk_cache_create(const char *name)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_destroy(struct disk_cache *cache)
+{
+}
+
+static inline void
+disk_cache_put(struct disk_cache *cache, const cache_key key,
+               const void *data, size_t size)
+{
+}
+
+static inline void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_H */